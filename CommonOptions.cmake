@@ -228,7 +228,7 @@ else()
 endif()
 
 if (COMPILER_IS_GCC)
-	if (MATH_SSE OR MATH_SSE2 OR MATH_SSE3 OR MATH_SSE41 OR MATH_AVX)
+	if (MATH_SSE OR MATH_SSE2 OR MATH_SSE3 OR MATH_SSE41 OR MATH_AVX OR MATH_AVX512)
 		add_definitions(-mfpmath=sse)
 	endif()
 endif()
@@ -248,7 +248,14 @@ if (MATH_FMA4 OR MATH_FMA3)
 	endif()
 endif()
 
-if (MATH_AVX)
+if (MATH_AVX512)
+	add_definitions(-DMATH_AVX512)
+	if (MSVC)
+		add_definitions(/arch:AVX512)
+	elseif (IS_GCC_LIKE)
+		add_definitions(-mavx512f -march=skylake-avx512 -mtune=skylake-avx512)
+	endif()
+elseif (MATH_AVX)
 	add_definitions(-DMATH_AVX)
 	if (MSVC)
 		add_definitions(/arch:AVX)
@@ -299,6 +306,16 @@ elseif (MATH_SSE)
 	endif()
 endif()
 
+if (MATH_SIMD_DISPATCH)
+	# Compile the SIMD kernels of all instruction set levels and choose between them at runtime.
+	add_definitions(-DMATH_SIMD_DISPATCH)
+endif()
+
+if (MATH_QUADTREE_POOLED_STORAGE)
+	# Store the objects of QuadTree nodes in a pooled arena instead of a std::vector per node.
+	add_definitions(-DMATH_QUADTREE_POOLED_STORAGE)
+endif()
+
 if (MATH_ENABLE_UNCOMMON_OPERATIONS)
 	add_definitions(-DMATH_ENABLE_UNCOMMON_OPERATIONS)
 endif()
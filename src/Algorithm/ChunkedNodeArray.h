@@ -0,0 +1,65 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file ChunkedNodeArray.h
+	@author Jukka Jylnki
+	@brief An array of spatial tree nodes that never move in memory once allocated. */
+#pragma once
+
+#include "../MathBuildConfig.h"
+#include "../MathGeoLibFwd.h"
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// Stores the nodes of a spatial tree in fixed-size chunks, so that the nodes never move in memory once allocated.
+/** This is required by the QuadTree and the Octree, since their nodes refer to each other, and objects refer to their
+	nodes, with raw pointers. The trees allocate their nodes in groups of four or eight siblings, and the chunk size is a
+	multiple of both, so that a group never straddles two chunks.
+	@param Node The node type of the tree. */
+template<typename Node>
+class ChunkedNodeArray
+{
+public:
+	static const int chunkSize = 1024;
+
+	ChunkedNodeArray():numNodes(0) {}
+	~ChunkedNodeArray()
+	{
+		for(size_t i = 0; i < chunks.size(); ++i)
+			delete[] chunks[i];
+	}
+
+	Node &operator[](int i) { return chunks[i / chunkSize][i % chunkSize]; }
+	const Node &operator[](int i) const { return chunks[i / chunkSize][i % chunkSize]; }
+	int size() const { return numNodes; }
+	bool empty() const { return numNodes == 0; }
+	/// Removes all nodes, but keeps the chunks allocated for reuse.
+	void clear() { numNodes = 0; }
+	void push_back(const Node &node)
+	{
+		if (numNodes == (int)chunks.size() * chunkSize)
+			chunks.push_back(new Node[chunkSize]);
+		(*this)[numNodes++] = node;
+	}
+
+private:
+	std::vector<Node*> chunks;
+	int numNodes;
+
+	ChunkedNodeArray(const ChunkedNodeArray &); // Not copyable, since the nodes point to each other.
+	void operator =(const ChunkedNodeArray &);
+};
+
+MATH_END_NAMESPACE
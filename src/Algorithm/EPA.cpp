@@ -0,0 +1,295 @@
+/* Copyright Jukka Jylanki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file EPA.cpp
+	@author Jukka Jylanki
+	@brief Implementation of the Expanding Polytope Algorithm (EPA) polytope. */
+#include "EPA.h"
+#include "../Math/MathFunc.h"
+#include "../Math/myassert.h"
+
+MATH_BEGIN_NAMESPACE
+
+void EPAPolytope::AddInitialVertex(const vec &pointA, const vec &pointB)
+{
+	assume(numVertices < 4);
+	vertex[numVertices] = pointA - pointB;
+	vertexA[numVertices] = pointA;
+	vertexB[numVertices] = pointB;
+	++numVertices;
+}
+
+bool EPAPolytope::IsAffinelyIndependent(const vec &point) const
+{
+	assume1(numVertices < 4, numVertices);
+	if (numVertices == 0)
+		return true;
+
+	// Use the same degeneracy test as ClosestPointToOriginOnSimplex(): the squared volume (area, length) of the simplex must not
+	// be tiny relative to the product of the squared lengths of the edges that span it. The test for the tetrahedron is evaluated
+	// in the same order of operations, so that the two always agree. Since the origin lies on the simplex, the distance from the
+	// origin is used as the scale of a single edge.
+	vec d = point - vertex[0];
+	if (numVertices == 1)
+		return d.LengthSq() > 1e-10f * Max(point.LengthSq(), vertex[0].LengthSq());
+	vec e = vertex[1] - vertex[0];
+	if (numVertices == 2)
+		return Cross(e, d).LengthSq() > 1e-10f * e.LengthSq() * d.LengthSq();
+	vec f = vertex[2] - vertex[0];
+	float volume = Dot(e, Cross(f, d));
+	return volume*volume > 1e-10f * (e.LengthSq() * f.LengthSq() * d.LengthSq());
+}
+
+void EPAPolytope::ReduceToClosestSubSimplex()
+{
+	assume1(numVertices <= 4, numVertices);
+	assume1(numFaces == 0, numFaces);
+	float lambda[4];
+	ClosestPointToOriginOnSimplex(vertex, vertexA, vertexB, lambda, numVertices);
+}
+
+int EPAPolytope::TetrahedronSearchDirections(vec *outDirections) const
+{
+	assume1(numVertices >= 1 && numVertices < 4, numVertices);
+	if (numVertices == 1)
+	{
+		// Any of the cardinal axes will do.
+		outDirections[0] = DIR_VEC(1.f, 0.f, 0.f);
+		outDirections[1] = DIR_VEC(-1.f, 0.f, 0.f);
+		outDirections[2] = DIR_VEC(0.f, 1.f, 0.f);
+		outDirections[3] = DIR_VEC(0.f, -1.f, 0.f);
+		outDirections[4] = DIR_VEC(0.f, 0.f, 1.f);
+		outDirections[5] = DIR_VEC(0.f, 0.f, -1.f);
+		return 6;
+	}
+	else if (numVertices == 2)
+	{
+		// Search to directions perpendicular to the line segment.
+		vec e = vertex[1] - vertex[0];
+		vec p1 = e.Perpendicular();
+		vec p2 = Cross(e, p1);
+		outDirections[0] = p1;
+		outDirections[1] = -p1;
+		outDirections[2] = p2;
+		outDirections[3] = -p2;
+		return 4;
+	}
+	else
+	{
+		// Search to both sides of the triangle.
+		vec normal = Cross(vertex[1] - vertex[0], vertex[2] - vertex[0]);
+		outDirections[0] = normal;
+		outDirections[1] = -normal;
+		return 2;
+	}
+}
+
+bool EPAPolytope::InitTetrahedron()
+{
+	assume1(numVertices == 4, numVertices);
+	numVertices = 3;
+	bool isDegenerate = !IsAffinelyIndependent(vertex[3]);
+	numVertices = 4;
+	if (isDegenerate)
+		return false;
+
+	numFaces = 0;
+	// Orient the faces so that their normals point outwards from the tetrahedron.
+	if (Dot(Cross(vertex[1] - vertex[0], vertex[2] - vertex[0]), vertex[3] - vertex[0]) < 0.f)
+	{
+		AddFace(0, 1, 2);
+		AddFace(0, 3, 1);
+		AddFace(0, 2, 3);
+		AddFace(1, 3, 2);
+	}
+	else
+	{
+		AddFace(0, 2, 1);
+		AddFace(0, 3, 2);
+		AddFace(0, 1, 3);
+		AddFace(2, 3, 1);
+	}
+	return true;
+}
+
+void EPAPolytope::AddFace(int v0, int v1, int v2)
+{
+	assume1(numFaces < maxFaces, numFaces);
+	Face &f = face[numFaces++];
+	f.v[0] = v0;
+	f.v[1] = v1;
+	f.v[2] = v2;
+	vec e1 = vertex[v1] - vertex[v0];
+	vec e2 = vertex[v2] - vertex[v0];
+	f.normal = Cross(e1, e2);
+	float lengthSq = f.normal.LengthSq();
+	// Use the same degeneracy test as IsAffinelyIndependent(). The normal of a nearly degenerate face would be dominated by
+	// floating point error, and could make the face appear closer to the origin than it is.
+	if (lengthSq > 1e-10f * e1.LengthSq() * e2.LengthSq())
+	{
+		f.normal /= Sqrt(lengthSq);
+		f.distance = Dot(f.normal, vertex[v0]);
+	}
+	else
+	{
+		f.normal = vec::zero;
+		f.distance = FLOAT_INF; // A degenerate face can never be the closest one.
+	}
+}
+
+int EPAPolytope::ClosestFace() const
+{
+	assume(numFaces > 0);
+	int closest = 0;
+	for(int i = 1; i < numFaces; ++i)
+		if (face[i].distance < face[closest].distance)
+			closest = i;
+	return closest;
+}
+
+int EPAPolytope::FaceWithEdge(int v0, int v1) const
+{
+	for(int i = 0; i < numFaces; ++i)
+	{
+		const Face &f = face[i];
+		if ((f.v[0] == v0 && f.v[1] == v1) || (f.v[1] == v0 && f.v[2] == v1) || (f.v[2] == v0 && f.v[0] == v1))
+			return i;
+	}
+	return -1;
+}
+
+bool EPAPolytope::Expand(const vec &pointA, const vec &pointB)
+{
+	if (numVertices >= maxVertices)
+		return false;
+	const vec newVertex = pointA - pointB;
+
+	// Start from the face that the new vertex lies furthest in front of.
+	int seed = -1;
+	float seedDistance = 0.f;
+	for(int i = 0; i < numFaces; ++i)
+	{
+		float d = Dot(face[i].normal, newVertex - vertex[face[i].v[0]]);
+		if (d > seedDistance)
+		{
+			seed = i;
+			seedDistance = d;
+		}
+	}
+	if (seed == -1)
+		return false; // The new vertex did not see any faces, so it is already contained in the polytope.
+
+	// Flood fill the region of faces visible from the new vertex across the face edges, and collect the edges on the boundary
+	// of that region. Due to floating point imprecision, a face that is nearly coplanar with the new vertex can appear visible
+	// without being connected to the rest of the visible region. Removing such a face would tear the polytope apart, so only
+	// the connected region is removed. Degenerate faces with zero area are removed whenever a neighbor of theirs is, since they
+	// do not have a normal to test against, but can still be the only link between the parts of a visible region.
+	bool visible[maxFaces] = {};
+	int stack[maxFaces];
+	int stackSize = 0;
+	int horizon[3*maxFaces][2];
+	int numHorizonEdges = 0;
+	int numVisibleFaces = 1;
+	visible[seed] = true;
+	stack[stackSize++] = seed;
+	while(stackSize > 0)
+	{
+		const Face &f = face[stack[--stackSize]];
+		for(int j = 0; j < 3; ++j)
+		{
+			int e0 = f.v[j];
+			int e1 = f.v[(j+1)%3];
+			int neighbor = FaceWithEdge(e1, e0);
+			if (neighbor != -1 && visible[neighbor])
+				continue; // The edge is interior to the visible region.
+			if (neighbor != -1 && (face[neighbor].distance == FLOAT_INF || Dot(face[neighbor].normal, newVertex - vertex[face[neighbor].v[0]]) > 0.f))
+			{
+				visible[neighbor] = true;
+				stack[stackSize++] = neighbor;
+				++numVisibleFaces;
+			}
+			else
+			{
+				horizon[numHorizonEdges][0] = e0;
+				horizon[numHorizonEdges][1] = e1;
+				++numHorizonEdges;
+			}
+		}
+	}
+	if (numFaces - numVisibleFaces + numHorizonEdges > maxFaces)
+		return false;
+
+	// Remove the visible faces, and fill the resulting hole with new faces that connect the new vertex to the horizon.
+	int numRemainingFaces = 0;
+	for(int i = 0; i < numFaces; ++i)
+		if (!visible[i])
+			face[numRemainingFaces++] = face[i];
+	numFaces = numRemainingFaces;
+
+	vertex[numVertices] = newVertex;
+	vertexA[numVertices] = pointA;
+	vertexB[numVertices] = pointB;
+	for(int i = 0; i < numHorizonEdges; ++i)
+		AddFace(horizon[i][0], horizon[i][1], numVertices);
+	++numVertices;
+	return true;
+}
+
+void EPAPolytope::ContactPoints(int faceIndex, vec &outPointA, vec &outPointB) const
+{
+	if (faceIndex < 0)
+	{
+		assume1(numVertices <= 4, numVertices);
+		vec s[4], sa[4], sb[4];
+		float lambda[4];
+		int n = numVertices;
+		for(int i = 0; i < n; ++i)
+		{
+			s[i] = vertex[i];
+			sa[i] = vertexA[i];
+			sb[i] = vertexB[i];
+		}
+		ClosestPointToOriginOnSimplex(s, sa, sb, lambda, n);
+		outPointA = lambda[0] * sa[0];
+		outPointB = lambda[0] * sb[0];
+		for(int i = 1; i < n; ++i)
+		{
+			outPointA += lambda[i] * sa[i];
+			outPointB += lambda[i] * sb[i];
+		}
+		return;
+	}
+
+	// Compute the barycentric coordinates of the projection of the origin onto the plane of the face as ratios of signed
+	// triangle areas. Unlike the method that solves the coordinates from dot products of the edge vectors, this stays accurate
+	// for the thin sliver faces that curved objects produce. The projection can fall slightly outside the face when the
+	// polytope has coplanar faces, in which case the coordinates extrapolate along the plane.
+	const Face &f = face[faceIndex];
+	vec p = f.distance * f.normal;
+	const vec &v0 = vertex[f.v[0]];
+	const vec &v1 = vertex[f.v[1]];
+	const vec &v2 = vertex[f.v[2]];
+	float area = Dot(f.normal, Cross(v1 - v0, v2 - v0));
+	float u = 1.f, v = 0.f, w = 0.f;
+	if (area > 0.f)
+	{
+		u = Dot(f.normal, Cross(v1 - p, v2 - p)) / area;
+		v = Dot(f.normal, Cross(v2 - p, v0 - p)) / area;
+		w = 1.f - u - v;
+	}
+	outPointA = u * vertexA[f.v[0]] + v * vertexA[f.v[1]] + w * vertexA[f.v[2]];
+	outPointB = u * vertexB[f.v[0]] + v * vertexB[f.v[1]] + w * vertexB[f.v[2]];
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,242 @@
+/* Copyright Jukka Jylanki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file EPA.h
+	@author Jukka Jylanki
+	@brief Implementation of the Expanding Polytope Algorithm (EPA) for computing the penetration depth of two intersecting convex objects. */
+#pragma once
+
+#include "../MathGeoLibFwd.h"
+#include "../Math/float3.h"
+#include "GJK.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// A convex polytope in the Minkowski difference set of two objects, used by the Expanding Polytope Algorithm.
+/** The polytope starts out as the tetrahedron that terminated the GJK intersection test, and is expanded one vertex
+	at a time toward the boundary of the Minkowski difference set. All storage is inline with a fixed capacity, so
+	using this structure does not allocate memory. */
+class EPAPolytope
+{
+public:
+	/// The maximum number of vertices the polytope can hold. A convex polytope with V vertices has at most 2V-4 triangular faces.
+	static const int maxVertices = 128;
+	static const int maxFaces = 2*maxVertices - 4;
+
+	struct Face
+	{
+		/// The indices of the vertices of this face, in counter-clockwise order when viewed from the outside of the polytope.
+		int v[3];
+		/// The outward-facing unit normal of this face.
+		vec normal;
+		/// The signed distance of the plane of this face from the origin.
+		float distance;
+	};
+
+	/// The vertices of the polytope in the Minkowski difference set a-b, i.e. vertex[i] = vertexA[i] - vertexB[i].
+	vec vertex[maxVertices];
+	/// The points on the objects a and b that formed each vertex.
+	vec vertexA[maxVertices];
+	vec vertexB[maxVertices];
+	int numVertices;
+
+	Face face[maxFaces];
+	int numFaces;
+
+	EPAPolytope():numVertices(0), numFaces(0) {}
+
+	/// Adds a new vertex to the polytope without updating the faces. Used to set up the initial tetrahedron.
+	void AddInitialVertex(const vec &pointA, const vec &pointB);
+
+	/// Returns true if the given point in the Minkowski difference set would form a simplex of one dimension higher with the current vertices.
+	/** The simplex is considered degenerate using the same relative test as ClosestPointToOriginOnSimplex(), i.e. if its squared
+		volume (or area or length) is tiny compared to the product of the squared lengths of its edges.
+		This function can only be called while the polytope contains less than four vertices. */
+	bool IsAffinelyIndependent(const vec &point) const;
+
+	/// Reduces the current vertices to the smallest sub-simplex of them that contains the point closest to the origin.
+	/** This is used to recover from a flat initial tetrahedron: the face or edge that holds the origin is kept, and the
+		tetrahedron is then grown again from it. This function can only be called while the polytope contains at most four
+		vertices and no faces. */
+	void ReduceToClosestSubSimplex();
+
+	/// Produces the search directions that are tried in order to grow the current vertices to a full tetrahedron.
+	/** This function can only be called while the polytope contains less than four vertices.
+		@param outDirections [out] An array of at least six elements that receives the search directions.
+		@return The number of search directions written to outDirections. */
+	int TetrahedronSearchDirections(vec *outDirections) const;
+
+	/// Creates the four faces of the initial tetrahedron from the first four vertices.
+	/** @return False if the tetrahedron is degenerate, in which case no faces are created. */
+	bool InitTetrahedron();
+
+	/// Returns the index of the face that lies closest to the origin.
+	int ClosestFace() const;
+
+	/// Expands the polytope to include the given new vertex. The faces visible from the new vertex are removed, and the
+	/// resulting hole is filled with new faces that connect the new vertex to the horizon.
+	/** @return False if the polytope cannot be expanded, because its capacity would be exceeded, or because the new vertex
+		is already contained in the polytope. */
+	bool Expand(const vec &pointA, const vec &pointB);
+
+	/// Computes the points on the objects a and b that correspond to the point of the given face closest to the origin.
+	/** If faceIndex is -1, the point closest to the origin on the simplex formed by the current (at most four) vertices is used instead. */
+	void ContactPoints(int faceIndex, vec &outPointA, vec &outPointB) const;
+
+private:
+	/// Adds a new face with the given vertices, and computes its normal and distance. The vertex order determines the orientation of the face.
+	void AddFace(int v0, int v1, int v2);
+
+	/// Returns the index of the face that has the directed edge v0->v1, or -1 if there is no such face.
+	int FaceWithEdge(int v0, int v1) const;
+};
+
+/// Computes the penetration depth, contact normal and contact points of two intersecting convex objects, starting from the
+/// simplex that terminated a GJK intersection test.
+/** The penetration depth is the length of the shortest translation that separates the two objects. It is found by the Expanding
+	Polytope Algorithm, which grows the GJK terminating simplex toward the boundary of the Minkowski difference set a-b, always
+	expanding the face that lies closest to the origin, until the support function cannot push that face any further.
+	The types A and B need to implement the function ExtremePoint(direction, projectionDistance).
+	@param simplex The simplex that terminated GJKIntersect(a, b, simplex).
+	@param outNormal [out] Receives the contact normal, which points from a toward b. Translating b by outDepth * outNormal
+		(or a by -outDepth * outNormal) brings the objects to touching contact.
+	@param outDepth [out] Receives the penetration depth.
+	@param outContactPointA [out] If not null, receives the point of a that penetrates deepest into b.
+	@param outContactPointB [out] If not null, receives the point on the surface of b that corresponds to outContactPointA, so that
+		outContactPointA - outContactPointB == outDepth * outNormal.
+	@see GJKIntersect(), EPAPolytope. */
+template<typename A, typename B>
+void EPAPenetration(const A &a, const B &b, const GJKSimplex &simplex, vec &outNormal, float &outDepth, vec *outContactPointA = 0, vec *outContactPointB = 0)
+{
+	assume1(simplex.numPoints >= 1 && simplex.numPoints <= 4, simplex.numPoints);
+	EPAPolytope polytope;
+	for(int i = 0; i < simplex.numPoints; ++i)
+		polytope.AddInitialVertex(simplex.pointA[i], simplex.pointB[i]);
+	float maxS, minS;
+
+	// If the origin was found to lie on a lower dimensional simplex, grow it to a tetrahedron by searching to
+	// directions orthogonal to it.
+	while(polytope.numVertices < 4 || !polytope.InitTetrahedron())
+	{
+		if (polytope.numVertices == 4)
+			polytope.ReduceToClosestSubSimplex(); // The initial tetrahedron is flat. Regrow it from the face or edge that holds the origin.
+		vec directions[6];
+		int numDirections = polytope.TetrahedronSearchDirections(directions);
+		bool grown = false;
+		for(int i = 0; i < numDirections && !grown; ++i)
+		{
+			vec pointA = a.ExtremePoint(directions[i], maxS);
+			vec pointB = b.ExtremePoint(-directions[i], minS);
+			if (polytope.IsAffinelyIndependent(pointA - pointB))
+			{
+				polytope.AddInitialVertex(pointA, pointB);
+				grown = true;
+			}
+		}
+		if (!grown)
+		{
+			// The Minkowski difference set is flat, which happens e.g. for two coplanar triangles. The objects are then
+			// only touching, and the direction orthogonal to the flat set separates them. If the set is just a single point,
+			// every direction is orthogonal to it, so report the direction from a toward b.
+			if (polytope.numVertices > 1)
+				outNormal = directions[0].Normalized();
+			else
+				outNormal = polytope.vertex[0].IsZero() ? DIR_VEC(1.f, 0.f, 0.f) : -polytope.vertex[0].Normalized();
+			outDepth = 0.f;
+			vec pointA, pointB;
+			polytope.ContactPoints(-1, pointA, pointB);
+			if (outContactPointA)
+				*outContactPointA = pointA;
+			if (outContactPointB)
+				*outContactPointB = pointB;
+			return;
+		}
+	}
+
+	int closest;
+	bool exhausted = false;
+	// The smallest support distance found along any of the searched face normals, which is an upper bound for the depth.
+	float minUpperBound = FLOAT_INF;
+	vec upperBoundNormal = vec::zero;
+	float upperBoundMaxS = 0.f;
+	int nIterations = EPAPolytope::maxVertices; // Robustness check: The polytope cannot grow any further than this anyway.
+	while(nIterations-- > 0)
+	{
+		closest = polytope.ClosestFace();
+		const EPAPolytope::Face &f = polytope.face[closest];
+		// Compute the extreme point in the direction of the face normal in the Minkowski set shape.
+		vec pointA = a.ExtremePoint(f.normal, maxS);
+		vec pointB = b.ExtremePoint(-f.normal, minS);
+#ifdef MATH_VEC_IS_FLOAT4
+		assume((pointA - pointB).w == 0.f);
+#endif
+		if (maxS + minS < minUpperBound)
+		{
+			minUpperBound = maxS + minS;
+			upperBoundNormal = f.normal;
+			upperBoundMaxS = maxS;
+		}
+		// If the support function cannot push the closest face notably further away from the origin, the face lies on the
+		// boundary of the Minkowski set shape, and the search is finished.
+		if (maxS + minS - f.distance <= 1e-4f * Max(1.f, f.distance))
+			break;
+		if (!polytope.Expand(pointA, pointB))
+		{
+			exhausted = true; // The polytope capacity has been exhausted. Report the best estimate found so far.
+			break;
+		}
+	}
+	if (!exhausted)
+		closest = polytope.ClosestFace();
+
+	const EPAPolytope::Face &f = polytope.face[closest];
+	// If the search was cut short, e.g. on curved objects that deeply penetrate, the closest face still lies notably inside
+	// the Minkowski set shape, and its distance underestimates the translation needed to separate the objects. The smallest
+	// support distance found is then reported instead, since translating b by that amount along its normal is guaranteed to
+	// separate the objects.
+	outNormal = exhausted ? upperBoundNormal : f.normal;
+	outDepth = Max(0.f, exhausted ? minUpperBound : f.distance);
+	if (outContactPointA || outContactPointB)
+	{
+		vec pointA, pointB;
+		polytope.ContactPoints(closest, pointA, pointB);
+		if (exhausted)
+		{
+			// The closest face is not orthogonal to the reported normal. Move the contact point of a onto the support plane of a,
+			// and place the contact point of b depth away from it along the normal, which puts it on the support plane of b.
+			pointA += (upperBoundMaxS - Dot(pointA, outNormal)) * outNormal;
+			pointB = pointA - outDepth * outNormal;
+		}
+		if (outContactPointA)
+			*outContactPointA = pointA;
+		if (outContactPointB)
+			*outContactPointB = pointB;
+	}
+}
+
+/// Tests whether the two convex objects a and b intersect, and if so, computes their penetration depth, contact normal and contact points.
+/** This function runs GJKIntersect() followed by EPAPenetration(). See EPAPenetration() for the meaning of the output parameters,
+	which are only written to if the objects intersect.
+	@return True if the objects intersect. */
+template<typename A, typename B>
+bool EPAPenetration(const A &a, const B &b, vec &outNormal, float &outDepth, vec *outContactPointA = 0, vec *outContactPointB = 0)
+{
+	GJKSimplex simplex;
+	if (!GJKIntersect(a, b, simplex))
+		return false;
+	EPAPenetration(a, b, simplex, outNormal, outDepth, outContactPointA, outContactPointB);
+	return true;
+}
+
+MATH_END_NAMESPACE
@@ -19,6 +19,7 @@
 #include "../Geometry/LineSegment.h"
 #include "../Geometry/Triangle.h"
 #include "../Geometry/Plane.h"
+#include "../Math/float4d.h"
 
 MATH_BEGIN_NAMESPACE
 
@@ -347,4 +348,245 @@ vec UpdateSimplex(vec *s, int &n)
 	}
 }
 
+/// Copies the simplex vertices at the given indices of (s, sa, sb) to the arrays (outS, outSa, outSb). The arrays sa and sb (and
+/// correspondingly outSa and outSb) may be null. The copy can be performed in place if the indices are in increasing order.
+static void SelectSimplexPoints(const vec *s, const vec *sa, const vec *sb, const int *indices, int numIndices, vec *outS, vec *outSa, vec *outSb)
+{
+	for(int i = 0; i < numIndices; ++i)
+	{
+		outS[i] = s[indices[i]];
+		if (sa)
+			outSa[i] = sa[indices[i]];
+		if (sb)
+			outSb[i] = sb[indices[i]];
+	}
+}
+
+static vec ClosestPointToOriginOnSegment(vec *s, vec *sa, vec *sb, float *lambda, int &n)
+{
+	vec d01 = s[1] - s[0];
+	float t = -Dot(s[0], d01);
+	if (t <= 0.f) // Closest to vertex s[0]. This also catches the degenerate case s[0] == s[1].
+	{
+		n = 1;
+		lambda[0] = 1.f;
+		return s[0];
+	}
+	float lengthSq = d01.LengthSq();
+	if (t >= lengthSq) // Closest to vertex s[1].
+	{
+		const int indices[1] = { 1 };
+		SelectSimplexPoints(s, sa, sb, indices, 1, s, sa, sb);
+		n = 1;
+		lambda[0] = 1.f;
+		return s[0];
+	}
+	// Closest to the interior of the line segment.
+	t /= lengthSq;
+	lambda[0] = 1.f - t;
+	lambda[1] = t;
+	return s[0] + t * d01;
+}
+
+/// Computes the closest point to the origin on the sub-simplex of (s, sa, sb) that consists of the given vertices. The
+/// resulting reduced simplex is written to (outS, outSa, outSb, outLambda, outN).
+static vec ClosestPointToOriginOnSubSimplex(const vec *s, const vec *sa, const vec *sb, const int *indices, int numIndices,
+	vec *outS, vec *outSa, vec *outSb, float *outLambda, int &outN)
+{
+	SelectSimplexPoints(s, sa, sb, indices, numIndices, outS, outSa, outSb);
+	outN = numIndices;
+	return ClosestPointToOriginOnSimplex(outS, outSa, outSb, outLambda, outN);
+}
+
+/// Computes the closest point to the origin on each of the given candidate sub-simplices of (s, sa, sb), and replaces
+/// the simplex with the candidate that is closest to the origin.
+static vec ClosestPointToOriginOnSubSimplices(vec *s, vec *sa, vec *sb, float *lambda, int &n, const int (*candidates)[3], int numCandidates, int numIndices)
+{
+	vec bestS[4], bestSa[4], bestSb[4];
+	float bestLambda[4];
+	int bestN = 0;
+	vec best = vec::zero;
+	float bestDistSq = FLOAT_INF;
+	for(int i = 0; i < numCandidates; ++i)
+	{
+		vec candS[4], candSa[4], candSb[4];
+		float candLambda[4];
+		int candN;
+		vec pt = ClosestPointToOriginOnSubSimplex(s, sa, sb, candidates[i], numIndices, candS, sa ? candSa : 0, sb ? candSb : 0, candLambda, candN);
+		float distSq = pt.LengthSq();
+		if (distSq < bestDistSq)
+		{
+			bestDistSq = distSq;
+			best = pt;
+			bestN = candN;
+			const int indices[4] = { 0, 1, 2, 3 };
+			SelectSimplexPoints(candS, sa ? candSa : 0, sb ? candSb : 0, indices, candN, bestS, bestSa, bestSb);
+			for(int j = 0; j < candN; ++j)
+				bestLambda[j] = candLambda[j];
+		}
+	}
+	n = bestN;
+	const int indices[4] = { 0, 1, 2, 3 };
+	SelectSimplexPoints(bestS, sa ? bestSa : 0, sb ? bestSb : 0, indices, bestN, s, sa, sb);
+	for(int j = 0; j < bestN; ++j)
+		lambda[j] = bestLambda[j];
+	return best;
+}
+
+static vec ClosestPointToOriginOnTriangle(vec *s, vec *sa, vec *sb, float *lambda, int &n)
+{
+	// Walk through the voronoi regions of the triangle, see Christer Ericson's Real-Time Collision Detection, p. 141.
+	vec d01 = s[1] - s[0];
+	vec d02 = s[2] - s[0];
+	// The dot products below are computed in double precision. The distance queries often end up with sliver triangles, e.g.
+	// two nearby support points at one end of a long edge, and the differences of products in va, vb and vc then cancel out
+	// catastrophically in float. The resulting error tilts the closest point direction, and with it the next search direction.
+	float4d s0(s[0].x, s[0].y, s[0].z, 0.0);
+	float4d s1(s[1].x, s[1].y, s[1].z, 0.0);
+	float4d s2(s[2].x, s[2].y, s[2].z, 0.0);
+	float4d e01 = s1 - s0;
+	float4d e02 = s2 - s0;
+	double d1 = -e01.Dot(s0);
+	double d2 = -e02.Dot(s0);
+	if (d1 <= 0.f && d2 <= 0.f) // Closest to vertex s[0].
+	{
+		n = 1;
+		lambda[0] = 1.f;
+		return s[0];
+	}
+	double d3 = -e01.Dot(s1);
+	double d4 = -e02.Dot(s1);
+	if (d3 >= 0.f && d4 <= d3) // Closest to vertex s[1].
+	{
+		const int indices[1] = { 1 };
+		SelectSimplexPoints(s, sa, sb, indices, 1, s, sa, sb);
+		n = 1;
+		lambda[0] = 1.f;
+		return s[0];
+	}
+	double vc = d1*d4 - d3*d2;
+	if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) // Closest to edge s[0]->s[1].
+	{
+		float t = (float)(d1 / (d1 - d3));
+		n = 2;
+		lambda[0] = 1.f - t;
+		lambda[1] = t;
+		return s[0] + t * d01;
+	}
+	double d5 = -e01.Dot(s2);
+	double d6 = -e02.Dot(s2);
+	if (d6 >= 0.f && d5 <= d6) // Closest to vertex s[2].
+	{
+		const int indices[1] = { 2 };
+		SelectSimplexPoints(s, sa, sb, indices, 1, s, sa, sb);
+		n = 1;
+		lambda[0] = 1.f;
+		return s[0];
+	}
+	double vb = d5*d2 - d1*d6;
+	if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) // Closest to edge s[0]->s[2].
+	{
+		float t = (float)(d2 / (d2 - d6));
+		const int indices[2] = { 0, 2 };
+		SelectSimplexPoints(s, sa, sb, indices, 2, s, sa, sb);
+		n = 2;
+		lambda[0] = 1.f - t;
+		lambda[1] = t;
+		return s[0] + t * d02;
+	}
+	double va = d3*d6 - d5*d4;
+	if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) // Closest to edge s[1]->s[2].
+	{
+		float t = (float)((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		const int indices[2] = { 1, 2 };
+		SelectSimplexPoints(s, sa, sb, indices, 2, s, sa, sb);
+		n = 2;
+		lambda[0] = 1.f - t;
+		lambda[1] = t;
+		return s[0] + t * (s[1] - s[0]);
+	}
+	double denom = va + vb + vc;
+	if (denom <= 1e-12f * Max(d01.LengthSq(), d02.LengthSq()))
+	{
+		// The triangle is degenerate (its vertices are collinear), and none of the tests above caught that due to
+		// floating point imprecision. Fall back to examining each edge separately.
+		static const int edges[3][3] = { { 0, 1, -1 }, { 0, 2, -1 }, { 1, 2, -1 } };
+		return ClosestPointToOriginOnSubSimplices(s, sa, sb, lambda, n, edges, 3, 2);
+	}
+	// Closest to the interior of the triangle.
+	float v = (float)(vb / denom);
+	float w = (float)(vc / denom);
+	lambda[0] = 1.f - v - w;
+	lambda[1] = v;
+	lambda[2] = w;
+	return s[0] + v * d01 + w * d02;
+}
+
+static vec ClosestPointToOriginOnTetrahedron(vec *s, vec *sa, vec *sb, float *lambda, int &n)
+{
+	// The faces of the tetrahedron, and for each face, the vertex opposite to it.
+	static const int faces[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+
+	vec d01 = s[1] - s[0];
+	vec d02 = s[2] - s[0];
+	vec d03 = s[3] - s[0];
+	float volume = Dot(d01, Cross(d02, d03));
+	float scale = d01.LengthSq() * d02.LengthSq() * d03.LengthSq();
+	if (volume*volume <= 1e-10f * scale)
+		return ClosestPointToOriginOnSubSimplices(s, sa, sb, lambda, n, faces, 4, 3); // Degenerate (flat) tetrahedron.
+
+	int outsideFaces[4][3];
+	int numOutsideFaces = 0;
+	float bary[4];
+	for(int i = 0; i < 4; ++i)
+	{
+		const int *f = faces[i];
+		vec normal = Cross(s[f[1]] - s[f[0]], s[f[2]] - s[f[0]]);
+		float originSide = -Dot(normal, s[f[0]]);
+		float vertexSide = Dot(normal, s[i] - s[f[0]]);
+		if (originSide * vertexSide < 0.f) // Is the origin on the opposite side of this face than the rest of the tetrahedron?
+		{
+			for(int j = 0; j < 3; ++j)
+				outsideFaces[numOutsideFaces][j] = f[j];
+			++numOutsideFaces;
+		}
+		bary[i] = originSide / vertexSide;
+	}
+	if (numOutsideFaces > 0)
+		return ClosestPointToOriginOnSubSimplices(s, sa, sb, lambda, n, outsideFaces, numOutsideFaces, 3);
+
+	// The origin is contained inside the tetrahedron.
+	for(int i = 0; i < 4; ++i)
+		lambda[i] = bary[i];
+	return vec::zero;
+}
+
+/// This function computes the point on the simplex defined by the array of points in s that lies closest to the origin, and
+/// reduces the simplex to the smallest sub-simplex that still contains that point. This is the counterpart of UpdateSimplex()
+/// for the GJK distance query, which needs the exact closest point and not just a new search direction.
+/** @param s [in, out] An array of points in the simplex. When this function returns, this point array is updated to contain the reduced simplex.
+	@param sa [in, out] The support points on the first shape that were used to form the Minkowski difference points s[i] = sa[i] - sb[i].
+	                    This array is reduced in tandem with s. The function does not otherwise access the contents of this array,
+	                    so it can be used to carry any per-vertex data along with the simplex, or be null.
+	@param sb [in, out] The support points on the second shape. This array is reduced in tandem with s, and may be null.
+	@param lambda [out] Receives the barycentric coordinates of the closest point with respect to the reduced simplex, so that
+	                    the closest points on the two shapes are given by lambda[0]*sa[0] + ... + lambda[n-1]*sa[n-1], and similarly for sb.
+	@param n [in, out] The number of points in the array s, in the range [1, 4]. When this function returns, this reference is updated
+	                   to specify how many points the reduced simplex contains. If the value 4 is returned, the origin is contained
+	                   inside the tetrahedron s.
+	@return The point on the simplex closest to the origin. */
+vec ClosestPointToOriginOnSimplex(vec *s, vec *sa, vec *sb, float *lambda, int &n)
+{
+	assume1(n >= 1 && n <= 4, n);
+	switch(n)
+	{
+	case 1:
+		lambda[0] = 1.f;
+		return s[0];
+	case 2: return ClosestPointToOriginOnSegment(s, sa, sb, lambda, n);
+	case 3: return ClosestPointToOriginOnTriangle(s, sa, sb, lambda, n);
+	default: return ClosestPointToOriginOnTetrahedron(s, sa, sb, lambda, n);
+	}
+}
+
 MATH_END_NAMESPACE
@@ -23,6 +23,7 @@
 MATH_BEGIN_NAMESPACE
 
 vec UpdateSimplex(vec *s, int &n);
+vec ClosestPointToOriginOnSimplex(vec *s, vec *sa, vec *sb, float *lambda, int &n);
 
 #define SUPPORT(dir) (a.ExtremePoint(dir, maxS) - b.ExtremePoint(-dir, minS));
 
@@ -60,4 +61,277 @@ bool GJKIntersect(const A &a, const B &b)
 	return false; // Report no intersection.
 }
 
+/// Stores the state of a GJK intersection test between a pair of objects, so that the next test of the same pair can be warm-started.
+/** When the objects move only a little between consecutive tests, as is typical when the same pair is tested on each frame of
+	a simulation, the support directions that terminated the previous test are likely to terminate the next test as well.
+	A default-constructed cache is empty, and the first test performed with it runs from scratch.
+	@see GJKIntersect(const A &, const B &, GJKCache &). */
+struct GJKCache
+{
+	/// The search directions that produced the support points of the simplex that terminated the previous test. Together with
+	/// the starting point a.AnyPointFast() - b.AnyPointFast(), these points form a simplex that likely contains the origin again.
+	/// If the previous test found the objects to be disjoint, this contains only the separating direction that was found.
+	vec dir[3];
+	/// The number of valid directions in the array dir, or 0 if this cache is empty.
+	int numDirs;
+
+	GJKCache():numDirs(0) {}
+};
+
+/// Tests whether the two convex objects a and b intersect, warm-starting the search from the result of the previous test of the same pair.
+/** In addition to the starting point a.AnyPointFast() - b.AnyPointFast(), this variant first re-evaluates the support points along
+	the directions stored in the cache. If the objects were disjoint in the previous test and have not moved much since, the previously found
+	separating direction still separates them, and the test finishes after a single support function evaluation. If the objects
+	intersected, the previous terminating simplex is rebuilt, and in most cases still contains the origin.
+	The simplex is processed using ClosestPointToOriginOnSimplex() rather than UpdateSimplex(), since a simplex rebuilt from
+	cached directions does not satisfy the construction invariants that UpdateSimplex() relies on.
+	@param cache [in, out] The state of the previous test of this pair. When this function returns, this is updated to hold the
+		state of this test. Use a separate cache for each pair of objects.
+	@return The same result as GJKIntersect(a, b). */
+template<typename A, typename B>
+bool GJKIntersect(const A &a, const B &b, GJKCache &cache)
+{
+	vec support[4], dir[4];
+	float lambda[4];
+	float maxS, minS;
+	// Start with an arbitrary point in the Minkowski set shape. This point is not a support point, so mark it with a zero direction.
+	support[0] = a.AnyPointFast() - b.AnyPointFast();
+	if (support[0].LengthSq() < 1e-7f) // Robustness check: Test if the first arbitrary point we guessed produced the zero vector we are looking for!
+		return true;
+	dir[0] = vec::zero;
+	int n = 1; // Stores the current number of points in the search simplex.
+	// Re-evaluate the support points along the cached directions at the current positions of the objects.
+	for(int i = 0; i < cache.numDirs; ++i)
+	{
+		dir[n] = cache.dir[i];
+		support[n] = SUPPORT(dir[n]);
+		if (minS + maxS < 0.f) // Does this direction separate the objects? Then the test is already finished.
+		{
+			cache.dir[0] = dir[n];
+			cache.numDirs = 1;
+			return false;
+		}
+		++n;
+	}
+	float distSq = FLOAT_INF; // The squared distance of the previous simplex from the origin.
+	int nIterations = 50; // Robustness check: Limit the maximum number of iterations to perform to avoid infinite loop if types A or B are buggy!
+	while(nIterations-- > 0)
+	{
+		// Find the point of the current simplex closest to the origin, and drop the simplex vertices that do not contribute to it.
+		// The directions of the remaining vertices are carried along in the dir array.
+		vec v = ClosestPointToOriginOnSimplex(support, dir, 0, lambda, n);
+		float newDistSq = v.LengthSq();
+		if (n == 4 || newDistSq < 1e-7f) // Was the origin contained in the current simplex? If so, then the convex shapes a and b do share a common point - intersection!
+		{
+			// Cache the directions of the most recently added support points, leaving room for the starting point in the next test.
+			cache.numDirs = 0;
+			for(int i = n-1; i >= 0 && cache.numDirs < 3; --i)
+				if (!dir[i].IsZero())
+					cache.dir[cache.numDirs++] = dir[i];
+			return true;
+		}
+		// Each new support point must bring the simplex closer to the origin. If it did not, e.g. because the support point repeated
+		// a vertex already in the simplex, the search would cycle without progress. This happens when the objects are just touching:
+		// the origin then lies outside the Minkowski set shape, within floating point precision of its boundary - no intersection.
+		if (newDistSq >= distSq)
+		{
+			cache.dir[0] = -v;
+			cache.numDirs = 1;
+			return false;
+		}
+		distSq = newDistSq;
+		// Compute the extreme point to the direction -v in the Minkowski set shape.
+		dir[n] = -v;
+		support[n] = SUPPORT(dir[n]);
+#ifdef MATH_VEC_IS_FLOAT4
+		assume(support[n].w == 0.f);
+#endif
+		// If the most extreme point in that search direction did not walk past the origin, then the origin cannot be contained in the Minkowski
+		// convex shape, and the two convex objects a and b do not share a common point - no intersection!
+		if (minS + maxS < 0.f)
+		{
+			cache.dir[0] = dir[n];
+			cache.numDirs = 1;
+			return false;
+		}
+		++n;
+	}
+	cache.numDirs = 0;
+	assume(false && "Warm-started GJK intersection test did not converge to a result!");
+	return false; // Report no intersection.
+}
+
+/// Stores the simplex that terminated a GJK intersection test.
+/** Each vertex of the simplex is stored as the pair of points on the two tested objects that formed it, i.e. the vertex
+	i of the simplex in the Minkowski difference set is pointA[i] - pointB[i]. This is used as the starting point of the
+	Expanding Polytope Algorithm, see EPAPenetration(). */
+struct GJKSimplex
+{
+	vec pointA[4];
+	vec pointB[4];
+	/// The number of vertices in the simplex, in the range [1, 4].
+	int numPoints;
+
+	GJKSimplex():numPoints(0) {}
+};
+
+/// Tests whether the two convex objects a and b intersect, and if so, returns the simplex that proves the intersection.
+/** @param outSimplex [out] If the objects intersect, receives a simplex of the Minkowski difference set a-b that contains the origin.
+		Usually this is a tetrahedron, but if the origin was found to lie on a lower dimensional simplex, it can have fewer vertices.
+		If the objects do not intersect, this is not modified.
+	@return The same result as GJKIntersect(a, b). */
+template<typename A, typename B>
+bool GJKIntersect(const A &a, const B &b, GJKSimplex &outSimplex)
+{
+	vec support[4], supportA[4], supportB[4];
+	float lambda[4];
+	float maxS, minS;
+	// Start with an arbitrary point in the Minkowski set shape.
+	supportA[0] = a.AnyPointFast();
+	supportB[0] = b.AnyPointFast();
+	support[0] = supportA[0] - supportB[0];
+	int n = 1; // Stores the current number of points in the search simplex.
+	float distSq = FLOAT_INF; // The squared distance of the previous simplex from the origin.
+	int nIterations = 50; // Robustness check: Limit the maximum number of iterations to perform to avoid infinite loop if types A or B are buggy!
+	while(nIterations-- > 0)
+	{
+		// Find the point of the current simplex closest to the origin, and drop the simplex vertices that do not contribute to it.
+		vec v = ClosestPointToOriginOnSimplex(support, supportA, supportB, lambda, n);
+		float newDistSq = v.LengthSq();
+		if (n == 4 || newDistSq < 1e-7f) // Was the origin contained in the current simplex? If so, then the convex shapes a and b do share a common point - intersection!
+		{
+			for(int i = 0; i < n; ++i)
+			{
+				outSimplex.pointA[i] = supportA[i];
+				outSimplex.pointB[i] = supportB[i];
+			}
+			outSimplex.numPoints = n;
+			return true;
+		}
+		// If the new support point did not bring the simplex closer to the origin, the search would cycle without progress.
+		// The objects are then just touching, see GJKIntersect(const A &, const B &, GJKCache &).
+		if (newDistSq >= distSq)
+			return false;
+		distSq = newDistSq;
+		// Compute the extreme point to the direction -v in the Minkowski set shape.
+		supportA[n] = a.ExtremePoint(-v, maxS);
+		supportB[n] = b.ExtremePoint(v, minS);
+		support[n] = supportA[n] - supportB[n];
+#ifdef MATH_VEC_IS_FLOAT4
+		assume(support[n].w == 0.f);
+#endif
+		// If the most extreme point in that search direction did not walk past the origin, then the origin cannot be contained in the Minkowski
+		// convex shape, and the two convex objects a and b do not share a common point - no intersection!
+		if (minS + maxS < 0.f)
+			return false;
+		++n;
+	}
+	assume(false && "GJK intersection test did not converge to a result!");
+	return false; // Report no intersection.
+}
+
+/// Computes the distance between the two convex objects a and b, and the closest points between them.
+/** Unlike GJKIntersect(), which stops as soon as it finds a separating direction, this function keeps refining the point of the Minkowski
+	difference set a-b that lies closest to the origin, until the support function cannot produce a point that would get notably closer.
+	The types A and B need to implement the functions ExtremePoint(direction, projectionDistance) and AnyPointFast().
+	@param outClosestPointA [out] If not null, receives the point on a that is closest to b.
+	@param outClosestPointB [out] If not null, receives the point on b that is closest to a. The distance between outClosestPointA and
+		outClosestPointB equals the returned distance. If a and b intersect, both receive the same point that lies inside a and b.
+	@param outSeparatingAxis [out] If not null and a and b do not intersect, receives the unit direction, pointing from a toward b,
+		of the search direction along which the gap between the support planes of a and b was the largest. This gap is a lower bound
+		for the distance, whereas the returned distance is an upper bound. When the closest features are long and nearly parallel,
+		the direction between the closest points can be notably less accurate than this axis, even if the distance has converged well.
+	@return The distance between a and b, or 0 if they intersect. */
+template<typename A, typename B>
+float GJKDistance(const A &a, const B &b, vec *outClosestPointA = 0, vec *outClosestPointB = 0, vec *outSeparatingAxis = 0)
+{
+	vec support[4], supportA[4], supportB[4];
+	float lambda[4];
+	float maxS, minS;
+	// Start with an arbitrary point in the Minkowski set shape.
+	supportA[0] = a.AnyPointFast();
+	supportB[0] = b.AnyPointFast();
+	support[0] = supportA[0] - supportB[0];
+	lambda[0] = 1.f;
+	int n = 1; // Stores the current number of points in the search simplex.
+	vec v = support[0]; // The point in the current simplex closest to the origin.
+	float distSq = v.LengthSq();
+	float maxLowerBound = -FLOAT_INF; // The largest lower bound for the distance found so far.
+	int nIterations = 50; // Robustness check: Limit the maximum number of iterations to perform to avoid infinite loop if types A or B are buggy!
+	while(nIterations-- > 0 && distSq >= 1e-7f) // If v is this close to the origin, treat the objects as touching.
+	{
+		// Compute the extreme point to the direction -v in the Minkowski set shape.
+		vec newSupportA = a.ExtremePoint(-v, maxS);
+		vec newSupportB = b.ExtremePoint(v, minS);
+		vec newSupport = newSupportA - newSupportB;
+#ifdef MATH_VEC_IS_FLOAT4
+		assume(newSupport.w == 0.f);
+#endif
+		float lowerBound = Dot(v, newSupport) / Sqrt(distSq);
+		if (lowerBound > maxLowerBound)
+		{
+			maxLowerBound = lowerBound;
+			if (outSeparatingAxis)
+				*outSeparatingAxis = -v / Sqrt(distSq);
+		}
+		// Dot(v, newSupport)/|v| is a lower bound for the distance, and |v| is an upper bound. If the two are close enough,
+		// the search has converged.
+		if (distSq - Dot(v, newSupport) <= 1e-5f * distSq)
+			break;
+		// Add the newly evaluated point to a copy of the search simplex, and find the point on it that is closest to the origin.
+		vec newSimplex[4], newSimplexA[4], newSimplexB[4];
+		float newLambda[4];
+		for(int i = 0; i < n; ++i)
+		{
+			newSimplex[i] = support[i];
+			newSimplexA[i] = supportA[i];
+			newSimplexB[i] = supportB[i];
+		}
+		newSimplex[n] = newSupport;
+		newSimplexA[n] = newSupportA;
+		newSimplexB[n] = newSupportB;
+		int newN = n + 1;
+		vec newV = ClosestPointToOriginOnSimplex(newSimplex, newSimplexA, newSimplexB, newLambda, newN);
+		float newDistSq = newV.LengthSq();
+		// Robustness check: If floating point imprecision prevents making further progress, the current result is as good as it
+		// gets. Keep it instead of the new simplex, which may have collapsed onto a feature further away from the origin. The
+		// same applies if the new simplex seems to contain the origin, even though Dot(v, newSupport) > 0 proves that the plane
+		// orthogonal to v separates the origin from the Minkowski set shape: the simplex is then a sliver that was misclassified.
+		if (newN == 4 ? Dot(v, newSupport) > 0.f : newDistSq >= distSq)
+			break;
+		for(int i = 0; i < newN; ++i)
+		{
+			support[i] = newSimplex[i];
+			supportA[i] = newSimplexA[i];
+			supportB[i] = newSimplexB[i];
+			lambda[i] = newLambda[i];
+		}
+		n = newN;
+		v = newV;
+		distSq = newDistSq;
+		if (n == 4) // Was the origin contained in the current simplex? If so, then the convex shapes a and b intersect.
+			break;
+	}
+	// If the iteration limit was reached, v still gives an upper bound for the distance, and is a very close approximation
+	// for all but the most ill-conditioned shapes.
+	bool intersects = (n == 4 || distSq < 1e-7f);
+
+	if (outClosestPointA || outClosestPointB)
+	{
+		// The closest points are the same convex combination of the support points as v is of the Minkowski difference points.
+		vec closestA = lambda[0] * supportA[0];
+		vec closestB = lambda[0] * supportB[0];
+		for(int i = 1; i < n; ++i)
+		{
+			closestA += lambda[i] * supportA[i];
+			closestB += lambda[i] * supportB[i];
+		}
+		if (outClosestPointA)
+			*outClosestPointA = closestA;
+		if (outClosestPointB)
+			*outClosestPointB = intersects ? closestA : closestB;
+	}
+	return intersects ? 0.f : Sqrt(distSq);
+}
+
 MATH_END_NAMESPACE
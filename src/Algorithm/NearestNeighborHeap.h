@@ -0,0 +1,130 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file NearestNeighborHeap.h
+	@author Jukka Jylnki
+	@brief A fixed-capacity heap for collecting the k nearest neighbors of a point. */
+#pragma once
+
+#include "../MathBuildConfig.h"
+#include "../MathGeoLibFwd.h"
+#include "../Math/MathConstants.h"
+#include "../Math/myassert.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// Holds the k closest objects found so far by a k-nearest neighbor query.
+/** The objects are stored in a max-heap ordered by their distance, inside a fixed-size array in the heap object itself,
+	so using this structure does not allocate memory. The farthest of the k objects is at the top of the heap, so that
+	a query can cheaply test whether a new object or a node of a spatial tree is close enough to matter.
+	@param T The type used to identify the objects, e.g. an object index.
+	@param Capacity The maximum number of neighbors that can be searched for. */
+template<typename T, int Capacity>
+class NearestNeighborHeap
+{
+public:
+	struct Entry
+	{
+		T object;
+		float distanceSq;
+	};
+
+	/// @param k The number of nearest neighbors to keep, in the range [0, Capacity].
+	explicit NearestNeighborHeap(int k)
+	:maxSize(k), size(0)
+	{
+		assert(k >= 0);
+		assert(k <= Capacity);
+	}
+
+	int Size() const { return size; }
+	bool Full() const { return size >= maxSize; }
+
+	/// Returns the squared distance an object has to be closer than to be accepted into this heap.
+	/// Before the heap has been filled, this is infinity.
+	float MaxDistanceSq() const { return Full() ? (maxSize > 0 ? entries[0].distanceSq : -FLOAT_INF) : FLOAT_INF; }
+
+	/// Returns true if the given object is currently held in this heap. Runs in linear time.
+	bool Contains(const T &object) const
+	{
+		for(int i = 0; i < size; ++i)
+			if (entries[i].object == object)
+				return true;
+		return false;
+	}
+
+	/// Adds the given object, if it is closer than the farthest object held so far, or if the heap is not full yet.
+	/// When the heap is full, the farthest object is dropped to make room.
+	void Insert(const T &object, float distanceSq)
+	{
+		if (!Full())
+		{
+			int i = size++;
+			while(i > 0 && entries[(i-1)/2].distanceSq < distanceSq)
+			{
+				entries[i] = entries[(i-1)/2];
+				i = (i-1)/2;
+			}
+			entries[i].object = object;
+			entries[i].distanceSq = distanceSq;
+		}
+		else if (maxSize > 0 && distanceSq < entries[0].distanceSq)
+		{
+			Entry e;
+			e.object = object;
+			e.distanceSq = distanceSq;
+			SiftDown(e, 0, size);
+		}
+	}
+
+	/// Sorts the held objects in ascending order of distance, so that operator[](0) returns the closest object.
+	/// After calling this, do not call Insert() anymore.
+	void SortAscending()
+	{
+		// Heapsort: Repeatedly move the farthest remaining object to the end of the array.
+		for(int end = size-1; end > 0; --end)
+		{
+			Entry last = entries[end];
+			entries[end] = entries[0];
+			SiftDown(last, 0, end);
+		}
+	}
+
+	const Entry &operator [](int i) const { assert(i >= 0 && i < size); return entries[i]; }
+
+private:
+	Entry entries[Capacity > 0 ? Capacity : 1];
+	int maxSize;
+	int size;
+
+	/// Places e into the hole at index i of the heap formed by the first n entries.
+	void SiftDown(const Entry &e, int i, int n)
+	{
+		for(;;)
+		{
+			int child = 2*i + 1;
+			if (child >= n)
+				break;
+			if (child + 1 < n && entries[child+1].distanceSq > entries[child].distanceSq)
+				++child;
+			if (entries[child].distanceSq <= e.distanceSq)
+				break;
+			entries[i] = entries[child];
+			i = child;
+		}
+		entries[i] = e;
+	}
+};
+
+MATH_END_NAMESPACE
@@ -0,0 +1,111 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file Parallel.cpp
+	@author Jukka Jylnki
+	@brief Utilities for distributing work to multiple threads. */
+#include "Parallel.h"
+#include "../Math/MathFunc.h"
+#include "../Math/assume.h"
+
+#ifdef MATH_ENABLE_THREADS
+#include <thread>
+#include <atomic>
+#include <vector>
+#endif
+
+MATH_BEGIN_NAMESPACE
+
+#ifdef MATH_ENABLE_THREADS
+struct ParallelTaskQueue
+{
+	ParallelTaskFunc func;
+	void *userData;
+	int numTasks;
+	std::atomic<int> nextTask;
+};
+
+static void RunTasksFromQueue(ParallelTaskQueue *queue)
+{
+	for(;;)
+	{
+		int task = queue->nextTask.fetch_add(1);
+		if (task >= queue->numTasks)
+			return;
+		queue->func(queue->userData, task);
+	}
+}
+#endif
+
+static void DefaultParallelTaskDispatcher(ParallelTaskFunc func, void *userData, int numTasks, int numThreads)
+{
+#ifdef MATH_ENABLE_THREADS
+	ParallelTaskQueue queue;
+	queue.func = func;
+	queue.userData = userData;
+	queue.numTasks = numTasks;
+	queue.nextTask = 0;
+
+	// The calling thread also participates in running the tasks, so spawn one thread less than requested.
+	std::vector<std::thread> threads;
+	for(int i = 1; i < numThreads; ++i)
+		threads.push_back(std::thread(RunTasksFromQueue, &queue));
+	RunTasksFromQueue(&queue);
+	for(size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+#else
+	MARK_UNUSED(numThreads);
+	for(int i = 0; i < numTasks; ++i)
+		func(userData, i);
+#endif
+}
+
+static ParallelTaskDispatcher parallelTaskDispatcher = 0;
+
+void SetParallelTaskDispatcher(ParallelTaskDispatcher dispatcher)
+{
+	parallelTaskDispatcher = dispatcher;
+}
+
+void RunParallelTasks(ParallelTaskFunc func, void *userData, int numTasks, int numThreads)
+{
+	assume(func);
+	assume(numThreads >= 0);
+	if (numThreads <= 0)
+		numThreads = NumHardwareThreads();
+	numThreads = Min(numThreads, numTasks);
+	if (numThreads <= 1)
+	{
+		for(int i = 0; i < numTasks; ++i)
+			func(userData, i);
+		return;
+	}
+
+	if (parallelTaskDispatcher)
+		parallelTaskDispatcher(func, userData, numTasks, numThreads);
+	else
+		DefaultParallelTaskDispatcher(func, userData, numTasks, numThreads);
+}
+
+int NumHardwareThreads()
+{
+#ifdef MATH_ENABLE_THREADS
+	int numThreads = (int)std::thread::hardware_concurrency();
+	return numThreads > 0 ? numThreads : 1;
+#else
+	return 1;
+#endif
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,53 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file Parallel.h
+	@author Jukka Jylnki
+	@brief Utilities for distributing work to multiple threads. */
+#pragma once
+
+#include "../MathBuildConfig.h"
+#include "../MathGeoLibFwd.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// A function that performs a single task of a parallel job.
+/** @param userData The user data pointer that was passed to RunParallelTasks().
+	@param taskIndex The index of the task to run, in the range [0, numTasks[. */
+typedef void (*ParallelTaskFunc)(void *userData, int taskIndex);
+
+/// A function that executes all the tasks of a parallel job, and returns only after every task has finished.
+/** Install a custom dispatcher with SetParallelTaskDispatcher() to run the parallel work of MathGeoLib on the job system
+	of the host application, instead of spawning new threads.
+	@param func The function to call for each task.
+	@param userData The user data pointer to pass to each call to func.
+	@param numTasks The number of tasks to run. The dispatcher must call func exactly once for each task index in [0, numTasks[.
+	@param numThreads The maximum number of threads that the caller wishes to be used for the job. The dispatcher may use fewer. */
+typedef void (*ParallelTaskDispatcher)(ParallelTaskFunc func, void *userData, int numTasks, int numThreads);
+
+/// Installs the dispatcher that is used to execute parallel jobs.
+/** @param dispatcher The dispatcher to use, or null to restore the default dispatcher. The default dispatcher uses std::thread
+		if MATH_ENABLE_THREADS is defined, and otherwise runs all tasks serially on the calling thread. */
+void SetParallelTaskDispatcher(ParallelTaskDispatcher dispatcher);
+
+/// Runs the given tasks using the currently installed dispatcher, and waits for all of them to finish.
+/** The tasks may be executed in any order and concurrently with each other, so the task function must be thread-safe.
+	@param numThreads The maximum number of threads to use. If 0, the number of hardware threads is used.
+		If 1, or if numTasks <= 1, all tasks are run serially on the calling thread. */
+void RunParallelTasks(ParallelTaskFunc func, void *userData, int numTasks, int numThreads);
+
+/// Returns the number of threads the system can run concurrently, or 1 if this cannot be determined.
+int NumHardwareThreads();
+
+MATH_END_NAMESPACE
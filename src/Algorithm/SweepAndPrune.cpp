@@ -0,0 +1,181 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file SweepAndPrune.cpp
+	@author Jukka Jylnki
+	@brief Implementation of the sort-and-sweep broadphase. */
+#include "SweepAndPrune.h"
+#include "../Geometry/AABB.h"
+#include "../Math/MathFunc.h"
+#include "../Math/Reinterpret.h"
+#include "../Math/myassert.h"
+
+MATH_BEGIN_NAMESPACE
+
+SweepAndPrune::SweepAndPrune()
+:sweepAxis(0)
+{
+}
+
+void SweepAndPrune::LoadEntry(Entry &e, const AABB &aabb, int index) const
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		const int axis = (sweepAxis + i) % 3;
+		e.min[i] = aabb.minPoint[axis];
+		e.max[i] = aabb.maxPoint[axis];
+	}
+	e.index = index;
+}
+
+void SweepAndPrune::Build(const AABB *aabbs, int numAABBs)
+{
+	assume(aabbs || numAABBs <= 0);
+	entries.resize(numAABBs > 0 ? numAABBs : 0);
+	if (numAABBs <= 0)
+		return;
+
+	// Sweep along the axis with the largest variance of the box centers, since that axis separates the boxes best.
+	float sum[3] = { 0.f, 0.f, 0.f };
+	float sumSq[3] = { 0.f, 0.f, 0.f };
+	for(int i = 0; i < numAABBs; ++i)
+	{
+		const vec c = aabbs[i].CenterPoint();
+		for(int j = 0; j < 3; ++j)
+		{
+			sum[j] += c[j];
+			sumSq[j] += c[j] * c[j];
+		}
+	}
+	float variance[3];
+	for(int j = 0; j < 3; ++j)
+		variance[j] = sumSq[j] - sum[j] * sum[j] / numAABBs;
+	sweepAxis = (variance[1] > variance[0]) ? 1 : 0;
+	if (variance[2] > variance[sweepAxis])
+		sweepAxis = 2;
+
+	for(int i = 0; i < numAABBs; ++i)
+		LoadEntry(entries[i], aabbs[i], i);
+	RadixSort();
+}
+
+void SweepAndPrune::Update(const AABB *aabbs, int numAABBs)
+{
+	if (numAABBs != NumAABBs())
+	{
+		Build(aabbs, numAABBs);
+		return;
+	}
+	for(size_t i = 0; i < entries.size(); ++i)
+		LoadEntry(entries[i], aabbs[entries[i].index], entries[i].index);
+	InsertionSort();
+}
+
+// Maps a float to an unsigned integer so that the integers compare in the same order as the floats.
+static inline u32 SortableFloatKey(float f)
+{
+	const u32 u = ReinterpretAsU32(f);
+	const u32 mask = (u32)(-(int)(u >> 31)) | 0x80000000U;
+	return u ^ mask;
+}
+
+void SweepAndPrune::RadixSort()
+{
+	// Sort (key, entry index) pairs with a three-pass 11-bit LSD radix sort, and then gather the entries once, instead
+	// of moving the full entries in every pass.
+	const int n = (int)entries.size();
+	std::vector<u32> keys(n), keys2(n), order(n), order2(n);
+	for(int i = 0; i < n; ++i)
+	{
+		keys[i] = SortableFloatKey(entries[i].min[0]);
+		order[i] = (u32)i;
+	}
+
+	for(int shift = 0; shift < 32; shift += 11)
+	{
+		u32 histogram[2048] = {};
+		for(int i = 0; i < n; ++i)
+			++histogram[(keys[i] >> shift) & 2047];
+		u32 offset = 0;
+		for(int i = 0; i < 2048; ++i)
+		{
+			const u32 count = histogram[i];
+			histogram[i] = offset;
+			offset += count;
+		}
+		for(int i = 0; i < n; ++i)
+		{
+			const u32 dst = histogram[(keys[i] >> shift) & 2047]++;
+			keys2[dst] = keys[i];
+			order2[dst] = order[i];
+		}
+		keys.swap(keys2);
+		order.swap(order2);
+	}
+
+	std::vector<Entry> sorted(n);
+	for(int i = 0; i < n; ++i)
+		sorted[i] = entries[order[i]];
+	entries.swap(sorted);
+}
+
+void SweepAndPrune::InsertionSort()
+{
+	const int n = (int)entries.size();
+	for(int i = 1; i < n; ++i)
+	{
+		if (!(entries[i].min[0] < entries[i-1].min[0]))
+			continue;
+		Entry e = entries[i];
+		int j = i;
+		do
+		{
+			entries[j] = entries[j-1];
+			--j;
+		} while(j > 0 && e.min[0] < entries[j-1].min[0]);
+		entries[j] = e;
+	}
+}
+
+int SweepAndPrune::FindOverlappingPairs(Pair *outPairs, int maxPairs) const
+{
+	assume(outPairs || maxPairs <= 0);
+	const int n = (int)entries.size();
+	const Entry *e = n > 0 ? &entries[0] : 0;
+	int numPairs = 0;
+	for(int i = 0; i < n; ++i)
+	{
+		const Entry &a = e[i];
+		// The entries are sorted by their min coordinate along the sweep axis, so none of the entries after the first one
+		// that starts at or after the end of a can overlap with a.
+		for(int j = i+1; j < n && e[j].min[0] < a.max[0]; ++j)
+		{
+			const Entry &b = e[j];
+			if (a.min[0] < b.max[0] &&
+			    a.min[1] < b.max[1] && b.min[1] < a.max[1] &&
+			    a.min[2] < b.max[2] && b.min[2] < a.max[2])
+			{
+				if (numPairs < maxPairs)
+				{
+					outPairs[numPairs].a = Min(a.index, b.index);
+					outPairs[numPairs].b = Max(a.index, b.index);
+				}
+				++numPairs;
+			}
+		}
+	}
+	return numPairs;
+}
+
+MATH_END_NAMESPACE
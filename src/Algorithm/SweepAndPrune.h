@@ -0,0 +1,110 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file SweepAndPrune.h
+	@author Jukka Jylnki
+	@brief A sort-and-sweep broadphase that finds all overlapping pairs in a set of AABBs. */
+#pragma once
+
+#include "../MathBuildConfig.h"
+#include "../MathGeoLibFwd.h"
+#include "../Math/float3.h"
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// Finds all pairs of overlapping AABBs in a set of boxes, using the sort-and-sweep (sweep-and-prune) method.
+/** The boxes are sorted by their min coordinate along a single axis. All pairs are then found in a single sweep over
+	the sorted list, where each box is tested only against the boxes that start before it ends along that axis.
+
+	The initial sort in Build() is done with a radix sort. Between frames, the boxes usually move only a little, so the
+	previous sorted order is nearly correct. Update() takes advantage of this by reusing the previous order, and fixing
+	it with an insertion sort, which runs in close to linear time for such input.
+
+	Sample usage:
+	@code
+	SweepAndPrune sap;
+	sap.Build(&aabbs[0], (int)aabbs.size());
+	std::vector<SweepAndPrune::Pair> pairs(1024);
+	for(;;) // Each frame:
+	{
+		sap.Update(&aabbs[0], (int)aabbs.size());
+		int numPairs = sap.FindOverlappingPairs(&pairs[0], (int)pairs.size());
+		if (numPairs > (int)pairs.size()) // Grow the buffer and query again if it was too small.
+		{
+			pairs.resize(numPairs);
+			sap.FindOverlappingPairs(&pairs[0], numPairs);
+		}
+		...
+	}
+	@endcode */
+class SweepAndPrune
+{
+public:
+	/// Identifies a pair of overlapping boxes by their indices in the array that was passed to Build() or Update().
+	/** The smaller index is always stored in a. */
+	struct Pair
+	{
+		int a;
+		int b;
+	};
+
+	SweepAndPrune();
+
+	/// Sorts the given set of boxes from scratch.
+	/** This chooses the sweep axis as the axis along which the centers of the boxes are spread the widest, and sorts
+		the boxes along it with a radix sort.
+		@param aabbs An array of numAABBs boxes. This function does not store a pointer to this array. */
+	void Build(const AABB *aabbs, int numAABBs);
+
+	/// Re-sorts the given set of boxes, reusing the sorted order from the previous call to Build() or Update().
+	/** The boxes must be the same boxes, in the same order, as in the previous call, but their positions and sizes may
+		have changed. If the number of boxes has changed, this function falls back to calling Build().
+		The sweep axis is not changed. Call Build() to choose the axis again, for example if the distribution of the
+		boxes has changed a lot. */
+	void Update(const AABB *aabbs, int numAABBs);
+
+	/// Finds all pairs of overlapping boxes.
+	/** Two boxes are overlapping if AABB::Intersects() returns true for them.
+		@param outPairs [out] An array that receives the overlapping pairs, in no particular order. At most maxPairs
+			pairs are written.
+		@param maxPairs The capacity of outPairs.
+		@return The total number of overlapping pairs. If this is greater than maxPairs, only the first maxPairs
+			pairs were written, and the query should be repeated with a larger array to find all of them. */
+	int FindOverlappingPairs(Pair *outPairs, int maxPairs) const;
+
+	/// Returns the number of boxes in the set.
+	int NumAABBs() const { return (int)entries.size(); }
+
+	/// Returns the axis (0=X, 1=Y, 2=Z) along which the boxes are sorted.
+	int SweepAxis() const { return sweepAxis; }
+
+private:
+	/// A box in the sorted list. The coordinates are rotated so that the sweep axis is in the first element.
+	struct Entry
+	{
+		float min[3];
+		float max[3];
+		int index;
+	};
+
+	std::vector<Entry> entries;
+	int sweepAxis;
+
+	void LoadEntry(Entry &e, const AABB &aabb, int index) const;
+	void RadixSort();
+	void InsertionSort();
+};
+
+MATH_END_NAMESPACE
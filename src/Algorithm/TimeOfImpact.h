@@ -0,0 +1,199 @@
+/* Copyright Jukka Jylanki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file TimeOfImpact.h
+	@author Jukka Jylanki
+	@brief Continuous collision detection of two moving convex objects by conservative advancement. */
+#pragma once
+
+#include "../MathGeoLibFwd.h"
+#include "../Math/float3.h"
+#include "../Math/Quat.h"
+#include "GJK.h"
+#include "EPA.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// Describes the rigid motion of an object over the time interval [0, 1] of a time of impact query.
+/** At time t, a point p of the object has moved to pivot + R(t) * (p - pivot) + t * velocity, where R(t) is the rotation
+	about the axis angularVelocity.Normalized() by the angle t * angularVelocity.Length(). */
+struct GJKMotion
+{
+	/// The translation of the object over the whole time interval.
+	vec velocity;
+	/// The rotation of the object over the whole time interval, as a rotation axis scaled by the rotation angle in radians.
+	/// This is zero for objects in purely linear motion.
+	vec angularVelocity;
+	/// The point the object rotates about, e.g. its center of mass. This is ignored if angularVelocity is zero.
+	vec pivot;
+
+	GJKMotion() {}
+	explicit GJKMotion(const vec &velocity_):velocity(velocity_), angularVelocity(vec::zero), pivot(POINT_VEC_SCALAR(0.f)) {}
+	GJKMotion(const vec &velocity_, const vec &angularVelocity_, const vec &pivot_)
+	:velocity(velocity_), angularVelocity(angularVelocity_), pivot(pivot_) {}
+
+	/// Returns the rotation of the object at the given time.
+	Quat RotationAt(float t) const
+	{
+		float angle = angularVelocity.Length();
+		return angle > 0.f ? Quat::RotateAxisAngle(DIR_TO_FLOAT3(angularVelocity / angle), angle * t) : Quat::identity;
+	}
+};
+
+/// Presents a convex object that has been moved by a GJKMotion to a given point in time, through the support function
+/// interface that the GJK queries use. The object itself is not modified or copied.
+template<typename T>
+struct GJKMovedObject
+{
+	const T &object;
+	Quat rotation;
+	Quat inverseRotation;
+	vec pivot;
+	vec translation;
+
+	GJKMovedObject(const T &object_, const GJKMotion &motion, float t)
+	:object(object_), rotation(motion.RotationAt(t)), inverseRotation(rotation.Conjugated()),
+	pivot(motion.pivot), translation(t * motion.velocity)
+	{
+	}
+
+	vec Transform(const vec &point) const { return pivot + rotation.Transform(point - pivot) + translation; }
+
+	vec AnyPointFast() const { return Transform(object.AnyPointFast()); }
+
+	vec ExtremePoint(const vec &direction, float &projectionDistance) const
+	{
+		float d;
+		vec extremePoint = Transform(object.ExtremePoint(inverseRotation.Transform(direction), d));
+		projectionDistance = Dot(extremePoint, direction);
+		return extremePoint;
+	}
+};
+
+/// Returns an upper bound for the distance of any point of the given object from the given pivot point.
+template<typename T>
+float GJKMaxDistanceFromPivot(const T &object, const vec &pivot)
+{
+	// Compute the bounding box of the object with the support function, and find its farthest corner from the pivot.
+	float negMinX, maxX, negMinY, maxY, negMinZ, maxZ;
+	object.ExtremePoint(DIR_VEC(-1.f, 0.f, 0.f), negMinX);
+	object.ExtremePoint(DIR_VEC(1.f, 0.f, 0.f), maxX);
+	object.ExtremePoint(DIR_VEC(0.f, -1.f, 0.f), negMinY);
+	object.ExtremePoint(DIR_VEC(0.f, 1.f, 0.f), maxY);
+	object.ExtremePoint(DIR_VEC(0.f, 0.f, -1.f), negMinZ);
+	object.ExtremePoint(DIR_VEC(0.f, 0.f, 1.f), maxZ);
+	float dx = Max(pivot.x + negMinX, maxX - pivot.x);
+	float dy = Max(pivot.y + negMinY, maxY - pivot.y);
+	float dz = Max(pivot.z + negMinZ, maxZ - pivot.z);
+	return Sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+/// Computes the first time at which the two moving convex objects a and b come into contact.
+/** This function performs conservative advancement: at each step, GJKDistance() gives the distance and a separating axis of the objects,
+	and the objects are then advanced in time by the largest step during which they provably cannot close the gap between them, computed
+	from the relative velocity along the separating axis and a bound on the rotational speed. Unlike sampling the motion
+	with repeated intersection tests, this never steps over a contact, no matter how thin or fast the objects are.
+	The types A and B need to implement the functions ExtremePoint(direction, projectionDistance) and AnyPointFast().
+	@param motionA The motion of a over the time interval [0, 1].
+	@param motionB The motion of b over the time interval [0, 1].
+	@param outTime [out] If the objects come into contact, receives the time of impact in the range [0, 1]. At that time, the objects
+		are separated by at most the given tolerance distance. If the objects do not come into contact, receives 1.
+	@param outNormal [out] If the objects come into contact, receives the contact normal at the time of impact, pointing from a toward b.
+		If the objects already intersect at time 0, this is the normal reported by EPAPenetration().
+	@param tolerance The distance at which the objects are considered to be in contact.
+	@return True if the objects come into contact during the time interval [0, 1]. False is also returned if the search did
+		not converge within its iteration limit. In that case outTime receives the time reached so far, which is a lower bound
+		for the time of impact, and outNormal is not meaningful. */
+template<typename A, typename B>
+bool GJKTimeOfImpact(const A &a, const GJKMotion &motionA, const B &b, const GJKMotion &motionB, float &outTime, vec &outNormal, float tolerance = 1e-3f)
+{
+	// The fastest that any point of an object can move along a direction due to rotation is |angularVelocity| * r, where r is
+	// the distance of the point from the pivot.
+	float rotationalSpeedBound = 0.f;
+	if (!motionA.angularVelocity.IsZero())
+		rotationalSpeedBound += motionA.angularVelocity.Length() * GJKMaxDistanceFromPivot(a, motionA.pivot);
+	if (!motionB.angularVelocity.IsZero())
+		rotationalSpeedBound += motionB.angularVelocity.Length() * GJKMaxDistanceFromPivot(b, motionB.pivot);
+
+	float t = 0.f;
+	int nIterations = 100; // Robustness check: Limit the maximum number of iterations to perform.
+	while(nIterations-- > 0)
+	{
+		GJKMovedObject<A> movedA(a, motionA, t);
+		GJKMovedObject<B> movedB(b, motionB, t);
+		vec separatingAxis;
+		float d = GJKDistance(movedA, movedB, 0, 0, &separatingAxis);
+		if (d == 0.f && t == 0.f)
+		{
+			// The objects intersect already at the start of the time interval.
+			float depth;
+			if (!EPAPenetration(movedA, movedB, outNormal, depth))
+			{
+				// The objects are just touching. Report the direction of the relative motion instead.
+				vec relativeVelocity = motionA.velocity - motionB.velocity;
+				outNormal = relativeVelocity.IsZero() ? DIR_VEC(1.f, 0.f, 0.f) : relativeVelocity.Normalized();
+			}
+			outTime = 0.f;
+			return true;
+		}
+		if (d > 0.f)
+			outNormal = separatingAxis;
+		if (d <= tolerance)
+		{
+			outTime = t;
+			return true;
+		}
+		// The distance returned by GJKDistance() is an upper bound, so advancing by it could step over the contact. Advance by
+		// the gap between the support planes of the objects along the separating axis instead, which is a lower bound for the
+		// distance.
+		float maxS, minS;
+		movedA.ExtremePoint(outNormal, maxS);
+		movedB.ExtremePoint(-outNormal, minS);
+		float gap = -(maxS + minS);
+		if (gap <= tolerance)
+		{
+			outTime = t;
+			return true;
+		}
+		// Compute an upper bound for how fast the gap between the objects can close along the normal.
+		float closingSpeed = Dot(motionA.velocity - motionB.velocity, outNormal) + rotationalSpeedBound;
+		if (closingSpeed <= 0.f)
+		{
+			outTime = 1.f; // The objects are moving apart.
+			return false;
+		}
+		t += gap / closingSpeed;
+		if (t > 1.f)
+		{
+			outTime = 1.f; // The objects cannot come into contact before the end of the time interval.
+			return false;
+		}
+	}
+	// Conservative advancement did not converge, which can happen when rotation dominates the motion. The objects have not
+	// been found to touch, but they cannot have come into contact before the current time either.
+	outTime = t;
+	return false;
+}
+
+/// Computes the first time at which the two linearly moving convex objects a and b come into contact.
+/** @param velocityA The translation of a over the time interval [0, 1].
+	@param velocityB The translation of b over the time interval [0, 1].
+	See GJKTimeOfImpact(const A &, const GJKMotion &, const B &, const GJKMotion &, float &, vec &, float) for the other parameters. */
+template<typename A, typename B>
+bool GJKTimeOfImpact(const A &a, const vec &velocityA, const B &b, const vec &velocityB, float &outTime, vec &outNormal, float tolerance = 1e-3f)
+{
+	return GJKTimeOfImpact(a, GJKMotion(velocityA), b, GJKMotion(velocityB), outTime, outNormal, tolerance);
+}
+
+MATH_END_NAMESPACE
@@ -179,6 +179,11 @@ bool AABB::IsDegenerate() const
 #endif
 }
 
+bool AABB::HasNegativeVolume() const
+{
+	return maxPoint.x < minPoint.x || maxPoint.y < minPoint.y || maxPoint.z < minPoint.z;
+}
+
 vec AABB::CenterPoint() const
 {
 	return (minPoint + maxPoint) * 0.5f;
@@ -164,6 +164,11 @@ public:
 		@see IsFinite(), Volume(), minPoint, maxPoint. */
 	bool IsDegenerate() const;
 
+	/// Tests if the min point of this AABB lies past its max point along any axis.
+	/** Unlike IsDegenerate(), this returns false for an AABB that is flat along one or more axes.
+		@see IsDegenerate(). */
+	bool HasNegativeVolume() const;
+
 	/// @return The center point of this AABB.
 	vec CenterPoint() const;
 	/// [similarOverload: CenterPoint]
@@ -0,0 +1,497 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file AABBArray.cpp
+	@author Jukka Jylnki
+	@brief Implementation for the structure-of-arrays AABB container. */
+#include "AABBArray.h"
+#include "Ray.h"
+#include "../Math/MathFunc.h"
+#include "../Math/SIMDCapability.h"
+
+MATH_BEGIN_NAMESPACE
+
+AABBArray::AABBArray(const AABB *aabbs, int numAABBs)
+{
+	Set(aabbs, numAABBs);
+}
+
+void AABBArray::Clear()
+{
+	minX.clear(); minY.clear(); minZ.clear();
+	maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void AABBArray::Reserve(int numAABBs)
+{
+	minX.reserve(numAABBs); minY.reserve(numAABBs); minZ.reserve(numAABBs);
+	maxX.reserve(numAABBs); maxY.reserve(numAABBs); maxZ.reserve(numAABBs);
+}
+
+void AABBArray::Add(const AABB &aabb)
+{
+	minX.push_back(aabb.minPoint.x); minY.push_back(aabb.minPoint.y); minZ.push_back(aabb.minPoint.z);
+	maxX.push_back(aabb.maxPoint.x); maxY.push_back(aabb.maxPoint.y); maxZ.push_back(aabb.maxPoint.z);
+}
+
+void AABBArray::Set(const AABB *aabbs, int numAABBs)
+{
+	assume(aabbs || numAABBs == 0);
+	minX.resize(numAABBs); minY.resize(numAABBs); minZ.resize(numAABBs);
+	maxX.resize(numAABBs); maxY.resize(numAABBs); maxZ.resize(numAABBs);
+	for(int i = 0; i < numAABBs; ++i)
+		Set(i, aabbs[i]);
+}
+
+void AABBArray::Set(int index, const AABB &aabb)
+{
+	assume1(index >= 0 && index < Size(), index);
+	minX[index] = aabb.minPoint.x; minY[index] = aabb.minPoint.y; minZ[index] = aabb.minPoint.z;
+	maxX[index] = aabb.maxPoint.x; maxY[index] = aabb.maxPoint.y; maxZ[index] = aabb.maxPoint.z;
+}
+
+AABB AABBArray::Get(int index) const
+{
+	assume1(index >= 0 && index < Size(), index);
+	return AABB(POINT_VEC(minX[index], minY[index], minZ[index]), POINT_VEC(maxX[index], maxY[index], maxZ[index]));
+}
+
+void AABBArray::RemoveSwap(int index)
+{
+	assume1(index >= 0 && index < Size(), index);
+	Set(index, Get(Size()-1));
+	minX.pop_back(); minY.pop_back(); minZ.pop_back();
+	maxX.pop_back(); maxY.pop_back(); maxZ.pop_back();
+}
+
+void AABBArray::Enclose(int index, const AABB &aabb)
+{
+	assume1(index >= 0 && index < Size(), index);
+	minX[index] = Min(minX[index], aabb.minPoint.x); minY[index] = Min(minY[index], aabb.minPoint.y); minZ[index] = Min(minZ[index], aabb.minPoint.z);
+	maxX[index] = Max(maxX[index], aabb.maxPoint.x); maxY[index] = Max(maxY[index], aabb.maxPoint.y); maxZ[index] = Max(maxZ[index], aabb.maxPoint.z);
+}
+
+// The query kernels below process the streams in blocks of 4 (SSE) or 8 (AVX) boxes, loading each coordinate directly
+// from its aligned stream. Each kernel returns the number of boxes it processed, and the caller handles the remaining
+// tail boxes with scalar code that computes the same result.
+typedef int (*FindIntersectingAABBFunc)(const AABBArray &boxes, const AABB &aabb, int *outIndices, int &numHits);
+typedef int (*FindIntersectingRayFunc)(const AABBArray &boxes, const float *rayPos, const float *invDir, float maxDistance, int *outIndices, float *outDistances, int &numHits);
+typedef int (*FindContainingFunc)(const AABBArray &boxes, const vec &point, int *outIndices, int &numHits);
+typedef int (*EncloseStreamsFunc)(float *const *dst, const float *const *src, int numAABBs, float *outMinMax);
+
+// Appends the indices of the lanes set in the given mask to outIndices. The index is written unconditionally, and the
+// output position is advanced only for the set lanes, which avoids a hard-to-predict branch per box.
+static inline int AppendIndices(int mask, int firstIndex, int numLanes, int *outIndices, int numHits)
+{
+	for(int j = 0; j < numLanes; ++j)
+	{
+		outIndices[numHits] = firstIndex + j;
+		numHits += (mask >> j) & 1;
+	}
+	return numHits;
+}
+
+static inline int AppendIndicesAndDistances(int mask, int firstIndex, int numLanes, const float *distances, int *outIndices, float *outDistances, int numHits)
+{
+	for(int j = 0; j < numLanes; ++j)
+	{
+		outIndices[numHits] = firstIndex + j;
+		outDistances[numHits] = distances[j];
+		numHits += (mask >> j) & 1;
+	}
+	return numHits;
+}
+
+// Clips the range [tNear, tFar] against a single slab. The comparisons are ordered to match the semantics of the
+// SSE/AVX min and max instructions, so that the scalar and the SIMD code paths agree also when the ray lies in the
+// plane of the slab and a NaN is produced.
+static inline void ClipSlab(float pos, float invDir, float slabMin, float slabMax, float &tNear, float &tFar)
+{
+	const float t1 = (slabMin - pos) * invDir;
+	const float t2 = (slabMax - pos) * invDir;
+	const float tMin = t1 < t2 ? t1 : t2;
+	const float tMax = t1 > t2 ? t1 : t2;
+	tNear = tMin > tNear ? tMin : tNear;
+	tFar = tMax < tFar ? tMax : tFar;
+}
+
+#ifdef MATH_SSE2_KERNELS
+MATH_TARGET_SSE2 static int FindIntersectingAABB_SSE2(const AABBArray &boxes, const AABB &aabb, int *outIndices, int &numHits)
+{
+	const float *minX = boxes.MinX(), *minY = boxes.MinY(), *minZ = boxes.MinZ();
+	const float *maxX = boxes.MaxX(), *maxY = boxes.MaxY(), *maxZ = boxes.MaxZ();
+	const __m128 qMinX = _mm_set1_ps(aabb.minPoint.x), qMinY = _mm_set1_ps(aabb.minPoint.y), qMinZ = _mm_set1_ps(aabb.minPoint.z);
+	const __m128 qMaxX = _mm_set1_ps(aabb.maxPoint.x), qMaxY = _mm_set1_ps(aabb.maxPoint.y), qMaxZ = _mm_set1_ps(aabb.maxPoint.z);
+
+	const int numBatched = boxes.Size() & ~3;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 4)
+	{
+		__m128 overlap = _mm_and_ps(_mm_cmplt_ps(_mm_load_ps(minX + i), qMaxX), _mm_cmplt_ps(qMinX, _mm_load_ps(maxX + i)));
+		overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmplt_ps(_mm_load_ps(minY + i), qMaxY), _mm_cmplt_ps(qMinY, _mm_load_ps(maxY + i))));
+		overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmplt_ps(_mm_load_ps(minZ + i), qMaxZ), _mm_cmplt_ps(qMinZ, _mm_load_ps(maxZ + i))));
+		n = AppendIndices(_mm_movemask_ps(overlap), i, 4, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_SSE2 static int FindIntersectingRay_SSE2(const AABBArray &boxes, const float *rayPos, const float *invDir, float maxDistance, int *outIndices, float *outDistances, int &numHits)
+{
+	const float *mins[3] = { boxes.MinX(), boxes.MinY(), boxes.MinZ() };
+	const float *maxs[3] = { boxes.MaxX(), boxes.MaxY(), boxes.MaxZ() };
+	__m128 pos[3], inv[3];
+	for(int j = 0; j < 3; ++j)
+	{
+		pos[j] = _mm_set1_ps(rayPos[j]);
+		inv[j] = _mm_set1_ps(invDir[j]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxD = _mm_set1_ps(maxDistance);
+
+	const int numBatched = boxes.Size() & ~3;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 4)
+	{
+		__m128 tNear = zero;
+		__m128 tFar = maxD;
+		for(int j = 0; j < 3; ++j)
+		{
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(mins[j] + i), pos[j]), inv[j]);
+			const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(maxs[j] + i), pos[j]), inv[j]);
+			tNear = _mm_max_ps(_mm_min_ps(t1, t2), tNear);
+			tFar = _mm_min_ps(_mm_max_ps(t1, t2), tFar);
+		}
+		const int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+		if (outDistances)
+		{
+			float distances[4];
+			_mm_storeu_ps(distances, tNear);
+			n = AppendIndicesAndDistances(mask, i, 4, distances, outIndices, outDistances, n);
+		}
+		else
+			n = AppendIndices(mask, i, 4, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_SSE2 static int FindContaining_SSE2(const AABBArray &boxes, const vec &point, int *outIndices, int &numHits)
+{
+	const float *minX = boxes.MinX(), *minY = boxes.MinY(), *minZ = boxes.MinZ();
+	const float *maxX = boxes.MaxX(), *maxY = boxes.MaxY(), *maxZ = boxes.MaxZ();
+	const __m128 x = _mm_set1_ps(point.x), y = _mm_set1_ps(point.y), z = _mm_set1_ps(point.z);
+
+	const int numBatched = boxes.Size() & ~3;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 4)
+	{
+		__m128 inside = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(minX + i), x), _mm_cmple_ps(x, _mm_load_ps(maxX + i)));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(minY + i), y), _mm_cmple_ps(y, _mm_load_ps(maxY + i))));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(minZ + i), z), _mm_cmple_ps(z, _mm_load_ps(maxZ + i))));
+		n = AppendIndices(_mm_movemask_ps(inside), i, 4, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_SSE2 static int EncloseStreams_SSE2(float *const *dst, const float *const *src, int numAABBs, float *outMinMax)
+{
+	const int numBatched = numAABBs & ~3;
+	for(int j = 0; j < 6; ++j)
+	{
+		// The first three streams hold the min coordinates, and the last three the max coordinates.
+		const bool isMin = j < 3;
+		__m128 acc = _mm_set1_ps(outMinMax[j]);
+		for(int i = 0; i < numBatched; i += 4)
+		{
+			__m128 v = _mm_load_ps(src[j] + i);
+			if (dst)
+			{
+				v = isMin ? _mm_min_ps(v, _mm_load_ps(dst[j] + i)) : _mm_max_ps(v, _mm_load_ps(dst[j] + i));
+				_mm_store_ps(dst[j] + i, v);
+			}
+			acc = isMin ? _mm_min_ps(acc, v) : _mm_max_ps(acc, v);
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, acc);
+		for(int k = 0; k < 4; ++k)
+			outMinMax[j] = isMin ? Min(outMinMax[j], lanes[k]) : Max(outMinMax[j], lanes[k]);
+	}
+	return numBatched;
+}
+#endif
+
+#ifdef MATH_AVX_KERNELS
+MATH_TARGET_AVX static int FindIntersectingAABB_AVX(const AABBArray &boxes, const AABB &aabb, int *outIndices, int &numHits)
+{
+	const float *minX = boxes.MinX(), *minY = boxes.MinY(), *minZ = boxes.MinZ();
+	const float *maxX = boxes.MaxX(), *maxY = boxes.MaxY(), *maxZ = boxes.MaxZ();
+	const __m256 qMinX = _mm256_set1_ps(aabb.minPoint.x), qMinY = _mm256_set1_ps(aabb.minPoint.y), qMinZ = _mm256_set1_ps(aabb.minPoint.z);
+	const __m256 qMaxX = _mm256_set1_ps(aabb.maxPoint.x), qMaxY = _mm256_set1_ps(aabb.maxPoint.y), qMaxZ = _mm256_set1_ps(aabb.maxPoint.z);
+
+	const int numBatched = boxes.Size() & ~7;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 8)
+	{
+		__m256 overlap = _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minX + i), qMaxX, _CMP_LT_OQ), _mm256_cmp_ps(qMinX, _mm256_load_ps(maxX + i), _CMP_LT_OQ));
+		overlap = _mm256_and_ps(overlap, _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minY + i), qMaxY, _CMP_LT_OQ), _mm256_cmp_ps(qMinY, _mm256_load_ps(maxY + i), _CMP_LT_OQ)));
+		overlap = _mm256_and_ps(overlap, _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minZ + i), qMaxZ, _CMP_LT_OQ), _mm256_cmp_ps(qMinZ, _mm256_load_ps(maxZ + i), _CMP_LT_OQ)));
+		n = AppendIndices(_mm256_movemask_ps(overlap), i, 8, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_AVX static int FindIntersectingRay_AVX(const AABBArray &boxes, const float *rayPos, const float *invDir, float maxDistance, int *outIndices, float *outDistances, int &numHits)
+{
+	const float *mins[3] = { boxes.MinX(), boxes.MinY(), boxes.MinZ() };
+	const float *maxs[3] = { boxes.MaxX(), boxes.MaxY(), boxes.MaxZ() };
+	__m256 pos[3], inv[3];
+	for(int j = 0; j < 3; ++j)
+	{
+		pos[j] = _mm256_set1_ps(rayPos[j]);
+		inv[j] = _mm256_set1_ps(invDir[j]);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxD = _mm256_set1_ps(maxDistance);
+
+	const int numBatched = boxes.Size() & ~7;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 8)
+	{
+		__m256 tNear = zero;
+		__m256 tFar = maxD;
+		for(int j = 0; j < 3; ++j)
+		{
+			const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(mins[j] + i), pos[j]), inv[j]);
+			const __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(maxs[j] + i), pos[j]), inv[j]);
+			tNear = _mm256_max_ps(_mm256_min_ps(t1, t2), tNear);
+			tFar = _mm256_min_ps(_mm256_max_ps(t1, t2), tFar);
+		}
+		const int mask = _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+		if (outDistances)
+		{
+			float distances[8];
+			_mm256_storeu_ps(distances, tNear);
+			n = AppendIndicesAndDistances(mask, i, 8, distances, outIndices, outDistances, n);
+		}
+		else
+			n = AppendIndices(mask, i, 8, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_AVX static int FindContaining_AVX(const AABBArray &boxes, const vec &point, int *outIndices, int &numHits)
+{
+	const float *minX = boxes.MinX(), *minY = boxes.MinY(), *minZ = boxes.MinZ();
+	const float *maxX = boxes.MaxX(), *maxY = boxes.MaxY(), *maxZ = boxes.MaxZ();
+	const __m256 x = _mm256_set1_ps(point.x), y = _mm256_set1_ps(point.y), z = _mm256_set1_ps(point.z);
+
+	const int numBatched = boxes.Size() & ~7;
+	int n = numHits;
+	for(int i = 0; i < numBatched; i += 8)
+	{
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minX + i), x, _CMP_LE_OQ), _mm256_cmp_ps(x, _mm256_load_ps(maxX + i), _CMP_LE_OQ));
+		inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minY + i), y, _CMP_LE_OQ), _mm256_cmp_ps(y, _mm256_load_ps(maxY + i), _CMP_LE_OQ)));
+		inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(minZ + i), z, _CMP_LE_OQ), _mm256_cmp_ps(z, _mm256_load_ps(maxZ + i), _CMP_LE_OQ)));
+		n = AppendIndices(_mm256_movemask_ps(inside), i, 8, outIndices, n);
+	}
+	numHits = n;
+	return numBatched;
+}
+
+MATH_TARGET_AVX static int EncloseStreams_AVX(float *const *dst, const float *const *src, int numAABBs, float *outMinMax)
+{
+	const int numBatched = numAABBs & ~7;
+	for(int j = 0; j < 6; ++j)
+	{
+		const bool isMin = j < 3;
+		__m256 acc = _mm256_set1_ps(outMinMax[j]);
+		for(int i = 0; i < numBatched; i += 8)
+		{
+			__m256 v = _mm256_load_ps(src[j] + i);
+			if (dst)
+			{
+				v = isMin ? _mm256_min_ps(v, _mm256_load_ps(dst[j] + i)) : _mm256_max_ps(v, _mm256_load_ps(dst[j] + i));
+				_mm256_store_ps(dst[j] + i, v);
+			}
+			acc = isMin ? _mm256_min_ps(acc, v) : _mm256_max_ps(acc, v);
+		}
+		float lanes[8];
+		_mm256_storeu_ps(lanes, acc);
+		for(int k = 0; k < 8; ++k)
+			outMinMax[j] = isMin ? Min(outMinMax[j], lanes[k]) : Max(outMinMax[j], lanes[k]);
+	}
+	return numBatched;
+}
+#endif
+
+static int FindIntersectingAABB_None(const AABBArray &, const AABB &, int *, int &) { return 0; }
+static int FindIntersectingRay_None(const AABBArray &, const float *, const float *, float, int *, float *, int &) { return 0; }
+static int FindContaining_None(const AABBArray &, const vec &, int *, int &) { return 0; }
+static int EncloseStreams_None(float *const *, const float *const *, int, float *) { return 0; }
+
+static FindIntersectingAABBFunc SelectFindIntersectingAABBKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &FindIntersectingAABB_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &FindIntersectingAABB_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &FindIntersectingAABB_None;
+}
+
+static FindIntersectingRayFunc SelectFindIntersectingRayKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &FindIntersectingRay_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &FindIntersectingRay_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &FindIntersectingRay_None;
+}
+
+static FindContainingFunc SelectFindContainingKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &FindContaining_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &FindContaining_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &FindContaining_None;
+}
+
+static EncloseStreamsFunc SelectEncloseStreamsKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &EncloseStreams_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &EncloseStreams_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &EncloseStreams_None;
+}
+
+int AABBArray::FindIntersecting(const AABB &aabb, int *outIndices) const
+{
+	assume(outIndices || IsEmpty());
+	static const FindIntersectingAABBFunc kernel = SelectFindIntersectingAABBKernel();
+
+	int numHits = 0;
+	for(int i = kernel(*this, aabb, outIndices, numHits); i < Size(); ++i)
+		if (minX[i] < aabb.maxPoint.x && aabb.minPoint.x < maxX[i] &&
+		    minY[i] < aabb.maxPoint.y && aabb.minPoint.y < maxY[i] &&
+		    minZ[i] < aabb.maxPoint.z && aabb.minPoint.z < maxZ[i])
+			outIndices[numHits++] = i;
+	return numHits;
+}
+
+int AABBArray::FindIntersecting(const Ray &ray, float maxDistance, int *outIndices, float *outDistances) const
+{
+	assume(outIndices || IsEmpty());
+	static const FindIntersectingRayFunc kernel = SelectFindIntersectingRayKernel();
+
+	const float rayPos[3] = { ray.pos.x, ray.pos.y, ray.pos.z };
+	const float invDir[3] = { 1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z };
+	int numHits = 0;
+	for(int i = kernel(*this, rayPos, invDir, maxDistance, outIndices, outDistances, numHits); i < Size(); ++i)
+	{
+		float tNear = 0.f;
+		float tFar = maxDistance;
+		ClipSlab(rayPos[0], invDir[0], minX[i], maxX[i], tNear, tFar);
+		ClipSlab(rayPos[1], invDir[1], minY[i], maxY[i], tNear, tFar);
+		ClipSlab(rayPos[2], invDir[2], minZ[i], maxZ[i], tNear, tFar);
+		if (tNear <= tFar)
+		{
+			if (outDistances)
+				outDistances[numHits] = tNear;
+			outIndices[numHits++] = i;
+		}
+	}
+	return numHits;
+}
+
+int AABBArray::FindContaining(const vec &point, int *outIndices) const
+{
+	assume(outIndices || IsEmpty());
+	static const FindContainingFunc kernel = SelectFindContainingKernel();
+
+	int numHits = 0;
+	for(int i = kernel(*this, point, outIndices, numHits); i < Size(); ++i)
+		if (minX[i] <= point.x && point.x <= maxX[i] &&
+		    minY[i] <= point.y && point.y <= maxY[i] &&
+		    minZ[i] <= point.z && point.z <= maxZ[i])
+			outIndices[numHits++] = i;
+	return numHits;
+}
+
+AABB AABBArray::MinimalEnclosingAABB() const
+{
+	static const EncloseStreamsFunc kernel = SelectEncloseStreamsKernel();
+
+	float minMax[6] = { FLOAT_INF, FLOAT_INF, FLOAT_INF, -FLOAT_INF, -FLOAT_INF, -FLOAT_INF };
+	if (IsEmpty())
+		return AABB(POINT_VEC(minMax[0], minMax[1], minMax[2]), POINT_VEC(minMax[3], minMax[4], minMax[5]));
+	const float *const src[6] = { MinX(), MinY(), MinZ(), MaxX(), MaxY(), MaxZ() };
+	for(int i = kernel(0, src, Size(), minMax); i < Size(); ++i)
+	{
+		for(int j = 0; j < 3; ++j)
+			minMax[j] = Min(minMax[j], src[j][i]);
+		for(int j = 3; j < 6; ++j)
+			minMax[j] = Max(minMax[j], src[j][i]);
+	}
+	return AABB(POINT_VEC(minMax[0], minMax[1], minMax[2]), POINT_VEC(minMax[3], minMax[4], minMax[5]));
+}
+
+void AABBArray::Enclose(const AABBArray &other)
+{
+	assume2(other.Size() == Size(), other.Size(), Size());
+	if (IsEmpty() || other.Size() != Size())
+		return;
+	static const EncloseStreamsFunc kernel = SelectEncloseStreamsKernel();
+
+	float *const dst[6] = { &minX[0], &minY[0], &minZ[0], &maxX[0], &maxY[0], &maxZ[0] };
+	const float *const src[6] = { other.MinX(), other.MinY(), other.MinZ(), other.MaxX(), other.MaxY(), other.MaxZ() };
+	float minMax[6] = { FLOAT_INF, FLOAT_INF, FLOAT_INF, -FLOAT_INF, -FLOAT_INF, -FLOAT_INF };
+	for(int i = kernel(dst, src, Size(), minMax); i < Size(); ++i)
+	{
+		for(int j = 0; j < 3; ++j)
+			dst[j][i] = Min(dst[j][i], src[j][i]);
+		for(int j = 3; j < 6; ++j)
+			dst[j][i] = Max(dst[j][i], src[j][i]);
+	}
+}
+
+MATH_END_NAMESPACE
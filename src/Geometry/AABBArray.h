@@ -0,0 +1,125 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file AABBArray.h
+	@author Jukka Jylnki
+	@brief A structure-of-arrays container of axis-aligned bounding boxes, with batched queries. */
+#pragma once
+
+#include "../MathGeoLibFwd.h"
+#include "../Math/SSEMath.h"
+#include "AABB.h"
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// Stores an array of axis-aligned bounding boxes in structure-of-arrays (SoA) form.
+/** Instead of storing an array of AABB objects, where the min and max coordinates of each box are interleaved in memory,
+	this container stores each of the six coordinates in its own contiguous stream (minX, minY, minZ, maxX, maxY, maxZ).
+	Each stream is aligned to 32 bytes. This layout allows testing 4 (SSE) or 8 (AVX) boxes against a query object
+	at a time without any shuffling, so bulk queries over the whole array run at close to memory bandwidth. The
+	SIMD code path is chosen at runtime through ActiveSIMDCapability(), and the results are identical to calling
+	the corresponding AABB member function for each box individually.
+
+	The query functions write the indices of the matching boxes to a caller-supplied array, which must have room
+	for Size() elements. */
+class AABBArray
+{
+public:
+	typedef std::vector<float, AlignedAllocator<float, 32> > FloatStream;
+
+	/// Constructs an empty array.
+	AABBArray() {}
+
+	/// Constructs an array from the given AABBs.
+	/** @see Set(). */
+	AABBArray(const AABB *aabbs, int numAABBs);
+
+	/// Returns the number of boxes in this array.
+	int Size() const { return (int)minX.size(); }
+	/// Returns true if this array contains no boxes.
+	bool IsEmpty() const { return minX.empty(); }
+
+	/// Removes all boxes from this array.
+	void Clear();
+	/// Preallocates memory for the given number of boxes.
+	void Reserve(int numAABBs);
+
+	/// Appends the given AABB to the end of this array.
+	void Add(const AABB &aabb);
+	/// Replaces the contents of this array with the given AABBs.
+	/** This transposes the given array of AABBs into SoA form. */
+	void Set(const AABB *aabbs, int numAABBs);
+	/// Overwrites the box at the given index.
+	void Set(int index, const AABB &aabb);
+	/// Returns the box at the given index as an AABB.
+	AABB Get(int index) const;
+	/// Removes the box at the given index, by moving the last box of the array to its place.
+	/** This function does not preserve the order of the boxes in this array. */
+	void RemoveSwap(int index);
+
+	/// Returns the start of the given coordinate stream.
+	/** The returned pointers are aligned to 32 bytes, and remain valid until the size of this array is next changed.
+		[similarOverload: MinX] */
+	const float *MinX() const { return minX.empty() ? 0 : &minX[0]; }
+	const float *MinY() const { return minY.empty() ? 0 : &minY[0]; }
+	const float *MinZ() const { return minZ.empty() ? 0 : &minZ[0]; }
+	const float *MaxX() const { return maxX.empty() ? 0 : &maxX[0]; }
+	const float *MaxY() const { return maxY.empty() ? 0 : &maxY[0]; }
+	const float *MaxZ() const { return maxZ.empty() ? 0 : &maxZ[0]; }
+
+	/// Finds all boxes in this array that intersect the given AABB.
+	/** This is a batched version of calling AABB::Intersects(aabb) for each box in this array.
+		@param outIndices [out] Receives the indices of the intersecting boxes, in increasing order. This array must
+			have room for Size() elements.
+		@return The number of intersecting boxes written to outIndices.
+		@see FindContaining(). */
+	int FindIntersecting(const AABB &aabb, int *outIndices) const;
+
+	/// Finds all boxes in this array that the given ray hits within the distance range [0, maxDistance].
+	/** This performs the slab test with the precomputed reciprocal of the ray direction.
+		@param outIndices [out] Receives the indices of the hit boxes, in increasing order. This array must have room
+			for Size() elements.
+		@param outDistances [out] If not null, receives the entry distance of the ray into each hit box, with a
+			value of 0 if the ray starts inside the box. The i'th element of this array corresponds to outIndices[i].
+		@return The number of hit boxes written to outIndices. */
+	int FindIntersecting(const Ray &ray, float maxDistance, int *outIndices, float *outDistances = 0) const;
+	int FindIntersecting(const Ray &ray, int *outIndices, float *outDistances = 0) const { return FindIntersecting(ray, FLOAT_INF, outIndices, outDistances); }
+
+	/// Finds all boxes in this array that contain the given point.
+	/** This is a batched version of calling AABB::Contains(point) for each box in this array. A point lying on the
+		boundary of a box is considered to be contained in it.
+		@param outIndices [out] Receives the indices of the containing boxes, in increasing order. This array must
+			have room for Size() elements.
+		@return The number of containing boxes written to outIndices. */
+	int FindContaining(const vec &point, int *outIndices) const;
+
+	/// Computes the smallest AABB that encloses all boxes in this array.
+	/** If this array is empty, the returned AABB is degenerate, with minPoint = +inf and maxPoint = -inf. */
+	AABB MinimalEnclosingAABB() const;
+
+	/// Expands each box in this array to enclose the box with the same index in the given array.
+	/** This is a batched version of calling AABB::Enclose(aabb) for each pair of boxes. It can be used for example
+		to compute swept bounds from the bounds of objects at the start and the end of a frame.
+		@param other The array of boxes to enclose. This must have the same size as this array. */
+	void Enclose(const AABBArray &other);
+
+	/// Expands the box at the given index to enclose the given AABB.
+	void Enclose(int index, const AABB &aabb);
+
+private:
+	FloatStream minX, minY, minZ, maxX, maxY, maxZ;
+};
+
+MATH_END_NAMESPACE
@@ -0,0 +1,266 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file BVH.h
+	@author Jukka Jylnki
+	@brief A dynamic bounding volume hierarchy of axis-aligned bounding boxes. */
+#pragma once
+
+#include "../Math/MathTypes.h"
+#include "../Math/myassert.h"
+#include "../Math/SSEMath.h"
+#include "AABB.h"
+#include "Ray.h"
+#include "Triangle.h"
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// A node of a BVH. The nodes of a BVH are stored in a single flat array, and refer to each other by indices.
+struct BVHNode
+{
+	/// If this is a leaf, stores the (enlarged) bounding box of the object in the leaf. If this is an inner node,
+	/// stores the union of the bounding boxes of the two children.
+	AABB aabb;
+	/// The index of the parent node, or -1 if this node is the root.
+	int parent;
+	/// The index of the left child, or -1 if this node is a leaf.
+	int left;
+	/// If this is an inner node, the index of the right child. If this is a leaf, the index of the object in this leaf.
+	int right;
+	/// The height of the subtree rooted at this node. 0 for leaves, and -1 for nodes that are not in use.
+	int height;
+
+	bool IsLeaf() const { return left == -1; }
+	int LeftChildIndex() const { assert(!IsLeaf()); return left; }
+	int RightChildIndex() const { assert(!IsLeaf()); return right; }
+	/// Returns the object stored in this leaf. Call BVH<T>::Object() to access the object itself.
+	int ObjectIndex() const { assert(IsLeaf()); return right; }
+};
+
+/// A bounding volume hierarchy of axis-aligned bounding boxes for dynamic data.
+/** Each leaf of the tree stores exactly one object. Unlike the KdTree, the tree is built incrementally, and supports
+	inserting, moving and removing objects at any time. When the tree is updated, it is kept balanced and its quality
+	is maintained by local tree rotations that reduce the surface area of the inner nodes.
+
+	All nodes are stored in a single flat array. The objects are referred to by an object index that stays the same
+	for the lifetime of the object in the tree, even though the node that stores it may change.
+
+	There are two ways to update moving objects:
+	- Call Update() for each moved object. If the new bounding box of the object is no longer contained in the enlarged
+	  bounding box of its leaf, the leaf is removed and reinserted into the tree. This is best when only some objects move.
+	- Call SetObjectAABB() for each moved object, and then call Refit() once to recompute all the inner node bounding boxes
+	  bottom-up, without changing the tree structure. This is best when most objects move a little each frame. */
+template<typename T>
+class BVH
+{
+public:
+	/// Constructs an empty tree.
+	/** @param aabbMargin The leaves of the tree store the bounding boxes of the objects enlarged by this amount in each
+			direction, so that objects that move only a little do not need to be reinserted in Update(). */
+	explicit BVH(float aabbMargin = 0.f);
+
+	/// Adds a new object to the tree.
+	/** @return The index of the object. Use this index to update and remove the object later.
+		@note The indices of removed objects are reused by subsequently added objects. */
+	int Insert(const T &object, const AABB &aabb);
+
+	/// Adds a new object to the tree. The type T must have a member function AABB T::BoundingAABB() const.
+	int Insert(const T &object) { return Insert(object, object.BoundingAABB()); }
+
+	/// Removes the given object from the tree.
+	void Remove(int objectIndex);
+
+	/// Moves the given object to a new location.
+	/** @return True if the object was reinserted into the tree, or false if the new bounding box still fits the leaf
+			of the object, and the tree was not modified. */
+	bool Update(int objectIndex, const AABB &aabb);
+
+	/// Sets the bounding box of the given object without updating the rest of the tree.
+	/** The tree is left in an inconsistent state until Refit() is called. */
+	void SetObjectAABB(int objectIndex, const AABB &aabb);
+
+	/// Recomputes the bounding boxes of all inner nodes from the bounding boxes of the leaves.
+	/** Call this after having moved objects with SetObjectAABB(). The running time is linear to the number of nodes.
+		@param rotate If true, tree rotations are also applied to all inner nodes during the refit to recover from the
+			degradation of the tree quality caused by the movement of the objects. */
+	void Refit(bool rotate = false);
+
+	/// Reorders the node array of the tree to depth-first order, so that each subtree occupies a contiguous range of
+	/// memory, and removes all unused nodes from the array.
+	/** This improves the memory locality of the queries, and allows Refit() to process the nodes with a single linear
+		pass over the node array. The object indices are not affected. */
+	void Compact();
+
+	/// Removes all objects and nodes from the tree.
+	void Clear();
+
+	/// Returns the object with the given index.
+	T &Object(int objectIndex);
+	const T &Object(int objectIndex) const;
+
+	/// Returns the bounding box of the leaf that stores the given object. This is the bounding box of the object,
+	/// enlarged by the margin of the tree.
+	const AABB &ObjectAABB(int objectIndex) const { return nodes[ObjectNodeIndex(objectIndex)].aabb; }
+
+	/// Returns the index of the leaf node that stores the given object.
+	int ObjectNodeIndex(int objectIndex) const;
+
+	/// Returns the number of objects stored in the tree.
+	int NumObjects() const { return numObjects; }
+
+	/// Returns the size of the node array. This includes unused nodes. @see Compact().
+	int NodeCapacity() const { return (int)nodes.size(); }
+
+	/// Returns the total number of nodes (all nodes, i.e. inner nodes + leaves) in the tree.
+	int NumNodes() const { return (int)nodes.size() - (int)freeNodes.size(); }
+
+	/// Returns the height of the tree. An empty tree has height 0, and a tree with a single object has height 1.
+	int TreeHeight() const { return root != -1 ? nodes[root].height + 1 : 0; }
+
+	/// Returns the index of the root node, or -1 if the tree is empty.
+	int RootIndex() const { return root; }
+
+	/// Returns the root node, or null if the tree is empty.
+	const BVHNode *Root() const { return root != -1 ? &nodes[root] : 0; }
+
+	/// Returns the node with the given index.
+	const BVHNode &Node(int nodeIndex) const { return nodes[nodeIndex]; }
+
+	/// Returns the bounding box of all objects in the tree.
+	AABB BoundingAABB() const;
+
+	/// Returns the sum of the surface areas of all inner nodes divided by the surface area of the root node.
+	/** This is proportional to the expected number of inner nodes a random ray visits, and is used as a measure of the
+		quality of the tree. Smaller is better. The running time is linear to the number of nodes. */
+	float SAHCost() const;
+
+	/// Traverses a ray through this tree, and calls the given leafCallback function for each leaf of the tree the ray hits,
+	/// in approximate front-to-back order.
+	/** @param r The ray to query through this tree.
+		@param leafCallback A function or a function object of prototype
+			bool LeafCallbackFunction(BVH<T> &tree, const BVHNode &leaf, const Ray &ray, float tNear, float &tFar);
+			tNear is the distance where the ray enters the bounding box of the leaf. tFar is the maximum distance along the
+			ray that is searched, initially FLOAT_INF. The callback may decrease tFar, e.g. to the distance of the nearest
+			hit found so far, and no nodes farther away than that are visited after that.
+			If the callback function returns true, the execution of the query is stopped and this function immediately
+			returns afterwards. If the callback function returns false, the execution of the query continues. */
+	template<typename Func>
+	inline void RayQuery(const Ray &r, Func &leafCallback);
+
+	/// Performs an AABB intersection query in this tree, and calls the given leafCallback function for each leaf of the
+	/// tree which intersects the given AABB.
+	/** @param aabb The axis-aligned bounding box to query through this tree.
+		@param leafCallback A function or a function object of prototype
+			bool LeafCallbackFunction(BVH<T> &tree, const BVHNode &leaf, const AABB &aabb);
+			If the callback function returns true, the execution of the query is stopped and this function immediately
+			returns afterwards. If the callback function returns false, the execution of the query continues. */
+	template<typename Func>
+	inline void AABBQuery(const AABB &aabb, Func &leafCallback);
+
+	/// Performs various consistency checks on the tree. Use only for debugging purposes.
+	void DebugSanityCheck() const;
+
+private:
+	/// The maximum supported tree height. The tree is kept balanced, so the height grows logarithmically to the number
+	/// of objects, and this limit is never reached in practice.
+	static const int maxTreeHeight = 64;
+
+	std::vector<BVHNode, AlignedAllocator<BVHNode, 16> > nodes;
+	std::vector<int> freeNodes;
+
+	std::vector<T, AlignedAllocator<T, 16> > objects;
+	/// For each object, stores the index of the leaf node that contains the object, or -1 if the object slot is unused.
+	std::vector<int> objectNodes;
+	std::vector<int> freeObjects;
+	int numObjects;
+
+	int root;
+	float aabbMargin;
+
+	/// If true, the nodes are stored in depth-first order, i.e. each parent comes before its children in the node array.
+	bool nodesInDepthFirstOrder;
+
+	/// A temporary array used by Refit() and Compact().
+	std::vector<int> scratch;
+
+	int AllocateNode();
+	void FreeNode(int nodeIndex);
+
+	/// Returns the given bounding box enlarged by the margin of the tree.
+	AABB EnlargedAABB(const AABB &aabb) const;
+
+	/// Returns the increase in the surface area of the tree, if the leaf with the given bounding box was inserted
+	/// into the subtree of the given node.
+	float InsertionCost(int nodeIndex, const AABB &leafAABB) const;
+
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+
+	/// Walks from the given node up to the root, recomputing the bounding boxes and heights and rotating the nodes on the way.
+	void RefitAncestors(int nodeIndex);
+
+	/// Recomputes the bounding box and the height of the given inner node from its children.
+	void RefitNode(int nodeIndex);
+
+	/// Rebalances the given inner node, or rotates it to reduce the surface area of the subtree, if possible.
+	void Rotate(int nodeIndex);
+
+	/// Swaps the child 'child' of the node 'nodeIndex' with the grandchild 'grandchild' of the node 'nodeIndex'.
+	void SwapChildAndGrandchild(int nodeIndex, int child, int grandchild);
+
+	void ConsiderRotation(int child, int grandchild, int otherGrandchild, float &bestAreaReduction, int &bestChild, int &bestGrandchild) const;
+
+	static AABB Union(const AABB &a, const AABB &b) { AABB u = a; u.Enclose(b); return u; }
+
+	///\todo Implement support for deep copying.
+	BVH(const BVH &);
+	void operator =(const BVH &);
+};
+
+/// Finds the nearest ray hit to a BVH<Triangle>.
+struct TriangleBVHRayQueryNearestHitVisitor
+{
+	float rayT;
+	vec pos;
+	int triangleIndex;
+	float2 barycentricUV;
+
+	TriangleBVHRayQueryNearestHitVisitor()
+	{
+		rayT = FLOAT_INF;
+		triangleIndex = -1;
+		pos = vec::nan;
+		barycentricUV = float2::nan;
+	}
+	bool operator()(BVH<Triangle> &tree, const BVHNode &leaf, const Ray &ray, float /*tNear*/, float &tFar)
+	{
+		const Triangle &tri = tree.Object(leaf.ObjectIndex());
+		float u, v;
+		float t = Triangle::IntersectLineTri(ray.pos, ray.dir, tri.a, tri.b, tri.c, u, v);
+		if (t >= 0.f && t < rayT)
+		{
+			rayT = t;
+			pos = ray.GetPoint(t);
+			barycentricUV = float2(u,v);
+			triangleIndex = leaf.ObjectIndex();
+			tFar = t; // No need to visit any nodes farther than this hit.
+		}
+		return false;
+	}
+};
+
+MATH_END_NAMESPACE
+
+#include "BVH.inl"
@@ -0,0 +1,634 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file BVH.inl
+	@author Jukka Jylnki
+	@brief Implementation for the BVH object. */
+#pragma once
+
+#include "AABB.h"
+#include "Ray.h"
+#include "../Math/assume.h"
+#include "../Math/MathFunc.h"
+
+MATH_BEGIN_NAMESPACE
+
+template<typename T>
+BVH<T>::BVH(float aabbMargin_)
+:numObjects(0),
+root(-1),
+aabbMargin(aabbMargin_),
+nodesInDepthFirstOrder(true)
+{
+	assume(aabbMargin >= 0.f);
+}
+
+template<typename T>
+int BVH<T>::AllocateNode()
+{
+	int nodeIndex;
+	if (!freeNodes.empty())
+	{
+		nodeIndex = freeNodes.back();
+		freeNodes.pop_back();
+	}
+	else
+	{
+		nodeIndex = (int)nodes.size();
+		nodes.push_back(BVHNode());
+	}
+	BVHNode &n = nodes[nodeIndex];
+	n.parent = -1;
+	n.left = -1;
+	n.right = -1;
+	n.height = 0;
+	return nodeIndex;
+}
+
+template<typename T>
+void BVH<T>::FreeNode(int nodeIndex)
+{
+	assert(nodes[nodeIndex].height >= 0);
+	nodes[nodeIndex].height = -1;
+	freeNodes.push_back(nodeIndex);
+}
+
+template<typename T>
+AABB BVH<T>::EnlargedAABB(const AABB &aabb) const
+{
+	return AABB(aabb.minPoint - DIR_VEC_SCALAR(aabbMargin), aabb.maxPoint + DIR_VEC_SCALAR(aabbMargin));
+}
+
+template<typename T>
+int BVH<T>::Insert(const T &object, const AABB &aabb)
+{
+	assume(aabb.IsFinite());
+	assume(!aabb.HasNegativeVolume());
+
+	int objectIndex;
+	if (!freeObjects.empty())
+	{
+		objectIndex = freeObjects.back();
+		freeObjects.pop_back();
+		objects[objectIndex] = object;
+	}
+	else
+	{
+		objectIndex = (int)objects.size();
+		objects.push_back(object);
+		objectNodes.push_back(-1);
+	}
+	++numObjects;
+
+	int leaf = AllocateNode();
+	nodes[leaf].aabb = EnlargedAABB(aabb);
+	nodes[leaf].right = objectIndex;
+	objectNodes[objectIndex] = leaf;
+	InsertLeaf(leaf);
+	return objectIndex;
+}
+
+template<typename T>
+void BVH<T>::Remove(int objectIndex)
+{
+	int leaf = ObjectNodeIndex(objectIndex);
+	RemoveLeaf(leaf);
+	FreeNode(leaf);
+	objectNodes[objectIndex] = -1;
+	objects[objectIndex] = T();
+	freeObjects.push_back(objectIndex);
+	--numObjects;
+}
+
+template<typename T>
+bool BVH<T>::Update(int objectIndex, const AABB &aabb)
+{
+	assume(aabb.IsFinite());
+	assume(!aabb.HasNegativeVolume());
+
+	int leaf = ObjectNodeIndex(objectIndex);
+	if (nodes[leaf].aabb.Contains(aabb))
+		return false; // The object still fits inside its leaf, no need to touch the tree.
+
+	RemoveLeaf(leaf);
+	nodes[leaf].aabb = EnlargedAABB(aabb);
+	InsertLeaf(leaf);
+	return true;
+}
+
+template<typename T>
+void BVH<T>::SetObjectAABB(int objectIndex, const AABB &aabb)
+{
+	assume(aabb.IsFinite());
+	assume(!aabb.HasNegativeVolume());
+
+	nodes[ObjectNodeIndex(objectIndex)].aabb = EnlargedAABB(aabb);
+}
+
+template<typename T>
+float BVH<T>::InsertionCost(int nodeIndex, const AABB &leafAABB) const
+{
+	const BVHNode &n = nodes[nodeIndex];
+	float area = Union(n.aabb, leafAABB).SurfaceArea();
+	// If the node is a leaf, a new inner node is created to hold the leaf and the node. Otherwise the node grows,
+	// and the leaf is passed further down.
+	return n.IsLeaf() ? area : area - n.aabb.SurfaceArea();
+}
+
+template<typename T>
+void BVH<T>::InsertLeaf(int leaf)
+{
+	nodesInDepthFirstOrder = false;
+	if (root == -1)
+	{
+		root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Descend the tree to find the sibling for the new leaf that causes the least increase in the surface area of the tree.
+	const AABB leafAABB = nodes[leaf].aabb;
+	int sibling = root;
+	while(!nodes[sibling].IsLeaf())
+	{
+		const BVHNode &n = nodes[sibling];
+		const float combinedArea = Union(n.aabb, leafAABB).SurfaceArea();
+		// The cost of creating a new parent for this node and the new leaf.
+		const float cost = 2.f * combinedArea;
+		// The cost that all the nodes below this node have to pay for growing this node.
+		const float inheritanceCost = 2.f * (combinedArea - n.aabb.SurfaceArea());
+		const float leftCost = InsertionCost(n.left, leafAABB) + inheritanceCost;
+		const float rightCost = InsertionCost(n.right, leafAABB) + inheritanceCost;
+		// Creating the new parent above a taller subtree would break the balance of the tree.
+		if (cost < leftCost && cost < rightCost && n.height <= 1)
+			break;
+		sibling = (leftCost < rightCost) ? n.left : n.right;
+	}
+
+	// Create a new parent node for the sibling and the new leaf.
+	const int oldParent = nodes[sibling].parent;
+	const int newParent = AllocateNode(); // Note: Invalidates all references to the nodes array.
+	BVHNode &p = nodes[newParent];
+	p.parent = oldParent;
+	p.aabb = Union(leafAABB, nodes[sibling].aabb);
+	p.height = nodes[sibling].height + 1;
+	p.left = sibling;
+	p.right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != -1)
+	{
+		if (nodes[oldParent].left == sibling)
+			nodes[oldParent].left = newParent;
+		else
+			nodes[oldParent].right = newParent;
+	}
+	else
+		root = newParent;
+
+	RefitAncestors(newParent);
+	assert(TreeHeight() <= maxTreeHeight);
+}
+
+template<typename T>
+void BVH<T>::RemoveLeaf(int leaf)
+{
+	nodesInDepthFirstOrder = false;
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	// Remove the parent of the leaf, and put the sibling of the leaf in its place.
+	const int parent = nodes[leaf].parent;
+	const int grandParent = nodes[parent].parent;
+	const int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+	nodes[sibling].parent = grandParent;
+	nodes[leaf].parent = -1;
+	FreeNode(parent);
+
+	if (grandParent != -1)
+	{
+		if (nodes[grandParent].left == parent)
+			nodes[grandParent].left = sibling;
+		else
+			nodes[grandParent].right = sibling;
+		RefitAncestors(grandParent);
+	}
+	else
+		root = sibling;
+}
+
+template<typename T>
+void BVH<T>::RefitNode(int nodeIndex)
+{
+	BVHNode &n = nodes[nodeIndex];
+	assert(!n.IsLeaf());
+	const BVHNode &left = nodes[n.left];
+	const BVHNode &right = nodes[n.right];
+	n.aabb = Union(left.aabb, right.aabb);
+	n.height = 1 + Max(left.height, right.height);
+}
+
+template<typename T>
+void BVH<T>::RefitAncestors(int nodeIndex)
+{
+	while(nodeIndex != -1)
+	{
+		RefitNode(nodeIndex);
+		Rotate(nodeIndex);
+		nodeIndex = nodes[nodeIndex].parent;
+	}
+}
+
+template<typename T>
+void BVH<T>::SwapChildAndGrandchild(int nodeIndex, int child, int grandchild)
+{
+	nodesInDepthFirstOrder = false;
+	const int otherChild = nodes[grandchild].parent;
+	assert(nodes[otherChild].parent == nodeIndex);
+	assert(nodes[child].parent == nodeIndex);
+
+	BVHNode &n = nodes[nodeIndex];
+	if (n.left == child)
+		n.left = grandchild;
+	else
+		n.right = grandchild;
+	nodes[grandchild].parent = nodeIndex;
+
+	BVHNode &o = nodes[otherChild];
+	if (o.left == grandchild)
+		o.left = child;
+	else
+		o.right = child;
+	nodes[child].parent = otherChild;
+
+	RefitNode(otherChild);
+	RefitNode(nodeIndex);
+}
+
+template<typename T>
+void BVH<T>::ConsiderRotation(int child, int grandchild, int otherGrandchild, float &bestAreaReduction, int &bestChild, int &bestGrandchild) const
+{
+	// Swapping child and grandchild makes child and otherGrandchild siblings. Only allow rotations that keep the tree balanced.
+	const BVHNode &c = nodes[child];
+	const BVHNode &g = nodes[grandchild];
+	const BVHNode &o = nodes[otherGrandchild];
+	if (c.height > o.height + 1 || o.height > c.height + 1)
+		return;
+	const int newHeight = 1 + Max(c.height, o.height);
+	if (g.height > newHeight + 1 || newHeight > g.height + 1)
+		return;
+
+	const float areaReduction = nodes[g.parent].aabb.SurfaceArea() - Union(c.aabb, o.aabb).SurfaceArea();
+	if (areaReduction > bestAreaReduction)
+	{
+		bestAreaReduction = areaReduction;
+		bestChild = child;
+		bestGrandchild = grandchild;
+	}
+}
+
+template<typename T>
+void BVH<T>::Rotate(int nodeIndex)
+{
+	const BVHNode &n = nodes[nodeIndex];
+	assert(!n.IsLeaf());
+	const int b = n.left;
+	const int c = n.right;
+	const BVHNode &B = nodes[b];
+	const BVHNode &C = nodes[c];
+
+	// If the subtree is out of balance, swap the shorter child with the taller child of the taller child.
+	if (C.height > B.height + 1)
+	{
+		SwapChildAndGrandchild(nodeIndex, b, (nodes[C.left].height > nodes[C.right].height) ? C.left : C.right);
+		return;
+	}
+	if (B.height > C.height + 1)
+	{
+		SwapChildAndGrandchild(nodeIndex, c, (nodes[B.left].height > nodes[B.right].height) ? B.left : B.right);
+		return;
+	}
+
+	// The subtree is balanced. Find the child-grandchild swap that reduces the surface area of the subtree the most.
+	// See Kopta et al. "Fast, effective BVH updates for animated scenes", 2012.
+	float bestAreaReduction = 0.f;
+	int bestChild = -1;
+	int bestGrandchild = -1;
+	if (!C.IsLeaf())
+	{
+		ConsiderRotation(b, C.left, C.right, bestAreaReduction, bestChild, bestGrandchild);
+		ConsiderRotation(b, C.right, C.left, bestAreaReduction, bestChild, bestGrandchild);
+	}
+	if (!B.IsLeaf())
+	{
+		ConsiderRotation(c, B.left, B.right, bestAreaReduction, bestChild, bestGrandchild);
+		ConsiderRotation(c, B.right, B.left, bestAreaReduction, bestChild, bestGrandchild);
+	}
+	if (bestChild != -1)
+		SwapChildAndGrandchild(nodeIndex, bestChild, bestGrandchild);
+}
+
+template<typename T>
+void BVH<T>::Refit(bool rotate)
+{
+	if (root == -1 || nodes[root].IsLeaf())
+		return;
+
+	if (nodesInDepthFirstOrder)
+	{
+		// Each parent is stored before its children, so sweeping the array backwards refits the children before their parents.
+		// Rotations only shuffle nodes inside the subtree of the rotated node, which has already been processed.
+		for(int i = (int)nodes.size()-1; i >= 0; --i)
+			if (nodes[i].height > 0)
+			{
+				RefitNode(i);
+				if (rotate)
+					Rotate(i);
+			}
+		return;
+	}
+
+	// Gather the inner nodes in breadth-first order, and process them in reverse.
+	scratch.clear();
+	scratch.push_back(root);
+	for(size_t i = 0; i < scratch.size(); ++i)
+	{
+		const BVHNode &n = nodes[scratch[i]];
+		if (!nodes[n.left].IsLeaf())
+			scratch.push_back(n.left);
+		if (!nodes[n.right].IsLeaf())
+			scratch.push_back(n.right);
+	}
+	for(int i = (int)scratch.size()-1; i >= 0; --i)
+	{
+		RefitNode(scratch[i]);
+		if (rotate)
+			Rotate(scratch[i]);
+	}
+}
+
+template<typename T>
+void BVH<T>::Compact()
+{
+	std::vector<BVHNode, AlignedAllocator<BVHNode, 16> > newNodes;
+	newNodes.reserve(NumNodes());
+
+	// Traverse the tree depth-first, left child first. The stack holds pairs of (old node index, new parent index).
+	scratch.clear();
+	if (root != -1)
+	{
+		scratch.push_back(root);
+		scratch.push_back(-1);
+	}
+	while(!scratch.empty())
+	{
+		const int parent = scratch.back(); scratch.pop_back();
+		const int oldIndex = scratch.back(); scratch.pop_back();
+		const int newIndex = (int)newNodes.size();
+		newNodes.push_back(nodes[oldIndex]);
+		BVHNode &n = newNodes.back();
+		n.parent = parent;
+		if (parent != -1)
+		{
+			// The left child is always visited first. Until then, the left child index of the parent is -2.
+			if (newNodes[parent].left == -2)
+				newNodes[parent].left = newIndex;
+			else
+				newNodes[parent].right = newIndex;
+		}
+
+		if (n.IsLeaf())
+			objectNodes[n.ObjectIndex()] = newIndex;
+		else
+		{
+			scratch.push_back(n.right);
+			scratch.push_back(newIndex);
+			scratch.push_back(n.left);
+			scratch.push_back(newIndex);
+			n.left = -2;
+			n.right = -2;
+		}
+	}
+
+	nodes.swap(newNodes);
+	freeNodes.clear();
+	root = nodes.empty() ? -1 : 0;
+	nodesInDepthFirstOrder = true;
+}
+
+template<typename T>
+void BVH<T>::Clear()
+{
+	nodes.clear();
+	freeNodes.clear();
+	objects.clear();
+	objectNodes.clear();
+	freeObjects.clear();
+	numObjects = 0;
+	root = -1;
+	nodesInDepthFirstOrder = true;
+}
+
+template<typename T>
+T &BVH<T>::Object(int objectIndex)
+{
+	assume(objectIndex >= 0 && objectIndex < (int)objects.size());
+	return objects[objectIndex];
+}
+
+template<typename T>
+const T &BVH<T>::Object(int objectIndex) const
+{
+	assume(objectIndex >= 0 && objectIndex < (int)objects.size());
+	return objects[objectIndex];
+}
+
+template<typename T>
+int BVH<T>::ObjectNodeIndex(int objectIndex) const
+{
+	assume(objectIndex >= 0 && objectIndex < (int)objectNodes.size());
+	assume(objectNodes[objectIndex] != -1 && "The given object has been removed from the tree!");
+	return objectNodes[objectIndex];
+}
+
+template<typename T>
+AABB BVH<T>::BoundingAABB() const
+{
+	if (root != -1)
+		return nodes[root].aabb;
+	AABB a;
+	a.SetNegativeInfinity();
+	return a;
+}
+
+template<typename T>
+float BVH<T>::SAHCost() const
+{
+	if (root == -1 || nodes[root].IsLeaf())
+		return 0.f;
+	float area = 0.f;
+	for(size_t i = 0; i < nodes.size(); ++i)
+		if (nodes[i].height > 0)
+			area += nodes[i].aabb.SurfaceArea();
+	return area / nodes[root].aabb.SurfaceArea();
+}
+
+template<typename T>
+template<typename Func>
+inline void BVH<T>::RayQuery(const Ray &r, Func &leafCallback)
+{
+	if (root == -1)
+		return;
+
+	float tNear = 0.f;
+	float tExit = FLOAT_INF;
+	if (!nodes[root].aabb.IntersectLineAABB(r.pos, r.dir, tNear, tExit))
+		return;
+
+	struct StackElem
+	{
+		int nodeIndex;
+		float tNear;
+	};
+	// Each step pops one node and pushes at most two, so the stack never holds more than one item per tree level.
+	const int cMaxStackItems = maxTreeHeight + 1;
+	StackElem stack[cMaxStackItems];
+	stack[0].nodeIndex = root;
+	stack[0].tNear = tNear;
+	int stackSize = 1;
+
+	float tFar = FLOAT_INF; // The maximum distance to search for, updated by the callback.
+	while(stackSize > 0)
+	{
+		const StackElem e = stack[--stackSize];
+		if (e.tNear > tFar)
+			continue; // The callback has found a hit closer than this node since it was pushed on the stack.
+
+		const BVHNode &n = nodes[e.nodeIndex];
+		if (n.IsLeaf())
+		{
+			if (leafCallback(*this, n, r, e.tNear, tFar))
+				return;
+			continue;
+		}
+
+		float tNearLeft = 0.f, tFarLeft = tFar;
+		float tNearRight = 0.f, tFarRight = tFar;
+		const bool hitLeft = nodes[n.left].aabb.IntersectLineAABB(r.pos, r.dir, tNearLeft, tFarLeft);
+		const bool hitRight = nodes[n.right].aabb.IntersectLineAABB(r.pos, r.dir, tNearRight, tFarRight);
+		assert(stackSize + 2 <= cMaxStackItems);
+
+		// Push the farther child first, so that the nearer child is visited first.
+		if (hitLeft && hitRight && tNearLeft < tNearRight)
+		{
+			stack[stackSize].nodeIndex = n.right;
+			stack[stackSize++].tNear = tNearRight;
+			stack[stackSize].nodeIndex = n.left;
+			stack[stackSize++].tNear = tNearLeft;
+		}
+		else
+		{
+			if (hitLeft)
+			{
+				stack[stackSize].nodeIndex = n.left;
+				stack[stackSize++].tNear = tNearLeft;
+			}
+			if (hitRight)
+			{
+				stack[stackSize].nodeIndex = n.right;
+				stack[stackSize++].tNear = tNearRight;
+			}
+		}
+	}
+}
+
+template<typename T>
+template<typename Func>
+inline void BVH<T>::AABBQuery(const AABB &aabb, Func &leafCallback)
+{
+	if (root == -1 || !aabb.Intersects(nodes[root].aabb))
+		return;
+
+	const int cMaxStackItems = maxTreeHeight + 1;
+	int stack[cMaxStackItems];
+	stack[0] = root;
+	int stackSize = 1;
+
+	while(stackSize > 0)
+	{
+		const BVHNode &n = nodes[stack[--stackSize]];
+		if (n.IsLeaf())
+		{
+			if (leafCallback(*this, n, aabb))
+				return;
+			continue;
+		}
+
+		assert(stackSize + 2 <= cMaxStackItems);
+		if (aabb.Intersects(nodes[n.right].aabb))
+			stack[stackSize++] = n.right;
+		if (aabb.Intersects(nodes[n.left].aabb))
+			stack[stackSize++] = n.left;
+	}
+}
+
+template<typename T>
+void BVH<T>::DebugSanityCheck() const
+{
+	assert(numObjects == (int)objects.size() - (int)freeObjects.size());
+	int numReachableNodes = 0;
+	int numLeaves = 0;
+	for(int i = 0; i < (int)nodes.size(); ++i)
+	{
+		const BVHNode &n = nodes[i];
+		if (n.height < 0)
+			continue; // Unused node.
+		++numReachableNodes;
+		if (n.parent == -1)
+			assert(i == root);
+		else
+			assert(nodes[n.parent].left == i || nodes[n.parent].right == i);
+
+		if (n.IsLeaf())
+		{
+			++numLeaves;
+			assert(n.height == 0);
+			assert(objectNodes[n.ObjectIndex()] == i);
+		}
+		else
+		{
+			const BVHNode &left = nodes[n.left];
+			const BVHNode &right = nodes[n.right];
+			assert(left.parent == i);
+			assert(right.parent == i);
+			assert(n.height == 1 + Max(left.height, right.height));
+			assert(left.height <= right.height + 1 && right.height <= left.height + 1);
+			assert(n.aabb.Contains(left.aabb));
+			assert(n.aabb.Contains(right.aabb));
+			MARK_UNUSED(left);
+			MARK_UNUSED(right);
+		}
+	}
+	assert(numLeaves == numObjects);
+	assert(numReachableNodes == NumNodes());
+	assert(numObjects == 0 || numReachableNodes == 2 * numObjects - 1);
+	MARK_UNUSED(numReachableNodes);
+	MARK_UNUSED(numLeaves);
+}
+
+MATH_END_NAMESPACE
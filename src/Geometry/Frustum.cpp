@@ -38,6 +38,7 @@
 #include "../Math/Quat.h"
 #include "../Algorithm/Random/LCG.h"
 #include "../Algorithm/GJK.h"
+#include "../Math/SIMDCapability.h"
 
 #ifdef MATH_ENABLE_STL_SUPPORT
 #include <iostream>
@@ -1097,6 +1098,237 @@ bool Frustum::Intersects(const Polyhedron &polyhedron) const
 	return this->ToPolyhedron().Intersects(polyhedron);
 }
 
+// The batch culling kernels below test blocks of 4 (SSE) or 8 (AVX) objects at a time against the six frustum planes.
+// The objects are transposed to SoA form on load, and each plane is broadcast to all lanes. For AABBs, the same
+// nearest/farthest corner test as in PBVolume::InsideOrIntersects() is used, so the results are identical to it. Since
+// the corner selection depends only on the signs of the plane normal, it is done once per plane for the whole block.
+// Each kernel returns the number of objects it processed, and the caller culls the remaining tail objects with the
+// scalar PBVolume code.
+typedef int (*CullAABBsFunc)(const Plane *planes, const AABB *aabbs, int numAABBs, u8 *outResults);
+typedef int (*CullSpheresFunc)(const Plane *planes, const Sphere *spheres, int numSpheres, u8 *outResults);
+
+static inline void WriteCullResults(int outsideMask, int notContainedMask, int numLanes, u8 *outResults)
+{
+	for(int i = 0; i < numLanes; ++i)
+		outResults[i] = (u8)(((outsideMask >> i) & 1) ? TestOutside : (((notContainedMask >> i) & 1) ? TestNotContained : TestInside));
+}
+
+#ifdef MATH_SSE2_KERNELS
+MATH_TARGET_SSE2 static int CullAABBs_SSE2(const Plane *planes, const AABB *aabbs, int numAABBs, u8 *outResults)
+{
+	__m128 nx[6], ny[6], nz[6], d[6];
+	bool negX[6], negY[6], negZ[6];
+	for(int j = 0; j < 6; ++j)
+	{
+		nx[j] = _mm_set1_ps(planes[j].normal.x);
+		ny[j] = _mm_set1_ps(planes[j].normal.y);
+		nz[j] = _mm_set1_ps(planes[j].normal.z);
+		d[j] = _mm_set1_ps(planes[j].d);
+		negX[j] = planes[j].normal.x < 0.f;
+		negY[j] = planes[j].normal.y < 0.f;
+		negZ[j] = planes[j].normal.z < 0.f;
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	const int numBatched = numAABBs & ~3;
+	for(int i = 0; i < numBatched; i += 4)
+	{
+		const AABB *a = aabbs + i;
+		const __m128 minX = _mm_setr_ps(a[0].minPoint.x, a[1].minPoint.x, a[2].minPoint.x, a[3].minPoint.x);
+		const __m128 minY = _mm_setr_ps(a[0].minPoint.y, a[1].minPoint.y, a[2].minPoint.y, a[3].minPoint.y);
+		const __m128 minZ = _mm_setr_ps(a[0].minPoint.z, a[1].minPoint.z, a[2].minPoint.z, a[3].minPoint.z);
+		const __m128 maxX = _mm_setr_ps(a[0].maxPoint.x, a[1].maxPoint.x, a[2].maxPoint.x, a[3].maxPoint.x);
+		const __m128 maxY = _mm_setr_ps(a[0].maxPoint.y, a[1].maxPoint.y, a[2].maxPoint.y, a[3].maxPoint.y);
+		const __m128 maxZ = _mm_setr_ps(a[0].maxPoint.z, a[1].maxPoint.z, a[2].maxPoint.z, a[3].maxPoint.z);
+
+		__m128 outside = zero;
+		__m128 notContained = zero;
+		for(int j = 0; j < 6; ++j)
+		{
+			// The corner nearest to the plane (furthest into the negative halfspace), and the corner farthest from it.
+			const __m128 nearDist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[j], negX[j] ? maxX : minX),
+				_mm_mul_ps(ny[j], negY[j] ? maxY : minY)), _mm_mul_ps(nz[j], negZ[j] ? maxZ : minZ)), d[j]);
+			const __m128 farDist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[j], negX[j] ? minX : maxX),
+				_mm_mul_ps(ny[j], negY[j] ? minY : maxY)), _mm_mul_ps(nz[j], negZ[j] ? minZ : maxZ)), d[j]);
+			outside = _mm_or_ps(outside, _mm_cmpge_ps(nearDist, zero));
+			notContained = _mm_or_ps(notContained, _mm_cmpge_ps(farDist, zero));
+		}
+		WriteCullResults(_mm_movemask_ps(outside), _mm_movemask_ps(notContained), 4, outResults + i);
+	}
+	return numBatched;
+}
+
+MATH_TARGET_SSE2 static int CullSpheres_SSE2(const Plane *planes, const Sphere *spheres, int numSpheres, u8 *outResults)
+{
+	__m128 nx[6], ny[6], nz[6], d[6];
+	for(int j = 0; j < 6; ++j)
+	{
+		nx[j] = _mm_set1_ps(planes[j].normal.x);
+		ny[j] = _mm_set1_ps(planes[j].normal.y);
+		nz[j] = _mm_set1_ps(planes[j].normal.z);
+		d[j] = _mm_set1_ps(planes[j].d);
+	}
+	const __m128 signMask = _mm_set1_ps(-0.f);
+
+	const int numBatched = numSpheres & ~3;
+	for(int i = 0; i < numBatched; i += 4)
+	{
+		const Sphere *s = spheres + i;
+		const __m128 x = _mm_setr_ps(s[0].pos.x, s[1].pos.x, s[2].pos.x, s[3].pos.x);
+		const __m128 y = _mm_setr_ps(s[0].pos.y, s[1].pos.y, s[2].pos.y, s[3].pos.y);
+		const __m128 z = _mm_setr_ps(s[0].pos.z, s[1].pos.z, s[2].pos.z, s[3].pos.z);
+		const __m128 r = _mm_setr_ps(s[0].r, s[1].r, s[2].r, s[3].r);
+		const __m128 negR = _mm_xor_ps(r, signMask);
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 notContained = _mm_setzero_ps();
+		for(int j = 0; j < 6; ++j)
+		{
+			const __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[j], x), _mm_mul_ps(ny[j], y)), _mm_mul_ps(nz[j], z)), d[j]);
+			outside = _mm_or_ps(outside, _mm_cmpge_ps(dist, r));
+			notContained = _mm_or_ps(notContained, _mm_cmpge_ps(dist, negR));
+		}
+		WriteCullResults(_mm_movemask_ps(outside), _mm_movemask_ps(notContained), 4, outResults + i);
+	}
+	return numBatched;
+}
+#endif
+
+#ifdef MATH_AVX_KERNELS
+MATH_TARGET_AVX static int CullAABBs_AVX(const Plane *planes, const AABB *aabbs, int numAABBs, u8 *outResults)
+{
+	__m256 nx[6], ny[6], nz[6], d[6];
+	bool negX[6], negY[6], negZ[6];
+	for(int j = 0; j < 6; ++j)
+	{
+		nx[j] = _mm256_set1_ps(planes[j].normal.x);
+		ny[j] = _mm256_set1_ps(planes[j].normal.y);
+		nz[j] = _mm256_set1_ps(planes[j].normal.z);
+		d[j] = _mm256_set1_ps(planes[j].d);
+		negX[j] = planes[j].normal.x < 0.f;
+		negY[j] = planes[j].normal.y < 0.f;
+		negZ[j] = planes[j].normal.z < 0.f;
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	const int numBatched = numAABBs & ~7;
+	for(int i = 0; i < numBatched; i += 8)
+	{
+		const AABB *a = aabbs + i;
+		const __m256 minX = _mm256_setr_ps(a[0].minPoint.x, a[1].minPoint.x, a[2].minPoint.x, a[3].minPoint.x, a[4].minPoint.x, a[5].minPoint.x, a[6].minPoint.x, a[7].minPoint.x);
+		const __m256 minY = _mm256_setr_ps(a[0].minPoint.y, a[1].minPoint.y, a[2].minPoint.y, a[3].minPoint.y, a[4].minPoint.y, a[5].minPoint.y, a[6].minPoint.y, a[7].minPoint.y);
+		const __m256 minZ = _mm256_setr_ps(a[0].minPoint.z, a[1].minPoint.z, a[2].minPoint.z, a[3].minPoint.z, a[4].minPoint.z, a[5].minPoint.z, a[6].minPoint.z, a[7].minPoint.z);
+		const __m256 maxX = _mm256_setr_ps(a[0].maxPoint.x, a[1].maxPoint.x, a[2].maxPoint.x, a[3].maxPoint.x, a[4].maxPoint.x, a[5].maxPoint.x, a[6].maxPoint.x, a[7].maxPoint.x);
+		const __m256 maxY = _mm256_setr_ps(a[0].maxPoint.y, a[1].maxPoint.y, a[2].maxPoint.y, a[3].maxPoint.y, a[4].maxPoint.y, a[5].maxPoint.y, a[6].maxPoint.y, a[7].maxPoint.y);
+		const __m256 maxZ = _mm256_setr_ps(a[0].maxPoint.z, a[1].maxPoint.z, a[2].maxPoint.z, a[3].maxPoint.z, a[4].maxPoint.z, a[5].maxPoint.z, a[6].maxPoint.z, a[7].maxPoint.z);
+
+		__m256 outside = zero;
+		__m256 notContained = zero;
+		for(int j = 0; j < 6; ++j)
+		{
+			const __m256 nearDist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[j], negX[j] ? maxX : minX),
+				_mm256_mul_ps(ny[j], negY[j] ? maxY : minY)), _mm256_mul_ps(nz[j], negZ[j] ? maxZ : minZ)), d[j]);
+			const __m256 farDist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[j], negX[j] ? minX : maxX),
+				_mm256_mul_ps(ny[j], negY[j] ? minY : maxY)), _mm256_mul_ps(nz[j], negZ[j] ? minZ : maxZ)), d[j]);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(nearDist, zero, _CMP_GE_OQ));
+			notContained = _mm256_or_ps(notContained, _mm256_cmp_ps(farDist, zero, _CMP_GE_OQ));
+		}
+		WriteCullResults(_mm256_movemask_ps(outside), _mm256_movemask_ps(notContained), 8, outResults + i);
+	}
+	return numBatched;
+}
+
+MATH_TARGET_AVX static int CullSpheres_AVX(const Plane *planes, const Sphere *spheres, int numSpheres, u8 *outResults)
+{
+	__m256 nx[6], ny[6], nz[6], d[6];
+	for(int j = 0; j < 6; ++j)
+	{
+		nx[j] = _mm256_set1_ps(planes[j].normal.x);
+		ny[j] = _mm256_set1_ps(planes[j].normal.y);
+		nz[j] = _mm256_set1_ps(planes[j].normal.z);
+		d[j] = _mm256_set1_ps(planes[j].d);
+	}
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+
+	const int numBatched = numSpheres & ~7;
+	for(int i = 0; i < numBatched; i += 8)
+	{
+		const Sphere *s = spheres + i;
+		const __m256 x = _mm256_setr_ps(s[0].pos.x, s[1].pos.x, s[2].pos.x, s[3].pos.x, s[4].pos.x, s[5].pos.x, s[6].pos.x, s[7].pos.x);
+		const __m256 y = _mm256_setr_ps(s[0].pos.y, s[1].pos.y, s[2].pos.y, s[3].pos.y, s[4].pos.y, s[5].pos.y, s[6].pos.y, s[7].pos.y);
+		const __m256 z = _mm256_setr_ps(s[0].pos.z, s[1].pos.z, s[2].pos.z, s[3].pos.z, s[4].pos.z, s[5].pos.z, s[6].pos.z, s[7].pos.z);
+		const __m256 r = _mm256_setr_ps(s[0].r, s[1].r, s[2].r, s[3].r, s[4].r, s[5].r, s[6].r, s[7].r);
+		const __m256 negR = _mm256_xor_ps(r, signMask);
+
+		__m256 outside = _mm256_setzero_ps();
+		__m256 notContained = _mm256_setzero_ps();
+		for(int j = 0; j < 6; ++j)
+		{
+			const __m256 dist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[j], x), _mm256_mul_ps(ny[j], y)), _mm256_mul_ps(nz[j], z)), d[j]);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, r, _CMP_GE_OQ));
+			notContained = _mm256_or_ps(notContained, _mm256_cmp_ps(dist, negR, _CMP_GE_OQ));
+		}
+		WriteCullResults(_mm256_movemask_ps(outside), _mm256_movemask_ps(notContained), 8, outResults + i);
+	}
+	return numBatched;
+}
+#endif
+
+static int CullAABBs_None(const Plane *, const AABB *, int, u8 *) { return 0; }
+static int CullSpheres_None(const Plane *, const Sphere *, int, u8 *) { return 0; }
+
+static CullAABBsFunc SelectCullAABBsKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &CullAABBs_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &CullAABBs_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &CullAABBs_None;
+}
+
+static CullSpheresFunc SelectCullSpheresKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &CullSpheres_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &CullSpheres_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &CullSpheres_None;
+}
+
+void Frustum::CullAABBs(const AABB *aabbs, int numAABBs, u8 *outResults) const
+{
+	assume(aabbs || numAABBs == 0);
+	assume(outResults || numAABBs == 0);
+	static const CullAABBsFunc kernel = SelectCullAABBsKernel();
+
+	const PBVolume<6> volume = ToPBVolume();
+	for(int i = kernel(volume.p, aabbs, numAABBs, outResults); i < numAABBs; ++i)
+		outResults[i] = (u8)volume.InsideOrIntersects(aabbs[i]);
+}
+
+void Frustum::CullSpheres(const Sphere *spheres, int numSpheres, u8 *outResults) const
+{
+	assume(spheres || numSpheres == 0);
+	assume(outResults || numSpheres == 0);
+	static const CullSpheresFunc kernel = SelectCullSpheresKernel();
+
+	const PBVolume<6> volume = ToPBVolume();
+	for(int i = kernel(volume.p, spheres, numSpheres, outResults); i < numSpheres; ++i)
+		outResults[i] = (u8)volume.InsideOrIntersects(spheres[i]);
+}
+
 #if defined(MATH_TINYXML_INTEROP) && defined(MATH_CONTAINERLIB_SUPPORT)
 
 void Frustum::DeserializeFromXml(TiXmlElement *e)
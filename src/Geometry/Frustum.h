@@ -623,6 +623,22 @@ public:
 	bool Intersects(const Frustum &frustum) const;
 	bool Intersects(const Polyhedron &polyhedron) const;
 
+	/// Performs an approximate culling test of the given array of AABBs against this Frustum.
+	/** This is a batched version of ToPBVolume().InsideOrIntersects(aabb) for each AABB. The frustum planes are
+		computed only once, and the AABBs are tested in blocks of 4 or 8 using SSE or AVX, if available. This is
+		much faster than calling Intersects() for each object, and best suited for view frustum culling of large
+		numbers of objects, when a small number of false positives does not matter.
+		@param outResults [out] An array of numAABBs elements that receives the culling result of each AABB, as a
+			value of the CullTestResult enum: TestOutside if the AABB is certainly outside this Frustum, TestInside
+			if it is fully inside, and TestNotContained otherwise. The AABB may still be outside this Frustum in that
+			last case, if no separating frustum plane was found.
+		@see CullSpheres(), Intersects(), PBVolume::InsideOrIntersects(). */
+	void CullAABBs(const AABB *aabbs, int numAABBs, u8 *outResults) const;
+	/// Performs an approximate culling test of the given array of Spheres against this Frustum.
+	/** This is a batched version of ToPBVolume().InsideOrIntersects(sphere) for each Sphere. See CullAABBs() for details.
+		@see CullAABBs(), Intersects(), PBVolume::InsideOrIntersects(). */
+	void CullSpheres(const Sphere *spheres, int numSpheres, u8 *outResults) const;
+
 #if defined(MATH_TINYXML_INTEROP) && defined(MATH_CONTAINERLIB_SUPPORT)
 	void DeserializeFromXml(TiXmlElement *e);
 #endif
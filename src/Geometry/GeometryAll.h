@@ -26,7 +26,9 @@
 #endif
 
 #include "AABB.h"
+#include "AABBArray.h"
 #include "AABB2D.h"
+#include "BVH.h"
 #include "Capsule.h"
 #include "Circle.h"
 #include "Frustum.h"
@@ -36,6 +38,8 @@
 #include "Line.h"
 #include "LineSegment.h"
 #include "OBB.h"
+#include "OBBArray.h"
+#include "Octree.h"
 #include "Plane.h"
 #include "Polygon.h"
 #include "Polyhedron.h"
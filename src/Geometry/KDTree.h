@@ -19,6 +19,9 @@
 
 #include "../Math/MathTypes.h"
 #include "../Math/myassert.h"
+#include "../Math/SSEMath.h"
+#include "../Algorithm/Parallel.h"
+#include "../Algorithm/NearestNeighborHeap.h"
 #include "Triangle.h"
 
 #ifdef MATH_CONTAINERLIB_SUPPORT
@@ -59,6 +62,72 @@ struct KdTreeNode
 	CardinalAxis SplitAxis() const { return (CardinalAxis)splitAxis; }
 };
 
+/// Specifies the strategy that KdTree<T>::Build() uses to choose the split planes of the tree.
+enum KdTreeSplitHeuristic
+{
+	/// Splits each node along the longest axis of its bounding box, at the center point. This is fast to build,
+	/// but on uneven geometry produces deep, unbalanced trees with lots of object duplication.
+	KdTreeSplitMidpoint = 0,
+	/// Chooses the split plane that minimizes the (binned) surface area heuristic cost. Slower to build,
+	/// but produces trees that are significantly faster to query with rays.
+	KdTreeSplitSAH
+};
+
+/// Specifies the parameters that are used to build a KdTree.
+/** The default values produce the same tree as the original midpoint split builder. */
+struct KdTreeBuildParams
+{
+	KdTreeBuildParams()
+	:splitHeuristic(KdTreeSplitMidpoint),
+	maxObjectsPerLeaf(16),
+	numBins(32),
+	traversalCost(1.f),
+	intersectionCost(1.5f),
+	numThreads(1)
+	{
+	}
+
+	/// The split plane selection strategy to use.
+	KdTreeSplitHeuristic splitHeuristic;
+
+	/// A leaf containing at most this many objects is never split further.
+	/// With KdTreeSplitSAH, leaves larger than this are split only if the SAH cost estimates the split to be profitable.
+	int maxObjectsPerLeaf;
+
+	/// Specifies how many candidate split planes (+1) are evaluated per axis when KdTreeSplitSAH is used.
+	int numBins;
+
+	/// The estimated cost of visiting a single inner node during traversal. Only used with KdTreeSplitSAH.
+	float traversalCost;
+
+	/// The estimated cost of testing a single object in a leaf. Only used with KdTreeSplitSAH.
+	/// The ratio intersectionCost/traversalCost drives how deep the tree is built.
+	float intersectionCost;
+
+	/// The maximum number of threads to use for building the tree. If 0, the number of hardware threads is used.
+	/// The built tree is identical regardless of the number of threads used. @see SetParallelTaskDispatcher().
+	int numThreads;
+};
+
+/// Describes the quality of a built kD-tree. Returned by KdTree<T>::Statistics().
+struct KdTreeStatistics
+{
+	int numNodes; ///< The total number of nodes (inner nodes + leaves) in the tree.
+	int numInnerNodes; ///< The number of inner nodes in the tree.
+	int numLeaves; ///< The number of leaf nodes in the tree.
+	int numEmptyLeaves; ///< The number of leaves that do not contain any objects.
+	int numObjectReferences; ///< The total number of object indices stored in all leaf buckets.
+	int maxLeafSize; ///< The number of objects in the largest leaf.
+	int treeHeight; ///< The maximum height of the tree, see KdTree<T>::TreeHeight().
+	float averageLeafSize; ///< The average number of objects in a non-empty leaf.
+	float averageLeafDepth; ///< The average depth of a non-empty leaf, weighted by the number of objects in the leaf.
+	/// The ratio numObjectReferences / NumObjects(). 1.0 means that no objects were duplicated into multiple leaves.
+	float duplicationFactor;
+	/// The expected cost of tracing a random ray through the tree, as estimated by the surface area heuristic
+	/// and the traversal and intersection costs that the tree was built with. Smaller is better.
+	float sahCost;
+};
+
 /// Type T must have a member function bool T.Intersects(const AABB &) const;
 template<typename T>
 class KdTree
@@ -85,6 +154,10 @@ public:
 	/// After Build() has been called, do *not* call AddObjects() again.
 	void Build();
 
+	/// Creates the kD-tree data structure using the given build parameters.
+	/// @see Build(), KdTreeBuildParams.
+	void Build(const KdTreeBuildParams &params);
+
 	/// Empties the whole kD-tree of all objects.
 	/// Call this function if you want to reuse this structure for rebuilding another kD-tree, after first
 	/// having called AddObjects/Build to build a previous tree.
@@ -117,6 +190,13 @@ public:
 	/// Returns the maximum height of the tree (the path from the root to the farthest leaf node).
 	int TreeHeight() const;
 
+	/// Computes statistics about the quality of the built tree.
+	/// Warning: This function iterates over the whole tree, so the running time is linear to the number of nodes, and not constant.
+	KdTreeStatistics Statistics() const;
+
+	/// Returns the parameters that were used to build this tree.
+	const KdTreeBuildParams &BuildParams() const { return buildParams; }
+
 	/// Returns the root node.
 	KdTreeNode *Root();
 	const KdTreeNode *Root() const;
@@ -141,6 +221,31 @@ public:
 	template<typename Func>
 	inline void RayQuery(const Ray &r, Func &leafCallback);
 
+#ifdef MATH_SSE
+	/// Traverses a packet of four rays through this kD-tree at the same time, using SSE.
+	/** The rays of a packet share the node fetches and the split plane tests, so this is faster than calling RayQuery() for
+		each ray when the rays are coherent, i.e. they start close to each other and point in similar directions.
+		If the direction vectors of the rays do not all have the same signs, the rays are traversed one at a time.
+		@param rays An array of four rays to query through this kD-tree.
+		@param leafCallback A function or a function object of prototype
+			int LeafCallbackFunction(KdTree<T> &tree, const KdTreeNode &leaf, const Ray *rays, const float *tNear, const float *tFar, int activeMask);
+			The callback is called for each leaf that at least one of the rays passes through. activeMask has bit i set
+			if the ray rays[i] passes through the leaf, in the distance range [tNear[i], tFar[i]]. The callback returns
+			a bitmask of the rays for which the query is finished. Those rays are not passed to the callback again, and
+			the query returns when all the rays have finished. */
+	template<typename Func>
+	inline void RayPacketQuery4(const Ray *rays, Func &leafCallback);
+#endif
+
+#ifdef MATH_AVX
+	/// Traverses a packet of eight rays through this kD-tree at the same time, using AVX.
+	/** @param rays An array of eight rays to query through this kD-tree.
+		@param leafCallback A function or a function object with the same prototype as in RayPacketQuery4().
+		@see RayPacketQuery4(). */
+	template<typename Func>
+	inline void RayPacketQuery8(const Ray *rays, Func &leafCallback);
+#endif
+
 	/// Performs an AABB intersection query in this kD-tree, and calls the given leafCallback function for each leaf
 	/// of the tree which intersects the given AABB.
 	/** @param aabb The axis-aligned bounding box to query through this kD-tree.
@@ -151,17 +256,21 @@ public:
 	template<typename Func>
 	inline void AABBQuery(const AABB &aabb, Func &leafCallback);
 
-#if 0 ///\bug Doesn't work properly. Fix up!
 	/// Performs an intersection query of this kD-tree against a given kD-tree, and calls the given
 	/// leafCallback function for each leaf pair that intersect each other.
-	/// @param leafCallback A function or a function object of prototype
-	///    bool LeafCallbackFunction(KdTree<T> &thisTree, KdTreeNode &thisLeaf, const AABB &thisLeafAABB,
-	///                              KdTree<T> &tree2, KdTreeNode &tree2Leaf, const OBB &tree2LeafOBB);
-	///    If the callback function returns true, the execution of the query is stopped and this function immediately
-	///    returns afterwards. If the callback function returns false, the execution of the query continues.
+	/** The two trees are traversed simultaneously. The nodes of tree2 are transformed to the local space of this tree,
+		and tested as OBBs against the AABBs of the nodes of this tree. Empty leaves are skipped.
+		@param thisWorldTransform The local->world transform of this tree.
+		@param tree2WorldTransform The local->world transform of tree2. The transforms may contain rotation, translation
+			and uniform scale, but not shear.
+		@param leafCallback A function or a function object of prototype
+		   bool LeafCallbackFunction(KdTree<T> &thisTree, KdTreeNode &thisLeaf, const AABB &thisLeafAABB,
+		                             KdTree<T> &tree2, KdTreeNode &tree2Leaf, const OBB &tree2LeafOBB);
+		   tree2LeafOBB is the bounding box of tree2Leaf in the local space of this tree.
+		   If the callback function returns true, the execution of the query is stopped and this function immediately
+		   returns afterwards. If the callback function returns false, the execution of the query continues. */
 	template<typename Func>
 	inline void KdTreeQuery(KdTree<T> &tree2, const float3x4 &thisWorldTransform, const float3x4 &tree2WorldTransform, Func &leafCallback);
-#endif
 
 #ifdef MATH_CONTAINERLIB_SUPPORT
 	/// Performs a nearest neighbor search on this kD-tree.
@@ -175,21 +284,92 @@ public:
 	inline void NearestObjects(const vec &point, Func &leafCallback);
 #endif
 
+	/// The maximum number of neighbors that KNearestObjects() can search for.
+	static const int maxNearestNeighbors = 64;
+
+	/// Finds the k objects in this kD-tree that are closest to the given point.
+	/** This query does not allocate memory. To call this function, type T must have a member function
+		float T.DistanceSq(const vec &point) const;
+		@param k The number of objects to find, at most maxNearestNeighbors.
+		@param outObjectIndices [out] Receives the indices of the found objects, closest first. Pass the indices to
+			Object() to access the objects. The array must have room for k elements.
+		@param outDistancesSq [out] If not null, receives the squared distances of the found objects to the point.
+		@return The number of objects found. This is less than k only if the tree contains fewer than k objects. */
+	int KNearestObjects(const vec &point, int k, u32 *outObjectIndices, float *outDistancesSq) const;
+
+	/// Finds all objects in this kD-tree that are at most the given distance away from the given point.
+	/** Type T must have a DistanceSq() member function, as in KNearestObjects().
+		@param outObjectIndices [out] Receives the indices of the found objects, in increasing order. This vector
+			is cleared first.
+		@param outDistancesSq [out] Receives the squared distances of the found objects to the point, in the same
+			order as the indices. This vector is cleared first. */
+	void ObjectsWithinRadius(const vec &point, float radius, std::vector<u32> &outObjectIndices, std::vector<float> &outDistancesSq) const;
+
 private:
 	static const int maxNodes = 256 * 1024;
 	static const int maxTreeDepth = 30;
+	/// A multithreaded Build() does not create tasks for subtrees with fewer objects than this.
+	static const int minObjectsPerBuildTask = 1024;
 
 	std::vector<KdTreeNode> nodes;
 	std::vector<u8, AlignedAllocator<u8, 16> > objects;
 	std::vector<u32*> buckets;
 
-	int AllocateNodePair();
+	static int AllocateNodePair(std::vector<KdTreeNode> &treeNodes);
 
 	void FreeBuckets();
 
 	AABB BoundingAABB(const u32 *bucket) const;
 
-	void SplitLeaf(int nodeIndex, const AABB &nodeAABB, int numObjectsInBucket, int leafDepth);
+	/// Describes a leaf whose subdivision was postponed by a multithreaded Build() to be run as a separate task.
+	struct SubtreeBuildTask
+	{
+		AABB nodeAABB;
+		int numObjects;
+		int depth;
+		u32 *bucket; ///< The objects of the leaf. Ownership is transferred to the task.
+		std::vector<KdTreeNode> nodes; ///< The nodes of the built subtree. The subtree root is at index 1.
+		std::vector<u32*> buckets; ///< The buckets of the built subtree. The bucket of the subtree root is at index 1.
+	};
+
+	struct SubtreeBuildTaskList
+	{
+		int maxObjectsPerTask; ///< Leaves with at most this many objects are split in a separate task.
+		std::vector<SubtreeBuildTask, AlignedAllocator<SubtreeBuildTask, 16> > tasks;
+	};
+
+	struct SubtreeBuildContext
+	{
+		const KdTree<T> *tree;
+		SubtreeBuildTaskList *deferredSplits;
+	};
+
+	/// Recursively subdivides the given leaf of the given node and bucket arrays.
+	/// @param deferredSplits If not null, leaves that are small enough are not split, but added to this list instead.
+	void SplitLeaf(std::vector<KdTreeNode> &treeNodes, std::vector<u32*> &treeBuckets, int nodeIndex, const AABB &nodeAABB,
+		int numObjectsInBucket, int leafDepth, SubtreeBuildTaskList *deferredSplits) const;
+
+	static void BuildSubtreeTask(void *userData, int taskIndex);
+
+	/// The implementation of RayPacketQuery4() and RayPacketQuery8(), parameterized by the SIMD instruction set.
+	template<typename Packet, typename Func>
+	inline void RayPacketQuery(const Ray *rays, Func &leafCallback);
+
+	/// Copies the subtree rooted at srcNodes[srcNodeIndex] to the leaf nodes[nodeIndex] of this tree, allocating nodes
+	/// and buckets in the same order as SplitLeaf().
+	void AppendSubtree(int nodeIndex, u32 bucketIndex, const std::vector<KdTreeNode> &srcNodes,
+		const std::vector<u32*> &srcBuckets, int srcNodeIndex, const SubtreeBuildTaskList *deferredSplits);
+
+	/// Finds the split plane with the smallest binned SAH cost for the given leaf.
+	/// @return False if no split is cheaper than keeping the node as a leaf.
+	bool FindSAHSplitPlane(const u32 *bucket, int numObjectsInBucket, const AABB &nodeAABB, CardinalAxis &splitAxis, float &splitPos) const;
+
+	void ComputeStatistics(int nodeIndex, const AABB &nodeAABB, int depth, KdTreeStatistics &stats, float &sahCost) const;
+
+	KdTreeBuildParams buildParams;
+
+	/// Caches the bounding boxes of all objects for the duration of Build().
+	std::vector<AABB, AlignedAllocator<AABB, 16> > objectAABBs;
 
 	///\todo Implement support for deep copying.
 	KdTree(const KdTree &);
@@ -242,6 +422,58 @@ struct TriangleKdTreeRayQueryNearestHitVisitor
 	}
 };
 
+/// Finds the nearest ray hits of a packet of up to eight rays to a KdTree<Triangle>.
+/** Use with KdTree<Triangle>::RayPacketQuery4() and KdTree<Triangle>::RayPacketQuery8(). The results for rays[i] are
+	stored to index i of the member arrays. */
+struct TriangleKdTreeRayPacketNearestHitVisitor
+{
+	float rayT[8];
+	vec pos[8];
+	u32 triangleIndex[8];
+	float2 barycentricUV[8];
+
+	TriangleKdTreeRayPacketNearestHitVisitor()
+	{
+		for(int i = 0; i < 8; ++i)
+		{
+			rayT[i] = FLOAT_INF;
+			triangleIndex[i] = KdTree<Triangle>::BUCKET_SENTINEL;
+			pos[i] = vec::nan;
+			barycentricUV[i] = float2::nan;
+		}
+	}
+	int operator()(KdTree<Triangle> &tree, const KdTreeNode &leaf, const Ray *rays, const float *tNear, const float *tFar, int activeMask)
+	{
+		u32 *bucket = tree.Bucket(leaf.bucketIndex);
+		assert(bucket);
+		while(*bucket != KdTree<Triangle>::BUCKET_SENTINEL)
+		{
+			const Triangle &tri = tree.Object(*bucket);
+			for(int i = 0; i < 8; ++i)
+				if ((activeMask & (1 << i)) != 0)
+				{
+					float u, v;
+					float t = Triangle::IntersectLineTri(rays[i].pos, rays[i].dir, tri.a, tri.b, tri.c, u, v);
+					if (t >= tNear[i] && t <= tFar[i] && t < rayT[i])
+					{
+						rayT[i] = t;
+						pos[i] = rays[i].GetPoint(t);
+						barycentricUV[i] = float2(u,v);
+						triangleIndex[i] = *bucket;
+					}
+				}
+			++bucket;
+		}
+
+		// The rays that hit a triangle in this leaf are finished, since the leaves are visited in front-to-back order.
+		int finishedMask = 0;
+		for(int i = 0; i < 8; ++i)
+			if ((activeMask & (1 << i)) != 0 && rayT[i] < FLOAT_INF)
+				finishedMask |= 1 << i;
+		return finishedMask;
+	}
+};
+
 MATH_END_NAMESPACE
 
 #include "KDTree.inl"
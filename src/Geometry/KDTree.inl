@@ -22,18 +22,62 @@
 #include "Ray.h"
 #include "../Math/assume.h"
 #include "../Math/MathFunc.h"
+#include "../Math/float3x4.h"
+#include <algorithm>
 
 MATH_BEGIN_NAMESPACE
 
+#ifdef MATH_SSE
+/// Abstracts the SIMD operations needed by the packet ray traversal of KdTree for packets of four rays.
+struct KdTreeRayPacket4
+{
+	typedef simd4f reg;
+	static const int numLanes = 4;
+	static FORCE_INLINE reg Load(const float *src) { return _mm_loadu_ps(src); }
+	static FORCE_INLINE void Store(float *dst, reg r) { _mm_storeu_ps(dst, r); }
+	static FORCE_INLINE reg Set1(float f) { return _mm_set1_ps(f); }
+	static FORCE_INLINE reg Sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+	static FORCE_INLINE reg Mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+	static FORCE_INLINE reg Min(reg a, reg b) { return _mm_min_ps(a, b); }
+	static FORCE_INLINE reg Max(reg a, reg b) { return _mm_max_ps(a, b); }
+	/// Returns a bitmask of the lanes where a <= b.
+	static FORCE_INLINE int LessOrEqual(reg a, reg b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+	/// Returns a bitmask of the lanes where !(a < b). Unlike GreaterOrEqual, this is true for NaNs.
+	static FORCE_INLINE int NotLess(reg a, reg b) { return _mm_movemask_ps(_mm_cmpnlt_ps(a, b)); }
+	/// Returns a bitmask of the lanes that have the sign bit set.
+	static FORCE_INLINE int SignMask(reg a) { return _mm_movemask_ps(a); }
+};
+#endif
+
+#ifdef MATH_AVX
+/// Abstracts the SIMD operations needed by the packet ray traversal of KdTree for packets of eight rays.
+struct KdTreeRayPacket8
+{
+	typedef __m256 reg;
+	static const int numLanes = 8;
+	static FORCE_INLINE reg Load(const float *src) { return _mm256_loadu_ps(src); }
+	static FORCE_INLINE void Store(float *dst, reg r) { _mm256_storeu_ps(dst, r); }
+	static FORCE_INLINE reg Set1(float f) { return _mm256_set1_ps(f); }
+	static FORCE_INLINE reg Sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+	static FORCE_INLINE reg Mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+	static FORCE_INLINE reg Min(reg a, reg b) { return _mm256_min_ps(a, b); }
+	static FORCE_INLINE reg Max(reg a, reg b) { return _mm256_max_ps(a, b); }
+	static FORCE_INLINE int LessOrEqual(reg a, reg b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+	static FORCE_INLINE int NotLess(reg a, reg b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_NLT_UQ)); }
+	static FORCE_INLINE int SignMask(reg a) { return _mm256_movemask_ps(a); }
+};
+#endif
+
 template<typename T>
-int KdTree<T>::AllocateNodePair()
+int KdTree<T>::AllocateNodePair(std::vector<KdTreeNode> &treeNodes)
 {
-	int index = (int)nodes.size();
+	int index = (int)treeNodes.size();
 	KdTreeNode n;
 	n.splitAxis = AxisNone; // The newly allocated nodes will be leaves.
+	n.childIndex = 0;
 	n.bucketIndex = 0;
-	nodes.push_back(n);
-	nodes.push_back(n);
+	treeNodes.push_back(n);
+	treeNodes.push_back(n);
 	return index;
 }
 
@@ -54,24 +98,120 @@ AABB KdTree<T>::BoundingAABB(const u32 *bucket) const
 	a.SetNegativeInfinity();
 
 	while(*bucket != BUCKET_SENTINEL)
-		a.Enclose(Object(*bucket++).BoundingAABB());
+		a.Enclose(objectAABBs[*bucket++]);
 
 	return a;
 }
 
 template<typename T>
-void KdTree<T>::SplitLeaf(int nodeIndex, const AABB &nodeAABB, int numObjectsInBucket, int leafDepth)
+bool KdTree<T>::FindSAHSplitPlane(const u32 *bucket, int numObjectsInBucket, const AABB &nodeAABB, CardinalAxis &splitAxis, float &splitPos) const
 {
-	if (leafDepth >= maxTreeDepth)
-		return; // Exceeded max depth - disallow splitting.
+	const int maxBins = 256;
+	const int numBins = Clamp(buildParams.numBins, 2, maxBins);
+	int numStarting[maxBins]; // numStarting[i]: The number of objects whose extent starts in bin i.
+	int numEnding[maxBins]; // numEnding[i]: The number of objects whose extent ends in bin i.
+
+	const vec nodeSize = nodeAABB.Size();
+	const float nodeArea = nodeAABB.SurfaceArea();
+	if (!(nodeArea > 0.f))
+		return false;
+
+	// The cost of not splitting at all.
+	float bestCost = buildParams.intersectionCost * numObjectsInBucket;
+	bool foundSplit = false;
+
+	for(int axis = AxisX; axis <= AxisZ; ++axis)
+	{
+		const float axisMin = nodeAABB.minPoint[axis];
+		const float axisSize = nodeSize[axis];
+		if (!(axisSize > 0.f))
+			continue; // The node is flat along this axis, nothing to split.
+
+		for(int i = 0; i < numBins; ++i)
+			numStarting[i] = numEnding[i] = 0;
+
+		const float binsPerUnit = numBins / axisSize;
+		for(const u32 *o = bucket; *o != BUCKET_SENTINEL; ++o)
+		{
+			const AABB &aabb = objectAABBs[*o];
+			int startBin = Clamp((int)((aabb.minPoint[axis] - axisMin) * binsPerUnit), 0, numBins-1);
+			int endBin = Clamp((int)((aabb.maxPoint[axis] - axisMin) * binsPerUnit), 0, numBins-1);
+			++numStarting[startBin];
+			++numEnding[endBin];
+		}
+
+		// The extents of the node cross-section perpendicular to the split axis.
+		const float a1 = nodeSize[(axis+1)%3];
+		const float a2 = nodeSize[(axis+2)%3];
+		const float crossArea = a1 * a2;
+		const float crossPerimeter = a1 + a2;
+
+		// Sweep the candidate planes at the bin boundaries from left to right.
+		int numLeft = 0;
+		int numRight = numObjectsInBucket;
+		for(int i = 1; i < numBins; ++i)
+		{
+			numLeft += numStarting[i-1];
+			numRight -= numEnding[i-1];
+			if (numLeft == numObjectsInBucket && numRight == numObjectsInBucket)
+				continue; // This plane would not separate any objects from each other.
+
+			const float leftLength = axisSize * i / numBins;
+			const float rightLength = axisSize - leftLength;
+			const float leftArea = 2.f * (crossArea + leftLength * crossPerimeter);
+			const float rightArea = 2.f * (crossArea + rightLength * crossPerimeter);
+			const float cost = buildParams.traversalCost + buildParams.intersectionCost * (leftArea * numLeft + rightArea * numRight) / nodeArea;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				splitAxis = (CardinalAxis)axis;
+				splitPos = axisMin + leftLength;
+				foundSplit = true;
+			}
+		}
+	}
+	return foundSplit;
+}
 
-	KdTreeNode *node = &nodes[nodeIndex];
+template<typename T>
+void KdTree<T>::SplitLeaf(std::vector<KdTreeNode> &treeNodes, std::vector<u32*> &treeBuckets, int nodeIndex, const AABB &nodeAABB,
+	int numObjectsInBucket, int leafDepth, SubtreeBuildTaskList *deferredSplits) const
+{
+	KdTreeNode *node = &treeNodes[nodeIndex];
 	assert(node->IsLeaf());
-	// Choose the longest axis for the split and convert the node from a leaf to an inner node.
 	int curBucketIndex = node->bucketIndex; // The existing objects.
 	assert(curBucketIndex != 0); // The leaf must contain some objects, otherwise this function should never be called!
-	CardinalAxis splitAxis = (CardinalAxis)nodeAABB.Size().MaxElementIndex();
-	float splitPos = nodeAABB.CenterPoint()[splitAxis];
+
+	if (deferredSplits && numObjectsInBucket <= deferredSplits->maxObjectsPerTask)
+	{
+		// Postpone splitting this leaf so that the subtree can be built in a separate task. The leaf is tagged with the
+		// task number (the child index of a leaf is otherwise unused) so that the subtree can be grafted here afterwards.
+		SubtreeBuildTask task;
+		task.nodeAABB = nodeAABB;
+		task.numObjects = numObjectsInBucket;
+		task.depth = leafDepth;
+		task.bucket = treeBuckets[curBucketIndex];
+		deferredSplits->tasks.push_back(task);
+		node->childIndex = (u32)deferredSplits->tasks.size();
+		return;
+	}
+
+	if (leafDepth >= maxTreeDepth)
+		return; // Exceeded max depth - disallow splitting.
+	const bool useSAH = (buildParams.splitHeuristic == KdTreeSplitSAH);
+	CardinalAxis splitAxis;
+	float splitPos;
+	if (useSAH)
+	{
+		if (!FindSAHSplitPlane(treeBuckets[curBucketIndex], numObjectsInBucket, nodeAABB, splitAxis, splitPos))
+			return; // Keeping this node as a leaf is cheaper than any split.
+	}
+	else
+	{
+		// Choose the longest axis for the split and convert the node from a leaf to an inner node.
+		splitAxis = (CardinalAxis)nodeAABB.Size().MaxElementIndex();
+		splitPos = nodeAABB.CenterPoint()[splitAxis];
+	}
 
 	// Compute the new bounding boxes for the left and right children.
 	AABB leftAABB = nodeAABB;
@@ -83,14 +223,14 @@ void KdTree<T>::SplitLeaf(int nodeIndex, const AABB &nodeAABB, int numObjectsInB
 	u32 *leftBucket = new u32[numObjectsInBucket+1];
 	u32 *rightBucket = new u32[numObjectsInBucket+1];
 
-	u32 *curObject = buckets[curBucketIndex];
+	u32 *curObject = treeBuckets[curBucketIndex];
 	u32 *l = leftBucket;
 	u32 *r = rightBucket;
 	int numObjectsLeft = 0;
 	int numObjectsRight = 0;
 	while(*curObject != BUCKET_SENTINEL)
 	{
-		AABB aabb = Object(*curObject).BoundingAABB();
+		const AABB &aabb = objectAABBs[*curObject];
 		bool left = leftAABB.Intersects(aabb);
 		bool right = rightAABB.Intersects(aabb);
 		if (!left && !right)
@@ -111,7 +251,10 @@ void KdTree<T>::SplitLeaf(int nodeIndex, const AABB &nodeAABB, int numObjectsInB
 	*r = BUCKET_SENTINEL;
 
 	// If we cannot split according to the given split axis, abort the whole process.
-	if (numObjectsLeft == numObjectsInBucket || numObjectsRight == numObjectsInBucket)
+	// The SAH builder is allowed to cut off empty space, in which case one of the children receives all the objects.
+	bool cannotSplit = useSAH ? (numObjectsLeft == numObjectsInBucket && numObjectsRight == numObjectsInBucket)
+	                          : (numObjectsLeft == numObjectsInBucket || numObjectsRight == numObjectsInBucket);
+	if (cannotSplit)
 	{
 		delete[] leftBucket;
 		delete[] rightBucket;
@@ -123,32 +266,97 @@ void KdTree<T>::SplitLeaf(int nodeIndex, const AABB &nodeAABB, int numObjectsInB
 	node->splitPos = splitPos;
 
 	// Allocate nodes for the children.
-	int childIndex = AllocateNodePair();
-	node = &nodes[nodeIndex]; // AllocateNodePair() above invalidates the 'node' pointer! Recompute it.
+	int childIndex = AllocateNodePair(treeNodes);
+	node = &treeNodes[nodeIndex]; // AllocateNodePair() above invalidates the 'node' pointer! Recompute it.
 	node->childIndex = childIndex;
 
 	// Recompute tighter AABB's for the children which have now been populated with objects.
-	leftAABB = BoundingAABB(leftBucket);
-	rightAABB = BoundingAABB(rightBucket);
+	// The SAH builder works on the actual cells of the tree, so the boxes must not extend past the split plane.
+	if (useSAH)
+	{
+		if (numObjectsLeft > 0)
+			leftAABB = leftAABB.Intersection(BoundingAABB(leftBucket));
+		if (numObjectsRight > 0)
+			rightAABB = rightAABB.Intersection(BoundingAABB(rightBucket));
+	}
+	else
+	{
+		leftAABB = BoundingAABB(leftBucket);
+		rightAABB = BoundingAABB(rightBucket);
+	}
 
 	// For the left child, reuse the bucket index the parent had. (free the bucket of the parent)
-	KdTreeNode *leftChild = &nodes[childIndex];
-	delete[] buckets[curBucketIndex];
-	buckets[curBucketIndex] = leftBucket;
+	KdTreeNode *leftChild = &treeNodes[childIndex];
+	delete[] treeBuckets[curBucketIndex];
+	treeBuckets[curBucketIndex] = leftBucket;
 	leftChild->bucketIndex = curBucketIndex;
 
 	// For the right child, allocate a new bucket.
-	KdTreeNode *rightChild = &nodes[childIndex+1];
-	rightChild->bucketIndex = (u32)buckets.size();
-	buckets.push_back(rightBucket);
+	KdTreeNode *rightChild = &treeNodes[childIndex+1];
+	rightChild->bucketIndex = (u32)treeBuckets.size();
+	treeBuckets.push_back(rightBucket);
 
-	assert(numObjectsLeft < numObjectsInBucket && numObjectsRight < numObjectsInBucket);
+	assert(useSAH || (numObjectsLeft < numObjectsInBucket && numObjectsRight < numObjectsInBucket));
 
 	// Recursively split children.
-	if (numObjectsLeft > 16)
-		SplitLeaf(childIndex, leftAABB, numObjectsLeft, leafDepth + 1);
-	if (numObjectsRight > 16)
-		SplitLeaf(childIndex+1, rightAABB, numObjectsRight, leafDepth + 1);
+	if (numObjectsLeft > buildParams.maxObjectsPerLeaf)
+		SplitLeaf(treeNodes, treeBuckets, childIndex, leftAABB, numObjectsLeft, leafDepth + 1, deferredSplits);
+	if (numObjectsRight > buildParams.maxObjectsPerLeaf)
+		SplitLeaf(treeNodes, treeBuckets, childIndex+1, rightAABB, numObjectsRight, leafDepth + 1, deferredSplits);
+}
+
+template<typename T>
+void KdTree<T>::BuildSubtreeTask(void *userData, int taskIndex)
+{
+	SubtreeBuildContext *context = (SubtreeBuildContext*)userData;
+	SubtreeBuildTask &task = context->deferredSplits->tasks[taskIndex];
+
+	// Build the subtree into its own node and bucket arrays, laid out like a tree of its own: index 0 is a dummy,
+	// and index 1 is the subtree root, which owns bucket 1.
+	KdTreeNode dummy;
+	dummy.splitAxis = AxisNone;
+	dummy.childIndex = 0;
+	dummy.bucketIndex = 0;
+	task.nodes.push_back(dummy);
+	KdTreeNode root = dummy;
+	root.bucketIndex = 1;
+	task.nodes.push_back(root);
+	task.buckets.push_back(0);
+	task.buckets.push_back(task.bucket);
+
+	context->tree->SplitLeaf(task.nodes, task.buckets, 1, task.nodeAABB, task.numObjects, task.depth, 0);
+}
+
+template<typename T>
+void KdTree<T>::AppendSubtree(int nodeIndex, u32 bucketIndex, const std::vector<KdTreeNode> &srcNodes,
+	const std::vector<u32*> &srcBuckets, int srcNodeIndex, const SubtreeBuildTaskList *deferredSplits)
+{
+	const KdTreeNode &src = srcNodes[srcNodeIndex];
+	if (src.IsLeaf())
+	{
+		if (deferredSplits && src.childIndex != 0)
+		{
+			// This leaf was split in a separate task, graft the subtree built by that task here.
+			const SubtreeBuildTask &task = deferredSplits->tasks[src.childIndex-1];
+			AppendSubtree(nodeIndex, bucketIndex, task.nodes, task.buckets, 1, 0);
+			return;
+		}
+		nodes[nodeIndex].bucketIndex = bucketIndex;
+		buckets[bucketIndex] = srcBuckets[src.bucketIndex];
+		return;
+	}
+
+	// Allocate the children and the bucket of the right child exactly in the same order as SplitLeaf() does.
+	int childIndex = AllocateNodePair(nodes);
+	KdTreeNode &node = nodes[nodeIndex];
+	node.splitAxis = src.splitAxis;
+	node.splitPos = src.splitPos;
+	node.childIndex = childIndex;
+	u32 rightBucketIndex = (u32)buckets.size();
+	buckets.push_back(0);
+
+	AppendSubtree(childIndex, bucketIndex, srcNodes, srcBuckets, src.LeftChildIndex(), deferredSplits);
+	AppendSubtree(childIndex+1, rightBucketIndex, srcNodes, srcBuckets, src.RightChildIndex(), deferredSplits);
 }
 
 template<typename T>
@@ -233,6 +441,58 @@ int KdTree<T>::TreeHeight() const
 	return TreeHeight(1);
 }
 
+template<typename T>
+void KdTree<T>::ComputeStatistics(int nodeIndex, const AABB &nodeAABB, int depth, KdTreeStatistics &stats, float &sahCost) const
+{
+	const KdTreeNode &node = nodes[nodeIndex];
+	const float area = nodeAABB.SurfaceArea();
+	if (node.IsLeaf())
+	{
+		++stats.numLeaves;
+		int numObjectsInLeaf = 0;
+		if (!node.IsEmptyLeaf())
+			for(const u32 *o = Bucket(node.bucketIndex); *o != BUCKET_SENTINEL; ++o)
+				++numObjectsInLeaf;
+		if (numObjectsInLeaf == 0)
+			++stats.numEmptyLeaves;
+		stats.numObjectReferences += numObjectsInLeaf;
+		stats.maxLeafSize = Max(stats.maxLeafSize, numObjectsInLeaf);
+		stats.averageLeafDepth += (float)depth * numObjectsInLeaf;
+		sahCost += area * buildParams.intersectionCost * numObjectsInLeaf;
+		return;
+	}
+
+	++stats.numInnerNodes;
+	sahCost += area * buildParams.traversalCost;
+	AABB leftAABB = nodeAABB;
+	AABB rightAABB = nodeAABB;
+	leftAABB.maxPoint[node.splitAxis] = node.splitPos;
+	rightAABB.minPoint[node.splitAxis] = node.splitPos;
+	ComputeStatistics(node.LeftChildIndex(), leftAABB, depth + 1, stats, sahCost);
+	ComputeStatistics(node.RightChildIndex(), rightAABB, depth + 1, stats, sahCost);
+}
+
+template<typename T>
+KdTreeStatistics KdTree<T>::Statistics() const
+{
+	KdTreeStatistics stats = KdTreeStatistics();
+	if (!Root())
+		return stats;
+
+	float sahCost = 0.f;
+	ComputeStatistics(1, rootAABB, 1, stats, sahCost);
+
+	stats.numNodes = stats.numInnerNodes + stats.numLeaves;
+	stats.treeHeight = TreeHeight();
+	int numNonEmptyLeaves = stats.numLeaves - stats.numEmptyLeaves;
+	stats.averageLeafSize = (numNonEmptyLeaves > 0) ? (float)stats.numObjectReferences / numNonEmptyLeaves : 0.f;
+	stats.averageLeafDepth = (stats.numObjectReferences > 0) ? stats.averageLeafDepth / stats.numObjectReferences : 0.f;
+	stats.duplicationFactor = (NumObjects() > 0) ? (float)stats.numObjectReferences / NumObjects() : 0.f;
+	float rootArea = rootAABB.SurfaceArea();
+	stats.sahCost = (rootArea > 0.f) ? sahCost / rootArea : 0.f;
+	return stats;
+}
+
 template<typename T>
 void KdTree<T>::AddObjects(const T *objects_, int numObjects)
 {
@@ -245,6 +505,15 @@ void KdTree<T>::AddObjects(const T *objects_, int numObjects)
 template<typename T>
 void KdTree<T>::Build()
 {
+	Build(KdTreeBuildParams());
+}
+
+template<typename T>
+void KdTree<T>::Build(const KdTreeBuildParams &params)
+{
+	assert(params.maxObjectsPerLeaf >= 1);
+	buildParams = params;
+
 	nodes.clear();
 	FreeBuckets();
 
@@ -272,11 +541,47 @@ void KdTree<T>::Build()
 	rootBucket[NumObjects()] = BUCKET_SENTINEL;
 	buckets.push_back(rootBucket);
 
+	objectAABBs.resize(NumObjects());
+	for(int i = 0; i < NumObjects(); ++i)
+		objectAABBs[i] = Object(i).BoundingAABB();
+
 	rootAABB = BoundingAABB(rootBucket);
 
 	// We now have a single root leaf node which is unsplit and contains all the objects
 	// in the kD-tree. Now recursively subdivide until the whole tree is built.
-	SplitLeaf(1, rootAABB, NumObjects(), 1);
+	const int numThreads = (params.numThreads > 0) ? params.numThreads : NumHardwareThreads();
+	const int maxObjectsPerTask = Max(NumObjects() / (numThreads * 8), (int)minObjectsPerBuildTask); // Cast to avoid odr-using the static member, which has no out-of-class definition.
+	if (numThreads <= 1 || NumObjects() <= maxObjectsPerTask)
+		SplitLeaf(nodes, buckets, 1, rootAABB, NumObjects(), 1, 0);
+	else
+	{
+		// Build the top of the tree serially until the leaves are small enough, and then build the subtrees
+		// under those leaves in parallel.
+		SubtreeBuildTaskList deferredSplits;
+		deferredSplits.maxObjectsPerTask = maxObjectsPerTask;
+		SplitLeaf(nodes, buckets, 1, rootAABB, NumObjects(), 1, &deferredSplits);
+
+		SubtreeBuildContext context;
+		context.tree = this;
+		context.deferredSplits = &deferredSplits;
+		RunParallelTasks(&KdTree<T>::BuildSubtreeTask, &context, (int)deferredSplits.tasks.size(), numThreads);
+
+		// Stitch the top of the tree and the subtrees together. The nodes and buckets are laid out again in the order
+		// the serial build would allocate them, so the result is identical regardless of the number of threads used.
+		// The buckets are transferred over to the new tree, so none of them are freed here.
+		std::vector<KdTreeNode> topNodes;
+		std::vector<u32*> topBuckets;
+		topNodes.swap(nodes);
+		topBuckets.swap(buckets);
+		nodes.push_back(topNodes[0]); // The dummy node.
+		nodes.push_back(topNodes[0]); // The root, which AppendSubtree() fills in.
+		buckets.push_back(0);
+		buckets.push_back(0);
+		AppendSubtree(1, 1, topNodes, topBuckets, 1, &deferredSplits);
+	}
+
+	// The object bounding boxes are only needed while building.
+	std::vector<AABB, AlignedAllocator<AABB, 16> >().swap(objectAABBs);
 
 #ifdef _DEBUG
 	needsBuilding = false;
@@ -448,6 +753,169 @@ inline void KdTree<T>::RayQuery(const Ray &r, Func &nodeProcessFunc)
 	}
 }
 
+/// Adapts a packet leaf callback to the single ray KdTree::RayQuery(), for one lane of a packet.
+template<typename T, typename Func>
+struct KdTreeRayPacketLaneAdapter
+{
+	Func *leafCallback;
+	const Ray *rays;
+	float *tNear;
+	float *tFar;
+	int lane;
+
+	bool operator()(KdTree<T> &tree, const KdTreeNode &leaf, const Ray &, float dNear, float dFar)
+	{
+		tNear[lane] = dNear;
+		tFar[lane] = dFar;
+		return ((*leafCallback)(tree, leaf, rays, tNear, tFar, 1 << lane) & (1 << lane)) != 0;
+	}
+};
+
+template<typename T>
+template<typename Packet, typename Func>
+inline void KdTree<T>::RayPacketQuery(const Ray *rays, Func &leafCallback)
+{
+	typedef typename Packet::reg reg;
+	const int numLanes = Packet::numLanes;
+
+	assume(rootAABB.IsFinite());
+	assume(!rootAABB.IsDegenerate());
+#ifdef _DEBUG
+	assume(!needsBuilding);
+#endif
+
+	// Clip each ray against the root box. Rays that miss the tree are not active to begin with.
+	float tNear[numLanes], tFar[numLanes];
+	float pos[3][numLanes], invDir[3][numLanes];
+	int activeMask = 0;
+	for(int i = 0; i < numLanes; ++i)
+	{
+		tNear[i] = 0.f;
+		tFar[i] = FLOAT_INF;
+		if (rootAABB.IntersectLineAABB(rays[i].pos, rays[i].dir, tNear[i], tFar[i]))
+			activeMask |= 1 << i;
+		else
+		{
+			tNear[i] = FLOAT_INF; // Make the ray inactive in all the interval tests below.
+			tFar[i] = -FLOAT_INF;
+		}
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			pos[axis][i] = rays[i].pos[axis];
+			invDir[axis][i] = 1.f / rays[i].dir[axis];
+		}
+	}
+	if (!activeMask)
+		return;
+
+	// The packet traversal visits the children of each node in the same order for all rays, which requires that the
+	// direction vectors of all the active rays have the same signs. Trace incoherent packets one ray at a time.
+	int nearChildOffset[3];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		int negativeLanes = Packet::SignMask(Packet::Load(invDir[axis])) & activeMask;
+		if (negativeLanes != 0 && negativeLanes != activeMask)
+		{
+			KdTreeRayPacketLaneAdapter<T, Func> adapter;
+			adapter.leafCallback = &leafCallback;
+			adapter.rays = rays;
+			adapter.tNear = tNear;
+			adapter.tFar = tFar;
+			for(int i = 0; i < numLanes; ++i)
+				if ((activeMask & (1 << i)) != 0)
+				{
+					adapter.lane = i;
+					RayQuery(rays[i], adapter);
+				}
+			return;
+		}
+		// If the rays travel in the negative direction, the right child is the one that is entered first.
+		nearChildOffset[axis] = (negativeLanes != 0) ? 1 : 0;
+	}
+
+	const reg rayPos[3] = { Packet::Load(pos[0]), Packet::Load(pos[1]), Packet::Load(pos[2]) };
+	const reg rayInvDir[3] = { Packet::Load(invDir[0]), Packet::Load(invDir[1]), Packet::Load(invDir[2]) };
+	reg tMin = Packet::Load(tNear);
+	reg tMax = Packet::Load(tFar);
+
+	struct StackElem
+	{
+		const KdTreeNode *node;
+		reg tMin;
+		reg tMax;
+	};
+	const int cMaxStackItems = maxTreeDepth*2;
+	StackElem stack[cMaxStackItems];
+	int stackSize = 0;
+
+	const KdTreeNode *node = Root();
+	for(;;)
+	{
+		while(!node->IsLeaf())
+		{
+			const int axis = node->splitAxis;
+			// The distance along each ray to the split plane. If a ray lies on the plane, this is NaN.
+			const reg d = Packet::Mul(Packet::Sub(Packet::Set1(node->splitPos), rayPos[axis]), rayInvDir[axis]);
+			const int liveLanes = Packet::LessOrEqual(tMin, tMax) & activeMask;
+			const int nearLanes = Packet::NotLess(d, tMin) & liveLanes; // Rays that lie on the plane go to the near child.
+			const int farLanes = Packet::LessOrEqual(d, tMax) & liveLanes;
+			const KdTreeNode *nearChild = &nodes[node->LeftChildIndex() + nearChildOffset[axis]];
+			const KdTreeNode *farChild = &nodes[node->RightChildIndex() - nearChildOffset[axis]];
+			if (!farLanes)
+				node = nearChild;
+			else if (!nearLanes)
+				node = farChild;
+			else
+			{
+				// Visit the near child first, and store the far child to the stack. Note the order of the operands
+				// to Min and Max: if d is NaN, the other operand is returned.
+				assert(stackSize < cMaxStackItems);
+				stack[stackSize].node = farChild;
+				stack[stackSize].tMin = Packet::Max(d, tMin);
+				stack[stackSize].tMax = tMax;
+				++stackSize;
+				tMax = Packet::Min(d, tMax);
+				node = nearChild;
+			}
+		}
+
+		const int leafLanes = Packet::LessOrEqual(tMin, tMax) & activeMask;
+		if (leafLanes)
+		{
+			Packet::Store(tNear, tMin);
+			Packet::Store(tFar, tMax);
+			activeMask &= ~leafCallback(*this, *node, rays, tNear, tFar, leafLanes);
+			if (!activeMask)
+				return; // All the rays have terminated.
+		}
+
+		if (stackSize == 0)
+			return;
+		--stackSize;
+		node = stack[stackSize].node;
+		tMin = stack[stackSize].tMin;
+		tMax = stack[stackSize].tMax;
+	}
+}
+
+#ifdef MATH_SSE
+template<typename T>
+template<typename Func>
+inline void KdTree<T>::RayPacketQuery4(const Ray *rays, Func &leafCallback)
+{
+	RayPacketQuery<KdTreeRayPacket4>(rays, leafCallback);
+}
+#endif
+
+#ifdef MATH_AVX
+template<typename T>
+template<typename Func>
+inline void KdTree<T>::RayPacketQuery8(const Ray *rays, Func &leafCallback)
+{
+	RayPacketQuery<KdTreeRayPacket8>(rays, leafCallback);
+}
+#endif
+
 template<typename T>
 template<typename Func>
 inline void KdTree<T>::AABBQuery(const AABB &aabb, Func &leafCallback)
@@ -462,6 +930,13 @@ inline void KdTree<T>::AABBQuery(const AABB &aabb, Func &leafCallback)
 	if (!aabb.Intersects(BoundingAABB()))
 		return;
 
+	// The SAH builder may leave the whole tree as a single leaf.
+	if (stack[0]->IsLeaf())
+	{
+		leafCallback(*this, *stack[0], aabb);
+		return;
+	}
+
 	while(stackSize > 0)
 	{
 		KdTreeNode *cur = stack[--stackSize];
@@ -498,174 +973,92 @@ inline void KdTree<T>::AABBQuery(const AABB &aabb, Func &leafCallback)
 	}
 }
 
-#if 0 ///\bug Doesn't work properly. Fix up!
-
-struct StackElem
+/// A pair of nodes on the traversal stack of KdTree::KdTreeQuery().
+struct KdTreeQueryStackElem
 {
 	KdTreeNode *thisNode;
 	KdTreeNode *tree2Node;
 	AABB thisAABB;
+	/// The bounds of tree2Node in the local space of tree2.
 	AABB tree2AABB;
+	/// The bounds of tree2Node in the local space of this tree.
 	OBB tree2OBB;
 };
 
-///\todo Fix up thread-safety!
-const int cMaxStackItems = 50*2;
-StackElem stack[cMaxStackItems*1000];
-
-
 template<typename T>
 template<typename Func>
 inline void KdTree<T>::KdTreeQuery(KdTree<T> &tree2, const float3x4 &thisWorldTransform, const float3x4 &tree2WorldTransform, Func &leafCallback)
 {
-	float3x4 tree2Transform = thisWorldTransform.Inverted() * tree2WorldTransform;
+	if (!Root() || !tree2.Root())
+		return;
 
-	int stackSize = 1;
-	stack[0].thisNode = Root();
-	stack[0].thisAABB = BoundingAABB();
-	stack[0].tree2Node = tree2.Root();
-	stack[0].tree2AABB = tree2.BoundingAABB();	
-	OBB tree2OBB = stack[0].tree2AABB.Transform(tree2Transform);
-	stack[0].tree2OBB = tree2OBB;
-
-	if (!stack[0].thisAABB.Intersects(tree2OBB))
+	// Maps the local space of tree2 to the local space of this tree.
+	const float3x4 tree2Transform = thisWorldTransform.Inverted() * tree2WorldTransform;
+
+	KdTreeQueryStackElem e;
+	e.thisNode = Root();
+	e.thisAABB = BoundingAABB();
+	e.tree2Node = tree2.Root();
+	e.tree2AABB = tree2.BoundingAABB();
+	e.tree2OBB = e.tree2AABB.Transform(tree2Transform);
+	if (!e.thisAABB.Intersects(e.tree2OBB))
 		return;
 
-	while(stackSize > 0)
+	std::vector<KdTreeQueryStackElem, AlignedAllocator<KdTreeQueryStackElem, 16> > stack;
+	stack.push_back(e);
+
+	while(!stack.empty())
 	{
-		assert(stackSize < cMaxStackItems*100);
-		--stackSize;
-		KdTreeNode *thisNode = stack[stackSize].thisNode;
-		KdTreeNode *tree2Node = stack[stackSize].tree2Node;
-		AABB thisAABB = stack[stackSize].thisAABB;
-		AABB tree2AABB = stack[stackSize].tree2AABB;
-		OBB tree2OBB = stack[stackSize].tree2OBB;
+		KdTreeQueryStackElem cur = stack.back();
+		stack.pop_back();
 
-		if (thisNode->IsLeaf() && tree2Node->IsLeaf())
-		{
-			if (leafCallback(*this, *thisNode, thisAABB, tree2, *tree2Node, tree2OBB, tree2Transform))
-				return;
-		}
-		else if (thisNode->IsLeaf())
+		const bool thisIsLeaf = cur.thisNode->IsLeaf();
+		const bool tree2IsLeaf = cur.tree2Node->IsLeaf();
+		if ((thisIsLeaf && cur.thisNode->IsEmptyLeaf()) || (tree2IsLeaf && cur.tree2Node->IsEmptyLeaf()))
+			continue; // An empty leaf can not overlap anything.
+
+		if (thisIsLeaf && tree2IsLeaf)
 		{
-			if (thisNode->IsEmptyLeaf())
-				continue; // We hit an empty leaf, no need to test this against tree2.
-
-			// Test this leaf node against both children of the tree2 inner node.
-			KdTreeNode *tree2LeftChild = &tree2.nodes[tree2Node->LeftChildIndex()];
-			KdTreeNode *tree2RightChild = &tree2.nodes[tree2Node->RightChildIndex()];
-			AABB tree2LeftAABB = tree2AABB;
-			AABB tree2RightAABB = tree2AABB;
-			tree2LeftAABB.maxPoint[tree2Node->splitAxis] = tree2Node->splitPos;
-			tree2RightAABB.minPoint[tree2Node->splitAxis] = tree2Node->splitPos;
-			OBB tree2LeftOBB = tree2LeftAABB.Transform(tree2Transform);
-			OBB tree2RightOBB = tree2RightAABB.Transform(tree2Transform);
-		//	if (thisAABB.Intersects(tree2LeftOBB))
-			{
-				stack[stackSize].tree2Node = tree2LeftChild;
-				stack[stackSize].tree2AABB = tree2LeftAABB;
-				stack[stackSize].tree2OBB = tree2LeftOBB;
-				++stackSize;
-			}
-		//	if (thisAABB.Intersects(tree2RightOBB))
-			{
-				stack[stackSize].thisNode = thisNode;
-				stack[stackSize].thisAABB = thisAABB;
-				stack[stackSize].tree2Node = tree2RightChild;
-				stack[stackSize].tree2AABB = tree2RightAABB;
-				stack[stackSize].tree2OBB = tree2RightOBB;
-				++stackSize;
-			}
+			if (leafCallback(*this, *cur.thisNode, cur.thisAABB, tree2, *cur.tree2Node, cur.tree2OBB))
+				return; // The callback requested to terminate the query, so quit.
+			continue;
 		}
-		else if (tree2Node->IsLeaf())
+
+		// Descend into the larger of the two nodes, which prunes the other tree more effectively.
+		e = cur;
+		if (!thisIsLeaf && (tree2IsLeaf || cur.thisAABB.Volume() >= cur.tree2OBB.Volume()))
 		{
-			if (tree2Node->IsEmptyLeaf())
-				continue; // We hit an empty leaf, no need to test the node against this tree further.
-
-			// Test both children of this inner node against the tree2 leaf node.
-			KdTreeNode *leftChild = &nodes[thisNode->LeftChildIndex()];
-			KdTreeNode *rightChild = &nodes[thisNode->RightChildIndex()];
-			AABB leftAABB = thisAABB;
-			AABB rightAABB = thisAABB;
-			leftAABB.maxPoint[thisNode->splitAxis] = thisNode->splitPos;
-			rightAABB.minPoint[thisNode->splitAxis] = thisNode->splitPos;
-		//	if (leftAABB.Intersects(tree2OBB))
-			{
-				stack[stackSize].thisNode = leftChild;
-				stack[stackSize].thisAABB = leftAABB;
-				++stackSize;
-			}
-		//	if (rightAABB.Intersects(tree2OBB))
-			{
-				stack[stackSize].thisNode = rightChild;
-				stack[stackSize].thisAABB = rightAABB;
-				stack[stackSize].tree2Node = tree2Node;
-				stack[stackSize].tree2AABB = tree2AABB;
-				stack[stackSize].tree2OBB = tree2OBB;
-				++stackSize;
-			}
+			const int axis = cur.thisNode->splitAxis;
+			e.thisNode = &nodes[cur.thisNode->RightChildIndex()];
+			e.thisAABB.minPoint[axis] = cur.thisNode->splitPos;
+			if (e.thisAABB.Intersects(cur.tree2OBB))
+				stack.push_back(e);
+
+			e.thisNode = &nodes[cur.thisNode->LeftChildIndex()];
+			e.thisAABB = cur.thisAABB;
+			e.thisAABB.maxPoint[axis] = cur.thisNode->splitPos;
+			if (e.thisAABB.Intersects(cur.tree2OBB))
+				stack.push_back(e);
 		}
 		else
 		{
-			// Test all child node pairs.
-			KdTreeNode *leftChild = &nodes[thisNode->LeftChildIndex()];
-			KdTreeNode *rightChild = &nodes[thisNode->RightChildIndex()];
-			AABB leftAABB = thisAABB;
-			AABB rightAABB = thisAABB;
-			leftAABB.maxPoint[thisNode->splitAxis] = thisNode->splitPos;
-			rightAABB.minPoint[thisNode->splitAxis] = thisNode->splitPos;
-
-			KdTreeNode *tree2LeftChild = &tree2.nodes[tree2Node->LeftChildIndex()];
-			KdTreeNode *tree2RightChild = &tree2.nodes[tree2Node->RightChildIndex()];
-			AABB tree2LeftAABB = tree2AABB;
-			AABB tree2RightAABB = tree2AABB;
-			tree2LeftAABB.maxPoint[tree2Node->splitAxis] = tree2Node->splitPos;
-			tree2RightAABB.minPoint[tree2Node->splitAxis] = tree2Node->splitPos;
-			OBB tree2LeftOBB = tree2LeftAABB.Transform(tree2Transform);
-			OBB tree2RightOBB = tree2RightAABB.Transform(tree2Transform);
-
-			if (leftAABB.Intersects(tree2LeftOBB))
-			{
-				stack[stackSize].thisNode = leftChild;
-				stack[stackSize].thisAABB = leftAABB;
-				stack[stackSize].tree2Node = tree2LeftChild;
-				stack[stackSize].tree2AABB = tree2LeftAABB;
-				stack[stackSize].tree2OBB = tree2LeftOBB;
-				++stackSize;
-			}
-			if (rightAABB.Intersects(tree2LeftOBB))
-			{
-				stack[stackSize].thisNode = rightChild;
-				stack[stackSize].thisAABB = rightAABB;
-				stack[stackSize].tree2Node = tree2LeftChild;
-				stack[stackSize].tree2AABB = tree2LeftAABB;
-				stack[stackSize].tree2OBB = tree2LeftOBB;
-				++stackSize;
-			}
-			if (leftAABB.Intersects(tree2RightOBB))
-			{
-				stack[stackSize].thisNode = leftChild;
-				stack[stackSize].thisAABB = leftAABB;
-				stack[stackSize].tree2Node = tree2RightChild;
-				stack[stackSize].tree2AABB = tree2RightAABB;
-				stack[stackSize].tree2OBB = tree2RightOBB;
-				++stackSize;
-			}
-			if (rightAABB.Intersects(tree2RightOBB))
-			{
-				stack[stackSize].thisNode = rightChild;
-				stack[stackSize].thisAABB = rightAABB;
-				stack[stackSize].tree2Node = tree2RightChild;
-				stack[stackSize].tree2AABB = tree2RightAABB;
-				stack[stackSize].tree2OBB = tree2RightOBB;
-				++stackSize;
-			}
+			const int axis = cur.tree2Node->splitAxis;
+			e.tree2Node = &tree2.nodes[cur.tree2Node->RightChildIndex()];
+			e.tree2AABB.minPoint[axis] = cur.tree2Node->splitPos;
+			e.tree2OBB = e.tree2AABB.Transform(tree2Transform);
+			if (cur.thisAABB.Intersects(e.tree2OBB))
+				stack.push_back(e);
+
+			e.tree2Node = &tree2.nodes[cur.tree2Node->LeftChildIndex()];
+			e.tree2AABB = cur.tree2AABB;
+			e.tree2AABB.maxPoint[axis] = cur.tree2Node->splitPos;
+			e.tree2OBB = e.tree2AABB.Transform(tree2Transform);
+			if (cur.thisAABB.Intersects(e.tree2OBB))
+				stack.push_back(e);
 		}
 	}
 }
 
-#endif
-
 #ifdef MATH_CONTAINERLIB_SUPPORT
 struct NearestObjectsTraversalNode
 {
@@ -716,4 +1109,132 @@ inline void KdTree<T>::NearestObjects(const vec &point, Func &leafCallback)
 }
 #endif
 
+template<typename T>
+int KdTree<T>::KNearestObjects(const vec &point, int k, u32 *outObjectIndices, float *outDistancesSq) const
+{
+#ifdef _DEBUG
+	assume(!needsBuilding);
+#endif
+	assert(k >= 0 && k <= maxNearestNeighbors);
+	NearestNeighborHeap<u32, maxNearestNeighbors> nearest(k);
+
+	struct StackItem
+	{
+		const KdTreeNode *node;
+		AABB aabb;
+		float distanceSq;
+	};
+	const int cMaxStackItems = maxTreeDepth*2;
+	StackItem stack[cMaxStackItems];
+	int stackSize = 0;
+	if (k > 0 && Root())
+	{
+		stack[0].node = Root();
+		stack[0].aabb = BoundingAABB();
+		stack[0].distanceSq = BoundingAABB().ClosestPoint(point).DistanceSq(point);
+		stackSize = 1;
+	}
+
+	while(stackSize > 0)
+	{
+		StackItem cur = stack[--stackSize];
+		// The nodes on the stack were pushed before closer objects may have been found, so check again.
+		if (cur.distanceSq > nearest.MaxDistanceSq())
+			continue;
+
+		if (cur.node->IsLeaf())
+		{
+			if (cur.node->IsEmptyLeaf())
+				continue;
+			for(const u32 *bucket = Bucket(cur.node->bucketIndex); *bucket != BUCKET_SENTINEL; ++bucket)
+			{
+				float d = Object(*bucket).DistanceSq(point);
+				// An object can be stored in several leaves, so skip it if it was already found in another leaf.
+				if (d < nearest.MaxDistanceSq() && !nearest.Contains(*bucket))
+					nearest.Insert(*bucket, d);
+			}
+			continue;
+		}
+
+		StackItem left, right;
+		left.node = &nodes[cur.node->LeftChildIndex()];
+		left.aabb = cur.aabb;
+		left.aabb.maxPoint[cur.node->splitAxis] = cur.node->splitPos;
+		left.distanceSq = left.aabb.ClosestPoint(point).DistanceSq(point);
+		right.node = &nodes[cur.node->RightChildIndex()];
+		right.aabb = cur.aabb;
+		right.aabb.minPoint[cur.node->splitAxis] = cur.node->splitPos;
+		right.distanceSq = right.aabb.ClosestPoint(point).DistanceSq(point);
+
+		// Push the farther child first, so that the closer child is visited first, and finds close objects early.
+		assert(stackSize + 2 <= cMaxStackItems);
+		if (left.distanceSq <= right.distanceSq)
+		{
+			stack[stackSize++] = right;
+			stack[stackSize++] = left;
+		}
+		else
+		{
+			stack[stackSize++] = left;
+			stack[stackSize++] = right;
+		}
+	}
+
+	nearest.SortAscending();
+	for(int i = 0; i < nearest.Size(); ++i)
+	{
+		outObjectIndices[i] = nearest[i].object;
+		if (outDistancesSq)
+			outDistancesSq[i] = nearest[i].distanceSq;
+	}
+	return nearest.Size();
+}
+
+template<typename T>
+void KdTree<T>::ObjectsWithinRadius(const vec &point, float radius, std::vector<u32> &outObjectIndices, std::vector<float> &outDistancesSq) const
+{
+#ifdef _DEBUG
+	assume(!needsBuilding);
+#endif
+	outObjectIndices.clear();
+	outDistancesSq.clear();
+	if (!Root() || radius < 0.f)
+		return;
+
+	const float radiusSq = radius * radius;
+	const AABB queryAABB(point - DIR_VEC_SCALAR(radius), point + DIR_VEC_SCALAR(radius));
+	const int cMaxStackItems = maxTreeDepth*2;
+	const KdTreeNode *stack[cMaxStackItems];
+	int stackSize = 0;
+	if (queryAABB.Intersects(BoundingAABB()))
+		stack[stackSize++] = Root();
+
+	while(stackSize > 0)
+	{
+		const KdTreeNode *cur = stack[--stackSize];
+		if (cur->IsLeaf())
+		{
+			if (cur->IsEmptyLeaf())
+				continue;
+			for(const u32 *bucket = Bucket(cur->bucketIndex); *bucket != BUCKET_SENTINEL; ++bucket)
+				if (Object(*bucket).DistanceSq(point) <= radiusSq)
+					outObjectIndices.push_back(*bucket);
+			continue;
+		}
+
+		assert(stackSize + 2 <= cMaxStackItems);
+		if (queryAABB.minPoint[cur->splitAxis] <= cur->splitPos)
+			stack[stackSize++] = &nodes[cur->LeftChildIndex()];
+		if (queryAABB.maxPoint[cur->splitAxis] >= cur->splitPos)
+			stack[stackSize++] = &nodes[cur->RightChildIndex()];
+	}
+
+	// An object can be stored in several leaves, so remove the duplicates.
+	std::sort(outObjectIndices.begin(), outObjectIndices.end());
+	outObjectIndices.erase(std::unique(outObjectIndices.begin(), outObjectIndices.end()), outObjectIndices.end());
+	outDistancesSq.resize(outObjectIndices.size());
+	for(size_t i = 0; i < outObjectIndices.size(); ++i)
+		outDistancesSq[i] = Object(outObjectIndices[i]).DistanceSq(point);
+}
+
 MATH_END_NAMESPACE
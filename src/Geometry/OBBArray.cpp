@@ -0,0 +1,446 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file OBBArray.cpp
+	@author Jukka Jylnki
+	@brief Implementation for the structure-of-arrays OBB container. */
+#include "OBBArray.h"
+#include "Sphere.h"
+#include "../Math/MathFunc.h"
+#include "../Math/BitOps.h"
+#include "../Math/SIMDCapability.h"
+
+MATH_BEGIN_NAMESPACE
+
+OBBArray::OBBArray(const OBB *obbs, int numOBBs)
+{
+	Set(obbs, numOBBs);
+}
+
+void OBBArray::Clear()
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		pos[i].clear();
+		r[i].clear();
+		for(int j = 0; j < 3; ++j)
+			axis[i][j].clear();
+	}
+}
+
+void OBBArray::Reserve(int numOBBs)
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		pos[i].reserve(numOBBs);
+		r[i].reserve(numOBBs);
+		for(int j = 0; j < 3; ++j)
+			axis[i][j].reserve(numOBBs);
+	}
+}
+
+void OBBArray::Add(const OBB &obb)
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		pos[i].push_back(obb.pos[i]);
+		r[i].push_back(obb.r[i]);
+		for(int j = 0; j < 3; ++j)
+			axis[i][j].push_back(obb.axis[i][j]);
+	}
+}
+
+void OBBArray::Set(const OBB *obbs, int numOBBs)
+{
+	assume(obbs || numOBBs == 0);
+	for(int i = 0; i < 3; ++i)
+	{
+		pos[i].resize(numOBBs);
+		r[i].resize(numOBBs);
+		for(int j = 0; j < 3; ++j)
+			axis[i][j].resize(numOBBs);
+	}
+	for(int i = 0; i < numOBBs; ++i)
+		Set(i, obbs[i]);
+}
+
+void OBBArray::Set(int index, const OBB &obb)
+{
+	assume1(index >= 0 && index < Size(), index);
+	for(int i = 0; i < 3; ++i)
+	{
+		pos[i][index] = obb.pos[i];
+		r[i][index] = obb.r[i];
+		for(int j = 0; j < 3; ++j)
+			axis[i][j][index] = obb.axis[i][j];
+	}
+}
+
+OBB OBBArray::Get(int index) const
+{
+	assume1(index >= 0 && index < Size(), index);
+	OBB obb;
+	obb.pos = POINT_VEC(pos[0][index], pos[1][index], pos[2][index]);
+	obb.r = DIR_VEC(r[0][index], r[1][index], r[2][index]);
+	for(int i = 0; i < 3; ++i)
+		obb.axis[i] = DIR_VEC(axis[i][0][index], axis[i][1][index], axis[i][2][index]);
+	return obb;
+}
+
+// The pairwise test kernels below process blocks of 4 (SSE) or 8 (AVX) pairs, one pair per lane, loading each scalar
+// directly from its aligned stream. They OR the result bits of the pairs into the output mask, which the caller has
+// cleared, and return the number of pairs they processed. The caller handles the remaining tail pairs with scalar code
+// that performs the same floating point operations in the same order, so that all code paths give identical results.
+typedef int (*PairwiseIntersectsOBBFunc)(const OBBArray &a, const OBBArray &b, float epsilon, u32 *outMask);
+typedef int (*PairwiseIntersectsSphereFunc)(const OBBArray &a, const Sphere *spheres, u32 *outMask);
+
+// The separating axis test of two OBBs, following Christer Ericson's Real-Time Collision Detection, p. 103-105, as in
+// OBB::Intersects(const OBB &, float).
+static bool PairIntersectsOBB(const OBBArray &a, const OBBArray &b, int index, float epsilon)
+{
+	float aAxis[3][3], bAxis[3][3], ar[3], br[3], d[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		ar[i] = a.HalfSize(i)[index];
+		br[i] = b.HalfSize(i)[index];
+		d[i] = b.Pos(i)[index] - a.Pos(i)[index];
+		for(int j = 0; j < 3; ++j)
+		{
+			aAxis[i][j] = a.Axis(i, j)[index];
+			bAxis[i][j] = b.Axis(i, j)[index];
+		}
+	}
+
+	// Express b and the translation vector in a's coordinate frame.
+	float R[3][3], AbsR[3][3], t[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		t[i] = d[0] * aAxis[i][0] + d[1] * aAxis[i][1] + d[2] * aAxis[i][2];
+		for(int j = 0; j < 3; ++j)
+		{
+			R[i][j] = aAxis[i][0] * bAxis[j][0] + aAxis[i][1] * bAxis[j][1] + aAxis[i][2] * bAxis[j][2];
+			AbsR[i][j] = Abs(R[i][j]) + epsilon;
+		}
+	}
+
+	// Test the three major axes of a and of b.
+	for(int i = 0; i < 3; ++i)
+		if (Abs(t[i]) > ar[i] + (br[0] * AbsR[i][0] + br[1] * AbsR[i][1] + br[2] * AbsR[i][2]))
+			return false;
+	for(int i = 0; i < 3; ++i)
+		if (Abs(t[0] * R[0][i] + t[1] * R[1][i] + t[2] * R[2][i]) > (ar[0] * AbsR[0][i] + ar[1] * AbsR[1][i] + ar[2] * AbsR[2][i]) + br[i])
+			return false;
+
+	// Test the 9 cross-axes A[i] x B[j].
+	for(int i = 0; i < 3; ++i)
+	{
+		const int i1 = (i+1) % 3, i2 = (i+2) % 3;
+		for(int j = 0; j < 3; ++j)
+		{
+			const int j1 = (j+1) % 3, j2 = (j+2) % 3;
+			float ra = ar[i1] * AbsR[i2][j] + ar[i2] * AbsR[i1][j];
+			float rb = br[j1] * AbsR[i][j2] + br[j2] * AbsR[i][j1];
+			if (Abs(t[i2] * R[i1][j] - t[i1] * R[i2][j]) > ra + rb)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Tests the OBB against the sphere by computing the squared distance from the sphere center to the OBB in the local
+// coordinate frame of the OBB. For an orthonormal basis, this equals the distance to the closest point of the OBB that
+// OBB::Intersects(const Sphere &) uses.
+static bool PairIntersectsSphere(const OBBArray &a, const Sphere &sphere, int index)
+{
+	float d[3];
+	for(int i = 0; i < 3; ++i)
+		d[i] = sphere.pos[i] - a.Pos(i)[index];
+	float distSq = 0.f;
+	for(int i = 0; i < 3; ++i)
+	{
+		float proj = d[0] * a.Axis(i, 0)[index] + d[1] * a.Axis(i, 1)[index] + d[2] * a.Axis(i, 2)[index];
+		float r = a.HalfSize(i)[index];
+		float excess = proj - Max(Min(proj, r), -r);
+		distSq += excess * excess;
+	}
+	return distSq <= sphere.r * sphere.r;
+}
+
+#ifdef MATH_SSE2_KERNELS
+MATH_TARGET_SSE2 static int PairwiseIntersectsOBB_SSE2(const OBBArray &a, const OBBArray &b, float epsilon, u32 *outMask)
+{
+	const __m128 eps = _mm_set1_ps(epsilon);
+	const __m128 signMask = _mm_set1_ps(-0.f);
+
+	const int numBatched = a.Size() & ~3;
+	for(int k = 0; k < numBatched; k += 4)
+	{
+		__m128 aAxis[3][3], bAxis[3][3], ar[3], br[3], d[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			ar[i] = _mm_load_ps(a.HalfSize(i) + k);
+			br[i] = _mm_load_ps(b.HalfSize(i) + k);
+			d[i] = _mm_sub_ps(_mm_load_ps(b.Pos(i) + k), _mm_load_ps(a.Pos(i) + k));
+			for(int j = 0; j < 3; ++j)
+			{
+				aAxis[i][j] = _mm_load_ps(a.Axis(i, j) + k);
+				bAxis[i][j] = _mm_load_ps(b.Axis(i, j) + k);
+			}
+		}
+
+		__m128 R[3][3], AbsR[3][3], t[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			t[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], aAxis[i][0]), _mm_mul_ps(d[1], aAxis[i][1])), _mm_mul_ps(d[2], aAxis[i][2]));
+			for(int j = 0; j < 3; ++j)
+			{
+				R[i][j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aAxis[i][0], bAxis[j][0]), _mm_mul_ps(aAxis[i][1], bAxis[j][1])), _mm_mul_ps(aAxis[i][2], bAxis[j][2]));
+				AbsR[i][j] = _mm_add_ps(_mm_andnot_ps(signMask, R[i][j]), eps);
+			}
+		}
+
+		__m128 separated = _mm_setzero_ps();
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m128 rb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(br[0], AbsR[i][0]), _mm_mul_ps(br[1], AbsR[i][1])), _mm_mul_ps(br[2], AbsR[i][2]));
+			separated = _mm_or_ps(separated, _mm_cmpgt_ps(_mm_andnot_ps(signMask, t[i]), _mm_add_ps(ar[i], rb)));
+		}
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m128 ra = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ar[0], AbsR[0][i]), _mm_mul_ps(ar[1], AbsR[1][i])), _mm_mul_ps(ar[2], AbsR[2][i]));
+			const __m128 lhs = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t[0], R[0][i]), _mm_mul_ps(t[1], R[1][i])), _mm_mul_ps(t[2], R[2][i]));
+			separated = _mm_or_ps(separated, _mm_cmpgt_ps(_mm_andnot_ps(signMask, lhs), _mm_add_ps(ra, br[i])));
+		}
+
+		// Most broadphase pairs are separated along one of the face axes, so skip the cross-axes if all lanes are done.
+		if (_mm_movemask_ps(separated) != 0xF)
+			for(int i = 0; i < 3; ++i)
+			{
+				const int i1 = (i+1) % 3, i2 = (i+2) % 3;
+				for(int j = 0; j < 3; ++j)
+				{
+					const int j1 = (j+1) % 3, j2 = (j+2) % 3;
+					const __m128 ra = _mm_add_ps(_mm_mul_ps(ar[i1], AbsR[i2][j]), _mm_mul_ps(ar[i2], AbsR[i1][j]));
+					const __m128 rb = _mm_add_ps(_mm_mul_ps(br[j1], AbsR[i][j2]), _mm_mul_ps(br[j2], AbsR[i][j1]));
+					const __m128 lhs = _mm_sub_ps(_mm_mul_ps(t[i2], R[i1][j]), _mm_mul_ps(t[i1], R[i2][j]));
+					separated = _mm_or_ps(separated, _mm_cmpgt_ps(_mm_andnot_ps(signMask, lhs), _mm_add_ps(ra, rb)));
+				}
+			}
+		outMask[k >> 5] |= (u32)(~_mm_movemask_ps(separated) & 0xF) << (k & 31);
+	}
+	return numBatched;
+}
+
+MATH_TARGET_SSE2 static int PairwiseIntersectsSphere_SSE2(const OBBArray &a, const Sphere *spheres, u32 *outMask)
+{
+	const __m128 signMask = _mm_set1_ps(-0.f);
+
+	const int numBatched = a.Size() & ~3;
+	for(int k = 0; k < numBatched; k += 4)
+	{
+		const Sphere *s = spheres + k;
+		__m128 d[3];
+		for(int i = 0; i < 3; ++i)
+			d[i] = _mm_sub_ps(_mm_setr_ps(s[0].pos[i], s[1].pos[i], s[2].pos[i], s[3].pos[i]), _mm_load_ps(a.Pos(i) + k));
+		const __m128 r = _mm_setr_ps(s[0].r, s[1].r, s[2].r, s[3].r);
+
+		__m128 distSq = _mm_setzero_ps();
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m128 proj = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], _mm_load_ps(a.Axis(i, 0) + k)), _mm_mul_ps(d[1], _mm_load_ps(a.Axis(i, 1) + k))),
+				_mm_mul_ps(d[2], _mm_load_ps(a.Axis(i, 2) + k)));
+			const __m128 halfSize = _mm_load_ps(a.HalfSize(i) + k);
+			const __m128 excess = _mm_sub_ps(proj, _mm_max_ps(_mm_min_ps(proj, halfSize), _mm_xor_ps(halfSize, signMask)));
+			distSq = _mm_add_ps(distSq, _mm_mul_ps(excess, excess));
+		}
+		outMask[k >> 5] |= (u32)_mm_movemask_ps(_mm_cmple_ps(distSq, _mm_mul_ps(r, r))) << (k & 31);
+	}
+	return numBatched;
+}
+#endif
+
+#ifdef MATH_AVX_KERNELS
+MATH_TARGET_AVX static int PairwiseIntersectsOBB_AVX(const OBBArray &a, const OBBArray &b, float epsilon, u32 *outMask)
+{
+	const __m256 eps = _mm256_set1_ps(epsilon);
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+
+	const int numBatched = a.Size() & ~7;
+	for(int k = 0; k < numBatched; k += 8)
+	{
+		__m256 aAxis[3][3], bAxis[3][3], ar[3], br[3], d[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			ar[i] = _mm256_load_ps(a.HalfSize(i) + k);
+			br[i] = _mm256_load_ps(b.HalfSize(i) + k);
+			d[i] = _mm256_sub_ps(_mm256_load_ps(b.Pos(i) + k), _mm256_load_ps(a.Pos(i) + k));
+			for(int j = 0; j < 3; ++j)
+			{
+				aAxis[i][j] = _mm256_load_ps(a.Axis(i, j) + k);
+				bAxis[i][j] = _mm256_load_ps(b.Axis(i, j) + k);
+			}
+		}
+
+		__m256 R[3][3], AbsR[3][3], t[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			t[i] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], aAxis[i][0]), _mm256_mul_ps(d[1], aAxis[i][1])), _mm256_mul_ps(d[2], aAxis[i][2]));
+			for(int j = 0; j < 3; ++j)
+			{
+				R[i][j] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(aAxis[i][0], bAxis[j][0]), _mm256_mul_ps(aAxis[i][1], bAxis[j][1])), _mm256_mul_ps(aAxis[i][2], bAxis[j][2]));
+				AbsR[i][j] = _mm256_add_ps(_mm256_andnot_ps(signMask, R[i][j]), eps);
+			}
+		}
+
+		__m256 separated = _mm256_setzero_ps();
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m256 rb = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(br[0], AbsR[i][0]), _mm256_mul_ps(br[1], AbsR[i][1])), _mm256_mul_ps(br[2], AbsR[i][2]));
+			separated = _mm256_or_ps(separated, _mm256_cmp_ps(_mm256_andnot_ps(signMask, t[i]), _mm256_add_ps(ar[i], rb), _CMP_GT_OQ));
+		}
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m256 ra = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ar[0], AbsR[0][i]), _mm256_mul_ps(ar[1], AbsR[1][i])), _mm256_mul_ps(ar[2], AbsR[2][i]));
+			const __m256 lhs = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(t[0], R[0][i]), _mm256_mul_ps(t[1], R[1][i])), _mm256_mul_ps(t[2], R[2][i]));
+			separated = _mm256_or_ps(separated, _mm256_cmp_ps(_mm256_andnot_ps(signMask, lhs), _mm256_add_ps(ra, br[i]), _CMP_GT_OQ));
+		}
+
+		if (_mm256_movemask_ps(separated) != 0xFF)
+			for(int i = 0; i < 3; ++i)
+			{
+				const int i1 = (i+1) % 3, i2 = (i+2) % 3;
+				for(int j = 0; j < 3; ++j)
+				{
+					const int j1 = (j+1) % 3, j2 = (j+2) % 3;
+					const __m256 ra = _mm256_add_ps(_mm256_mul_ps(ar[i1], AbsR[i2][j]), _mm256_mul_ps(ar[i2], AbsR[i1][j]));
+					const __m256 rb = _mm256_add_ps(_mm256_mul_ps(br[j1], AbsR[i][j2]), _mm256_mul_ps(br[j2], AbsR[i][j1]));
+					const __m256 lhs = _mm256_sub_ps(_mm256_mul_ps(t[i2], R[i1][j]), _mm256_mul_ps(t[i1], R[i2][j]));
+					separated = _mm256_or_ps(separated, _mm256_cmp_ps(_mm256_andnot_ps(signMask, lhs), _mm256_add_ps(ra, rb), _CMP_GT_OQ));
+				}
+			}
+		outMask[k >> 5] |= (u32)(~_mm256_movemask_ps(separated) & 0xFF) << (k & 31);
+	}
+	return numBatched;
+}
+
+MATH_TARGET_AVX static int PairwiseIntersectsSphere_AVX(const OBBArray &a, const Sphere *spheres, u32 *outMask)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+
+	const int numBatched = a.Size() & ~7;
+	for(int k = 0; k < numBatched; k += 8)
+	{
+		const Sphere *s = spheres + k;
+		__m256 d[3];
+		for(int i = 0; i < 3; ++i)
+			d[i] = _mm256_sub_ps(_mm256_setr_ps(s[0].pos[i], s[1].pos[i], s[2].pos[i], s[3].pos[i], s[4].pos[i], s[5].pos[i], s[6].pos[i], s[7].pos[i]),
+				_mm256_load_ps(a.Pos(i) + k));
+		const __m256 r = _mm256_setr_ps(s[0].r, s[1].r, s[2].r, s[3].r, s[4].r, s[5].r, s[6].r, s[7].r);
+
+		__m256 distSq = _mm256_setzero_ps();
+		for(int i = 0; i < 3; ++i)
+		{
+			const __m256 proj = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], _mm256_load_ps(a.Axis(i, 0) + k)), _mm256_mul_ps(d[1], _mm256_load_ps(a.Axis(i, 1) + k))),
+				_mm256_mul_ps(d[2], _mm256_load_ps(a.Axis(i, 2) + k)));
+			const __m256 halfSize = _mm256_load_ps(a.HalfSize(i) + k);
+			const __m256 excess = _mm256_sub_ps(proj, _mm256_max_ps(_mm256_min_ps(proj, halfSize), _mm256_xor_ps(halfSize, signMask)));
+			distSq = _mm256_add_ps(distSq, _mm256_mul_ps(excess, excess));
+		}
+		outMask[k >> 5] |= (u32)_mm256_movemask_ps(_mm256_cmp_ps(distSq, _mm256_mul_ps(r, r), _CMP_LE_OQ)) << (k & 31);
+	}
+	return numBatched;
+}
+#endif
+
+static int PairwiseIntersectsOBB_None(const OBBArray &, const OBBArray &, float, u32 *) { return 0; }
+static int PairwiseIntersectsSphere_None(const OBBArray &, const Sphere *, u32 *) { return 0; }
+
+static PairwiseIntersectsOBBFunc SelectPairwiseIntersectsOBBKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &PairwiseIntersectsOBB_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &PairwiseIntersectsOBB_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &PairwiseIntersectsOBB_None;
+}
+
+static PairwiseIntersectsSphereFunc SelectPairwiseIntersectsSphereKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &PairwiseIntersectsSphere_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &PairwiseIntersectsSphere_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &PairwiseIntersectsSphere_None;
+}
+
+// Clears the result mask, and returns the number of u32 elements in it.
+static int ClearMask(u32 *outMask, int numPairs)
+{
+	const int numWords = (numPairs + 31) / 32;
+	for(int i = 0; i < numWords; ++i)
+		outMask[i] = 0;
+	return numWords;
+}
+
+static int CountMask(const u32 *mask, int numWords)
+{
+	int numSet = 0;
+	for(int i = 0; i < numWords; ++i)
+		numSet += CountBitsSet(mask[i]);
+	return numSet;
+}
+
+int OBBArray::PairwiseIntersects(const OBBArray &other, u32 *outMask, float epsilon) const
+{
+	assume2(other.Size() == Size(), other.Size(), Size());
+	assume(outMask || IsEmpty());
+	if (IsEmpty() || other.Size() != Size())
+		return 0;
+	static const PairwiseIntersectsOBBFunc kernel = SelectPairwiseIntersectsOBBKernel();
+
+	const int numWords = ClearMask(outMask, Size());
+	for(int i = kernel(*this, other, epsilon, outMask); i < Size(); ++i)
+		if (PairIntersectsOBB(*this, other, i, epsilon))
+			outMask[i >> 5] |= 1u << (i & 31);
+	return CountMask(outMask, numWords);
+}
+
+int OBBArray::PairwiseIntersects(const Sphere *spheres, u32 *outMask) const
+{
+	assume(spheres || IsEmpty());
+	assume(outMask || IsEmpty());
+	if (IsEmpty())
+		return 0;
+	static const PairwiseIntersectsSphereFunc kernel = SelectPairwiseIntersectsSphereKernel();
+
+	const int numWords = ClearMask(outMask, Size());
+	for(int i = kernel(*this, spheres, outMask); i < Size(); ++i)
+		if (PairIntersectsSphere(*this, spheres[i], i))
+			outMask[i >> 5] |= 1u << (i & 31);
+	return CountMask(outMask, numWords);
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,100 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file OBBArray.h
+	@author Jukka Jylnki
+	@brief A structure-of-arrays container of oriented bounding boxes, with batched pairwise narrowphase tests. */
+#pragma once
+
+#include "../MathGeoLibFwd.h"
+#include "../Math/SSEMath.h"
+#include "OBB.h"
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// Stores an array of oriented bounding boxes in structure-of-arrays (SoA) form.
+/** Each of the 15 scalars that define an OBB (the center point, the half-sizes and the three axis vectors) is stored in
+	its own contiguous stream, aligned to 32 bytes. This allows running the narrowphase tests for 4 (SSE) or 8 (AVX)
+	pairs of objects at a time, one pair per SIMD lane, without any shuffling.
+
+	The intended use is to test the list of potentially colliding pairs produced by a broadphase: the first objects of
+	the pairs are added to one OBBArray, and the second objects to another one (or to an array of Spheres), so that the
+	objects with the same index form a pair. The batched tests then write one result bit per pair. The SIMD code path is
+	chosen at runtime through ActiveSIMDCapability(). */
+class OBBArray
+{
+public:
+	typedef std::vector<float, AlignedAllocator<float, 32> > FloatStream;
+
+	/// Constructs an empty array.
+	OBBArray() {}
+
+	/// Constructs an array from the given OBBs.
+	/** @see Set(). */
+	OBBArray(const OBB *obbs, int numOBBs);
+
+	/// Returns the number of boxes in this array.
+	int Size() const { return (int)pos[0].size(); }
+	/// Returns true if this array contains no boxes.
+	bool IsEmpty() const { return pos[0].empty(); }
+
+	/// Removes all boxes from this array.
+	void Clear();
+	/// Preallocates memory for the given number of boxes.
+	void Reserve(int numOBBs);
+
+	/// Appends the given OBB to the end of this array.
+	void Add(const OBB &obb);
+	/// Replaces the contents of this array with the given OBBs.
+	/** This transposes the given array of OBBs into SoA form. */
+	void Set(const OBB *obbs, int numOBBs);
+	/// Overwrites the box at the given index.
+	void Set(int index, const OBB &obb);
+	/// Returns the box at the given index as an OBB.
+	OBB Get(int index) const;
+
+	/// Returns the start of the stream of the given coordinate (0=x, 1=y, 2=z) of the box centers.
+	/** The returned pointers are aligned to 32 bytes, and remain valid until the size of this array is next changed.
+		[similarOverload: Pos] */
+	const float *Pos(int coord) const { return pos[coord].empty() ? 0 : &pos[coord][0]; }
+	/// Returns the start of the stream of the half-sizes of the boxes along their given local axis.
+	const float *HalfSize(int axisIndex) const { return r[axisIndex].empty() ? 0 : &r[axisIndex][0]; }
+	/// Returns the start of the stream of the given coordinate of the given local axis of the boxes.
+	const float *Axis(int axisIndex, int coord) const { return axis[axisIndex][coord].empty() ? 0 : &axis[axisIndex][coord][0]; }
+
+	/// Tests the pairs of boxes with the same index in this array and in the given array for intersection.
+	/** This is a batched version of calling Get(i).Intersects(other.Get(i), epsilon) for each index i. The test is the
+		separating axis test of OBB::Intersects(const OBB &, float), which tests the 15 potentially separating axes of each pair.
+		@param other The second boxes of the pairs. This must have the same size as this array.
+		@param outMask [out] Receives one bit per pair, which is set if the pair intersects. The result of the pair i is stored
+			in the bit (i % 32) of the element outMask[i / 32]. This array must have room for (Size() + 31) / 32 elements.
+		@return The number of intersecting pairs.
+		@see OBB::Intersects(), PairwiseIntersects(const Sphere *, u32 *). */
+	int PairwiseIntersects(const OBBArray &other, u32 *outMask, float epsilon = 1e-3f) const;
+
+	/// Tests the pairs formed by the boxes in this array and the spheres with the same index for intersection.
+	/** This is a batched version of calling Get(i).Intersects(spheres[i]) for each index i.
+		@param spheres An array of Size() spheres, which are the second objects of the pairs.
+		@param outMask [out] Receives one bit per pair, in the same format as in PairwiseIntersects(const OBBArray &, u32 *, float).
+		@return The number of intersecting pairs. */
+	int PairwiseIntersects(const Sphere *spheres, u32 *outMask) const;
+
+private:
+	FloatStream pos[3];
+	FloatStream r[3];
+	FloatStream axis[3][3];
+};
+
+MATH_END_NAMESPACE
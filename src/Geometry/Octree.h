@@ -0,0 +1,265 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file Octree.h
+	@author Jukka Jylnki
+	@brief An Octree spatial query acceleration structure for dynamic data. */
+#pragma once
+
+#ifdef MATH_GRAPHICSENGINE_INTEROP
+#include "Time/Profiler.h"
+#else
+#define MGL_PROFILE(x)
+#endif
+#include "../Math/float3.h"
+#include "AABB.h"
+#include "../Math/MathTypes.h"
+#include "../Math/myassert.h"
+#include "../Algorithm/ChunkedNodeArray.h"
+#include <vector>
+#include <queue>
+
+MATH_BEGIN_NAMESPACE
+
+/// A fixed split rule for all Octrees: An Octree leaf node is only ever split if the leaf contains at least this many objects.
+/// Leaves containing fewer than this many objects are always kept as leaves until the object count is exceeded.
+static const int minOctreeNodeObjectCount = 16;
+
+/// A fixed split limit rule for all Octrees: If the Octree node side length is smaller than this, the node will
+/// never be split again into smaller subnodes. This provides a hard limit safety net for infinite/extra long recursion
+/// in case multiple identical overlapping objects are placed into the tree.
+static const float minOctreeOctantSize = 0.05f;
+
+/// An Octree for storing dynamic objects with 3D extents. This is the 3D counterpart of QuadTree<T>.
+/** To store objects of type T in an Octree, the following free functions must be defined for T:
+	@code
+	float MinX(const T &object); float MaxX(const T &object); // And similarly MinY, MaxY, MinZ and MaxZ.
+	void AssociateOctreeNode(const T &object, Octree<T>::Node *node);
+	Octree<T>::Node *GetOctreeNode(const T &object); // Only required by Remove() and Update().
+	@endcode
+
+	Like QuadTree<T>, the tree can be made loose by specifying a looseness factor greater than one. In a loose Octree,
+	the bounds of each node are expanded by the looseness factor around the node center. An object is placed into
+	the node that contains its center, down to the deepest node whose loose bounds still contain the whole object.
+	Moving objects should be updated with Update(), which only relinks the object in the tree when it has left the
+	loose bounds of its current node. */
+template<typename T>
+class Octree
+{
+public:
+	/// @note For space compactness, an Octree node does not store its own AABB extents.
+	struct Node
+	{
+		/// If 0, this node is the root.
+		Node *parent;
+		/// Indicates the first of the eight consecutive child nodes of this node, or 0xFFFFFFFF if this node is a leaf.
+		/// The child at childIndex+i lies on the positive side of the center along the X axis if bit 0 of i is set,
+		/// along the Y axis if bit 1 is set, and along the Z axis if bit 2 is set.
+		u32 childIndex;
+		/// Stores the actual objects in this node/leaf.
+		std::vector<T> objects;
+
+		vec center;
+		vec radius;
+
+		bool IsLeaf() const { return childIndex == 0xFFFFFFFF; }
+
+		u32 ChildIndex(int octant) const { return childIndex + octant; }
+
+		/// This assumes that the Octree contains unique objects and never duplicates.
+		void Remove(const T &object)
+		{
+			for(size_t i = 0; i < objects.size(); ++i)
+				if (objects[i] == object)
+				{
+					AssociateOctreeNode(object, 0); // Mark in the object that it has been removed from the octree.
+					std::swap(objects[i], objects.back());
+					objects.pop_back();
+					return;
+				}
+		}
+
+		AABB ComputeAABB() const
+		{
+			return AABB(center - radius, center + radius);
+		}
+	};
+
+	/// Helper struct used when traversing through the tree.
+	struct TraversalStackItem
+	{
+		Node *node;
+	};
+
+	/// @param looseness_ The factor by which the bounds of each node are scaled for object placement. This must be
+	///	at least 1. A value of 1 creates a regular (non-loose) Octree. A value of 2 is a common choice for a loose tree.
+	explicit Octree(float looseness_ = 1.f)
+	:rootNodeIndex(-1),
+	boundingAABB(POINT_VEC_SCALAR(0.f), POINT_VEC_SCALAR(1.f)),
+	looseness(looseness_)
+	{
+		assert(looseness >= 1.f);
+	}
+
+	/// Removes all nodes and objects in this tree and reinitializes the tree to a single root node.
+	void Clear(const vec &minPoint = POINT_VEC_SCALAR(-1.f), const vec &maxPoint = POINT_VEC_SCALAR(1.f));
+
+	/// Places the given object into the proper (leaf) node of the tree. After placing, if the leaf split rule is
+	/// satisfied, subdivides the leaf node into 8 suboctants and reassigns the objects to new leaves.
+	void Add(const T &object);
+
+	/// Removes the given object from this tree.
+	/// To call this function, you must define a function Octree<T>::Node *GetOctreeNode(const T &object)
+	/// which returns the node of this octree where the object resides in.
+	void Remove(const T &object);
+
+	/// Updates the location of the given object in this tree after the object has moved or changed size.
+	/** If the object is still contained in the loose bounds of its current node, this function does nothing. Otherwise
+		the object is removed and added back to the tree. If the object is not in the tree, it is added.
+		This function requires the same GetOctreeNode() function as Remove(). */
+	void Update(const T &object);
+
+	/// @return The bounding box for the whole tree.
+	/// @note This bounding box does not tightly bound the objects themselves, only the root node of the tree.
+	AABB BoundingAABB() const { return boundingAABB; }
+
+	/// @return The looseness factor this tree was created with.
+	float Looseness() const { return looseness; }
+
+	/// @return The loose bounds of the given node, which contain all the objects stored in that node.
+	/// For a tree with looseness 1, this is the same as node->ComputeAABB().
+	AABB LooseAABB(const Node *node) const { return AABB(node->center - node->radius * looseness, node->center + node->radius * looseness); }
+
+	/// @return The topmost node in the tree.
+	Node *Root();
+	const Node *Root() const;
+
+	/// Returns the total number of nodes (all nodes, i.e. inner nodes + leaves) in the tree.
+	/// Runs in constant time.
+	int NumNodes() const;
+
+	/// Returns the total number of leaf nodes in the tree.
+	/// @warning Runs in time linear 'O(n)' to the number of nodes in the tree.
+	int NumLeaves() const;
+
+	/// Returns the total number of inner nodes in the tree.
+	/// @warning Runs in time linear 'O(n)' to the number of nodes in the tree.
+	int NumInnerNodes() const;
+
+	/// Returns the total number of objects stored in the tree.
+	/// @warning Runs in time linear 'O(n)' to the number of nodes in the tree.
+	int NumObjects() const;
+
+	/// Returns the maximum height of the whole tree (the path from the root to the farthest leaf node).
+	int TreeHeight() const;
+
+	/// Returns the height of the subtree rooted at 'node'.
+	int TreeHeight(const Node *node) const;
+
+	/// Performs an AABB intersection query in this Octree, and calls the given callback function for each non-empty
+	/// node of the tree which intersects the given AABB.
+	/** @param aabb The axis-aligned bounding box to intersect this Octree with.
+		@param callback A function or a function object of prototype
+			bool callbackFunction(Octree<T> &tree, const AABB &queryAABB, Octree<T>::Node &node);
+		If the callback function returns true, the execution of the query is stopped and this function immediately
+		returns afterwards. If the callback function returns false, the execution of the query continues. */
+	template<typename Func>
+	inline void AABBQuery(const AABB &aabb, Func &callback);
+
+	/// Finds all object pairs inside the given AABB which have colliding AABBs. For each such pair, calls the
+	/// specified callback function.
+	/** @param callback A function or a function object of prototype
+			void callbackFunction(const T &objectA, const T &objectB);
+		In a loose tree, the callback is called exactly once for each colliding pair in which at least one of the
+		objects intersects the given AABB. */
+	template<typename Func>
+	inline void CollidingPairsQuery(const AABB &aabb, Func &callback);
+
+	/// Performs a node-granular nearest neighbor search on this Octree.
+	/** This query calls the given nodeCallback function for each node of this Octree that contains objects, sorted by closest first
+		to the target point. At any given time, the nodeCallback function may terminate the search by returning true in its callback.
+		@param point The target point to find the nearest nodes to.
+		@param nodeCallback A function or a function object of prototype
+		   bool NodeCallbackFunction(Octree<T> &tree, const vec &targetPoint, Octree<T>::Node &node, float minDistanceSquared);
+		   If the callback function returns true, the execution of the query is immediately stopped.
+		   If the callback function returns false, the execution of the query continues.
+		   tree points to this Octree, in which the query is being performed.
+		   targetPoint is the point passed in the function call to NearestNeighborNodes.
+		   node points to the Octree node that is being traversed.
+		   minDistanceSquared is the squared minimum distance the objects in this node (and all future nodes to be passed to the
+		   callback) have to the point that is being queried. */
+	template<typename Func>
+	inline void NearestNeighborNodes(const vec &point, Func &nodeCallback);
+
+	/// Performs an object-granular nearest neighbor search on this Octree.
+	/** This query calls the given objectCallback function for each object in this Octree, starting from the object closest to the
+		given target point, and proceeding in distance-sorted order. The distance to an object is measured to the box given by
+		the MinX()-MaxZ() functions of the object.
+		@param targetPoint The target point to find the nearest neighbors to.
+		@param objectCallback The function object that should be invoked by the query for each object. This function should be of prototype
+		   bool NearestNeighborObjectCallback(Octree<T> &tree, const vec &targetPoint, Octree<T>::Node *node,
+		                                      float distanceSquared, const T &nearestNeighborObject, int nearestNeighborIndex);
+		   If this function returns true, the execution of the query is immediately stopped.
+		   If the callback function returns false, the execution of the query continues.
+		   tree points to this Octree, in which the query is being performed.
+		   targetPoint is the point passed in the function call to NearestNeighborObjects.
+		   node points to the Octree node where nearestNeighborObject resides in.
+		   distanceSquared is the squared distance between targetPoint and nearestNeighborObject.
+		   nearestNeighborObject gives the next closest object to targetPoint.
+		   nearestNeighborIndex provides a conveniency counter that tells how many nearest neighbors are closer to targetPoint than this object. */
+	template<typename Func>
+	inline void NearestNeighborObjects(const vec &targetPoint, Func &objectCallback);
+
+	/// Performs various consistency checks on the given node. Use only for debugging purposes.
+	void DebugSanityCheckNode(Node *n);
+
+	/// Returns the bounding box of the given object, as given by its MinX()-MaxZ() functions.
+	static AABB ObjectAABB(const T &object)
+	{
+		return AABB(POINT_VEC(MinX(object), MinY(object), MinZ(object)), POINT_VEC(MaxX(object), MaxY(object), MaxZ(object)));
+	}
+
+private:
+	void Add(const T &object, Node *n);
+
+	/// Allocates a sequential 8-tuple of Octree nodes, contiguous in memory.
+	int AllocateNodeGroup(Node *parent);
+
+	void SplitLeaf(Node *leaf);
+
+	/// Returns the index (0-7) of the child octant of n that the given object should be placed into, or -1 if the
+	/// object does not fit inside the loose bounds of any of the child octants and must be stored in n itself.
+	int ChildOctantForObject(const Node *n, const T &object) const;
+
+	/// Pushes the child nodes of n whose loose bounds may intersect the given AABB onto the traversal stack.
+	void PushIntersectingChildren(const Node *n, const AABB &aabb, std::vector<TraversalStackItem> &stack);
+
+	/// Implements CollidingPairsQuery() for a loose tree, where colliding objects can reside in sibling subtrees.
+	template<typename Func>
+	inline void LooseCollidingPairsQuery(const AABB &aabb, Func &callback);
+
+	ChunkedNodeArray<Node> nodes;
+
+	/// Specifies the index to the root node, or -1 if there is no root (nodes.size() == 0).
+	int rootNodeIndex;
+	AABB boundingAABB;
+	float looseness;
+
+	/// Doubles the size of the root node, so that the old root becomes the child octant octantForRoot of the new root.
+	void GrowRoot(int octantForRoot);
+};
+
+MATH_END_NAMESPACE
+
+#include "Octree.inl"
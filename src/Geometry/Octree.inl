@@ -0,0 +1,657 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file Octree.inl
+	@author Jukka Jylnki
+	@brief Implementation for the Octree object. */
+#pragma once
+
+#include "../Math/MathFunc.h"
+#include <functional>
+
+MATH_BEGIN_NAMESPACE
+
+template<typename T>
+void Octree<T>::Clear(const vec &minPoint, const vec &maxPoint)
+{
+	nodes.clear();
+
+	boundingAABB.minPoint = minPoint;
+	boundingAABB.maxPoint = maxPoint;
+
+	assert(!boundingAABB.IsDegenerate());
+
+	rootNodeIndex = AllocateNodeGroup(0);
+	assert(Root());
+	Node *root = Root();
+	root->center = (minPoint + maxPoint) * 0.5f;
+	root->radius = maxPoint - root->center;
+}
+
+template<typename T>
+void Octree<T>::Add(const T &object)
+{
+	MGL_PROFILE(Octree_Add);
+	assert(Root() && "Error: Octree has not been initialized with a root node! Call Octree::Clear() to initialize the root node.");
+
+	assert(boundingAABB.IsFinite());
+	assert(!boundingAABB.IsDegenerate());
+
+	AABB objectAABB = ObjectAABB(object);
+	assert(objectAABB.IsFinite());
+	assert(!objectAABB.HasNegativeVolume());
+
+	// Grow the root until the object fits inside the root node.
+	while(!boundingAABB.Contains(objectAABB))
+	{
+		// On each axis, grow towards the side the object lies on. The old root ends up on the opposite side.
+		int octantForRoot = 0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float size = boundingAABB.maxPoint[axis] - boundingAABB.minPoint[axis];
+			if (objectAABB.minPoint[axis] < boundingAABB.minPoint[axis])
+			{
+				boundingAABB.minPoint[axis] -= size;
+				octantForRoot |= 1 << axis;
+			}
+			else
+				boundingAABB.maxPoint[axis] += size;
+		}
+		GrowRoot(octantForRoot);
+	}
+
+	Add(object, Root());
+}
+
+template<typename T>
+void Octree<T>::Remove(const T &object)
+{
+	Node *n = GetOctreeNode(object);
+	if (n)
+		n->Remove(object);
+}
+
+template<typename T>
+void Octree<T>::Update(const T &object)
+{
+	MGL_PROFILE(Octree_Update);
+	Node *n = GetOctreeNode(object);
+	// Fast path: As long as the object stays inside the loose bounds of its node, all queries still find it there.
+	if (n && LooseAABB(n).Contains(ObjectAABB(object)))
+		return;
+	Remove(object);
+	Add(object);
+}
+
+template<typename T>
+int Octree<T>::ChildOctantForObject(const Node *n, const T &object) const
+{
+	assert(MinX(object) <= MaxX(object));
+	assert(MinY(object) <= MaxY(object));
+	assert(MinZ(object) <= MaxZ(object));
+
+	// Pick the child octant that contains the center point of the object.
+	const vec childRadius = n->radius * 0.5f;
+	vec childCenter = n->center - childRadius;
+	int octant = 0;
+	if (MinX(object) + MaxX(object) >= 2.f * n->center.x)
+	{
+		octant += 1;
+		childCenter.x = n->center.x + childRadius.x;
+	}
+	if (MinY(object) + MaxY(object) >= 2.f * n->center.y)
+	{
+		octant += 2;
+		childCenter.y = n->center.y + childRadius.y;
+	}
+	if (MinZ(object) + MaxZ(object) >= 2.f * n->center.z)
+	{
+		octant += 4;
+		childCenter.z = n->center.z + childRadius.z;
+	}
+
+	// The object can only be placed into the child if it fits inside its loose bounds. If looseness == 1, this
+	// rejects exactly the objects that straddle the split planes of n.
+	const vec looseRadius = childRadius * looseness;
+	if (MinX(object) < childCenter.x - looseRadius.x || MaxX(object) > childCenter.x + looseRadius.x ||
+	    MinY(object) < childCenter.y - looseRadius.y || MaxY(object) > childCenter.y + looseRadius.y ||
+	    MinZ(object) < childCenter.z - looseRadius.z || MaxZ(object) > childCenter.z + looseRadius.z)
+		return -1;
+	return octant;
+}
+
+template<typename T>
+void Octree<T>::Add(const T &object, Node *n)
+{
+	for(;;)
+	{
+		if (n->IsLeaf())
+		{
+			n->objects.push_back(object);
+			AssociateOctreeNode(object, n);
+			if ((int)n->objects.size() > minOctreeNodeObjectCount && Min(n->radius.x, n->radius.y, n->radius.z) >= minOctreeOctantSize)
+				SplitLeaf(n);
+			return;
+		}
+
+		// Traverse the Octree to decide which octant to place this object into. We must put the object onto this
+		// node if it does not fit into any of the child octants.
+		int octant = ChildOctantForObject(n, object);
+		if (octant < 0)
+		{
+			n->objects.push_back(object);
+			AssociateOctreeNode(object, n);
+			return;
+		}
+		assert(nodes[n->ChildIndex(octant)].parent == n);
+		n = &nodes[n->ChildIndex(octant)];
+	}
+}
+
+template<typename T>
+typename Octree<T>::Node *Octree<T>::Root()
+{
+	return nodes.empty() ? 0 : &nodes[rootNodeIndex];
+}
+
+template<typename T>
+const typename Octree<T>::Node *Octree<T>::Root() const
+{
+	return nodes.empty() ? 0 : &nodes[rootNodeIndex];
+}
+
+template<typename T>
+int Octree<T>::AllocateNodeGroup(Node *parent)
+{
+	int index = (int)nodes.size();
+	Node n;
+	n.parent = parent;
+	n.childIndex = 0xFFFFFFFF;
+	n.center = POINT_VEC_SCALAR(0.f);
+	n.radius = DIR_VEC_SCALAR(0.f);
+	if (parent)
+		n.radius = parent->radius * 0.5f;
+	for(int i = 0; i < 8; ++i)
+	{
+		if (parent)
+		{
+			n.center.x = parent->center.x + ((i & 1) ? n.radius.x : -n.radius.x);
+			n.center.y = parent->center.y + ((i & 2) ? n.radius.y : -n.radius.y);
+			n.center.z = parent->center.z + ((i & 4) ? n.radius.z : -n.radius.z);
+		}
+		nodes.push_back(n);
+	}
+	return index;
+}
+
+template<typename T>
+void Octree<T>::SplitLeaf(Node *leaf)
+{
+	assert(leaf->IsLeaf());
+	assert(leaf->childIndex == 0xFFFFFFFF);
+
+	leaf->childIndex = AllocateNodeGroup(leaf);
+
+	size_t i = 0;
+	while(i < leaf->objects.size())
+	{
+		const T &object = leaf->objects[i];
+
+		// We must leave this object in this node if it does not fit into any of the child octants.
+		int octant = ChildOctantForObject(leaf, object);
+		if (octant < 0)
+		{
+			++i;
+			continue;
+		}
+
+		Add(object, &nodes[leaf->ChildIndex(octant)]);
+
+		// Remove the object we added to a child from this node.
+		leaf->objects[i] = leaf->objects.back();
+		leaf->objects.pop_back();
+	}
+}
+
+template<typename T>
+void Octree<T>::PushIntersectingChildren(const Node *n, const AABB &aabb, std::vector<TraversalStackItem> &stack)
+{
+	// The loose bounds of the child octants extend this much past the split planes of n.
+	const vec overlap = n->radius * (0.5f * (looseness - 1.f));
+	const vec &center = n->center;
+	// Whether the query box reaches the negative and the positive halves of n along each axis.
+	const bool negX = aabb.minPoint.x <= center.x + overlap.x;
+	const bool posX = aabb.maxPoint.x >= center.x - overlap.x;
+	const bool negY = aabb.minPoint.y <= center.y + overlap.y;
+	const bool posY = aabb.maxPoint.y >= center.y - overlap.y;
+	const bool negZ = aabb.minPoint.z <= center.z + overlap.z;
+	const bool posZ = aabb.maxPoint.z >= center.z - overlap.z;
+	Node *children = &nodes[n->childIndex];
+	TraversalStackItem child;
+	for(int i = 0; i < 8; ++i)
+		if (((i & 1) ? posX : negX) && ((i & 2) ? posY : negY) && ((i & 4) ? posZ : negZ))
+		{
+			child.node = children + i;
+			stack.push_back(child);
+		}
+}
+
+template<typename T>
+template<typename Func>
+inline void Octree<T>::AABBQuery(const AABB &aabb, Func &callback)
+{
+	MGL_PROFILE(Octree_AABBQuery);
+	std::vector<TraversalStackItem> stack;
+	TraversalStackItem n;
+	n.node = Root();
+	if (!n.node || !aabb.Intersects(LooseAABB(n.node)))
+		return;
+	stack.push_back(n);
+
+	while(!stack.empty())
+	{
+		TraversalStackItem i = stack.back();
+		stack.pop_back();
+
+		if (i.node->objects.size() > 0)
+		{
+			if (callback(*this, aabb, *i.node))
+				return;
+		}
+		if (!i.node->IsLeaf())
+			PushIntersectingChildren(i.node, aabb, stack);
+	}
+}
+
+template<typename T, typename Func>
+class FindCollidingOctreePairs
+{
+public:
+	Func *collisionCallback;
+
+	bool operator ()(Octree<T> & /*tree*/, const AABB &queryAABB, typename Octree<T>::Node &node)
+	{
+		for(size_t i = 0; i < node.objects.size(); ++i)
+		{
+			AABB aabbI = Octree<T>::ObjectAABB(node.objects[i]);
+			if (!queryAABB.Intersects(aabbI))
+				continue;
+
+			for(size_t j = i+1; j < node.objects.size(); ++j)
+			{
+				AABB aabbJ = Octree<T>::ObjectAABB(node.objects[j]);
+				if (aabbI.Intersects(aabbJ))
+					(*collisionCallback)(node.objects[i], node.objects[j]);
+			}
+
+			typename Octree<T>::Node *n = node.parent;
+			while(n)
+			{
+				for(size_t j = 0; j < n->objects.size(); ++j)
+				{
+					AABB aabbJ = Octree<T>::ObjectAABB(n->objects[j]);
+					if (aabbI.Intersects(aabbJ))
+						(*collisionCallback)(node.objects[i], n->objects[j]);
+				}
+				assert(n != n->parent);
+				n = n->parent;
+			}
+		}
+		return false;
+	}
+};
+
+template<typename T>
+template<typename Func>
+inline void Octree<T>::CollidingPairsQuery(const AABB &aabb, Func &callback)
+{
+	MGL_PROFILE(Octree_CollidingPairsQuery);
+	if (looseness > 1.f)
+	{
+		LooseCollidingPairsQuery(aabb, callback);
+		return;
+	}
+	// In a regular Octree, each object is contained in its node, so two objects can only collide if one of them
+	// is stored in an ancestor node of the other (or in the same node).
+	FindCollidingOctreePairs<T, Func> func;
+	func.collisionCallback = &callback;
+	AABBQuery(aabb, func);
+}
+
+template<typename T>
+template<typename Func>
+inline void Octree<T>::LooseCollidingPairsQuery(const AABB &aabb, Func &callback)
+{
+	// The loose bounds of sibling nodes overlap, so each object that intersects the query AABB is queried against the
+	// whole tree. A pair that is found from both of its objects is only reported from the one that comes first in the
+	// order given by the node addresses and the indices of the objects in their nodes.
+	std::less<const Node*> nodeLess;
+	std::vector<TraversalStackItem> stack;
+	std::vector<TraversalStackItem> objectStack;
+	TraversalStackItem t;
+	t.node = Root();
+	if (!t.node || !aabb.Intersects(LooseAABB(t.node)))
+		return;
+	stack.push_back(t);
+
+	while(!stack.empty())
+	{
+		Node *a = stack.back().node;
+		stack.pop_back();
+
+		for(size_t i = 0; i < a->objects.size(); ++i)
+		{
+			AABB aabbI = ObjectAABB(a->objects[i]);
+			if (!aabb.Intersects(aabbI))
+				continue;
+
+			t.node = Root();
+			if (aabbI.Intersects(LooseAABB(t.node)))
+				objectStack.push_back(t);
+			while(!objectStack.empty())
+			{
+				Node *b = objectStack.back().node;
+				objectStack.pop_back();
+				for(size_t j = 0; j < b->objects.size(); ++j)
+				{
+					AABB aabbJ = ObjectAABB(b->objects[j]);
+					if (!aabbI.Intersects(aabbJ) || (b == a && j == i))
+						continue;
+					const bool objectFirst = (b == a) ? (i < j) : nodeLess(a, b);
+					if (objectFirst || !aabb.Intersects(aabbJ))
+						callback(a->objects[i], b->objects[j]);
+				}
+				if (!b->IsLeaf())
+					PushIntersectingChildren(b, aabbI, objectStack);
+			}
+		}
+
+		if (!a->IsLeaf())
+			PushIntersectingChildren(a, aabb, stack);
+	}
+}
+
+template<typename T>
+struct OctreeTraversalNode
+{
+	/// The squared distance of this node to the query point.
+	float d;
+	typename Octree<T>::Node *node;
+
+	/// We compare in reverse order, since we want the node with the smallest distance to be visited first,
+	/// and std::priority_queue stores the node that compares largest on top.
+	bool operator <(const OctreeTraversalNode &t) const { return d > t.d; }
+};
+
+template<typename T>
+template<typename Func>
+inline void Octree<T>::NearestNeighborNodes(const vec &point, Func &nodeCallback)
+{
+	MGL_PROFILE(Octree_NearestNeighborNodes);
+	std::priority_queue<OctreeTraversalNode<T> > queue;
+
+	OctreeTraversalNode<T> t;
+	t.node = Root();
+	if (!t.node)
+		return;
+	t.d = 0.f;
+	queue.push(t);
+
+	while(!queue.empty())
+	{
+		t = queue.top();
+		queue.pop();
+
+		if (t.node->objects.size() > 0)
+		{
+			bool stopIteration = nodeCallback(*this, point, *t.node, t.d);
+			if (stopIteration)
+				return;
+		}
+
+		if (!t.node->IsLeaf())
+		{
+			// The objects of a child node lie inside its loose bounds, so the distance to the loose bounds is a lower
+			// bound for the distance to any object in that child.
+			Node *children = &nodes[t.node->childIndex];
+			for(int i = 0; i < 8; ++i)
+			{
+				OctreeTraversalNode<T> n;
+				n.node = children + i;
+				n.d = LooseAABB(n.node).ClosestPoint(point).DistanceSq(point);
+				queue.push(n);
+			}
+		}
+	}
+}
+
+template<typename ObjectCallbackFunc, typename T>
+struct OctreeNearestNeighborObjectSearch
+{
+	OctreeNearestNeighborObjectSearch()
+	:objectCallback(0), numObjectsOutputted(0), stopped(false)
+	{
+	}
+
+	ObjectCallbackFunc *objectCallback;
+
+	struct NearestObject
+	{
+		/// The squared distance of this object to the query point.
+		float d;
+		typename Octree<T>::Node *node;
+		const T *object;
+
+		/// We compare in reverse order, since we want the object with the smallest distance to be visited first,
+		/// and std::priority_queue stores the object that compares largest on top.
+		bool operator <(const NearestObject &t) const { return d > t.d; }
+	};
+
+	std::priority_queue<NearestObject> queue;
+
+	int numObjectsOutputted;
+
+	/// Set to true when the object callback has asked to stop the search.
+	bool stopped;
+
+	/// Outputs all queued objects that are at most the given squared distance away from the query point.
+	bool OutputObjectsCloserThan(Octree<T> &tree, const vec &point, float maxDistanceSquared)
+	{
+		while(!queue.empty() && queue.top().d <= maxDistanceSquared)
+		{
+			const NearestObject &nextNearestObject = queue.top();
+			bool shouldStopIteration = (*objectCallback)(tree, point, nextNearestObject.node, nextNearestObject.d, *nextNearestObject.object, numObjectsOutputted++);
+			if (shouldStopIteration)
+			{
+				stopped = true;
+				return true;
+			}
+			queue.pop();
+		}
+		return false;
+	}
+
+	bool operator ()(Octree<T> &tree, const vec &point, typename Octree<T>::Node &node, float minDistanceSquared)
+	{
+		// Output all objects that are closer than the next closest node.
+		if (OutputObjectsCloserThan(tree, point, minDistanceSquared))
+			return true;
+
+		// Queue up all objects in the new node.
+		for(size_t i = 0; i < node.objects.size(); ++i)
+		{
+			NearestObject obj;
+			obj.d = Octree<T>::ObjectAABB(node.objects[i]).ClosestPoint(point).DistanceSq(point);
+			obj.node = &node;
+			obj.object = &node.objects[i];
+			queue.push(obj);
+		}
+
+		return false;
+	}
+};
+
+template<typename T>
+template<typename Func>
+inline void Octree<T>::NearestNeighborObjects(const vec &point, Func &objectCallback)
+{
+	OctreeNearestNeighborObjectSearch<Func, T> search;
+	search.objectCallback = &objectCallback;
+
+	NearestNeighborNodes(point, search);
+
+	// If the search was not stopped early, all nodes have been visited, so the remaining queued objects are the farthest ones.
+	if (!search.stopped)
+		search.OutputObjectsCloserThan(*this, point, FLOAT_INF);
+}
+
+template<typename T>
+void Octree<T>::GrowRoot(int octantForRoot)
+{
+	// rootNodeIndex always points to the first index of the eight octants. Swap the root node to its proper place.
+	Node *oldRoot = &nodes[rootNodeIndex+octantForRoot];
+
+	if (octantForRoot != 0)
+	{
+		Swap(nodes[rootNodeIndex], nodes[rootNodeIndex+octantForRoot]);
+
+		// Fix up the refs to the swapped old root node.
+		if (!oldRoot->IsLeaf())
+			for(int i = 0; i < 8; ++i)
+				nodes[oldRoot->ChildIndex(i)].parent = oldRoot;
+
+		// Fix up object->node associations to the swapped old root node.
+		for(size_t i = 0; i < oldRoot->objects.size(); ++i)
+			AssociateOctreeNode(oldRoot->objects[i], oldRoot);
+	}
+
+	int oldRootNodeIndex = rootNodeIndex;
+	rootNodeIndex = AllocateNodeGroup(0);
+	Node *newRoot = &nodes[rootNodeIndex];
+	newRoot->center = (boundingAABB.minPoint + boundingAABB.maxPoint) * 0.5f;
+	newRoot->radius = boundingAABB.maxPoint - newRoot->center;
+	newRoot->childIndex = oldRootNodeIndex;
+
+	for(int i = 0; i < 8; ++i)
+	{
+		Node *n = &nodes[newRoot->ChildIndex(i)];
+		n->parent = newRoot;
+		n->radius = newRoot->radius * 0.5f;
+		n->center.x = newRoot->center.x + ((i & 1) ? n->radius.x : -n->radius.x);
+		n->center.y = newRoot->center.y + ((i & 2) ? n->radius.y : -n->radius.y);
+		n->center.z = newRoot->center.z + ((i & 4) ? n->radius.z : -n->radius.z);
+	}
+
+	DebugSanityCheckNode(Root());
+}
+
+template<typename T>
+int Octree<T>::NumNodes() const
+{
+	return std::max<int>(0, nodes.size() - 7); // The seven nodes after rootNodeIndex are dummy unused, since the root node is not an octant.
+}
+
+template<typename T>
+int Octree<T>::NumLeaves() const
+{
+	int numLeaves = 0;
+	for(int i = 0; i < (int)nodes.size(); ++i)
+		if (i <= rootNodeIndex || i >= rootNodeIndex + 8) // The seven nodes after rootNodeIndex are dummy unused, since the root node is not an octant.
+			if (nodes[i].IsLeaf())
+				++numLeaves;
+
+	return numLeaves;
+}
+
+template<typename T>
+int Octree<T>::NumInnerNodes() const
+{
+	int numInnerNodes = 0;
+	for(int i = 0; i < (int)nodes.size(); ++i)
+		if (i <= rootNodeIndex || i >= rootNodeIndex + 8) // The seven nodes after rootNodeIndex are dummy unused, since the root node is not an octant.
+			if (!nodes[i].IsLeaf())
+				++numInnerNodes;
+
+	return numInnerNodes;
+}
+
+template<typename T>
+int Octree<T>::NumObjects() const
+{
+	int numObjects = 0;
+	for(int i = 0; i < (int)nodes.size(); ++i)
+		numObjects += (int)nodes[i].objects.size();
+	return numObjects;
+}
+
+template<typename T>
+int Octree<T>::TreeHeight(const Node *node) const
+{
+	if (node->IsLeaf())
+		return 1;
+	int height = 0;
+	for(int i = 0; i < 8; ++i)
+		height = Max(height, TreeHeight(&nodes[node->ChildIndex(i)]));
+	return 1 + height;
+}
+
+template<typename T>
+int Octree<T>::TreeHeight() const
+{
+	if (!Root())
+		return 0;
+	return TreeHeight(Root());
+}
+
+template<typename T>
+void Octree<T>::DebugSanityCheckNode(Node *n)
+{
+#ifdef _DEBUG
+	assert(n);
+	assert(n->parent || n == Root()); // If no parent, must be root.
+	assert(n != Root() || !n->parent); // If not root, must have a parent.
+
+	// Must have a good AABB.
+	AABB aabb = n->ComputeAABB();
+	assert(aabb.IsFinite());
+	assert(aabb.minPoint.x <= aabb.maxPoint.x);
+	assert(aabb.minPoint.y <= aabb.maxPoint.y);
+	assert(aabb.minPoint.z <= aabb.maxPoint.z);
+
+	// Each object in this node must be contained in the loose bounds of this node.
+	AABB looseAABB = LooseAABB(n);
+	for(size_t i = 0; i < n->objects.size(); ++i)
+		assert(looseAABB.Contains(ObjectAABB(n->objects[i])));
+
+	// Parent <-> child links must be valid.
+	if (!n->IsLeaf())
+	{
+		for(int i = 0; i < 8; ++i)
+		{
+			Node *child = &nodes[n->ChildIndex(i)];
+			assert(child->parent == n);
+
+			// Must contain all its child nodes.
+			assert(aabb.Contains(child->center));
+			assert(aabb.Contains(child->ComputeAABB()));
+
+			DebugSanityCheckNode(child);
+		}
+	}
+#else
+	MARK_UNUSED(n);
+#endif
+}
+
+MATH_END_NAMESPACE
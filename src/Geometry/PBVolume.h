@@ -61,6 +61,56 @@ public:
 		return true;
 	}
 
+	/// Returns a bitmask that has the bit of each plane of this PBVolume set.
+	/** Pass this as the plane mask of the root object when culling a hierarchy of objects with the masked
+		InsideOrIntersects() functions. */
+	static u32 AllPlanesMask()
+	{
+		return (u32)(((u64)1 << N) - 1);
+	}
+
+	/// Classifies the given AABB against a single plane of this PBVolume.
+	/** @param planeIndex The index of the plane to test, in the range [0, N-1].
+		@return TestOutside if the AABB lies in the positive halfspace of the plane, TestInside if it lies fully in
+			the negative halfspace, and TestNotContained if it straddles the plane. */
+	CullTestResult PlaneTest(int planeIndex, const AABB &aabb) const
+	{
+		const Plane &plane = p[planeIndex];
+		vec nPoint;
+		vec pPoint;
+		nPoint.x = (plane.normal.x < 0.f ? aabb.maxPoint.x : aabb.minPoint.x);
+		nPoint.y = (plane.normal.y < 0.f ? aabb.maxPoint.y : aabb.minPoint.y);
+		nPoint.z = (plane.normal.z < 0.f ? aabb.maxPoint.z : aabb.minPoint.z);
+#ifdef MATH_VEC_IS_FLOAT4
+		nPoint.w = 1.f;
+#endif
+
+		pPoint.x = (plane.normal.x >= 0.f ? aabb.maxPoint.x : aabb.minPoint.x);
+		pPoint.y = (plane.normal.y >= 0.f ? aabb.maxPoint.y : aabb.minPoint.y);
+		pPoint.z = (plane.normal.z >= 0.f ? aabb.maxPoint.z : aabb.minPoint.z);
+#ifdef MATH_VEC_IS_FLOAT4
+		pPoint.w = 1.f;
+#endif
+
+		if (plane.SignedDistance(nPoint) >= 0.f)
+			return TestOutside; // The AABB is certainly outside this plane.
+		if (plane.SignedDistance(pPoint) >= 0.f)
+			return TestNotContained; // At least one vertex is outside this plane.
+		return TestInside;
+	}
+
+	/// Classifies the given Sphere against a single plane of this PBVolume.
+	/** @see PlaneTest(int, const AABB &). */
+	CullTestResult PlaneTest(int planeIndex, const Sphere &sphere) const
+	{
+		float d = p[planeIndex].SignedDistance(sphere.pos);
+		if (d >= sphere.r)
+			return TestOutside;
+		else if (d >= -sphere.r)
+			return TestNotContained;
+		return TestInside;
+	}
+
 	/// Performs an *approximate* intersection test between this PBVolume and the given AABB.
 	/** This function is best used for high-performance object culling purposes, e.g. for frustum-aabb culling, when
 		a small percentage of false positives do not matter.
@@ -72,36 +122,10 @@ public:
 
 		for(int i = 0; i < N; ++i)
 		{
-			vec nPoint;
-			vec pPoint;
-			nPoint.x = (p[i].normal.x < 0.f ? aabb.maxPoint.x : aabb.minPoint.x);
-			nPoint.y = (p[i].normal.y < 0.f ? aabb.maxPoint.y : aabb.minPoint.y);
-			nPoint.z = (p[i].normal.z < 0.f ? aabb.maxPoint.z : aabb.minPoint.z);
-#ifdef MATH_VEC_IS_FLOAT4
-			nPoint.w = 1.f;
-#endif
-
-			pPoint.x = (p[i].normal.x >= 0.f ? aabb.maxPoint.x : aabb.minPoint.x);
-			pPoint.y = (p[i].normal.y >= 0.f ? aabb.maxPoint.y : aabb.minPoint.y);
-			pPoint.z = (p[i].normal.z >= 0.f ? aabb.maxPoint.z : aabb.minPoint.z);
-#ifdef MATH_VEC_IS_FLOAT4
-			pPoint.w = 1.f;
-#endif
-
-			/*
-			// Find the n and p points of the aabb. (The nearest and farthest corners relative to the plane)
-			const vec &sign = npPointsSignLUT[((p[i].normal.z >= 0.f) ? 4 : 0) +
-												 ((p[i].normal.y >= 0.f) ? 2 : 0) +
-												 ((p[i].normal.x >= 0.f) ? 1 : 0)];
-			const vec nPoint = c + sign*r;
-			const vec pPoint = c - sign*r;
-			*/
-
-			float a = p[i].SignedDistance(nPoint);
-			if (a >= 0.f)
+			CullTestResult planeResult = PlaneTest(i, aabb);
+			if (planeResult == TestOutside)
 				return TestOutside; // The AABB is certainly outside this PBVolume.
-			a = p[i].SignedDistance(pPoint);
-			if (a >= 0.f)
+			if (planeResult == TestNotContained)
 				result = TestNotContained; // At least one vertex is outside this PBVolume. The whole AABB can't possibly be contained in this PBVolume.
 		}
 
@@ -115,16 +139,80 @@ public:
 		CullTestResult result = TestInside;
 		for(int i = 0; i < N; ++i)
 		{
-			float d = p[i].SignedDistance(sphere.pos);
-			if (d >= sphere.r)
+			CullTestResult planeResult = PlaneTest(i, sphere);
+			if (planeResult == TestOutside)
 				return TestOutside;
-			else if (d >= -sphere.r)
+			else if (planeResult == TestNotContained)
 				result = TestNotContained;
 		}
 		return result;
 	}
 
+	/// Performs an *approximate* intersection test between this PBVolume and the given AABB, using plane masking and
+	/// plane coherency.
+	/** This function returns the same result as InsideOrIntersects(aabb), but skips most of the plane tests when culling
+		a bounding volume hierarchy, or when culling the same objects frame after frame.
+		- Plane masking: If a parent object lies fully inside a plane, so do all of its children, and the plane does not
+		need to be tested again for them. Start the traversal with the mask AllPlanesMask() at the root, and pass the
+		mask that this function outputs for a parent on as the input mask of each of its children.
+		- Plane coherency: An object that was culled by a plane is likely to be culled by the same plane again the next
+		frame, so that plane is tested first.
+		This supports at most 32 planes.
+		@param planeMask [in, out] A bitmask of the planes to test. The object must lie fully inside each plane whose bit
+			is not set. On return, the bits of the planes that the object lies fully inside of have been cleared. If the
+			function returns TestOutside, the contents of this mask are undefined.
+		@param lastRejectingPlane [in, out] The index of the plane that culled this object the last time, which is tested
+			first. If a different plane culls the object, its index is written here. Store this per object between
+			calls, and initialize it to 0.
+		@return An enum denoting whether the given object is inside or intersects this PBVolume. See the CullTestResult
+			enum for the interpretation of the return values. */
+	CullTestResult InsideOrIntersects(const AABB &aabb, u32 &planeMask, int &lastRejectingPlane) const
+	{
+		return MaskedInsideOrIntersects(aabb, planeMask, lastRejectingPlane);
+	}
+
+	/// Performs an *approximate* intersection test between this PBVolume and the given Sphere, using plane masking
+	/// and plane coherency.
+	/** @see InsideOrIntersects(const AABB &, u32 &, int &). */
+	CullTestResult InsideOrIntersects(const Sphere &sphere, u32 &planeMask, int &lastRejectingPlane) const
+	{
+		return MaskedInsideOrIntersects(sphere, planeMask, lastRejectingPlane);
+	}
+
 private:
+	template<typename T>
+	CullTestResult MaskedInsideOrIntersects(const T &object, u32 &planeMask, int &lastRejectingPlane) const
+	{
+		assume(N <= 32);
+		assume(lastRejectingPlane >= 0 && lastRejectingPlane < N);
+		const int firstPlane = lastRejectingPlane;
+		if ((planeMask >> firstPlane) & 1)
+		{
+			CullTestResult planeResult = PlaneTest(firstPlane, object);
+			if (planeResult == TestOutside)
+				return TestOutside;
+			if (planeResult == TestInside)
+				planeMask &= ~((u32)1 << firstPlane);
+		}
+
+		for(int i = 0; i < N; ++i)
+			if (i != firstPlane && ((planeMask >> i) & 1))
+			{
+				CullTestResult planeResult = PlaneTest(i, object);
+				if (planeResult == TestOutside)
+				{
+					lastRejectingPlane = i;
+					return TestOutside;
+				}
+				if (planeResult == TestInside)
+					planeMask &= ~((u32)1 << i);
+			}
+
+		// The object is inside all the planes that were masked out on input, so it is fully contained only if it was
+		// also found to be inside each of the planes that were tested.
+		return planeMask == 0 ? TestInside : TestNotContained;
+	}
+
 	struct CornerPt // A helper struct used only internally in ToPolyhedron.
 	{
 		int ptIndex; // Index to the Polyhedron list of vertices.
@@ -25,6 +25,11 @@
 #include "../Math/float2.h"
 #include "AABB2D.h"
 #include "../Math/MathTypes.h"
+#include "../Algorithm/Parallel.h"
+#include "../Algorithm/NearestNeighborHeap.h"
+#include "../Algorithm/ChunkedNodeArray.h"
+#include <vector>
+#include <utility>
 
 #ifdef MATH_CONTAINERLIB_SUPPORT
 #include "Container/MaxHeap.h"
@@ -52,6 +57,162 @@ inline float MaxY(const float3 &pt) { return pt.y; }
 //#define QUADTREE_VERBOSE_LOGGING
 //#endif
 
+#ifdef MATH_QUADTREE_POOLED_STORAGE
+/// A memory arena that stores the object lists of all the nodes of a single QuadTree.
+/** The arena hands out blocks with capacities that are powers of two, carved from large slabs. Freed blocks are kept in
+	per-capacity free lists and reused, so once the tree has warmed up, adding and removing objects does not allocate
+	memory. The objects of each node are contiguous in memory, and lie close to the objects of the other nodes, which
+	improves the memory locality of queries. The slabs never move in memory, so the node object lists can refer to
+	their blocks with raw pointers.
+	@note The element type T must be default-constructible and assignable. */
+template<typename T>
+class QuadTreeObjectPool
+{
+public:
+	/// The capacity of the smallest block. Block capacities are minBlockCapacity << sizeClass.
+	static const u32 minBlockCapacity = 8;
+	static const int maxSizeClasses = 24;
+	/// The number of objects in a slab. Blocks larger than this get a slab of their own.
+	static const u32 slabCapacity = 4096;
+
+	QuadTreeObjectPool():currentSlab(0), currentSlabUsed(slabCapacity) {}
+	~QuadTreeObjectPool() { Clear(); }
+
+	/// Allocates a block of the given size class.
+	T *Allocate(int sizeClass)
+	{
+		assert(sizeClass >= 0 && sizeClass < maxSizeClasses);
+		if (!freeBlocks[sizeClass].empty())
+		{
+			T *block = freeBlocks[sizeClass].back();
+			freeBlocks[sizeClass].pop_back();
+			return block;
+		}
+		const u32 capacity = minBlockCapacity << sizeClass;
+		if (capacity > slabCapacity)
+		{
+			slabs.push_back(new T[capacity]);
+			return slabs.back();
+		}
+		if (currentSlabUsed + capacity > slabCapacity)
+		{
+			currentSlab = new T[slabCapacity];
+			slabs.push_back(currentSlab);
+			currentSlabUsed = 0;
+		}
+		T *block = currentSlab + currentSlabUsed;
+		currentSlabUsed += capacity;
+		return block;
+	}
+
+	/// Returns the given block to the free list of its size class.
+	void Free(T *block, int sizeClass)
+	{
+		freeBlocks[sizeClass].push_back(block);
+	}
+
+	/// Frees all blocks at once, and releases the memory of the slabs.
+	void Clear()
+	{
+		for(size_t i = 0; i < slabs.size(); ++i)
+			delete[] slabs[i];
+		slabs.clear();
+		currentSlab = 0;
+		currentSlabUsed = slabCapacity;
+		for(int i = 0; i < maxSizeClasses; ++i)
+			freeBlocks[i].clear();
+	}
+
+private:
+	std::vector<T*> slabs;
+	T *currentSlab;
+	u32 currentSlabUsed;
+	std::vector<T*> freeBlocks[maxSizeClasses];
+
+	QuadTreeObjectPool(const QuadTreeObjectPool &); // Not copyable, since the object lists point to the slabs.
+	void operator =(const QuadTreeObjectPool &);
+};
+
+/// The list of objects of a single QuadTree node, stored in a QuadTreeObjectPool.
+/** This class provides the subset of the std::vector interface that the QuadTree and its query callbacks use, so that
+	code that accesses QuadTree<T>::Node::objects works the same in both storage modes. Like a std::vector, the list
+	keeps its block when it becomes empty, and only returns it to the pool when clear() is called. */
+template<typename T>
+class QuadTreeObjectList
+{
+public:
+	QuadTreeObjectList():pool(0), data(0), count(0), sizeClass(-1) {}
+	explicit QuadTreeObjectList(QuadTreeObjectPool<T> *pool_):pool(pool_), data(0), count(0), sizeClass(-1) {}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T &operator[](size_t i) { assert(i < count); return data[i]; }
+	const T &operator[](size_t i) const { assert(i < count); return data[i]; }
+
+	T *begin() { return data; }
+	T *end() { return data + count; }
+	const T *begin() const { return data; }
+	const T *end() const { return data + count; }
+
+	T &back() { assert(count > 0); return data[count-1]; }
+	const T &back() const { assert(count > 0); return data[count-1]; }
+
+	void push_back(const T &object)
+	{
+		if (sizeClass < 0 || count == (QuadTreeObjectPool<T>::minBlockCapacity << sizeClass))
+			Grow();
+		data[count++] = object;
+	}
+
+	void pop_back()
+	{
+		assert(count > 0);
+		--count;
+	}
+
+	/// Removes all objects from this list, and returns its block to the pool.
+	void clear()
+	{
+		if (sizeClass >= 0)
+			pool->Free(data, sizeClass);
+		data = 0;
+		count = 0;
+		sizeClass = -1;
+	}
+
+private:
+	QuadTreeObjectPool<T> *pool;
+	T *data;
+	u32 count;
+	int sizeClass;
+
+	void Grow()
+	{
+		assert(pool);
+		const int newSizeClass = sizeClass + 1;
+		T *newData = pool->Allocate(newSizeClass);
+		for(u32 i = 0; i < count; ++i)
+			newData[i] = data[i];
+		// The old block is not overwritten until it is allocated again, so an object being pushed from it stays valid.
+		if (sizeClass >= 0)
+			pool->Free(data, sizeClass);
+		data = newData;
+		sizeClass = newSizeClass;
+	}
+};
+#endif
+
+/// A QuadTree for storing dynamic objects with 2D extents.
+/** The tree can be made loose by specifying a looseness factor greater than one. In a loose QuadTree, the bounds of
+	each node are expanded by the looseness factor around the node center, so that the loose bounds of sibling nodes
+	overlap. An object is placed into the node that contains its center, down to the deepest node whose loose bounds
+	still contain the whole object. This prevents small objects that straddle the split lines of a node from piling up
+	in the inner nodes near the root, which happens in a regular QuadTree when objects move around. With a looseness
+	factor of 2, every object ends up at a depth determined only by its size.
+
+	Moving objects should be updated with Update(), which only relinks the object in the tree when it has left the
+	loose bounds of its current node. */
 template<typename T>
 class QuadTree
 {
@@ -66,6 +227,8 @@ public:
 		/// Stores the actual objects in this node/leaf.
 #ifdef MATH_CONTAINERLIB_SUPPORT
 		Array<T> objects;
+#elif defined(MATH_QUADTREE_POOLED_STORAGE)
+		QuadTreeObjectList<T> objects;
 #else
 		std::vector<T> objects;
 #endif
@@ -114,16 +277,17 @@ public:
 		Node *node;
 	};
 
-	QuadTree()
+	/// @param looseness_ The factor by which the bounds of each node are scaled for object placement. This must be
+	///	at least 1. A value of 1 creates a regular (non-loose) QuadTree. A value of 2 is a common choice for a loose tree.
+	explicit QuadTree(float looseness_ = 1.f)
 	:rootNodeIndex(-1),
-	boundingAABB(float2(0,0), float2(1,1))
+	boundingAABB(float2(0,0), float2(1,1)),
+	looseness(looseness_)
 #ifdef QUADTREE_VERBOSE_LOGGING
 	,totalNumObjectsInTree(0)
 #endif
 	{
-		///\todo Currently storing persistent raw pointers to this array outside the array.
-		/// Remove the requirement to never reallocate the vector!
-		nodes.reserve(200000);
+		assert(looseness >= 1.f);
 	}
 
 	/// Removes all nodes and objects in this tree and reinitializes the tree to a single root node.
@@ -138,10 +302,23 @@ public:
 	/// which returns the node of this quadtree where the object resides in.
 	void Remove(const T &object);
 
+	/// Updates the location of the given object in this tree after the object has moved or changed size.
+	/** If the object is still contained in the loose bounds of its current node, this function does nothing. Otherwise
+		the object is removed and added back to the tree. If the object is not in the tree, it is added.
+		This function requires the same GetQuadTreeNode() function as Remove(). */
+	void Update(const T &object);
+
 	/// @return The bounding rectangle for the whole tree.
 	/// @note This bounding rectangle does not tightly bound the objects themselves, only the root node of the tree.
 	AABB2D BoundingAABB() const { return boundingAABB; }
 
+	/// @return The looseness factor this tree was created with.
+	float Looseness() const { return looseness; }
+
+	/// @return The loose bounds of the given node, which contain all the objects stored in that node.
+	/// For a tree with looseness 1, this is the same as node->ComputeAABB().
+	AABB2D LooseAABB(const Node *node) const { return AABB2D(node->center - node->radius * looseness, node->center + node->radius * looseness); }
+
 	/// @return The topmost node in the tree.
 	Node *Root();
 	const Node *Root() const;
@@ -180,9 +357,23 @@ public:
 
 	/// Finds all object pairs inside the given AABB which have colliding AABBs. For each such pair, calls the
 	/// specified callback function.
+	/** @param callback A function or a function object of prototype
+			void callbackFunction(const T &objectA, const T &objectB);
+		In a loose tree, the callback is called exactly once for each colliding pair in which at least one of the
+		objects intersects the given AABB. */
 	template<typename Func>
 	inline void CollidingPairsQuery(const AABB2D &aabb, Func &callback);
 
+	/// Finds the same object pairs as CollidingPairsQuery(), using multiple threads.
+	/** The tree is split at a fixed depth into independent subtrees, and the nodes above that depth. These are processed
+		in parallel, and the pairs found by each are buffered. Afterwards, the callback is called on the calling thread
+		for each pair, in the same order as CollidingPairsQuery() would call it. The tree must not be modified while
+		this query runs.
+		@param numThreads The maximum number of threads to use. If 0, the number of hardware threads is used. If 1, this
+			function is the same as CollidingPairsQuery(). */
+	template<typename Func>
+	inline void CollidingPairsQueryParallel(const AABB2D &aabb, Func &callback, int numThreads = 0);
+
 #ifdef MATH_CONTAINERLIB_SUPPORT
 	/// Performs a node-granular nearest neighbor search on this QuadTree.
 	/** This query calls the given nodeCallback function for each node of this QuadTree that contains objects, sorted by closest first
@@ -219,6 +410,25 @@ public:
 	inline void NearestNeighborObjects(const float2 &targetPoint, Func &objectCallback);
 #endif
 
+	/// The maximum number of neighbors that KNearestObjects() can search for.
+	static const int maxNearestNeighbors = 64;
+
+	/// Finds the k objects in this QuadTree that are closest to the given point.
+	/** The distance to an object is measured to the rectangle given by its MinX()-MaxY() functions. Apart from the
+		traversal stack, this query does not allocate memory.
+		@param k The number of objects to find, at most maxNearestNeighbors.
+		@param outObjects [out] Receives the found objects, closest first. The array must have room for k elements.
+		@param outDistancesSq [out] If not null, receives the squared distances of the found objects to the point.
+		@return The number of objects found. This is less than k only if the tree contains fewer than k objects. */
+	int KNearestObjects(const float2 &point, int k, T *outObjects, float *outDistancesSq);
+
+	/// Finds all objects in this QuadTree that are at most the given distance away from the given point.
+	/** The distance to an object is measured as in KNearestObjects().
+		@param outObjects [out] Receives the found objects, in no particular order. This vector is cleared first.
+		@param outDistancesSq [out] Receives the squared distances of the found objects to the point, in the same
+			order as the objects. This vector is cleared first. */
+	void ObjectsWithinRadius(const float2 &point, float radius, std::vector<T> &outObjects, std::vector<float> &outDistancesSq);
+
 	/// Performs various consistency checks on the given node. Use only for debugging purposes.
 	void DebugSanityCheckNode(Node *n);
 
@@ -230,15 +440,68 @@ private:
 
 	void SplitLeaf(Node *leaf);
 
-//#ifdef MATH_CONTAINERLIB_SUPPORT
-//	Array<Node> nodes;
-//#else
-	std::vector<Node> nodes;
-//#endif
+	/// Returns the index (0-3) of the child quadrant of n that the given object should be placed into, or -1 if the
+	/// object does not fit inside the loose bounds of any of the child quadrants and must be stored in n itself.
+	int ChildQuadrantForObject(const Node *n, const T &object) const;
+
+	/// Pushes the child nodes of n whose loose bounds may intersect the given AABB onto the traversal stack.
+	void PushIntersectingChildren(const Node *n, const AABB2D &aabb, std::vector<TraversalStackItem> &stack);
+
+	/// Implements CollidingPairsQuery() for a loose tree, where colliding objects can reside in sibling subtrees.
+	template<typename Func>
+	inline void LooseCollidingPairsQuery(const AABB2D &aabb, Func &callback);
+
+	/// Finds the colliding pairs for the objects stored in node a of a loose tree.
+	template<typename Func>
+	inline void LooseCollidingPairsInNode(Node *a, const AABB2D &aabb, Func &callback, std::vector<TraversalStackItem> &objectStack);
+
+	/// Finds the colliding pairs for the objects stored in the given node, and also in all the nodes under it if
+	/// wholeSubtree is true. Objects are tested against the objects in the ancestor nodes as well.
+	template<typename Func>
+	inline void CollidingPairsInSubtree(Node *subtreeRoot, bool wholeSubtree, const AABB2D &aabb, Func &callback);
+
+	/// A part of the tree that CollidingPairsQueryParallel() processes as a single task.
+	struct CollidingPairsWorkItem
+	{
+		Node *node;
+		/// If false, only the objects in node itself are processed, and not the nodes under it.
+		bool wholeSubtree;
+	};
+
+	struct CollidingPairsJob
+	{
+		QuadTree<T> *tree;
+		AABB2D aabb;
+		std::vector<CollidingPairsWorkItem> items;
+		/// The pairs found by each work item, in the order they were found.
+		std::vector<std::vector<std::pair<T, T> > > pairs;
+	};
+
+	static void CollidingPairsTask(void *userData, int taskIndex);
+
+	/// A node on the traversal stack of KNearestObjects(), along with its distance to the query point.
+	struct NearestNeighborStackItem
+	{
+		Node *node;
+		float distanceSq;
+	};
+
+	/// Returns the squared distance from the given point to the rectangle given by the MinX()-MaxY() functions of the object.
+	static float ObjectDistanceSq(const T &object, const float2 &point)
+	{
+		return AABB2D(float2(MinX(object), MinY(object)), float2(MaxX(object), MaxY(object))).DistanceSq(point);
+	}
+
+	ChunkedNodeArray<Node> nodes;
+
+#ifdef MATH_QUADTREE_POOLED_STORAGE
+	QuadTreeObjectPool<T> objectPool;
+#endif
 
 	/// Specifies the index to the root node, or -1 if there is no root (nodes.size() == 0).
 	int rootNodeIndex;
 	AABB2D boundingAABB;
+	float looseness;
 
 	void GrowRootTopLeft();
 	void GrowRootTopRight();
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../Math/MathFunc.h"
+#include <functional>
 
 MATH_BEGIN_NAMESPACE
 
@@ -25,6 +26,9 @@ template<typename T>
 void QuadTree<T>::Clear(const float2 &minXY, const float2 &maxXY)
 {
 	nodes.clear();
+#ifdef MATH_QUADTREE_POOLED_STORAGE
+	objectPool.Clear();
+#endif
 
 	boundingAABB.minPoint = minXY;
 	boundingAABB.maxPoint = maxXY;
@@ -125,34 +129,53 @@ void QuadTree<T>::Remove(const T &object)
 	}
 }
 
+template<typename T>
+void QuadTree<T>::Update(const T &object)
+{
+	MGL_PROFILE(QuadTree_Update);
+	Node *n = GetQuadTreeNode(object);
+	// Fast path: As long as the object stays inside the loose bounds of its node, all queries still find it there.
+	if (n && LooseAABB(n).Contains(GetAABB2D(object)))
+		return;
+	Remove(object);
+	Add(object);
+}
+
+template<typename T>
+int QuadTree<T>::ChildQuadrantForObject(const Node *n, const T &object) const
+{
+	assert(MinX(object) <= MaxX(object));
+	assert(MinY(object) <= MaxY(object));
+
+	// Pick the child quadrant that contains the center point of the object.
+	const float2 childRadius = n->radius * 0.5f;
+	float2 childCenter = n->center - childRadius;
+	int quadrant = 0;
+	if (MinX(object) + MaxX(object) >= 2.f * n->center.x)
+	{
+		quadrant += 1;
+		childCenter.x = n->center.x + childRadius.x;
+	}
+	if (MinY(object) + MaxY(object) >= 2.f * n->center.y)
+	{
+		quadrant += 2;
+		childCenter.y = n->center.y + childRadius.y;
+	}
+
+	// The object can only be placed into the child if it fits inside its loose bounds. If looseness == 1, this
+	// rejects exactly the objects that straddle the split lines of n.
+	const float2 looseRadius = childRadius * looseness;
+	if (MinX(object) < childCenter.x - looseRadius.x || MaxX(object) > childCenter.x + looseRadius.x ||
+	    MinY(object) < childCenter.y - looseRadius.y || MaxY(object) > childCenter.y + looseRadius.y)
+		return -1;
+	return quadrant;
+}
+
 template<typename T>
 void QuadTree<T>::Add(const T &object, Node *n)
 {
 	for(;;)
 	{
-		// Traverse the QuadTree to decide which quad to place this object into.
-		assert(MinX(object) <= MaxX(object));
-		float left = n->center.x - MinX(object); // If left > 0.f, then the object overlaps with the left quadrant.
-		float right = MaxX(object) - n->center.x; // If right > 0.f, then the object overlaps with the right quadrant.
-		assert(MinY(object) <= MaxY(object));
-		float top = n->center.y - MinY(object); // If top > 0.f, then the object overlaps with the top quadrant.
-		float bottom = MaxY(object) - n->center.y; // If bottom > 0.f, then the object overlaps with the bottom quadrant.
-		float leftAndRight = Min(left, right); // If > 0.f, then the object straddles left-right halves.
-		float topAndBottom = Min(top, bottom); // If > 0.f, then the object straddles top-bottom halves.
-		float straddledEitherOne = Max(leftAndRight, topAndBottom); // If > 0.f, then the object is in two or more quadrants.
-
-		// Note: It can happen that !left && !right, or !top && !bottom,
-		// but the if()s below are set up so that right/bottom is taken if no left/top, so that is ok.
-
-		// We must put the object onto this node if
-		// a) the object straddled the parent->child split lines.
-		// b) this object is a leaf.
-		if (straddledEitherOne > 0.f)
-		{
-			n->objects.push_back(object);
-			AssociateQuadTreeNode(object, n);
-			return;
-		}
 		if (n->IsLeaf())
 		{
 			n->objects.push_back(object);
@@ -161,32 +184,18 @@ void QuadTree<T>::Add(const T &object, Node *n)
 				SplitLeaf(n);
 			return;
 		}
-		if (left > 0.f)
-		{
-			if (top > 0.f)
-			{
-				assert(nodes[n->TopLeftChildIndex()].parent == n);
-				n = &nodes[n->TopLeftChildIndex()];
-			}
-			else
-			{
-				assert(nodes[n->BottomLeftChildIndex()].parent == n);
-				n = &nodes[n->BottomLeftChildIndex()];
-			}
-		}
-		else
+
+		// Traverse the QuadTree to decide which quad to place this object into. We must put the object onto this
+		// node if it does not fit into any of the child quadrants.
+		int quadrant = ChildQuadrantForObject(n, object);
+		if (quadrant < 0)
 		{
-			if (top > 0.f)
-			{
-				assert(nodes[n->TopRightChildIndex()].parent == n);
-				n = &nodes[n->TopRightChildIndex()];
-			}
-			else
-			{
-				assert(nodes[n->BottomRightChildIndex()].parent == n);
-				n = &nodes[n->BottomRightChildIndex()];
-			}
+			n->objects.push_back(object);
+			AssociateQuadTreeNode(object, n);
+			return;
 		}
+		assert(nodes[n->childIndex + quadrant].parent == n);
+		n = &nodes[n->childIndex + quadrant];
 	}
 }
 
@@ -205,13 +214,15 @@ const typename QuadTree<T>::Node *QuadTree<T>::Root() const
 template<typename T>
 int QuadTree<T>::AllocateNodeGroup(Node *parent)
 {
-#ifdef _DEBUG
-	size_t oldCap = nodes.capacity();
-#endif
 	int index = (int)nodes.size();
 	Node n;
 	n.parent = parent;
 	n.childIndex = 0xFFFFFFFF;
+	n.center = float2::zero;
+	n.radius = float2::zero;
+#ifdef MATH_QUADTREE_POOLED_STORAGE
+	n.objects = QuadTreeObjectList<T>(&objectPool);
+#endif
 	// The nodes are in order top-left (--), top-right, bottom-left, bottom-right.
 	if (parent)
 	{
@@ -231,9 +242,6 @@ int QuadTree<T>::AllocateNodeGroup(Node *parent)
 	if (parent)
 		n.center.x = parent->center.x + n.radius.x;
 	nodes.push_back(n);
-#ifdef _DEBUG
-	assert(nodes.capacity() == oldCap); // Limitation: Cannot resize the nodes vector!
-#endif
 	return index;
 }
 
@@ -250,49 +258,15 @@ void QuadTree<T>::SplitLeaf(Node *leaf)
 	{
 		const T &object = leaf->objects[i];
 
-		// Traverse the QuadTree to decide which quad to place this object into.
-		assert(MinX(object) <= MaxX(object));
-		float left = leaf->center.x - MinX(object); // If left > 0.f, then the object overlaps with the left quadrant.
-		float right = MaxX(object) - leaf->center.x; // If right > 0.f, then the object overlaps with the right quadrant.
-		assert(MinY(object) <= MaxY(object));
-		float top = leaf->center.y - MinY(object); // If top > 0.f, then the object overlaps with the top quadrant.
-		float bottom = MaxY(object) - leaf->center.y; // If bottom > 0.f, then the object overlaps with the bottom quadrant.
-		float leftAndRight = Min(left, right); // If > 0.f, then the object straddles left-right halves.
-		float topAndBottom = Min(top, bottom); // If > 0.f, then the object straddles top-bottom halves.
-		float straddledEitherOne = Max(leftAndRight, topAndBottom); // If > 0.f, then the object is in two or more quadrants.
-
-		// Note: It can happen that !left && !right, or !top && !bottom,
-		// but the if()s below are set up so that right/bottom is taken if no left/top, so that is ok.
-
-		// We must leave this object in this node if the object straddled the parent->child split lines.
-		if (straddledEitherOne > 0.f)
+		// We must leave this object in this node if it does not fit into any of the child quadrants.
+		int quadrant = ChildQuadrantForObject(leaf, object);
+		if (quadrant < 0)
 		{
 			++i;
 			continue;
 		}
 
-		if (left > 0.f)
-		{
-			if (top > 0.f)
-			{
-				Add(object, &nodes[leaf->TopLeftChildIndex()]);
-			}
-			else
-			{
-				Add(object, &nodes[leaf->BottomLeftChildIndex()]);
-			}
-		}
-		else
-		{
-			if (top > 0.f)
-			{
-				Add(object, &nodes[leaf->TopRightChildIndex()]);
-			}
-			else
-			{
-				Add(object, &nodes[leaf->BottomRightChildIndex()]);
-			}
-		}
+		Add(object, &nodes[leaf->childIndex + quadrant]);
 
 		// Remove the object we added to a child from this node.
 		leaf->objects[i] = leaf->objects.back();
@@ -300,6 +274,36 @@ void QuadTree<T>::SplitLeaf(Node *leaf)
 	}
 }
 
+template<typename T>
+void QuadTree<T>::PushIntersectingChildren(const Node *n, const AABB2D &aabb, std::vector<TraversalStackItem> &stack)
+{
+	// The loose bounds of the child quadrants extend this much past the split lines of n.
+	const float2 overlap = n->radius * (0.5f * (looseness - 1.f));
+	const float2 &center = n->center;
+	Node *children = &nodes[n->childIndex];
+	TraversalStackItem child;
+	if (aabb.minPoint.x <= center.x + overlap.x && aabb.minPoint.y <= center.y + overlap.y)
+	{
+		child.node = children; // n->TopLeftChildIndex()
+		stack.push_back(child);
+	}
+	if (aabb.maxPoint.x >= center.x - overlap.x && aabb.maxPoint.y >= center.y - overlap.y)
+	{
+		child.node = children + 3; // n->BottomRightChildIndex()
+		stack.push_back(child);
+	}
+	if (aabb.minPoint.x <= center.x + overlap.x && aabb.maxPoint.y >= center.y - overlap.y)
+	{
+		child.node = children + 2; // n->BottomLeftChildIndex()
+		stack.push_back(child);
+	}
+	if (aabb.maxPoint.x >= center.x - overlap.x && aabb.minPoint.y <= center.y + overlap.y)
+	{
+		child.node = children + 1; // n->TopRightChildIndex()
+		stack.push_back(child);
+	}
+}
+
 template<typename T>
 template<typename Func>
 inline void QuadTree<T>::AABBQuery(const AABB2D &aabb, Func &callback)
@@ -308,7 +312,7 @@ inline void QuadTree<T>::AABBQuery(const AABB2D &aabb, Func &callback)
 	std::vector<TraversalStackItem> stack;
 	TraversalStackItem n;
 	n.node = Root();
-	if (!n.node || !aabb.Intersects(BoundingAABB()))
+	if (!n.node || !aabb.Intersects(LooseAABB(n.node)))
 		return;
 	stack.push_back(n);
 
@@ -317,8 +321,8 @@ inline void QuadTree<T>::AABBQuery(const AABB2D &aabb, Func &callback)
 		TraversalStackItem i = stack.back();
 		stack.pop_back();
 
-		// aabb intersects the node's aabb.
-		// Which aabb's of the four child quadrants does it intersect?
+		// aabb intersects the node's loose aabb.
+		// Which loose aabb's of the four child quadrants does it intersect?
 
 		if (i.node->objects.size() > 0)
 		{
@@ -326,32 +330,7 @@ inline void QuadTree<T>::AABBQuery(const AABB2D &aabb, Func &callback)
 				return;
 		}
 		if (!i.node->IsLeaf())
-		{
-			if (aabb.minPoint.x <= i.node->center.x && aabb.minPoint.y <= i.node->center.y)
-			{
-				TraversalStackItem child;
-				child.node = &nodes[i.node->TopLeftChildIndex()];
-				stack.push_back(child);
-			}
-			if (aabb.maxPoint.x >= i.node->center.x && aabb.maxPoint.y >= i.node->center.y)
-			{
-				TraversalStackItem child;
-				child.node = &nodes[i.node->BottomRightChildIndex()];
-				stack.push_back(child);
-			}
-			if (aabb.minPoint.x <= i.node->center.x && aabb.maxPoint.y >= i.node->center.y)
-			{
-				TraversalStackItem child;
-				child.node = &nodes[i.node->BottomLeftChildIndex()];
-				stack.push_back(child);
-			}
-			if (aabb.maxPoint.x >= i.node->center.x && aabb.minPoint.y <= i.node->center.y)
-			{
-				TraversalStackItem child;
-				child.node = &nodes[i.node->TopRightChildIndex()];
-				stack.push_back(child);
-			}
-		}
+			PushIntersectingChildren(i.node, aabb, stack);
 	}
 }
 
@@ -398,11 +377,190 @@ template<typename Func>
 inline void QuadTree<T>::CollidingPairsQuery(const AABB2D &aabb, Func &callback)
 {
 	MGL_PROFILE(QuadTree_CollidingPairsQuery);
+	if (looseness > 1.f)
+	{
+		LooseCollidingPairsQuery(aabb, callback);
+		return;
+	}
+	// In a regular QuadTree, each object is contained in its node, so two objects can only collide if one of them
+	// is stored in an ancestor node of the other (or in the same node).
 	FindCollidingPairs<T, Func> func;
 	func.collisionCallback = &callback;
 	AABBQuery(aabb, func);
 }
 
+template<typename T>
+template<typename Func>
+inline void QuadTree<T>::LooseCollidingPairsQuery(const AABB2D &aabb, Func &callback)
+{
+	std::vector<TraversalStackItem> stack;
+	std::vector<TraversalStackItem> objectStack;
+	TraversalStackItem t;
+	t.node = Root();
+	if (!t.node || !aabb.Intersects(LooseAABB(t.node)))
+		return;
+	stack.push_back(t);
+
+	while(!stack.empty())
+	{
+		Node *a = stack.back().node;
+		stack.pop_back();
+
+		LooseCollidingPairsInNode(a, aabb, callback, objectStack);
+
+		if (!a->IsLeaf())
+			PushIntersectingChildren(a, aabb, stack);
+	}
+}
+
+template<typename T>
+template<typename Func>
+inline void QuadTree<T>::LooseCollidingPairsInNode(Node *a, const AABB2D &aabb, Func &callback, std::vector<TraversalStackItem> &objectStack)
+{
+	// In a loose QuadTree, the loose bounds of sibling nodes overlap, so colliding objects can be stored in different
+	// subtrees. Therefore each object that intersects the query AABB is queried against the whole tree. A pair is
+	// found twice if both of its objects intersect the query AABB, in which case it is only reported from the object
+	// that comes first in the order given by the node addresses and the indices of the objects in their nodes.
+	std::less<const Node*> nodeLess;
+	TraversalStackItem t;
+	for(size_t i = 0; i < a->objects.size(); ++i)
+	{
+		AABB2D aabbI = GetAABB2D(a->objects[i]);
+		if (!aabb.Intersects(aabbI))
+			continue;
+
+		t.node = Root();
+		if (aabbI.Intersects(LooseAABB(t.node)))
+			objectStack.push_back(t);
+		while(!objectStack.empty())
+		{
+			Node *b = objectStack.back().node;
+			objectStack.pop_back();
+			for(size_t j = 0; j < b->objects.size(); ++j)
+			{
+				AABB2D aabbJ = GetAABB2D(b->objects[j]);
+				if (!aabbI.Intersects(aabbJ) || (b == a && j == i))
+					continue;
+				const bool objectFirst = (b == a) ? (i < j) : nodeLess(a, b);
+				if (objectFirst || !aabb.Intersects(aabbJ))
+					callback(a->objects[i], b->objects[j]);
+			}
+			if (!b->IsLeaf())
+				PushIntersectingChildren(b, aabbI, objectStack);
+		}
+	}
+}
+
+template<typename T>
+template<typename Func>
+inline void QuadTree<T>::CollidingPairsInSubtree(Node *subtreeRoot, bool wholeSubtree, const AABB2D &aabb, Func &callback)
+{
+	FindCollidingPairs<T, Func> func;
+	func.collisionCallback = &callback;
+	std::vector<TraversalStackItem> stack;
+	std::vector<TraversalStackItem> objectStack;
+	TraversalStackItem t;
+	t.node = subtreeRoot;
+	stack.push_back(t);
+
+	// This visits the nodes in the same order as CollidingPairsQuery() does.
+	while(!stack.empty())
+	{
+		Node *n = stack.back().node;
+		stack.pop_back();
+
+		if (looseness > 1.f)
+			LooseCollidingPairsInNode(n, aabb, callback, objectStack);
+		else if (n->objects.size() > 0)
+			func(*this, aabb, *n);
+
+		if (wholeSubtree && !n->IsLeaf())
+			PushIntersectingChildren(n, aabb, stack);
+	}
+}
+
+template<typename T>
+struct AppendCollidingPair
+{
+	std::vector<std::pair<T, T> > *pairs;
+
+	void operator ()(const T &a, const T &b)
+	{
+		pairs->push_back(std::make_pair(a, b));
+	}
+};
+
+template<typename T>
+void QuadTree<T>::CollidingPairsTask(void *userData, int taskIndex)
+{
+	CollidingPairsJob *job = reinterpret_cast<CollidingPairsJob*>(userData);
+	const CollidingPairsWorkItem &item = job->items[taskIndex];
+	AppendCollidingPair<T> append;
+	append.pairs = &job->pairs[taskIndex];
+	job->tree->CollidingPairsInSubtree(item.node, item.wholeSubtree, job->aabb, append);
+}
+
+template<typename T>
+template<typename Func>
+inline void QuadTree<T>::CollidingPairsQueryParallel(const AABB2D &aabb, Func &callback, int numThreads)
+{
+	MGL_PROFILE(QuadTree_CollidingPairsQueryParallel);
+	if (numThreads <= 0)
+		numThreads = NumHardwareThreads();
+	if (numThreads <= 1)
+	{
+		CollidingPairsQuery(aabb, callback);
+		return;
+	}
+
+	TraversalStackItem t;
+	t.node = Root();
+	if (!t.node || !aabb.Intersects(LooseAABB(t.node)))
+		return;
+
+	// Split the tree at the depth where a full tree would have at least eight subtrees per thread.
+	int splitDepth = 0;
+	while((1 << (2*splitDepth)) < numThreads * 8)
+		++splitDepth;
+
+	// Traverse the top of the tree in the same order as the serial query does. The inner nodes above splitDepth become
+	// work items of their own, and the subtrees at splitDepth become work items as a whole. Objects in the subtrees
+	// are tested against the objects in the inner nodes above them by the subtree work items.
+	CollidingPairsJob job;
+	job.tree = this;
+	job.aabb = aabb;
+	std::vector<TraversalStackItem> stack;
+	std::vector<int> depths;
+	stack.push_back(t);
+	depths.push_back(0);
+	while(!stack.empty())
+	{
+		Node *n = stack.back().node;
+		int depth = depths.back();
+		stack.pop_back();
+		depths.pop_back();
+
+		CollidingPairsWorkItem item;
+		item.node = n;
+		item.wholeSubtree = (depth >= splitDepth || n->IsLeaf());
+		job.items.push_back(item);
+
+		if (!item.wholeSubtree)
+		{
+			PushIntersectingChildren(n, aabb, stack);
+			depths.resize(stack.size(), depth + 1);
+		}
+	}
+
+	job.pairs.resize(job.items.size());
+	RunParallelTasks(&QuadTree<T>::CollidingPairsTask, &job, (int)job.items.size(), numThreads);
+
+	// Report the pairs in work item order, which is the order the serial query reports them in.
+	for(size_t i = 0; i < job.pairs.size(); ++i)
+		for(size_t j = 0; j < job.pairs[i].size(); ++j)
+			callback(job.pairs[i][j].first, job.pairs[i][j].second);
+}
+
 template<typename T>
 struct TraversalNode
 {
@@ -464,7 +622,7 @@ inline void QuadTree<T>::NearestNeighborNodes(const float2 &point, Func &leafCal
 			{
 				TraversalNode<T> &n = queue.BeginInsert();
 				n.node = childNode; // t.node->TopLeftChildIndex()
-				n.d = n.node->DistanceSq(point);
+				n.d = LooseAABB(n.node).DistanceSq(point);
 				queue.FinishInsert();
 			}
 
@@ -472,7 +630,7 @@ inline void QuadTree<T>::NearestNeighborNodes(const float2 &point, Func &leafCal
 			{
 				TraversalNode<T> &n = queue.BeginInsert();
 				n.node = childNode + 1; // t.node->TopRightChildIndex()
-				n.d = n.node->DistanceSq(point);
+				n.d = LooseAABB(n.node).DistanceSq(point);
 				queue.FinishInsert();
 			}
 
@@ -480,7 +638,7 @@ inline void QuadTree<T>::NearestNeighborNodes(const float2 &point, Func &leafCal
 			{
 				TraversalNode<T> &n = queue.BeginInsert();
 				n.node = childNode + 2; // t.node->BottomLeftChildIndex()
-				n.d = n.node->DistanceSq(point);
+				n.d = LooseAABB(n.node).DistanceSq(point);
 				queue.FinishInsert();
 			}
 
@@ -488,7 +646,7 @@ inline void QuadTree<T>::NearestNeighborNodes(const float2 &point, Func &leafCal
 			{
 				TraversalNode<T> &n = queue.BeginInsert();
 				n.node = childNode + 3; // t.node->BottomRightChildIndex()
-				n.d = n.node->DistanceSq(point);
+				n.d = LooseAABB(n.node).DistanceSq(point);
 				queue.FinishInsert();
 			}
 		}
@@ -595,6 +753,102 @@ inline void QuadTree<T>::NearestNeighborObjects(const float2 &point, Func &leafC
 }
 #endif
 
+template<typename T>
+int QuadTree<T>::KNearestObjects(const float2 &point, int k, T *outObjects, float *outDistancesSq)
+{
+	MGL_PROFILE(QuadTree_KNearestObjects);
+	assert(k >= 0 && k <= maxNearestNeighbors);
+	NearestNeighborHeap<const T*, maxNearestNeighbors> nearest(k);
+
+	std::vector<NearestNeighborStackItem> stack;
+	if (k > 0 && Root())
+	{
+		NearestNeighborStackItem root = { Root(), LooseAABB(Root()).DistanceSq(point) };
+		stack.push_back(root);
+	}
+
+	while(!stack.empty())
+	{
+		NearestNeighborStackItem cur = stack.back();
+		stack.pop_back();
+		// The nodes on the stack were pushed before closer objects may have been found, so check again.
+		if (cur.distanceSq > nearest.MaxDistanceSq())
+			continue;
+
+		for(size_t i = 0; i < cur.node->objects.size(); ++i)
+		{
+			float d = ObjectDistanceSq(cur.node->objects[i], point);
+			if (d < nearest.MaxDistanceSq())
+				nearest.Insert(&cur.node->objects[i], d);
+		}
+
+		if (!cur.node->IsLeaf())
+		{
+			// Push the children farthest first, so that the closest child is visited first, and finds close objects early.
+			NearestNeighborStackItem children[4];
+			for(int i = 0; i < 4; ++i)
+			{
+				NearestNeighborStackItem child = { &nodes[cur.node->childIndex + i], 0.f };
+				child.distanceSq = LooseAABB(child.node).DistanceSq(point);
+				int j = i;
+				for(; j > 0 && children[j-1].distanceSq < child.distanceSq; --j)
+					children[j] = children[j-1];
+				children[j] = child;
+			}
+			for(int i = 0; i < 4; ++i)
+				if (children[i].distanceSq <= nearest.MaxDistanceSq())
+					stack.push_back(children[i]);
+		}
+	}
+
+	nearest.SortAscending();
+	for(int i = 0; i < nearest.Size(); ++i)
+	{
+		outObjects[i] = *nearest[i].object;
+		if (outDistancesSq)
+			outDistancesSq[i] = nearest[i].distanceSq;
+	}
+	return nearest.Size();
+}
+
+template<typename T>
+void QuadTree<T>::ObjectsWithinRadius(const float2 &point, float radius, std::vector<T> &outObjects, std::vector<float> &outDistancesSq)
+{
+	MGL_PROFILE(QuadTree_ObjectsWithinRadius);
+	outObjects.clear();
+	outDistancesSq.clear();
+	if (!Root() || radius < 0.f)
+		return;
+
+	const float radiusSq = radius * radius;
+	const AABB2D queryAABB(point - float2(radius, radius), point + float2(radius, radius));
+	std::vector<TraversalStackItem> stack;
+	TraversalStackItem t;
+	t.node = Root();
+	if (!queryAABB.Intersects(LooseAABB(t.node)))
+		return;
+	stack.push_back(t);
+
+	while(!stack.empty())
+	{
+		Node *n = stack.back().node;
+		stack.pop_back();
+
+		for(size_t i = 0; i < n->objects.size(); ++i)
+		{
+			float d = ObjectDistanceSq(n->objects[i], point);
+			if (d <= radiusSq)
+			{
+				outObjects.push_back(n->objects[i]);
+				outDistancesSq.push_back(d);
+			}
+		}
+
+		if (!n->IsLeaf())
+			PushIntersectingChildren(n, queryAABB, stack);
+	}
+}
+
 template<typename T>
 void QuadTree<T>::GrowRootTopLeft()
 {
@@ -770,12 +1024,13 @@ void QuadTree<T>::DebugSanityCheckNode(Node *n)
 	assert(aabb.minPoint.y <= aabb.maxPoint.y);
 
 	LOGI("Node AABB: %s.", aabb.ToString().c_str());
-	// Each object in this node must be contained in this node.
+	// Each object in this node must be contained in the loose bounds of this node.
+	AABB2D looseAABB = LooseAABB(n);
 	for(size_t i = 0; i < n->objects.size(); ++i)
 	{
 		LOGI("Object AABB: %s.", GetAABB2D(n->objects[i]).ToString().c_str());
 
-		assert(aabb.Contains(GetAABB2D(n->objects[i])));
+		assert(looseAABB.Contains(GetAABB2D(n->objects[i])));
 	}
 
 	// Parent <-> child links must be valid.
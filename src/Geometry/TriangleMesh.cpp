@@ -22,12 +22,15 @@
 #include "Triangle.h"
 #include "Ray.h"
 #include "Polyhedron.h"
+#include "AABB.h"
 #include "../MathGeoLibFwd.h"
 #include "../Math/MathConstants.h"
 #include "../Math/myassert.h"
-#include "../../tests/SystemInfo.h"
+#include "../Math/SIMDCapability.h"
+#include "../Algorithm/Parallel.h"
 
 #include <vector>
+#include <algorithm>
 
 #include "../Math/SSEMath.h"
 
@@ -35,140 +38,25 @@
 // instead of (v0, v1, v2) triplets for faster ray-triangle mesh intersection.
 #define SOA_HAS_EDGES
 
-MATH_BEGIN_NAMESPACE
-
-enum SIMDCapability
-{
-	SIMD_NONE,
-	SIMD_SSE,
-	SIMD_SSE2,
-//	SIMD_SSE3,
-//	SIMD_SSSE3,
-//	SIMD_SSE4,
-	SIMD_SSE41,
-//	SIMD_SSE42,
-	SIMD_AVX
-};
-
-SIMDCapability DetectSIMDCapability()
-{
-#ifdef WIN32 ///\todo SIMD detection for other x86 platforms.
-
-#ifdef MATH_SSE
-	int CPUInfo[4] = {-1};
-
-	unsigned    nIds;//, nExIds, i;
-	int nFeatureInfo = 0;
-//	bool    bSSE3Instructions = false;
-//	bool    bSupplementalSSE3 = false;
-//	bool    bCMPXCHG16B = false;
-#ifdef MATH_SSE41
-	bool    bSSE41Extensions = false;
-#endif
-//	bool    bSSE42Extensions = false;
-//	bool    bPOPCNT = false;
-
-//	bool    bLAHF_SAHFAvailable = false;
-//	bool    bCmpLegacy = false;
-//	bool    bLZCNT = false;
-//	bool    bSSE4A = false;
-//	bool    bMisalignedSSE = false;
-//	bool    bPREFETCH = false;
-//	bool    bMMXExtensions = false;
-//	bool    b3DNowExt = false;
-//	bool    b3DNow = false;
-//	bool    bFP128 = false;
-#ifdef MATH_AVX
-	bool    hasAVX = false;
-#endif
-//	bool    bMOVOptimization = false;
-
-	CpuId(CPUInfo, 0);
-	nIds = CPUInfo[0];
-
-	// Get the information associated with each valid Id
-//	for (i=0; i<=nIds; ++i)
-	if (nIds >= 1)
-	{
-	//	__cpuid(CPUInfo, i);
-
-		CpuId(CPUInfo, 1);
-		// Interpret CPU feature information.
-//		if  (i == 1)
-		{
-//			bSSE3Instructions = (CPUInfo[2] & 0x1) || false;
-//			bSupplementalSSE3 = (CPUInfo[2] & 0x200) || false;
-//			bCMPXCHG16B= (CPUInfo[2] & 0x2000) || false;
-//			bSSE41Extensions = (CPUInfo[2] & 0x80000) || false;
-//			bSSE42Extensions = (CPUInfo[2] & 0x100000) || false;
-//			bPOPCNT= (CPUInfo[2] & 0x800000) || false;
-#ifdef MATH_AVX
-			hasAVX = (CPUInfo[2] & 0x10000000) || false;
-#endif
-			nFeatureInfo = CPUInfo[3];
-		}
-	}
-
-//	const bool hasMMX = (nFeatureInfo & (1 << 23)) != 0;
-
-	// Calling __cpuid with 0x80000000 as the InfoType argument
-	// gets the number of valid extended IDs.
-//	__cpuid(CPUInfo, 0x80000000);
-//	nExIds = CPUInfo[0];
-/*
-	// Get the information associated with each extended ID.
-	for (i=0x80000000; i<=nExIds; ++i)
-	{
-		__cpuid(CPUInfo, i);
-
-		if  (i == 0x80000001)
-		{
-			bLAHF_SAHFAvailable = (CPUInfo[2] & 0x1) || false;
-			bCmpLegacy = (CPUInfo[2] & 0x2) || false;
-			bLZCNT = (CPUInfo[2] & 0x20) || false;
-			bSSE4A = (CPUInfo[2] & 0x40) || false;
-			bMisalignedSSE = (CPUInfo[2] & 0x80) || false;
-			bPREFETCH = (CPUInfo[2] & 0x100) || false;
-			bMMXExtensions = (CPUInfo[3] & 0x40000) || false;
-			b3DNowExt = (CPUInfo[3] & 0x40000000) || false;
-			b3DNow = (CPUInfo[3] & 0x80000000) || false;
-		}
-
-		if  (i == 0x8000001A)
-		{
-			bFP128 = (CPUInfo[0] & 0x1) || false;
-			bMOVOptimization = (CPUInfo[0] & 0x2) || false;
-		}
-	}
-*/
-#ifdef MATH_AVX
-	if (hasAVX)
-		return SIMD_AVX;
-#endif
-#ifdef MATH_SSE41
-	if (bSSE41Extensions)
-		return SIMD_SSE41;
-#endif
-#ifdef MATH_SSE2
-	const bool hasSSE2 = (nFeatureInfo & (1 << 26)) != 0;
-	if (hasSSE2)
-		return SIMD_SSE2;
-#endif
-#ifdef MATH_SSE
-	const bool hasSSE = (nFeatureInfo & (1 << 25)) != 0;
-	if (hasSSE)
-		return SIMD_SSE;
-#endif
+// The batched ray intersection routines test blocks of rays against blocks of triangles. A block of triangles
+// takes 36 bytes per triangle, so a block of 256 triangles (9KB) stays resident in the L1 cache while the rays of
+// a ray block are tested against it.
+static const int intersectRaysTriangleBlockSize = 256;
+static const int intersectRaysRayBlockSize = 64;
+// The minimum number of rays to process in a single task when intersecting rays using multiple threads.
+static const int minRaysPerIntersectTask = 256;
+// The maximum number of triangles in a BVH leaf. This is a multiple of each SIMD width, so that the leaves consist of
+// whole SoA blocks.
+static const int bvhLeafTriangles = 16;
 
-#endif // ~ MATH_SSE not defined.
-#endif
-	return SIMD_NONE;
-}
+MATH_BEGIN_NAMESPACE
 
-const int simdCapability = DetectSIMDCapability();
+// The SIMD instruction set level to use. This determines the vertex data layout that Set() produces, so it must stay
+// fixed for the lifetime of the program.
+const int simdCapability = ActiveSIMDCapability();
 
 TriangleMesh::TriangleMesh()
-:data(0), numTriangles(0), vertexSizeBytes(0)
+:data(0), numTriangles(0), vertexSizeBytes(0), bvhNodes(0), numBVHNodes(0), bvhTriangleIndices(0)
 #ifdef _DEBUG
 , vertexDataLayout(0)
 #endif
@@ -179,10 +67,11 @@ TriangleMesh::TriangleMesh()
 TriangleMesh::~TriangleMesh()
 {
 	AlignedFree(data);
+	FreeBVH();
 }
 
 TriangleMesh::TriangleMesh(const TriangleMesh &rhs)
-:data(0), numTriangles(0), vertexSizeBytes(0)
+:data(0), numTriangles(0), vertexSizeBytes(0), bvhNodes(0), numBVHNodes(0), bvhTriangleIndices(0)
 #ifdef _DEBUG
 , vertexDataLayout(0)
 #endif
@@ -201,15 +90,39 @@ TriangleMesh &TriangleMesh::operator =(const TriangleMesh &rhs)
 	ReallocVertexBuffer(rhs.numTriangles, rhs.vertexSizeBytes);
 	memcpy(data, rhs.data, numTriangles*3*vertexSizeBytes);
 
+	FreeBVH();
+	if (rhs.bvhNodes)
+	{
+		numBVHNodes = rhs.numBVHNodes;
+		bvhNodes = new TriangleMeshBVHNode[numBVHNodes];
+		memcpy(bvhNodes, rhs.bvhNodes, numBVHNodes*sizeof(TriangleMeshBVHNode));
+		bvhTriangleIndices = new int[numTriangles];
+		memcpy(bvhTriangleIndices, rhs.bvhTriangleIndices, numTriangles*sizeof(int));
+	}
+
 	return *this;
 }
 
+// Returns the number of triangles in a block of the SoA vertex data layout that Set() produces.
+static int SoABlockSize()
+{
+#ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
+	if (simdCapability == SIMD_AVX512)
+		return 16;
+	if (simdCapability == SIMD_AVX)
+		return 8;
+	if (simdCapability == SIMD_SSE41 || simdCapability == SIMD_SSE2)
+		return 4;
+#endif
+	return 1;
+}
+
 void TriangleMesh::Set(const Polyhedron &polyhedron)
 {
 	TriangleArray tris = polyhedron.Triangulate();
 	if (!tris.empty())
 	{
-		int alignment = (simdCapability == SIMD_AVX) ? 8 : ((simdCapability == SIMD_SSE41 || simdCapability == SIMD_SSE2) ? 4 : 1);
+		int alignment = SoABlockSize();
 		vec degen = POINT_VEC_SCALAR(-FLOAT_INF);
 		Triangle degent(degen, degen, degen);
 		while(tris.size() % alignment != 0)
@@ -218,30 +131,166 @@ void TriangleMesh::Set(const Polyhedron &polyhedron)
 	}
 }
 
-void TriangleMesh::Set(const float *triangleMesh, int numTris, int vtxSizeBytes)
+struct BVHBuildTriangle
+{
+	AABB aabb;
+	vec centroid;
+	int index; // The index of the triangle in the input array, or -1 for a padding triangle.
+};
+
+// Orders the triangles by their centroid along the given axis, and places all padding triangles after the real ones.
+struct BVHBuildTriangleLess
+{
+	int axis;
+	explicit BVHBuildTriangleLess(int axis_):axis(axis_) {}
+	bool operator()(const BVHBuildTriangle &a, const BVHBuildTriangle &b) const
+	{
+		if (a.index == -1 || b.index == -1)
+			return a.index != -1 && b.index == -1;
+		return a.centroid[axis] < b.centroid[axis];
+	}
+};
+
+// Recursively builds the BVH node for the triangles [begin, end[ by splitting them at the centroid median along the
+// axis of the largest centroid extent. Each split is rounded to a multiple of blockSize, so that every leaf starts at an
+// SoA block boundary. Returns the index of the created node.
+static int BuildBVHNode(std::vector<TriangleMeshBVHNode> &nodes, BVHBuildTriangle *tris, int begin, int end, int blockSize)
+{
+	const int nodeIndex = (int)nodes.size();
+	nodes.push_back(TriangleMeshBVHNode());
+
+	AABB bounds;
+	AABB centroidBounds;
+	bounds.SetNegativeInfinity();
+	centroidBounds.SetNegativeInfinity();
+	for(int i = begin; i < end; ++i)
+		if (tris[i].index != -1)
+		{
+			bounds.Enclose(tris[i].aabb);
+			centroidBounds.Enclose(tris[i].centroid);
+		}
+
+	int childOrFirstTriangle = begin;
+	int numTris = end - begin;
+	if (numTris > bvhLeafTriangles)
+	{
+		const vec size = centroidBounds.Size();
+		const int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+		const int mid = begin + (numTris / 2 + blockSize - 1) / blockSize * blockSize;
+		std::nth_element(tris + begin, tris + mid, tris + end, BVHBuildTriangleLess(axis));
+		BuildBVHNode(nodes, tris, begin, mid, blockSize);
+		childOrFirstTriangle = BuildBVHNode(nodes, tris, mid, end, blockSize);
+		numTris = 0;
+	}
+
+	TriangleMeshBVHNode &node = nodes[nodeIndex];
+	for(int i = 0; i < 3; ++i)
+	{
+		node.aabbMin[i] = bounds.minPoint[i];
+		node.aabbMax[i] = bounds.maxPoint[i];
+	}
+	node.childOrFirstTriangle = childOrFirstTriangle;
+	node.numTriangles = numTris;
+	return nodeIndex;
+}
+
+void TriangleMesh::Set(const float *triangleMesh, int numTris, int vtxSizeBytes, bool buildBVH)
 {
+	FreeBVH();
+
+	std::vector<float> sortedVertexData;
+	std::vector<TriangleMeshBVHNode> nodes;
+	std::vector<int> triangleIndices;
+	if (buildBVH && numTris > 0)
+	{
+		assert(vtxSizeBytes % 4 == 0);
+		const int vertexSizeFloats = vtxSizeBytes / 4;
+		const int triangleSizeFloats = vertexSizeFloats * 3;
+		const int blockSize = SoABlockSize();
+		const int numPaddedTris = (numTris + blockSize - 1) / blockSize * blockSize;
+
+		std::vector<BVHBuildTriangle> tris(numPaddedTris);
+		for(int i = 0; i < numPaddedTris; ++i)
+		{
+			tris[i].index = (i < numTris) ? i : -1;
+			if (i >= numTris)
+				continue;
+			const float *t = triangleMesh + i * triangleSizeFloats;
+			const vec a = POINT_VEC(t[0], t[1], t[2]);
+			const vec b = POINT_VEC(t[vertexSizeFloats], t[vertexSizeFloats+1], t[vertexSizeFloats+2]);
+			const vec c = POINT_VEC(t[2*vertexSizeFloats], t[2*vertexSizeFloats+1], t[2*vertexSizeFloats+2]);
+			tris[i].aabb = Triangle(a, b, c).BoundingAABB();
+			tris[i].centroid = (a + b + c) / 3.f;
+		}
+
+		BuildBVHNode(nodes, &tris[0], 0, numPaddedTris, blockSize);
+
+		// Rearrange the vertex data to the BVH leaf order. The padding triangles are zero-area triangles at the
+		// origin, which never produce a hit.
+		sortedVertexData.resize(numPaddedTris * triangleSizeFloats, 0.f);
+		triangleIndices.resize(numPaddedTris);
+		for(int i = 0; i < numPaddedTris; ++i)
+		{
+			triangleIndices[i] = tris[i].index;
+			if (tris[i].index != -1)
+				memcpy(&sortedVertexData[i * triangleSizeFloats], triangleMesh + tris[i].index * triangleSizeFloats, triangleSizeFloats * sizeof(float));
+		}
+		triangleMesh = &sortedVertexData[0];
+		numTris = numPaddedTris;
+	}
+
 #ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
-	if (simdCapability == SIMD_AVX)
-		SetSoA8(triangleMesh, numTriangles, vertexSizeBytes);
+	if (simdCapability == SIMD_AVX512)
+		SetSoA16(triangleMesh, numTris, vtxSizeBytes);
+	else if (simdCapability == SIMD_AVX)
+		SetSoA8(triangleMesh, numTris, vtxSizeBytes);
 	else if (simdCapability == SIMD_SSE41 || simdCapability == SIMD_SSE2)
-		SetSoA4(triangleMesh, numTriangles, vertexSizeBytes);
+		SetSoA4(triangleMesh, numTris, vtxSizeBytes);
 	else
 #endif
 		SetAoS(triangleMesh, numTris, vtxSizeBytes);
+
+	if (!nodes.empty())
+	{
+		numBVHNodes = (int)nodes.size();
+		bvhNodes = new TriangleMeshBVHNode[numBVHNodes];
+		memcpy(bvhNodes, &nodes[0], numBVHNodes * sizeof(TriangleMeshBVHNode));
+		bvhTriangleIndices = new int[numTris];
+		memcpy(bvhTriangleIndices, &triangleIndices[0], numTris * sizeof(int));
+	}
+}
+
+void TriangleMesh::FreeBVH()
+{
+	delete[] bvhNodes;
+	delete[] bvhTriangleIndices;
+	bvhNodes = 0;
+	bvhTriangleIndices = 0;
+	numBVHNodes = 0;
 }
 
 float TriangleMesh::IntersectRay(const Ray &ray) const
 {
+	if (bvhNodes)
+	{
+		int triangleIndex;
+		float u, v;
+		return IntersectRayBVH(ray, FLOAT_INF, false, triangleIndex, u, v);
+	}
 #ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
-#ifdef MATH_AVX
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return IntersectRay_AVX512(ray);
+#endif
+#ifdef MATH_AVX_KERNELS
 	if (simdCapability == SIMD_AVX)
 		return IntersectRay_AVX(ray);
 #endif
-#ifdef MATH_SSE41
+#ifdef MATH_SSE41_KERNELS
 	if (simdCapability == SIMD_SSE41)
 		return IntersectRay_SSE41(ray);
 #endif
-#ifdef MATH_SSE2
+#ifdef MATH_SSE2_KERNELS
 	if (simdCapability == SIMD_SSE2)
 		return IntersectRay_SSE2(ray);
 #endif
@@ -253,16 +302,25 @@ float TriangleMesh::IntersectRay(const Ray &ray) const
 
 float TriangleMesh::IntersectRay_TriangleIndex(const Ray &ray, int &outTriangleIndex) const
 {
+	if (bvhNodes)
+	{
+		float u, v;
+		return IntersectRayBVH(ray, FLOAT_INF, false, outTriangleIndex, u, v);
+	}
 #ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
-#ifdef MATH_AVX
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return IntersectRay_TriangleIndex_AVX512(ray, outTriangleIndex);
+#endif
+#ifdef MATH_AVX_KERNELS
 	if (simdCapability == SIMD_AVX)
 		return IntersectRay_TriangleIndex_AVX(ray, outTriangleIndex);
 #endif
-#ifdef MATH_SSE41
+#ifdef MATH_SSE41_KERNELS
 	if (simdCapability == SIMD_SSE41)
 		return IntersectRay_TriangleIndex_SSE41(ray, outTriangleIndex);
 #endif
-#ifdef MATH_SSE2
+#ifdef MATH_SSE2_KERNELS
 	if (simdCapability == SIMD_SSE2)
 		return IntersectRay_TriangleIndex_SSE2(ray, outTriangleIndex);
 #endif
@@ -273,16 +331,22 @@ float TriangleMesh::IntersectRay_TriangleIndex(const Ray &ray, int &outTriangleI
 
 float TriangleMesh::IntersectRay_TriangleIndex_UV(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
 {
+	if (bvhNodes)
+		return IntersectRayBVH(ray, FLOAT_INF, false, outTriangleIndex, outU, outV);
 #ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
-#ifdef MATH_AVX
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return IntersectRay_TriangleIndex_UV_AVX512(ray, outTriangleIndex, outU, outV);
+#endif
+#ifdef MATH_AVX_KERNELS
 	if (simdCapability == SIMD_AVX)
 		return IntersectRay_TriangleIndex_UV_AVX(ray, outTriangleIndex, outU, outV);
 #endif
-#ifdef MATH_SSE41
+#ifdef MATH_SSE41_KERNELS
 	if (simdCapability == SIMD_SSE41)
 		return IntersectRay_TriangleIndex_UV_SSE41(ray, outTriangleIndex, outU, outV);
 #endif
-#ifdef MATH_SSE2
+#ifdef MATH_SSE2_KERNELS
 	if (simdCapability == SIMD_SSE2)
 		return IntersectRay_TriangleIndex_UV_SSE2(ray, outTriangleIndex, outU, outV);
 #endif
@@ -291,11 +355,383 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV(const Ray &ray, int &outTriang
 	return IntersectRay_TriangleIndex_UV_CPP(ray, outTriangleIndex, outU, outV);
 }
 
+bool TriangleMesh::IntersectRayAny(const Ray &ray, float maxDistance) const
+{
+	if (bvhNodes)
+	{
+		int triangleIndex = -1;
+		float u, v;
+		IntersectRayBVH(ray, maxDistance, true, triangleIndex, u, v);
+		return triangleIndex != -1;
+	}
+#ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return IntersectRayAny_AVX512(ray, maxDistance);
+#endif
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability == SIMD_AVX)
+		return IntersectRayAny_AVX(ray, maxDistance);
+#endif
+#ifdef MATH_SSE41_KERNELS
+	if (simdCapability == SIMD_SSE41)
+		return IntersectRayAny_SSE41(ray, maxDistance);
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability == SIMD_SSE2)
+		return IntersectRayAny_SSE2(ray, maxDistance);
+#endif
+#endif
+
+	return IntersectRayAny_CPP(ray, maxDistance);
+}
+
+void TriangleMesh::IntersectRays(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+#ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return IntersectRays_AVX512(rays, numRays, outT, outTriangleIndex, numThreads);
+#endif
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability == SIMD_AVX)
+		return IntersectRays_AVX(rays, numRays, outT, outTriangleIndex, numThreads);
+#endif
+#ifdef MATH_SSE41_KERNELS
+	if (simdCapability == SIMD_SSE41)
+		return IntersectRays_SSE41(rays, numRays, outT, outTriangleIndex, numThreads);
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability == SIMD_SSE2)
+		return IntersectRays_SSE2(rays, numRays, outT, outTriangleIndex, numThreads);
+#endif
+#endif
+
+	IntersectRays_CPP(rays, numRays, outT, outTriangleIndex, numThreads);
+}
+
+void TriangleMesh::IntersectRays_CPP(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+#ifdef _DEBUG
+	assert(vertexDataLayout == 0); // Must be AoS structured!
+#endif
+	IntersectRaysParallel(&TriangleMesh::IntersectRayRange_CPP, rays, numRays, outT, outTriangleIndex, numThreads);
+}
+
+#ifdef MATH_SSE2_KERNELS
+void TriangleMesh::IntersectRays_SSE2(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+	IntersectRaysParallel(&TriangleMesh::IntersectRayRange_SSE2, rays, numRays, outT, outTriangleIndex, numThreads);
+}
+#endif
+
+#ifdef MATH_SSE41_KERNELS
+void TriangleMesh::IntersectRays_SSE41(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+	IntersectRaysParallel(&TriangleMesh::IntersectRayRange_SSE41, rays, numRays, outT, outTriangleIndex, numThreads);
+}
+#endif
+
+#ifdef MATH_AVX_KERNELS
+void TriangleMesh::IntersectRays_AVX(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+	IntersectRaysParallel(&TriangleMesh::IntersectRayRange_AVX, rays, numRays, outT, outTriangleIndex, numThreads);
+}
+#endif
+
+#ifdef MATH_AVX512_KERNELS
+void TriangleMesh::IntersectRays_AVX512(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+	IntersectRaysParallel(&TriangleMesh::IntersectRayRange_AVX512, rays, numRays, outT, outTriangleIndex, numThreads);
+}
+#endif
+
+void TriangleMesh::IntersectRaysBlocked(IntersectRayRangeFunc intersectRange, const Ray *rays, int numRays, float *outT, int *outTriangleIndex) const
+{
+	if (bvhNodes)
+	{
+		// With a BVH, each ray only visits a small part of the triangle data, so there is nothing to gain from
+		// blocking the rays.
+		for(int i = 0; i < numRays; ++i)
+		{
+			int triangleIndex = -1;
+			float u, v;
+			outT[i] = IntersectRayBVH(rays[i], FLOAT_INF, false, triangleIndex, u, v);
+			if (outTriangleIndex)
+				outTriangleIndex[i] = triangleIndex;
+		}
+		return;
+	}
+
+	for(int i = 0; i < numRays; ++i)
+	{
+		outT[i] = FLOAT_INF;
+		if (outTriangleIndex)
+			outTriangleIndex[i] = -1;
+	}
+
+	for(int rayStart = 0; rayStart < numRays; rayStart += intersectRaysRayBlockSize)
+	{
+		const int rayEnd = Min(rayStart + intersectRaysRayBlockSize, numRays);
+		for(int triStart = 0; triStart < numTriangles; triStart += intersectRaysTriangleBlockSize)
+		{
+			const int triEnd = Min(triStart + intersectRaysTriangleBlockSize, numTriangles);
+			for(int i = rayStart; i < rayEnd; ++i)
+			{
+				int triangleIndex = -1;
+				outT[i] = (this->*intersectRange)(rays[i], triStart, triEnd, outT[i], triangleIndex);
+				if (triangleIndex != -1 && outTriangleIndex)
+					outTriangleIndex[i] = triangleIndex;
+			}
+		}
+	}
+}
+
+struct TriangleMesh::IntersectRaysJob
+{
+	const TriangleMesh *mesh;
+	IntersectRayRangeFunc intersectRange;
+	const Ray *rays;
+	int numRays;
+	float *outT;
+	int *outTriangleIndex;
+	int raysPerTask;
+};
+
+void TriangleMesh::IntersectRaysTask(void *userData, int taskIndex)
+{
+	const IntersectRaysJob *job = reinterpret_cast<const IntersectRaysJob*>(userData);
+	const int rayStart = taskIndex * job->raysPerTask;
+	const int numRays = Min(job->raysPerTask, job->numRays - rayStart);
+	job->mesh->IntersectRaysBlocked(job->intersectRange, job->rays + rayStart, numRays, job->outT + rayStart,
+		job->outTriangleIndex ? job->outTriangleIndex + rayStart : 0);
+}
+
+void TriangleMesh::IntersectRaysParallel(IntersectRayRangeFunc intersectRange, const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const
+{
+	assume(rays || numRays == 0);
+	assume(outT || numRays == 0);
+	assume(numThreads >= 0);
+	if (numThreads <= 0)
+		numThreads = NumHardwareThreads();
+
+	const int numTasks = Min(numThreads * 4, numRays / minRaysPerIntersectTask);
+	if (numThreads <= 1 || numTasks <= 1)
+	{
+		IntersectRaysBlocked(intersectRange, rays, numRays, outT, outTriangleIndex);
+		return;
+	}
+
+	IntersectRaysJob job;
+	job.mesh = this;
+	job.intersectRange = intersectRange;
+	job.rays = rays;
+	job.numRays = numRays;
+	job.outT = outT;
+	job.outTriangleIndex = outTriangleIndex;
+	job.raysPerTask = (numRays + numTasks - 1) / numTasks;
+	RunParallelTasks(&TriangleMesh::IntersectRaysTask, &job, (numRays + job.raysPerTask - 1) / job.raysPerTask, numThreads);
+}
+
+struct IntersectRayTaskResult
+{
+	float t;
+	int triangleIndex;
+	float u;
+	float v;
+};
+
+struct TriangleMesh::IntersectRayJob
+{
+	const TriangleMesh *mesh;
+	IntersectRayRangeUVFunc intersectRange;
+	const Ray *ray;
+	int trianglesPerTask;
+	IntersectRayTaskResult *results;
+};
+
+void TriangleMesh::IntersectRayTask(void *userData, int taskIndex)
+{
+	const IntersectRayJob *job = reinterpret_cast<const IntersectRayJob*>(userData);
+	const int triStart = taskIndex * job->trianglesPerTask;
+	const int triEnd = Min(triStart + job->trianglesPerTask, job->mesh->numTriangles);
+	IntersectRayTaskResult &result = job->results[taskIndex];
+	result.triangleIndex = -1;
+	result.t = (job->mesh->*job->intersectRange)(*job->ray, triStart, triEnd, FLOAT_INF, result.triangleIndex, result.u, result.v);
+}
+
+TriangleMesh::IntersectRayRangeUVFunc TriangleMesh::ActiveIntersectRayRangeUVFunc() const
+{
+#ifndef MATH_AUTOMATIC_SSE // TODO: Restore support for this when MATH_AUTOMATIC_SSE is defined!
+#ifdef MATH_AVX512_KERNELS
+	if (simdCapability == SIMD_AVX512)
+		return &TriangleMesh::IntersectRayRange_UV_AVX512;
+#endif
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability == SIMD_AVX)
+		return &TriangleMesh::IntersectRayRange_UV_AVX;
+#endif
+#ifdef MATH_SSE41_KERNELS
+	if (simdCapability == SIMD_SSE41)
+		return &TriangleMesh::IntersectRayRange_UV_SSE41;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability == SIMD_SSE2)
+		return &TriangleMesh::IntersectRayRange_UV_SSE2;
+#endif
+#endif
+	return &TriangleMesh::IntersectRayRange_UV_CPP;
+}
+
+float TriangleMesh::IntersectRayParallel(const Ray &ray, int &outTriangleIndex, float &outU, float &outV, int numThreads, int minTrianglesPerTask) const
+{
+	assume(numThreads >= 0);
+	assume(minTrianglesPerTask > 0);
+	if (numThreads <= 0)
+		numThreads = NumHardwareThreads();
+
+	const IntersectRayRangeUVFunc intersectRange = ActiveIntersectRayRangeUVFunc();
+
+	// Round the task size up to a whole number of SoA blocks, so that every task starts at a block boundary in
+	// each of the vertex data layouts.
+	const int trianglesPerTask = (Max(minTrianglesPerTask, 1) + 15) & ~15;
+	const int numTasks = (numTriangles + trianglesPerTask - 1) / trianglesPerTask;
+	if (numTasks <= 1)
+	{
+		int triangleIndex = -1;
+		float u, v;
+		float t = (this->*intersectRange)(ray, 0, numTriangles, FLOAT_INF, triangleIndex, u, v);
+		if (triangleIndex != -1)
+		{
+			outTriangleIndex = bvhTriangleIndices ? bvhTriangleIndices[triangleIndex] : triangleIndex;
+			outU = u;
+			outV = v;
+		}
+		return t;
+	}
+
+	std::vector<IntersectRayTaskResult> results(numTasks);
+	IntersectRayJob job;
+	job.mesh = this;
+	job.intersectRange = intersectRange;
+	job.ray = &ray;
+	job.trianglesPerTask = trianglesPerTask;
+	job.results = &results[0];
+	if (numThreads <= 1)
+	{
+		// Use the same partitioning as the threaded path, so that the result does not depend on the thread count.
+		for(int i = 0; i < numTasks; ++i)
+			IntersectRayTask(&job, i);
+	}
+	else
+		RunParallelTasks(&TriangleMesh::IntersectRayTask, &job, numTasks, numThreads);
+
+	// Reduce in task order, and only accept strictly closer hits, so that ties always resolve to the same triangle
+	// regardless of the order in which the tasks finished.
+	float nearestT = FLOAT_INF;
+	for(int i = 0; i < numTasks; ++i)
+		if (results[i].triangleIndex != -1 && results[i].t < nearestT)
+		{
+			nearestT = results[i].t;
+			outTriangleIndex = bvhTriangleIndices ? bvhTriangleIndices[results[i].triangleIndex] : results[i].triangleIndex;
+			outU = results[i].u;
+			outV = results[i].v;
+		}
+	return nearestT;
+}
+
+// Returns the distance along the ray to the point where it enters the given BVH node, or FLOAT_INF if the ray misses
+// the node or enters it only at a distance >= maxT.
+static inline float RayBVHNodeEntryDistance(const TriangleMeshBVHNode &node, const float *pos, const float *invDir, float maxT)
+{
+	float tNear = 0.f;
+	float tFar = maxT;
+	for(int i = 0; i < 3; ++i)
+	{
+		float t1 = (node.aabbMin[i] - pos[i]) * invDir[i];
+		float t2 = (node.aabbMax[i] - pos[i]) * invDir[i];
+		if (t1 > t2)
+			Swap(t1, t2);
+		tNear = Max(tNear, t1);
+		tFar = Min(tFar, t2);
+	}
+	// Widen the interval by a few ulps, so that rays that graze a flat node (e.g. a single axis-aligned triangle)
+	// are not rejected due to the rounding in the slab computations.
+	return (tNear <= tFar * 1.0000004f && tNear < maxT) ? tNear : FLOAT_INF;
+}
+
+float TriangleMesh::IntersectRayBVH(const Ray &ray, float maxT, bool anyHit, int &outTriangleIndex, float &outU, float &outV) const
+{
+	assume(bvhNodes);
+	const IntersectRayRangeUVFunc intersectRange = ActiveIntersectRayRangeUVFunc();
+	const float pos[3] = { ray.pos.x, ray.pos.y, ray.pos.z };
+	const float invDir[3] = { 1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z };
+
+	// The stack holds the nodes that remain to be visited, along with the distances at which the ray enters them.
+	// The tree is built by median splits, so its depth is logarithmic in the number of triangles.
+	int stackNodes[64];
+	float stackDistances[64];
+	int stackSize = 0;
+
+	float nearestT = maxT;
+	int nodeIndex = RayBVHNodeEntryDistance(bvhNodes[0], pos, invDir, nearestT) < FLOAT_INF ? 0 : -1;
+	while(nodeIndex != -1)
+	{
+		const TriangleMeshBVHNode &node = bvhNodes[nodeIndex];
+		nodeIndex = -1;
+		if (node.numTriangles > 0)
+		{
+			int triangleIndex = -1;
+			float u, v;
+			float t = (this->*intersectRange)(ray, node.childOrFirstTriangle, node.childOrFirstTriangle + node.numTriangles, nearestT, triangleIndex, u, v);
+			if (triangleIndex != -1)
+			{
+				nearestT = t;
+				outTriangleIndex = bvhTriangleIndices[triangleIndex];
+				outU = u;
+				outV = v;
+				if (anyHit)
+					return nearestT;
+			}
+		}
+		else
+		{
+			// Visit the nearer child first, since its hits make it more likely that the farther one can be skipped.
+			int first = (int)(&node - bvhNodes) + 1;
+			int second = node.childOrFirstTriangle;
+			float tFirst = RayBVHNodeEntryDistance(bvhNodes[first], pos, invDir, nearestT);
+			float tSecond = RayBVHNodeEntryDistance(bvhNodes[second], pos, invDir, nearestT);
+			if (tSecond < tFirst)
+			{
+				Swap(first, second);
+				Swap(tFirst, tSecond);
+			}
+			if (tSecond < FLOAT_INF)
+			{
+				assert(stackSize < 64);
+				stackNodes[stackSize] = second;
+				stackDistances[stackSize++] = tSecond;
+			}
+			if (tFirst < FLOAT_INF)
+				nodeIndex = first;
+		}
+
+		// Pop the next node that the ray may still hit closer than the nearest hit found so far.
+		while(nodeIndex == -1 && stackSize > 0)
+		{
+			--stackSize;
+			if (stackDistances[stackSize] < nearestT)
+				nodeIndex = stackNodes[stackSize];
+		}
+	}
+	return nearestT;
+}
+
 void TriangleMesh::ReallocVertexBuffer(int numTris, int vertexSizeBytes_)
 {
 	AlignedFree(data);
 	vertexSizeBytes = vertexSizeBytes_;
-	data = (float*)AlignedMalloc(numTris * 3 * vertexSizeBytes, 32);
+	data = (float*)AlignedMalloc(numTris * 3 * vertexSizeBytes, 64);
 	numTriangles = numTris;
 }
 
@@ -407,6 +843,51 @@ void TriangleMesh::SetSoA8(const float *vertexData, int numTris, int vtxSizeByte
 #endif
 }
 
+void TriangleMesh::SetSoA16(const float *vertexData, int numTris, int vtxSizeBytes)
+{
+	ReallocVertexBuffer(numTris, 3*sizeof(float));
+#ifdef _DEBUG
+	vertexDataLayout = 3; // SoA16
+#endif
+
+	assert(vtxSizeBytes % 4 == 0);
+	int vertexSizeFloats = vtxSizeBytes / 4;
+	int triangleSizeFloats = vertexSizeFloats * 3;
+	assert(numTris % 16 == 0); // We must have an evenly divisible amount of triangles, so that the SoA swizzling succeeds.
+
+	// From 16x (xyz xyz xyz)
+	// To 16x x, 16x y, 16x z for each of v0, v1 and v2.
+
+	float *o = data;
+	for(int i = 0; i + 16 <= numTris; i += 16) // 16 triangles at a time.
+	{
+		for (int j = 0; j < 3; ++j) // v0, v1, v2
+		{
+			const float *src = vertexData;
+			for (int k = 0; k < 3; ++k) // x,y,z
+			{
+				for(int l = 0; l < 16; ++l)
+					*o++ = src[l * triangleSizeFloats];
+				++src;
+			}
+			vertexData += vertexSizeFloats;
+		}
+		vertexData += 15 * triangleSizeFloats;
+	}
+
+#ifdef SOA_HAS_EDGES
+	o = data;
+	for(int i = 0; i + 16 <= numTris; i += 16)
+	{
+		for(int j = 48; j < 96; ++j)
+			o[j] -= o[j-48];
+		for(int j = 96; j < 144; ++j)
+			o[j] -= o[j-96];
+		o += 144;
+	}
+#endif
+}
+
 float TriangleMesh::IntersectRay_TriangleIndex_UV_CPP(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
 {
 	assert(sizeof(float3) == 3*sizeof(float));
@@ -435,9 +916,70 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_CPP(const Ray &ray, int &outTr
 	return nearestD;
 }
 
+bool TriangleMesh::IntersectRayAny_CPP(const Ray &ray, float maxDistance) const
+{
+#ifdef _DEBUG
+	assert(vertexDataLayout == 0); // Must be AoS structured!
+#endif
+
+	const Triangle *tris = reinterpret_cast<const Triangle*>(data);
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		float u, v;
+		float d = Triangle::IntersectLineTri(ray.pos, ray.dir, tris->a, tris->b, tris->c, u, v);
+		if (d >= 0.f && d < maxDistance)
+			return true;
+		++tris;
+	}
+
+	return false;
+}
+
+float TriangleMesh::IntersectRayRange_CPP(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const
+{
+	float nearestD = maxT;
+
+	const Triangle *tris = reinterpret_cast<const Triangle*>(data) + triStart;
+	for(int i = triStart; i < triEnd; ++i)
+	{
+		float u, v;
+		float d = Triangle::IntersectLineTri(ray.pos, ray.dir, tris->a, tris->b, tris->c, u, v);
+		if (d >= 0.f && d < nearestD)
+		{
+			nearestD = d;
+			outTriangleIndex = i;
+		}
+		++tris;
+	}
+
+	return nearestD;
+}
+
+float TriangleMesh::IntersectRayRange_UV_CPP(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const
+{
+	float nearestD = maxT;
+
+	const Triangle *tris = reinterpret_cast<const Triangle*>(data) + triStart;
+	for(int i = triStart; i < triEnd; ++i)
+	{
+		float u, v;
+		float d = Triangle::IntersectLineTri(ray.pos, ray.dir, tris->a, tris->b, tris->c, u, v);
+		if (d >= 0.f && d < nearestD)
+		{
+			nearestD = d;
+			outTriangleIndex = i;
+			outU = u;
+			outV = v;
+		}
+		++tris;
+	}
+
+	return nearestD;
+}
+
 MATH_END_NAMESPACE
 
-#ifdef MATH_SSE2
+#ifdef MATH_SSE2_KERNELS
 #define MATH_GEN_SSE2
 #include "TriangleMesh_IntersectRay_SSE.inl"
 
@@ -449,32 +991,106 @@ MATH_END_NAMESPACE
 #define MATH_GEN_TRIANGLEINDEX
 #define MATH_GEN_UV
 #include "TriangleMesh_IntersectRay_SSE.inl"
+
+#define MATH_GEN_SSE2
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_RANGE
+#include "TriangleMesh_IntersectRay_SSE.inl"
+
+#define MATH_GEN_SSE2
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_UV
+#define MATH_GEN_RANGE
+#include "TriangleMesh_IntersectRay_SSE.inl"
+
+#define MATH_GEN_SSE2
+#define MATH_GEN_ANY
+#include "TriangleMesh_IntersectRay_SSE.inl"
 #endif
 
-#ifdef MATH_SSE41
+#ifdef MATH_SSE41_KERNELS
+#define MATH_GEN_SSE41
+#include "TriangleMesh_IntersectRay_SSE.inl"
+
+#define MATH_GEN_SSE41
+#define MATH_GEN_TRIANGLEINDEX
+#include "TriangleMesh_IntersectRay_SSE.inl"
+
 #define MATH_GEN_SSE41
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_UV
 #include "TriangleMesh_IntersectRay_SSE.inl"
 
 #define MATH_GEN_SSE41
 #define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_RANGE
 #include "TriangleMesh_IntersectRay_SSE.inl"
 
 #define MATH_GEN_SSE41
 #define MATH_GEN_TRIANGLEINDEX
 #define MATH_GEN_UV
+#define MATH_GEN_RANGE
+#include "TriangleMesh_IntersectRay_SSE.inl"
+
+#define MATH_GEN_SSE41
+#define MATH_GEN_ANY
 #include "TriangleMesh_IntersectRay_SSE.inl"
 #endif
 
-#ifdef MATH_AVX
+#ifdef MATH_AVX_KERNELS
+#define MATH_GEN_AVX
+#include "TriangleMesh_IntersectRay_AVX.inl"
+
 #define MATH_GEN_AVX
+#define MATH_GEN_TRIANGLEINDEX
+#include "TriangleMesh_IntersectRay_AVX.inl"
+
+#define MATH_GEN_AVX
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_UV
 #include "TriangleMesh_IntersectRay_AVX.inl"
 
 #define MATH_GEN_AVX
 #define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_RANGE
 #include "TriangleMesh_IntersectRay_AVX.inl"
 
 #define MATH_GEN_AVX
 #define MATH_GEN_TRIANGLEINDEX
 #define MATH_GEN_UV
+#define MATH_GEN_RANGE
 #include "TriangleMesh_IntersectRay_AVX.inl"
+
+#define MATH_GEN_AVX
+#define MATH_GEN_ANY
+#include "TriangleMesh_IntersectRay_AVX.inl"
+#endif
+
+#ifdef MATH_AVX512_KERNELS
+#define MATH_GEN_AVX512
+#include "TriangleMesh_IntersectRay_AVX512.inl"
+
+#define MATH_GEN_AVX512
+#define MATH_GEN_TRIANGLEINDEX
+#include "TriangleMesh_IntersectRay_AVX512.inl"
+
+#define MATH_GEN_AVX512
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_UV
+#include "TriangleMesh_IntersectRay_AVX512.inl"
+
+#define MATH_GEN_AVX512
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_RANGE
+#include "TriangleMesh_IntersectRay_AVX512.inl"
+
+#define MATH_GEN_AVX512
+#define MATH_GEN_TRIANGLEINDEX
+#define MATH_GEN_UV
+#define MATH_GEN_RANGE
+#include "TriangleMesh_IntersectRay_AVX512.inl"
+
+#define MATH_GEN_AVX512
+#define MATH_GEN_ANY
+#include "TriangleMesh_IntersectRay_AVX512.inl"
 #endif
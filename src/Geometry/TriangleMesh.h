@@ -23,6 +23,19 @@
 
 MATH_BEGIN_NAMESPACE
 
+/// A node of the bounding volume hierarchy that TriangleMesh optionally builds over its triangles.
+/** The nodes are stored in a flat array in depth-first order, so the first child of an inner node immediately
+	follows it in the array. */
+struct TriangleMeshBVHNode
+{
+	float aabbMin[3];
+	/// For inner nodes, the index of the second child node. For leaf nodes, the index of the first triangle.
+	int childOrFirstTriangle;
+	float aabbMax[3];
+	/// The number of triangles in this leaf node, or 0 if this is an inner node.
+	int numTriangles;
+};
+
 /// Represents an unindiced triangle mesh.
 /** This class stores a triangle mesh as flat array, optimized for ray intersections. */
 class TriangleMesh
@@ -36,49 +49,151 @@ public:
 
 	/// Specifies the vertex data of this triangle mesh. Replaces any old
 	/// specified geometry.
-	/// @param vertexSizeBytes The size (stride) of a single vertex in memory.
-	void Set(const float *triangleMesh, int numTriangles, int vertexSizeBytes);
-	void Set(const float3 *triangleMesh, int numTris) { Set(reinterpret_cast<const float *>(triangleMesh), numTris, sizeof(float3)); }
-	void Set(const Triangle *triangleMesh, int numTris) { Set(reinterpret_cast<const float *>(triangleMesh), numTris, sizeof(Triangle)/3); }
+	/** @param vertexSizeBytes The size (stride) of a single vertex in memory.
+		@param buildBVH If true, a bounding volume hierarchy is built over the triangles, which makes the cost of
+			IntersectRay(), IntersectRayAny() and IntersectRays() logarithmic instead of linear in the number of
+			triangles. The triangles are then stored internally in the BVH leaf order, but the triangle indices that
+			the intersection functions return still refer to the order in which the triangles were passed in here.
+			When a BVH is built, numTriangles does not need to be a multiple of the SIMD width. */
+	void Set(const float *triangleMesh, int numTriangles, int vertexSizeBytes, bool buildBVH = false);
+	void Set(const float3 *triangleMesh, int numTris, bool buildBVH = false) { Set(reinterpret_cast<const float *>(triangleMesh), numTris, sizeof(float3), buildBVH); }
+	void Set(const Triangle *triangleMesh, int numTris, bool buildBVH = false) { Set(reinterpret_cast<const float *>(triangleMesh), numTris, sizeof(Triangle)/3, buildBVH); }
 
 	void Set(const Polyhedron &polyhedron);
 
+	/// Returns true if a bounding volume hierarchy was built for this mesh in the last call to Set().
+	bool HasBVH() const { return bvhNodes != 0; }
+
 	float IntersectRay(const Ray &ray) const;
 	float IntersectRay_TriangleIndex(const Ray &ray, int &outTriangleIndex) const;
 	float IntersectRay_TriangleIndex_UV(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
 
+	/// Computes the nearest intersection of each ray in the given array with this mesh.
+	/** The rays are processed in blocks against blocks of triangles, so that each block of triangle data is streamed
+		from memory once per block of rays instead of once per ray. Use this instead of repeated calls to IntersectRay()
+		when testing a large number of rays against a small mesh.
+		@param rays An array of numRays rays to test.
+		@param outT [out] An array of numRays elements that receives the distance to the nearest hit along each ray, or
+			FLOAT_INF if the ray does not hit the mesh.
+		@param outTriangleIndex [out] If not null, an array of numRays elements that receives the index of the triangle
+			that each ray hit, or -1 if the ray does not hit the mesh.
+		@param numThreads The maximum number of threads to use. If 0, the number of hardware threads is used. Small
+			batches of rays are always processed on the calling thread. */
+	void IntersectRays(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+
+	/// Tests whether the given ray hits any triangle of this mesh closer than the given distance.
+	/** Unlike IntersectRay(), this function returns as soon as it finds a hit, instead of searching for the nearest one.
+		Use this for shadow rays and line-of-sight tests.
+		@param maxDistance Only hits at a distance d < maxDistance along the ray are reported.
+		@return True if the ray hits a triangle at a distance [0, maxDistance[ along the ray. */
+	bool IntersectRayAny(const Ray &ray, float maxDistance = FLOAT_INF) const;
+
+	/// Computes the nearest intersection of the given ray with this mesh using multiple threads.
+	/** The triangle data is partitioned into tasks of consecutive triangles, each task finds the nearest hit in its
+		own range, and the per-task results are reduced in triangle order. The partitioning depends only on the number
+		of triangles and minTrianglesPerTask, and not on the number of threads, so the result is identical for any
+		thread count. Use this for single rays against very large meshes, e.g. millions of triangles. For small meshes,
+		the threading overhead dominates, and IntersectRay_TriangleIndex_UV() is faster.
+		@param outTriangleIndex [out] Receives the index of the triangle that was hit, or is left unmodified if there is no hit.
+		@param outU [out] Receives the barycentric U coordinate of the hit, or is left unmodified if there is no hit.
+		@param outV [out] Receives the barycentric V coordinate of the hit, or is left unmodified if there is no hit.
+		@param numThreads The maximum number of threads to use. If 0, the number of hardware threads is used.
+		@param minTrianglesPerTask The minimum number of triangles to process in a single task. If the mesh has fewer
+			triangles than this, the ray is processed on the calling thread.
+		@return The distance to the nearest hit along the ray, or FLOAT_INF if the ray does not hit the mesh. */
+	float IntersectRayParallel(const Ray &ray, int &outTriangleIndex, float &outU, float &outV, int numThreads = 0, int minTrianglesPerTask = 65536) const;
+
+	// The functions below operate directly on the internal vertex data layout. They always test all the triangles
+	// even if a BVH has been built, and if so, report the triangle indices in the internal BVH leaf order.
 	void SetAoS(const float *vertexData, int numTriangles, int vertexSizeBytes);
 	void SetSoA4(const float *vertexData, int numTriangles, int vertexSizeBytes);
 	void SetSoA8(const float *vertexData, int numTriangles, int vertexSizeBytes);
+	void SetSoA16(const float *vertexData, int numTriangles, int vertexSizeBytes);
 
 	float IntersectRay_TriangleIndex_UV_CPP(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
+	void IntersectRays_CPP(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+	bool IntersectRayAny_CPP(const Ray &ray, float maxDistance = FLOAT_INF) const;
 
-#ifdef MATH_SSE2
+#ifdef MATH_SSE2_KERNELS
 	float IntersectRay_SSE2(const Ray &ray) const;
 	float IntersectRay_TriangleIndex_SSE2(const Ray &ray, int &outTriangleIndex) const;
 	float IntersectRay_TriangleIndex_UV_SSE2(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
+	void IntersectRays_SSE2(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+	bool IntersectRayAny_SSE2(const Ray &ray, float maxDistance = FLOAT_INF) const;
 #endif
 
-#ifdef MATH_SSE41
+#ifdef MATH_SSE41_KERNELS
 	float IntersectRay_SSE41(const Ray &ray) const;
 	float IntersectRay_TriangleIndex_SSE41(const Ray &ray, int &outTriangleIndex) const;
 	float IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
+	void IntersectRays_SSE41(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+	bool IntersectRayAny_SSE41(const Ray &ray, float maxDistance = FLOAT_INF) const;
 #endif
 
-#ifdef MATH_AVX
+#ifdef MATH_AVX_KERNELS
 	float IntersectRay_AVX(const Ray &ray) const;
 	float IntersectRay_TriangleIndex_AVX(const Ray &ray, int &outTriangleIndex) const;
 	float IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
+	void IntersectRays_AVX(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+	bool IntersectRayAny_AVX(const Ray &ray, float maxDistance = FLOAT_INF) const;
+#endif
+
+#ifdef MATH_AVX512_KERNELS
+	float IntersectRay_AVX512(const Ray &ray) const;
+	float IntersectRay_TriangleIndex_AVX512(const Ray &ray, int &outTriangleIndex) const;
+	float IntersectRay_TriangleIndex_UV_AVX512(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const;
+	void IntersectRays_AVX512(const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads = 0) const;
+	bool IntersectRayAny_AVX512(const Ray &ray, float maxDistance = FLOAT_INF) const;
 #endif
 
 private:
 	float *data; // This is always allocated to tightly-packed numTriangles*3*vertexSizeBytes bytes.
 	int numTriangles;
 	int vertexSizeBytes;
+	TriangleMeshBVHNode *bvhNodes; // If null, the intersection functions test all the triangles.
+	int numBVHNodes;
+	int *bvhTriangleIndices; // Maps the internal triangle order to the triangle indices that were passed to Set().
 #ifdef _DEBUG
-	int vertexDataLayout; // 0 - AoS, 1 - SoA4, 2 - SoA8
+	int vertexDataLayout; // 0 - AoS, 1 - SoA4, 2 - SoA8, 3 - SoA16
 #endif
 	void ReallocVertexBuffer(int numTriangles, int vertexSizeBytes);
+	void FreeBVH();
+
+	/// Returns the distance to the nearest hit of the ray with the triangles [triStart, triEnd[ that is closer than maxT,
+	/// or maxT if there is no such hit. outTriangleIndex is written only if a closer hit is found.
+	float IntersectRayRange_CPP(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	float IntersectRayRange_UV_CPP(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+#ifdef MATH_SSE2_KERNELS
+	float IntersectRayRange_SSE2(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	float IntersectRayRange_UV_SSE2(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+#endif
+#ifdef MATH_SSE41_KERNELS
+	float IntersectRayRange_SSE41(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	float IntersectRayRange_UV_SSE41(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+#endif
+#ifdef MATH_AVX_KERNELS
+	float IntersectRayRange_AVX(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	float IntersectRayRange_UV_AVX(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+#endif
+#ifdef MATH_AVX512_KERNELS
+	float IntersectRayRange_AVX512(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	float IntersectRayRange_UV_AVX512(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+#endif
+
+	typedef float (TriangleMesh::*IntersectRayRangeFunc)(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const;
+	struct IntersectRaysJob;
+	static void IntersectRaysTask(void *userData, int taskIndex);
+	void IntersectRaysBlocked(IntersectRayRangeFunc intersectRange, const Ray *rays, int numRays, float *outT, int *outTriangleIndex) const;
+	void IntersectRaysParallel(IntersectRayRangeFunc intersectRange, const Ray *rays, int numRays, float *outT, int *outTriangleIndex, int numThreads) const;
+
+	typedef float (TriangleMesh::*IntersectRayRangeUVFunc)(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const;
+	struct IntersectRayJob;
+	static void IntersectRayTask(void *userData, int taskIndex);
+	IntersectRayRangeUVFunc ActiveIntersectRayRangeUVFunc() const;
+
+	/// Traverses the BVH to find the nearest hit closer than maxT, or if anyHit is true, returns at the first found
+	/// hit closer than maxT. Returns maxT if there is no hit, and then leaves the output parameters unmodified.
+	float IntersectRayBVH(const Ray &ray, float maxT, bool anyHit, int &outTriangleIndex, float &outU, float &outV) const;
 };
 
 MATH_END_NAMESPACE
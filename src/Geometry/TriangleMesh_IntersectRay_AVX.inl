@@ -20,12 +20,18 @@
 
 MATH_BEGIN_NAMESPACE
 
-#if !defined(MATH_GEN_TRIANGLEINDEX)
-float TriangleMesh::IntersectRay_AVX(const Ray &ray) const
+#if defined(MATH_GEN_ANY)
+MATH_TARGET_AVX bool TriangleMesh::IntersectRayAny_AVX(const Ray &ray, float maxDistance) const
+#elif defined(MATH_GEN_RANGE) && defined(MATH_GEN_UV)
+MATH_TARGET_AVX float TriangleMesh::IntersectRayRange_UV_AVX(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const
+#elif defined(MATH_GEN_RANGE)
+MATH_TARGET_AVX float TriangleMesh::IntersectRayRange_AVX(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const
+#elif !defined(MATH_GEN_TRIANGLEINDEX)
+MATH_TARGET_AVX float TriangleMesh::IntersectRay_AVX(const Ray &ray) const
 #elif defined(MATH_GEN_TRIANGLEINDEX) && !defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_AVX(const Ray &ray, int &outTriangleIndex) const
+MATH_TARGET_AVX float TriangleMesh::IntersectRay_TriangleIndex_AVX(const Ray &ray, int &outTriangleIndex) const
 #elif defined(MATH_GEN_TRIANGLEINDEX) && defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
+MATH_TARGET_AVX float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
 #endif
 {
 //	std::cout << numTris << " tris: ";
@@ -39,7 +45,13 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 
 //	hitTriangleIndex = -1;
 //	float3 pt;
+#ifdef MATH_GEN_RANGE
+	__m256 nearestD = _mm256_set1_ps(maxT); // Only accept hits that are closer than the nearest hit found so far.
+#elif defined(MATH_GEN_ANY)
+	__m256 nearestD = _mm256_set1_ps(maxDistance); // Only hits closer than maxDistance count.
+#else
 	__m256 nearestD = _mm256_set1_ps(inf);
+#endif
 #ifdef MATH_GEN_UV
 	__m256 nearestU = _mm256_set1_ps(inf);
 	__m256 nearestV = _mm256_set1_ps(inf);
@@ -59,13 +71,23 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 	const __m256 epsilon = _mm256_set1_ps(1e-4f);
 	const __m256 zero = _mm256_setzero_ps();
 	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 signMask = _mm256_set1_ps(-0.f); // -0.f = 1 << 31
 
 	assert(((uintptr_t)data & 0x1F) == 0);
 
+#ifdef MATH_GEN_RANGE
+	assert(triStart % 8 == 0);
+	assert(triEnd % 8 == 0);
+	const float *tris = reinterpret_cast<const float*>(data) + triStart*9;
+
+	for(int i = triStart; i+8 <= triEnd; i += 8)
+	{
+#else
 	const float *tris = reinterpret_cast<const float*>(data);
 
 	for(int i = 0; i+8 <= numTriangles; i += 8)
 	{
+#endif
 		__m256 v0x = _mm256_load_ps(tris);
 		__m256 v0y = _mm256_load_ps(tris+8);
 		__m256 v0z = _mm256_load_ps(tris+16);
@@ -111,7 +133,7 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 //			return FLOAT_INF;
 		__m256 recipDet = _mm256_rcp_ps(det);
 
-		__m256 absdet = abs_ps256(det);
+		__m256 absdet = _mm256_andnot_ps(signMask, det);
 		__m256 out = _mm256_cmp_ps(absdet, epsilon, _CMP_LT_OQ);
 
 		// Calculate distance from v0 to ray origin
@@ -169,11 +191,21 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 
 		// The mask out now contains 0xFF in all indices which are worse than previous, and
 		// 0x00 in indices which are better.
+#ifdef MATH_GEN_ANY
+		// Any triangle that was not rejected is a hit, so there is no need to look further. Test t < maxDistance
+		// explicitly, since the comparisons above do not reject NaNs (e.g. from degenerate padding triangles).
+		if (_mm256_movemask_ps(_mm256_andnot_ps(out, _mm256_cmp_ps(t, nearestD, _CMP_LT_OQ))) != 0)
+			return true;
+#else
 		nearestD = _mm256_blendv_ps(t, nearestD, out);
+#endif
 
 		tris += 72;
 	}
 
+#ifdef MATH_GEN_ANY
+	return false;
+#else
 	float ds[8];
 	_mm256_store_ps(ds, nearestD);
 #ifdef MATH_GEN_UV
@@ -188,7 +220,11 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 	_mm256_storeu_si256((__m256i*)ds2, nearestIndex);
 #endif
 
+#ifdef MATH_GEN_RANGE
+	float smallestT = maxT;
+#else
 	float smallestT = FLOAT_INF;
+#endif
 //	float u = FLOAT_NAN, v = FLOAT_NAN;
 	for(int i = 0; i < 8; ++i)
 		if (ds[i] < smallestT)
@@ -218,6 +254,7 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 //	std::cout << "(AVX) " << processedBytes / avgtimes * 1000.0 / 1024.0 / 1024.0 / 1024.0 << "GB/sec." << std::endl;
 
 	return smallestT;
+#endif
 }
 
 
@@ -227,5 +264,11 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX(const Ray &ray, int &outTr
 #ifdef MATH_GEN_UV
 #undef MATH_GEN_UV
 #endif
+#ifdef MATH_GEN_RANGE
+#undef MATH_GEN_RANGE
+#endif
+#ifdef MATH_GEN_ANY
+#undef MATH_GEN_ANY
+#endif
 
 MATH_END_NAMESPACE
@@ -0,0 +1,235 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file TriangleMesh_IntersectRay_AVX512.inl
+	@author Jukka Jylnki
+	@brief AVX-512 implementation of ray-mesh intersection routines. */
+
+#include "../Math/SSEMath.h"
+
+MATH_BEGIN_NAMESPACE
+
+#if defined(MATH_GEN_ANY)
+MATH_TARGET_AVX512 bool TriangleMesh::IntersectRayAny_AVX512(const Ray &ray, float maxDistance) const
+#elif defined(MATH_GEN_RANGE) && defined(MATH_GEN_UV)
+MATH_TARGET_AVX512 float TriangleMesh::IntersectRayRange_UV_AVX512(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const
+#elif defined(MATH_GEN_RANGE)
+MATH_TARGET_AVX512 float TriangleMesh::IntersectRayRange_AVX512(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const
+#elif !defined(MATH_GEN_TRIANGLEINDEX)
+MATH_TARGET_AVX512 float TriangleMesh::IntersectRay_AVX512(const Ray &ray) const
+#elif defined(MATH_GEN_TRIANGLEINDEX) && !defined(MATH_GEN_UV)
+MATH_TARGET_AVX512 float TriangleMesh::IntersectRay_TriangleIndex_AVX512(const Ray &ray, int &outTriangleIndex) const
+#elif defined(MATH_GEN_TRIANGLEINDEX) && defined(MATH_GEN_UV)
+MATH_TARGET_AVX512 float TriangleMesh::IntersectRay_TriangleIndex_UV_AVX512(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
+#endif
+{
+	assert(sizeof(float3) == 3*sizeof(float));
+	assert(sizeof(Triangle) == 3*sizeof(vec));
+#ifdef _DEBUG
+	assert(vertexDataLayout == 3); // Must be SoA16 structured!
+#endif
+
+#if defined(MATH_GEN_RANGE)
+	__m512 nearestD = _mm512_set1_ps(maxT); // Only accept hits that are closer than the nearest hit found so far.
+#elif defined(MATH_GEN_ANY)
+	__m512 nearestD = _mm512_set1_ps(maxDistance); // Only hits closer than maxDistance count.
+#else
+	__m512 nearestD = _mm512_set1_ps(inf);
+#endif
+#ifdef MATH_GEN_UV
+	__m512 nearestU = _mm512_set1_ps(inf);
+	__m512 nearestV = _mm512_set1_ps(inf);
+#endif
+#ifdef MATH_GEN_TRIANGLEINDEX
+	__m512i nearestIndex = _mm512_set1_epi32(-1);
+#endif
+
+	const __m512 lX = _mm512_set1_ps(ray.pos.x);
+	const __m512 lY = _mm512_set1_ps(ray.pos.y);
+	const __m512 lZ = _mm512_set1_ps(ray.pos.z);
+
+	const __m512 dX = _mm512_set1_ps(ray.dir.x);
+	const __m512 dY = _mm512_set1_ps(ray.dir.y);
+	const __m512 dZ = _mm512_set1_ps(ray.dir.z);
+
+	const __m512 epsilon = _mm512_set1_ps(1e-4f);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.f);
+
+	assert(((uintptr_t)data & 0x3F) == 0);
+
+#ifdef MATH_GEN_RANGE
+	assert(triStart % 16 == 0);
+	assert(triEnd % 16 == 0);
+	const float *tris = reinterpret_cast<const float*>(data) + triStart*9;
+
+	for(int i = triStart; i+16 <= triEnd; i += 16)
+	{
+#else
+	const float *tris = reinterpret_cast<const float*>(data);
+
+	for(int i = 0; i+16 <= numTriangles; i += 16)
+	{
+#endif
+		__m512 v0x = _mm512_load_ps(tris);
+		__m512 v0y = _mm512_load_ps(tris+16);
+		__m512 v0z = _mm512_load_ps(tris+32);
+
+#ifdef SOA_HAS_EDGES
+		// Edge vectors
+		__m512 e1x = _mm512_load_ps(tris+48);
+		__m512 e1y = _mm512_load_ps(tris+64);
+		__m512 e1z = _mm512_load_ps(tris+80);
+
+		__m512 e2x = _mm512_load_ps(tris+96);
+		__m512 e2y = _mm512_load_ps(tris+112);
+		__m512 e2z = _mm512_load_ps(tris+128);
+#else
+		__m512 v1x = _mm512_load_ps(tris+48);
+		__m512 v1y = _mm512_load_ps(tris+64);
+		__m512 v1z = _mm512_load_ps(tris+80);
+
+		__m512 v2x = _mm512_load_ps(tris+96);
+		__m512 v2y = _mm512_load_ps(tris+112);
+		__m512 v2z = _mm512_load_ps(tris+128);
+
+		// Edge vectors
+		__m512 e1x = _mm512_sub_ps(v1x, v0x);
+		__m512 e1y = _mm512_sub_ps(v1y, v0y);
+		__m512 e1z = _mm512_sub_ps(v1z, v0z);
+
+		__m512 e2x = _mm512_sub_ps(v2x, v0x);
+		__m512 e2y = _mm512_sub_ps(v2y, v0y);
+		__m512 e2z = _mm512_sub_ps(v2z, v0z);
+#endif
+		// begin calculating determinant - also used to calculate U parameter
+		__m512 px = _mm512_sub_ps(_mm512_mul_ps(dY, e2z), _mm512_mul_ps(dZ, e2y));
+		__m512 py = _mm512_sub_ps(_mm512_mul_ps(dZ, e2x), _mm512_mul_ps(dX, e2z));
+		__m512 pz = _mm512_sub_ps(_mm512_mul_ps(dX, e2y), _mm512_mul_ps(dY, e2x));
+
+		// If det < 0, intersecting backfacing tri, > 0, intersecting frontfacing tri, 0, parallel to plane.
+		__m512 det = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)), _mm512_mul_ps(e1z, pz));
+
+		// Unlike the SSE and AVX kernels that accumulate a mask of rejected lanes, this kernel accumulates the mask
+		// of lanes that are still potential hits. Each test below is only evaluated for the lanes that passed all the
+		// previous tests, and since all the comparisons are ordered, NaNs are always rejected.
+
+		// If determinant is near zero, ray lies in plane of triangle.
+		__mmask16 hit = _mm512_cmp_ps_mask(_mm512_abs_ps(det), epsilon, _CMP_GE_OQ);
+		__m512 recipDet = _mm512_rcp14_ps(det);
+
+		// Calculate distance from v0 to ray origin
+		__m512 tx = _mm512_sub_ps(lX, v0x);
+		__m512 ty = _mm512_sub_ps(lY, v0y);
+		__m512 tz = _mm512_sub_ps(lZ, v0z);
+
+		// Output barycentric u
+		__m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(tx, px), _mm512_mul_ps(ty, py)), _mm512_mul_ps(tz, pz)), recipDet);
+		hit = _mm512_mask_cmp_ps_mask(hit, u, zero, _CMP_GE_OQ);
+		hit = _mm512_mask_cmp_ps_mask(hit, u, one, _CMP_LE_OQ);
+
+		// Prepare to test V parameter
+		__m512 qx = _mm512_sub_ps(_mm512_mul_ps(ty, e1z), _mm512_mul_ps(tz, e1y));
+		__m512 qy = _mm512_sub_ps(_mm512_mul_ps(tz, e1x), _mm512_mul_ps(tx, e1z));
+		__m512 qz = _mm512_sub_ps(_mm512_mul_ps(tx, e1y), _mm512_mul_ps(ty, e1x));
+
+		// Output barycentric v
+		__m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dX, qx), _mm512_mul_ps(dY, qy)), _mm512_mul_ps(dZ, qz)), recipDet);
+		hit = _mm512_mask_cmp_ps_mask(hit, v, zero, _CMP_GE_OQ);
+		hit = _mm512_mask_cmp_ps_mask(hit, _mm512_add_ps(u, v), one, _CMP_LE_OQ);
+
+		// Output signed distance from ray to triangle.
+		__m512 t = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)), _mm512_mul_ps(e2z, qz)), recipDet);
+
+		// In front of the ray, and better than the previous result?
+		hit = _mm512_mask_cmp_ps_mask(hit, t, zero, _CMP_GE_OQ);
+		hit = _mm512_mask_cmp_ps_mask(hit, t, nearestD, _CMP_LT_OQ);
+
+#ifdef MATH_GEN_ANY
+		// Any triangle that passed all the tests is a hit, so there is no need to look further.
+		if (hit)
+			return true;
+#else
+		nearestD = _mm512_mask_mov_ps(nearestD, hit, t);
+#endif
+
+#ifdef MATH_GEN_UV
+		nearestU = _mm512_mask_mov_ps(nearestU, hit, u);
+		nearestV = _mm512_mask_mov_ps(nearestV, hit, v);
+#endif
+
+		// Store the index of the triangle that was hit.
+#ifdef MATH_GEN_TRIANGLEINDEX
+		nearestIndex = _mm512_mask_mov_epi32(nearestIndex, hit, _mm512_set1_epi32(i));
+#endif
+
+		tris += 144;
+	}
+
+#ifdef MATH_GEN_ANY
+	return false;
+#else
+	float ds[16];
+	_mm512_storeu_ps(ds, nearestD);
+#ifdef MATH_GEN_UV
+	float su[16];
+	float sv[16];
+	_mm512_storeu_ps(su, nearestU);
+	_mm512_storeu_ps(sv, nearestV);
+#endif
+
+#ifdef MATH_GEN_TRIANGLEINDEX
+	u32 ds2[16];
+	_mm512_storeu_si512(ds2, nearestIndex);
+#endif
+
+#ifdef MATH_GEN_RANGE
+	float smallestT = maxT;
+#else
+	float smallestT = FLOAT_INF;
+#endif
+	for(int i = 0; i < 16; ++i)
+		if (ds[i] < smallestT)
+		{
+			smallestT = ds[i];
+#ifdef MATH_GEN_TRIANGLEINDEX
+			outTriangleIndex = ds2[i]+i;
+#endif
+#ifdef MATH_GEN_UV
+			outU = su[i];
+			outV = sv[i];
+#endif
+		}
+
+	return smallestT;
+#endif
+}
+
+#ifdef MATH_GEN_AVX512
+#undef MATH_GEN_AVX512
+#endif
+#ifdef MATH_GEN_TRIANGLEINDEX
+#undef MATH_GEN_TRIANGLEINDEX
+#endif
+#ifdef MATH_GEN_UV
+#undef MATH_GEN_UV
+#endif
+#ifdef MATH_GEN_RANGE
+#undef MATH_GEN_RANGE
+#endif
+#ifdef MATH_GEN_ANY
+#undef MATH_GEN_ANY
+#endif
+
+MATH_END_NAMESPACE
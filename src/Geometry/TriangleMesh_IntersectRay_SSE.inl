@@ -17,18 +17,30 @@
 	@brief SSE implementation of ray-mesh intersection routines. */
 MATH_BEGIN_NAMESPACE
 
-#if defined(MATH_GEN_SSE2) && !defined(MATH_GEN_TRIANGLEINDEX)
-float TriangleMesh::IntersectRay_SSE2(const Ray &ray) const
+#if defined(MATH_GEN_SSE2) && defined(MATH_GEN_ANY)
+MATH_TARGET_SSE2 bool TriangleMesh::IntersectRayAny_SSE2(const Ray &ray, float maxDistance) const
+#elif defined(MATH_GEN_SSE41) && defined(MATH_GEN_ANY)
+MATH_TARGET_SSE41 bool TriangleMesh::IntersectRayAny_SSE41(const Ray &ray, float maxDistance) const
+#elif defined(MATH_GEN_SSE2) && defined(MATH_GEN_RANGE) && defined(MATH_GEN_UV)
+MATH_TARGET_SSE2 float TriangleMesh::IntersectRayRange_UV_SSE2(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const
+#elif defined(MATH_GEN_SSE41) && defined(MATH_GEN_RANGE) && defined(MATH_GEN_UV)
+MATH_TARGET_SSE41 float TriangleMesh::IntersectRayRange_UV_SSE41(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex, float &outU, float &outV) const
+#elif defined(MATH_GEN_SSE2) && defined(MATH_GEN_RANGE)
+MATH_TARGET_SSE2 float TriangleMesh::IntersectRayRange_SSE2(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const
+#elif defined(MATH_GEN_SSE41) && defined(MATH_GEN_RANGE)
+MATH_TARGET_SSE41 float TriangleMesh::IntersectRayRange_SSE41(const Ray &ray, int triStart, int triEnd, float maxT, int &outTriangleIndex) const
+#elif defined(MATH_GEN_SSE2) && !defined(MATH_GEN_TRIANGLEINDEX)
+MATH_TARGET_SSE2 float TriangleMesh::IntersectRay_SSE2(const Ray &ray) const
 #elif defined(MATH_GEN_SSE2) && defined(MATH_GEN_TRIANGLEINDEX) && !defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_SSE2(const Ray &ray, int &outTriangleIndex) const
+MATH_TARGET_SSE2 float TriangleMesh::IntersectRay_TriangleIndex_SSE2(const Ray &ray, int &outTriangleIndex) const
 #elif defined(MATH_GEN_SSE2) && defined(MATH_GEN_TRIANGLEINDEX) && defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE2(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
+MATH_TARGET_SSE2 float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE2(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
 #elif defined(MATH_GEN_SSE41) && !defined(MATH_GEN_TRIANGLEINDEX)
-float TriangleMesh::IntersectRay_SSE41(const Ray &ray) const
+MATH_TARGET_SSE41 float TriangleMesh::IntersectRay_SSE41(const Ray &ray) const
 #elif defined(MATH_GEN_SSE41) && defined(MATH_GEN_TRIANGLEINDEX) && !defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_SSE41(const Ray &ray, int &outTriangleIndex) const
+MATH_TARGET_SSE41 float TriangleMesh::IntersectRay_TriangleIndex_SSE41(const Ray &ray, int &outTriangleIndex) const
 #elif defined(MATH_GEN_SSE41) && defined(MATH_GEN_TRIANGLEINDEX) && defined(MATH_GEN_UV)
-float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
+MATH_TARGET_SSE41 float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &outTriangleIndex, float &outU, float &outV) const
 #endif
 {
 //	std::cout << numTris << " tris: ";
@@ -40,7 +52,13 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 	assert(vertexDataLayout == 1); // Must be SoA4 structured!
 #endif
 	
+#ifdef MATH_GEN_RANGE
+	__m128 nearestD = _mm_set1_ps(maxT); // Only accept hits that are closer than the nearest hit found so far.
+#elif defined(MATH_GEN_ANY)
+	__m128 nearestD = _mm_set1_ps(maxDistance); // Only hits closer than maxDistance count.
+#else
 	__m128 nearestD = _mm_set1_ps(inf);
+#endif
 #ifdef MATH_GEN_UV
 	__m128 nearestU = _mm_set1_ps(inf);
 	__m128 nearestV = _mm_set1_ps(inf);
@@ -65,10 +83,19 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 
 	assert(((uintptr_t)data & 0xF) == 0);
 
+#ifdef MATH_GEN_RANGE
+	assert(triStart % 4 == 0);
+	assert(triEnd % 4 == 0);
+	const float *tris = reinterpret_cast<const float*>(data) + triStart*9;
+
+	for(int i = triStart; i+4 <= triEnd; i += 4)
+	{
+#else
 	const float *tris = reinterpret_cast<const float*>(data);
 
 	for(int i = 0; i+4 <= numTriangles; i += 4)
 	{
+#endif
 		__m128 v0x = _mm_load_ps(tris);
 		__m128 v0y = _mm_load_ps(tris+4);
 		__m128 v0z = _mm_load_ps(tris+8);
@@ -163,7 +190,12 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 		// The mask 'out' now contains 0xFF in all indices which are worse than previous, and
 		// 0x00 in indices which are better.
 
-#ifdef MATH_GEN_SSE41
+#ifdef MATH_GEN_ANY
+		// Any triangle that was not rejected is a hit, so there is no need to look further. Test t < maxDistance
+		// explicitly, since the comparisons above do not reject NaNs (e.g. from degenerate padding triangles).
+		if (_mm_movemask_ps(_mm_andnot_ps(out, _mm_cmplt_ps(t, nearestD))) != 0)
+			return true;
+#elif defined(MATH_GEN_SSE41)
 		nearestD = _mm_blendv_ps(t, nearestD, out);
 #else
 		// If SSE 4.1 is not available:
@@ -206,16 +238,26 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 		tris += 36;
 	}
 
-	float4 d = nearestD;
+#ifdef MATH_GEN_ANY
+	return false;
+#else
+	float d[4];
+	_mm_storeu_ps(d, nearestD);
 #ifdef MATH_GEN_UV
-	float4 u = nearestU;
-	float4 v = nearestV;
+	float u[4];
+	float v[4];
+	_mm_storeu_ps(u, nearestU);
+	_mm_storeu_ps(v, nearestV);
 #endif
 #ifdef MATH_GEN_TRIANGLEINDEX
 	u32 idx[4];
 	_mm_store_si128((__m128i*)idx, nearestIndex);
 #endif
+#ifdef MATH_GEN_RANGE
+	float smallestT = maxT;
+#else
 	float smallestT = FLOAT_INF;
+#endif
 	for(int i = 0; i < 4; ++i)
 		if (d[i] < smallestT)
 		{
@@ -244,6 +286,7 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 //	std::cout << "(SSE) " << processedBytes / avgtimes * 1000.0 / 1024.0 / 1024.0 / 1024.0 << "GB/sec." << std::endl;
 
 	return smallestT;
+#endif
 }
 
 
@@ -266,5 +309,11 @@ float TriangleMesh::IntersectRay_TriangleIndex_UV_SSE41(const Ray &ray, int &out
 #ifdef MATH_GEN_UV
 #undef MATH_GEN_UV
 #endif
+#ifdef MATH_GEN_RANGE
+#undef MATH_GEN_RANGE
+#endif
+#ifdef MATH_GEN_ANY
+#undef MATH_GEN_ANY
+#endif
 
 MATH_END_NAMESPACE
@@ -37,5 +37,6 @@
 #include "Polynomial.h"
 #include "Quat.h"
 #include "Rect.h"
+#include "SIMDCapability.h"
 #include "SSEMath.h"
 #include "TransformOps.h"
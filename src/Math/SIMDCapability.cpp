@@ -0,0 +1,148 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file SIMDCapability.cpp
+	@author Jukka Jylnki
+	@brief Runtime detection of the SIMD instruction sets supported by the host CPU. */
+#include "SIMDCapability.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MATH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) || defined(__clang__)
+#include <cpuid.h>
+#endif
+#endif
+
+MATH_BEGIN_NAMESPACE
+
+#ifdef MATH_X86
+// Like CpuId() in tests/SystemInfo.cpp, but also specifies the sub-leaf, which is needed to query the extended features.
+static bool CpuIdEx(unsigned int *outInfo, unsigned int infoType, unsigned int subInfoType)
+{
+#ifdef _MSC_VER
+	__cpuidex(reinterpret_cast<int*>(outInfo), (int)infoType, (int)subInfoType);
+	return true;
+#elif defined(__GNUC__) || defined(__clang__)
+	if (__get_cpuid_max(infoType & 0x80000000U, 0) < infoType)
+		return false;
+	__cpuid_count(infoType, subInfoType, outInfo[0], outInfo[1], outInfo[2], outInfo[3]);
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Returns the bitmask of the register states that the operating system saves on context switches.
+static unsigned int ExtendedControlRegister()
+{
+#ifdef _MSC_VER
+	return (unsigned int)_xgetbv(0);
+#elif defined(__GNUC__) || defined(__clang__)
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#else
+	return 0;
+#endif
+}
+#endif
+
+SIMDCapability DetectSIMDCapability()
+{
+#ifdef MATH_X86
+	unsigned int info[4] = {};
+	if (!CpuIdEx(info, 0, 0))
+		return SIMD_NONE;
+	const unsigned int maxLeaf = info[0];
+	if (maxLeaf < 1 || !CpuIdEx(info, 1, 0))
+		return SIMD_NONE;
+	const unsigned int features = info[3]; // edx
+	const unsigned int extendedFeatures = info[2]; // ecx
+
+	const bool hasSSE = (features & (1U << 25)) != 0;
+	const bool hasSSE2 = (features & (1U << 26)) != 0;
+	const bool hasSSE41 = (extendedFeatures & (1U << 19)) != 0;
+	const bool hasOSXSAVE = (extendedFeatures & (1U << 27)) != 0;
+	const bool hasAVX = (extendedFeatures & (1U << 28)) != 0;
+
+	// The OS must have enabled saving the YMM (bits 1 and 2), and for AVX-512 also the opmask and ZMM (bits 5-7) states.
+	const unsigned int xcr0 = hasOSXSAVE ? ExtendedControlRegister() : 0;
+	const bool osSavesYMM = (xcr0 & 0x6) == 0x6;
+	const bool osSavesZMM = (xcr0 & 0xE6) == 0xE6;
+
+	bool hasAVX512 = false;
+	if (maxLeaf >= 7 && CpuIdEx(info, 7, 0))
+		hasAVX512 = (info[1] & (1U << 16)) != 0; // ebx: AVX512F
+
+	if (hasAVX512 && hasAVX && osSavesZMM)
+		return SIMD_AVX512;
+	if (hasAVX && osSavesYMM)
+		return SIMD_AVX;
+	if (hasSSE41)
+		return SIMD_SSE41;
+	if (hasSSE2)
+		return SIMD_SSE2;
+	if (hasSSE)
+		return SIMD_SSE;
+#endif
+	return SIMD_NONE;
+}
+
+static SIMDCapability CompiledSIMDCapability()
+{
+#if defined(MATH_AVX512_KERNELS)
+	return SIMD_AVX512;
+#elif defined(MATH_AVX_KERNELS)
+	return SIMD_AVX;
+#elif defined(MATH_SSE41_KERNELS)
+	return SIMD_SSE41;
+#elif defined(MATH_SSE2_KERNELS)
+	return SIMD_SSE2;
+#elif defined(MATH_SSE)
+	return SIMD_SSE;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+static SIMDCapability SelectActiveSIMDCapability()
+{
+	const SIMDCapability detected = DetectSIMDCapability();
+	const SIMDCapability compiled = CompiledSIMDCapability();
+	return detected < compiled ? detected : compiled;
+}
+
+SIMDCapability ActiveSIMDCapability()
+{
+	static const SIMDCapability capability = SelectActiveSIMDCapability();
+	return capability;
+}
+
+const char *SIMDCapabilityToString(SIMDCapability capability)
+{
+	switch(capability)
+	{
+	case SIMD_SSE: return "SSE";
+	case SIMD_SSE2: return "SSE2";
+	case SIMD_SSE41: return "SSE4.1";
+	case SIMD_AVX: return "AVX";
+	case SIMD_AVX512: return "AVX-512";
+	default: return "None";
+	}
+}
+
+MATH_END_NAMESPACE
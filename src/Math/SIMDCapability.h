@@ -0,0 +1,51 @@
+/* Copyright Jukka Jylnki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+/** @file SIMDCapability.h
+	@author Jukka Jylnki
+	@brief Runtime detection of the SIMD instruction sets supported by the host CPU. */
+#pragma once
+
+#include "../MathBuildConfig.h"
+#include "MathNamespace.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// Identifies an x86 SIMD instruction set level. Each level implies support for all the levels before it.
+enum SIMDCapability
+{
+	SIMD_NONE,
+	SIMD_SSE,
+	SIMD_SSE2,
+	SIMD_SSE41,
+	SIMD_AVX,
+	SIMD_AVX512 ///< AVX-512F.
+};
+
+/// Queries the host CPU and operating system for the highest supported SIMD instruction set level.
+/** The AVX and AVX-512 levels are reported only if the operating system also saves the wider registers on context
+	switches. On non-x86 platforms, this returns SIMD_NONE. This function executes CPUID each time it is called, so
+	prefer ActiveSIMDCapability() in performance-sensitive code. */
+SIMDCapability DetectSIMDCapability();
+
+/// Returns the SIMD instruction set level that the runtime-dispatched functions of MathGeoLib use.
+/** This is the highest level that is both supported by the host CPU, and for which MathGeoLib was compiled with
+	kernels. If MATH_SIMD_DISPATCH is not defined, the kernels are compiled only up to the instruction set level
+	specified in MathBuildConfig.h. The result is detected on the first call, and cached. */
+SIMDCapability ActiveSIMDCapability();
+
+/// Returns a human-readable name of the given SIMD instruction set level, e.g. "AVX".
+const char *SIMDCapabilityToString(SIMDCapability capability);
+
+MATH_END_NAMESPACE
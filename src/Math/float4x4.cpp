@@ -32,6 +32,7 @@
 #include "float4x4_sse.h"
 #include "float4x4_neon.h"
 #include "quat_simd.h"
+#include "SIMDCapability.h"
 
 #ifdef MATH_ENABLE_STL_SUPPORT
 #include <iostream>
@@ -1592,26 +1593,141 @@ float4 float4x4::Transform(const float4 &vector) const
 #endif
 }
 
+// The batch transform kernels below process the float3 array in groups of four points, i.e. three __m128 registers
+// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] at a time. The groups are deinterleaved to the SoA form [x0 x1 x2 x3] ...,
+// transformed, and interleaved back. The kernels return the number of points they processed, and the caller
+// transforms the remaining tail points with the scalar code path. For directions, w is zero so the translation
+// part of the matrix is ignored.
+typedef int (*TransformFloat3ArrayFunc)(const float4x4 &m, float3 *array, int numPoints, float w);
+
+#ifdef MATH_SSE2_KERNELS
+#define SOA_SHUFFLE(a, b, i3, i2, i1, i0) _mm_shuffle_ps((a), (b), _MM_SHUFFLE((i3), (i2), (i1), (i0)))
+
+MATH_TARGET_SSE2 static int TransformFloat3Array_SSE2(const float4x4 &m, float3 *array, int numPoints, float w)
+{
+	const __m128 m00 = _mm_set1_ps(m.v[0][0]), m01 = _mm_set1_ps(m.v[0][1]), m02 = _mm_set1_ps(m.v[0][2]), m03 = _mm_set1_ps(m.v[0][3] * w);
+	const __m128 m10 = _mm_set1_ps(m.v[1][0]), m11 = _mm_set1_ps(m.v[1][1]), m12 = _mm_set1_ps(m.v[1][2]), m13 = _mm_set1_ps(m.v[1][3] * w);
+	const __m128 m20 = _mm_set1_ps(m.v[2][0]), m21 = _mm_set1_ps(m.v[2][1]), m22 = _mm_set1_ps(m.v[2][2]), m23 = _mm_set1_ps(m.v[2][3] * w);
+
+	const int numBatched = numPoints & ~3;
+	float *data = array->ptr();
+	for(int i = 0; i < numBatched; i += 4, data += 12)
+	{
+		__m128 a = _mm_loadu_ps(data);
+		__m128 b = _mm_loadu_ps(data + 4);
+		__m128 c = _mm_loadu_ps(data + 8);
+
+		__m128 x = SOA_SHUFFLE(a, SOA_SHUFFLE(b, c, 1, 1, 2, 2), 2, 0, 3, 0);
+		__m128 y = SOA_SHUFFLE(SOA_SHUFFLE(a, b, 0, 0, 1, 1), SOA_SHUFFLE(b, c, 2, 2, 3, 3), 2, 0, 2, 0);
+		__m128 z = SOA_SHUFFLE(SOA_SHUFFLE(a, b, 1, 1, 2, 2), c, 3, 0, 2, 0);
+
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_add_ps(_mm_mul_ps(m02, z), m03));
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m12, z), m13));
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_add_ps(_mm_mul_ps(m22, z), m23));
+
+		_mm_storeu_ps(data, SOA_SHUFFLE(SOA_SHUFFLE(tx, ty, 0, 0, 0, 0), SOA_SHUFFLE(tz, tx, 1, 1, 0, 0), 2, 0, 2, 0));
+		_mm_storeu_ps(data + 4, SOA_SHUFFLE(SOA_SHUFFLE(ty, tz, 1, 1, 1, 1), SOA_SHUFFLE(tx, ty, 2, 2, 2, 2), 2, 0, 2, 0));
+		_mm_storeu_ps(data + 8, SOA_SHUFFLE(SOA_SHUFFLE(tz, tx, 3, 3, 2, 2), SOA_SHUFFLE(ty, tz, 3, 3, 3, 3), 2, 0, 2, 0));
+	}
+	return numBatched;
+}
+
+#undef SOA_SHUFFLE
+#endif
+
+#ifdef MATH_AVX_KERNELS
+#define SOA_SHUFFLE(a, b, i3, i2, i1, i0) _mm256_shuffle_ps((a), (b), _MM_SHUFFLE((i3), (i2), (i1), (i0)))
+
+// Same as the SSE2 kernel, but transforms eight points at a time: points 0-3 are processed in the low 128-bit lanes,
+// and points 4-7 in the high lanes, since _mm256_shuffle_ps does not cross the lanes.
+MATH_TARGET_AVX static int TransformFloat3Array_AVX(const float4x4 &m, float3 *array, int numPoints, float w)
+{
+	const __m256 m00 = _mm256_set1_ps(m.v[0][0]), m01 = _mm256_set1_ps(m.v[0][1]), m02 = _mm256_set1_ps(m.v[0][2]), m03 = _mm256_set1_ps(m.v[0][3] * w);
+	const __m256 m10 = _mm256_set1_ps(m.v[1][0]), m11 = _mm256_set1_ps(m.v[1][1]), m12 = _mm256_set1_ps(m.v[1][2]), m13 = _mm256_set1_ps(m.v[1][3] * w);
+	const __m256 m20 = _mm256_set1_ps(m.v[2][0]), m21 = _mm256_set1_ps(m.v[2][1]), m22 = _mm256_set1_ps(m.v[2][2]), m23 = _mm256_set1_ps(m.v[2][3] * w);
+
+	const int numBatched = numPoints & ~7;
+	float *data = array->ptr();
+	for(int i = 0; i < numBatched; i += 8, data += 24)
+	{
+		__m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data)), _mm_loadu_ps(data + 12), 1);
+		__m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data + 4)), _mm_loadu_ps(data + 16), 1);
+		__m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data + 8)), _mm_loadu_ps(data + 20), 1);
+
+		__m256 x = SOA_SHUFFLE(a, SOA_SHUFFLE(b, c, 1, 1, 2, 2), 2, 0, 3, 0);
+		__m256 y = SOA_SHUFFLE(SOA_SHUFFLE(a, b, 0, 0, 1, 1), SOA_SHUFFLE(b, c, 2, 2, 3, 3), 2, 0, 2, 0);
+		__m256 z = SOA_SHUFFLE(SOA_SHUFFLE(a, b, 1, 1, 2, 2), c, 3, 0, 2, 0);
+
+		__m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m01, y)), _mm256_add_ps(_mm256_mul_ps(m02, z), m03));
+		__m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, x), _mm256_mul_ps(m11, y)), _mm256_add_ps(_mm256_mul_ps(m12, z), m13));
+		__m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, x), _mm256_mul_ps(m21, y)), _mm256_add_ps(_mm256_mul_ps(m22, z), m23));
+
+		a = SOA_SHUFFLE(SOA_SHUFFLE(tx, ty, 0, 0, 0, 0), SOA_SHUFFLE(tz, tx, 1, 1, 0, 0), 2, 0, 2, 0);
+		b = SOA_SHUFFLE(SOA_SHUFFLE(ty, tz, 1, 1, 1, 1), SOA_SHUFFLE(tx, ty, 2, 2, 2, 2), 2, 0, 2, 0);
+		c = SOA_SHUFFLE(SOA_SHUFFLE(tz, tx, 3, 3, 2, 2), SOA_SHUFFLE(ty, tz, 3, 3, 3, 3), 2, 0, 2, 0);
+		_mm_storeu_ps(data, _mm256_castps256_ps128(a));
+		_mm_storeu_ps(data + 4, _mm256_castps256_ps128(b));
+		_mm_storeu_ps(data + 8, _mm256_castps256_ps128(c));
+		_mm_storeu_ps(data + 12, _mm256_extractf128_ps(a, 1));
+		_mm_storeu_ps(data + 16, _mm256_extractf128_ps(b, 1));
+		_mm_storeu_ps(data + 20, _mm256_extractf128_ps(c, 1));
+	}
+	return numBatched;
+}
+
+#undef SOA_SHUFFLE
+#endif
+
+static int TransformFloat3Array_None(const float4x4 &, float3 *, int, float)
+{
+	return 0;
+}
+
+static TransformFloat3ArrayFunc SelectTransformFloat3ArrayKernel()
+{
+	const int simdCapability = ActiveSIMDCapability();
+#ifdef MATH_AVX_KERNELS
+	if (simdCapability >= SIMD_AVX)
+		return &TransformFloat3Array_AVX;
+#endif
+#ifdef MATH_SSE2_KERNELS
+	if (simdCapability >= SIMD_SSE2)
+		return &TransformFloat3Array_SSE2;
+#endif
+	MARK_UNUSED(simdCapability);
+	return &TransformFloat3Array_None;
+}
+
+static int TransformFloat3Array(const float4x4 &m, float3 *array, int numPoints, float w)
+{
+	static const TransformFloat3ArrayFunc kernel = SelectTransformFloat3ArrayKernel();
+	return kernel(m, array, numPoints, w);
+}
+
 void float4x4::TransformPos(float3 *pointArray, int numPoints) const
 {
-	///\todo SSE.
 	assume(pointArray);
 #ifndef MATH_ENABLE_INSECURE_OPTIMIZATIONS
 	if (!pointArray)
 		return;
 #endif
-	for(int i = 0; i < numPoints; ++i)
+	for(int i = TransformFloat3Array(*this, pointArray, numPoints, 1.f); i < numPoints; ++i)
 		pointArray[i] = this->TransformPos(pointArray[i]);
 }
 
 void float4x4::TransformPos(float3 *pointArray, int numPoints, int strideBytes) const
 {
-	///\todo SSE.
 	assume(pointArray);
 #ifndef MATH_ENABLE_INSECURE_OPTIMIZATIONS
 	if (!pointArray)
 		return;
 #endif
+	if (strideBytes == sizeof(float3))
+	{
+		TransformPos(pointArray, numPoints);
+		return;
+	}
+	///\todo SSE for strided data.
 	u8 *data = reinterpret_cast<u8*>(pointArray);
 	for(int i = 0; i < numPoints; ++i)
 	{
@@ -1623,24 +1739,28 @@ void float4x4::TransformPos(float3 *pointArray, int numPoints, int strideBytes)
 
 void float4x4::TransformDir(float3 *dirArray, int numVectors) const
 {
-	///\todo SSE.
 	assume(dirArray);
 #ifndef MATH_ENABLE_INSECURE_OPTIMIZATIONS
 	if (!dirArray)
 		return;
 #endif
-	for(int i = 0; i < numVectors; ++i)
+	for(int i = TransformFloat3Array(*this, dirArray, numVectors, 0.f); i < numVectors; ++i)
 		dirArray[i] = this->TransformDir(dirArray[i]);
 }
 
 void float4x4::TransformDir(float3 *dirArray, int numVectors, int strideBytes) const
 {
-	///\todo SSE.
 	assume(dirArray);
 #ifndef MATH_ENABLE_INSECURE_OPTIMIZATIONS
 	if (!dirArray)
 		return;
 #endif
+	if (strideBytes == sizeof(float3))
+	{
+		TransformDir(dirArray, numVectors);
+		return;
+	}
+	///\todo SSE for strided data.
 	u8 *data = reinterpret_cast<u8*>(dirArray);
 	for(int i = 0; i < numVectors; ++i)
 	{
@@ -79,6 +79,14 @@
 #define MATH_ENABLE_STL_SUPPORT
 #endif
 
+// If MATH_ENABLE_THREADS is defined, MathGeoLib can use std::thread to run long operations (e.g. building a kD-tree)
+// on multiple threads. This is enabled by default when compiling as C++11 or newer. Define MATH_NO_THREADS to disable.
+#if !defined(MATH_ENABLE_THREADS) && !defined(MATH_NO_THREADS) && !defined(__EMSCRIPTEN__)
+#if __cplusplus > 199711L || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define MATH_ENABLE_THREADS
+#endif
+#endif
+
 // If MATH_TINYXML_INTEROP is defined, MathGeoLib integrates with TinyXML to provide
 // serialization and deserialization to XML for the data structures.
 #ifndef MATH_TINYXML_INTEROP
@@ -91,6 +99,13 @@
 //#define MATH_CONTAINERLIB_SUPPORT
 #endif
 
+// If MATH_QUADTREE_POOLED_STORAGE is defined, the objects of all the nodes of a QuadTree are stored in a single pooled
+// arena owned by the tree, instead of a separate std::vector in each node. This avoids a heap allocation per node, and
+// improves the memory locality of queries. See QuadTreeObjectPool.
+#ifndef MATH_QUADTREE_POOLED_STORAGE
+//#define MATH_QUADTREE_POOLED_STORAGE
+#endif
+
 // If MATH_GRAPHICSENGINE_INTEROP is defined, MathGeoLib integrates with a certain
 // graphics engine. Do not enable, only for internal use.
 #ifndef MATH_GRAPHICSENGINE_INTEROP
@@ -134,6 +149,7 @@
 #define MATH_WITH_GRISU3
 
 // Uncomment to specify the SIMD instruction set level in use.
+//#define MATH_AVX512 // AVX-512F.
 //#define MATH_AVX
 //#define MATH_SSE41
 //#define MATH_SSE3
@@ -148,7 +164,13 @@
 #include <arm_neon.h>
 #endif
 
-// MATH_FMA implies MATH_AVX, which implies MATH_SSE41, which implies MATH_SSE3, which implies MATH_SSE2, which implies MATH_SSE.
+// MATH_AVX512 and MATH_FMA imply MATH_AVX, which implies MATH_SSE41, which implies MATH_SSE3, which implies MATH_SSE2, which implies MATH_SSE.
+#ifdef MATH_AVX512
+#ifndef MATH_AVX
+#define MATH_AVX
+#endif
+#endif
+
 #ifdef MATH_FMA
 #ifndef MATH_AVX
 #define MATH_AVX
@@ -192,6 +214,63 @@
 #include <xmmintrin.h>
 #endif
 
+// If MATH_SIMD_DISPATCH is defined, the SIMD kernels of the hot batch functions (TriangleMesh ray intersection and
+// the float4x4 batch transforms) are compiled for every x86 instruction set level, independent of the level chosen
+// above, and the best kernel that the host CPU supports is selected at runtime. This allows shipping a single binary
+// that targets e.g. SSE2, but still uses AVX on the hosts that have it.
+#if defined(MATH_SIMD_DISPATCH) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) \
+	&& (defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__))
+#if defined(__GNUC__) || defined(__clang__)
+#include <immintrin.h> // Declares the intrinsics of all instruction sets, for use in functions with a target attribute.
+#endif
+#define MATH_SSE2_KERNELS
+#define MATH_SSE41_KERNELS
+#define MATH_AVX_KERNELS
+#define MATH_AVX512_KERNELS
+#else
+#ifdef MATH_SSE2
+#define MATH_SSE2_KERNELS
+#endif
+#ifdef MATH_SSE41
+#define MATH_SSE41_KERNELS
+#endif
+#ifdef MATH_AVX
+#define MATH_AVX_KERNELS
+#endif
+#ifdef MATH_AVX512
+#define MATH_AVX512_KERNELS
+#endif
+#endif
+
+// Annotate the functions that contain the kernels of each instruction set with these, so that the compiler allows the
+// intrinsics of that instruction set in them even if the rest of the code is compiled for a lower level.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(MATH_SIMD_DISPATCH)
+#ifndef MATH_SSE2
+#define MATH_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+#ifndef MATH_SSE41
+#define MATH_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+#ifndef MATH_AVX
+#define MATH_TARGET_AVX __attribute__((target("avx")))
+#endif
+#ifndef MATH_AVX512
+#define MATH_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+#ifndef MATH_TARGET_SSE2
+#define MATH_TARGET_SSE2
+#endif
+#ifndef MATH_TARGET_SSE41
+#define MATH_TARGET_SSE41
+#endif
+#ifndef MATH_TARGET_AVX
+#define MATH_TARGET_AVX
+#endif
+#ifndef MATH_TARGET_AVX512
+#define MATH_TARGET_AVX512
+#endif
+
 #if defined(MATH_SSE) || defined(MATH_NEON)
 #define MATH_SIMD // A common #define to signal the simd4f type is available.
 
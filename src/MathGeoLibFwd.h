@@ -76,6 +76,7 @@ template<int N>
 class PBVolume;
 
 class AABB;
+class AABBArray;
 class Capsule;
 class Circle;
 class Cone;
@@ -86,6 +87,7 @@ struct HitInfo;
 class Line;
 class LineSegment;
 class OBB;
+class OBBArray;
 class Plane;
 class Polygon;
 class Polyhedron;
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+// Note: TestData is not pulled in with a using directive here, since TestData::AABBArray() would shadow the class.
+
+// Generates an odd number of boxes, so that both the SIMD blocks and the scalar tail of the queries get exercised.
+static std::vector<AABB> RandomAABBs(LCG &rng, int numAABBs)
+{
+	std::vector<AABB> aabbs;
+	for(int i = 0; i < numAABBs; ++i)
+		aabbs.push_back(RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), 30.f));
+	return aabbs;
+}
+
+UNIQUE_TEST(AABBArray_SetGet)
+{
+	std::vector<AABB> aabbs = RandomAABBs(rng, 13);
+	AABBArray arr(&aabbs[0], (int)aabbs.size());
+	assert(arr.Size() == 13);
+	assert(IS32ALIGNED(arr.MinX()));
+	assert(IS32ALIGNED(arr.MaxZ()));
+	for(int i = 0; i < arr.Size(); ++i)
+		assert(arr.Get(i).Equals(aabbs[i]));
+
+	arr.RemoveSwap(3);
+	assert(arr.Size() == 12);
+	assert(arr.Get(3).Equals(aabbs[12]));
+
+	arr.Clear();
+	assert(arr.IsEmpty());
+	arr.Add(aabbs[5]);
+	assert(arr.Size() == 1);
+	assert(arr.Get(0).Equals(aabbs[5]));
+}
+
+RANDOMIZED_TEST(AABBArray_FindIntersecting_AABB)
+{
+	std::vector<AABB> aabbs = RandomAABBs(rng, 101);
+	AABBArray arr(&aabbs[0], (int)aabbs.size());
+	AABB query = RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), 50.f);
+
+	std::vector<int> indices(aabbs.size());
+	int numHits = arr.FindIntersecting(query, &indices[0]);
+	int n = 0;
+	for(int i = 0; i < (int)aabbs.size(); ++i)
+		if (aabbs[i].Intersects(query))
+		{
+			assert(n < numHits);
+			assert2(indices[n] == i, indices[n], i);
+			++n;
+		}
+	assert2(n == numHits, n, numHits);
+}
+
+RANDOMIZED_TEST(AABBArray_FindContaining)
+{
+	std::vector<AABB> aabbs = RandomAABBs(rng, 101);
+	AABBArray arr(&aabbs[0], (int)aabbs.size());
+	// Pick a point inside one of the boxes, so that there is at least one hit.
+	vec pt = aabbs[rng.Int(0, (int)aabbs.size()-1)].RandomPointInside(rng);
+
+	std::vector<int> indices(aabbs.size());
+	int numHits = arr.FindContaining(pt, &indices[0]);
+	assert(numHits >= 1);
+	int n = 0;
+	for(int i = 0; i < (int)aabbs.size(); ++i)
+		if (aabbs[i].Contains(pt))
+		{
+			assert(n < numHits);
+			assert2(indices[n] == i, indices[n], i);
+			++n;
+		}
+	assert2(n == numHits, n, numHits);
+}
+
+RANDOMIZED_TEST(AABBArray_FindIntersecting_Ray)
+{
+	std::vector<AABB> aabbs = RandomAABBs(rng, 101);
+	AABBArray arr(&aabbs[0], (int)aabbs.size());
+	Ray ray(aabbs[0].CenterPoint(), vec::RandomDir(rng));
+
+	std::vector<int> indices(aabbs.size());
+	std::vector<float> distances(aabbs.size());
+	int numHits = arr.FindIntersecting(ray, &indices[0], &distances[0]);
+	assert(numHits >= 1);
+	assert(indices[0] == 0);
+	assert(distances[0] == 0.f);
+	int n = 0;
+	for(int i = 0; i < (int)aabbs.size(); ++i)
+	{
+		float dNear, dFar;
+		if (aabbs[i].Intersects(ray, dNear, dFar))
+		{
+			assert(n < numHits);
+			assert2(indices[n] == i, indices[n], i);
+			assert2(EqualAbs(distances[n], dNear, 1e-2f), distances[n], dNear);
+			++n;
+		}
+	}
+	assert2(n == numHits, n, numHits);
+
+	// Limiting the distance must give the prefix of the hits that start within it.
+	const float maxDistance = 50.f;
+	int numNearHits = arr.FindIntersecting(ray, maxDistance, &indices[0]);
+	int numExpected = 0;
+	for(int i = 0; i < numHits; ++i)
+		if (distances[i] <= maxDistance)
+			++numExpected;
+	assert2(numNearHits == numExpected, numNearHits, numExpected);
+}
+
+RANDOMIZED_TEST(AABBArray_Enclose)
+{
+	std::vector<AABB> aabbs = RandomAABBs(rng, 37);
+	std::vector<AABB> aabbs2 = RandomAABBs(rng, 37);
+	AABBArray arr(&aabbs[0], (int)aabbs.size());
+	AABBArray arr2(&aabbs2[0], (int)aabbs2.size());
+
+	AABB expected = aabbs[0];
+	for(size_t i = 1; i < aabbs.size(); ++i)
+		expected.Enclose(aabbs[i]);
+	assert(arr.MinimalEnclosingAABB().Equals(expected));
+
+	arr.Enclose(arr2);
+	for(int i = 0; i < arr.Size(); ++i)
+	{
+		AABB a = aabbs[i];
+		a.Enclose(aabbs2[i]);
+		assert(arr.Get(i).Equals(a));
+	}
+
+	AABBArray empty;
+	assert(empty.MinimalEnclosingAABB().minPoint.x == FLOAT_INF);
+}
+
+struct AABBArrayBenchmarkData
+{
+	std::vector<AABB> aabbs;
+	AABBArray arr;
+	std::vector<int> indices;
+	AABB query;
+
+	AABBArrayBenchmarkData()
+	{
+		LCG rng(1234);
+		aabbs = RandomAABBs(rng, 10000);
+		arr.Set(&aabbs[0], (int)aabbs.size());
+		indices.resize(aabbs.size());
+		query = RandomAABBContainingPoint(POINT_VEC_SCALAR(0.f), 100.f);
+	}
+};
+
+BENCHMARK_ITERS(AABB_Intersects_AABB_array_10000, 10, 100, "AABB::Intersects(AABB) over std::vector<AABB> of 10000 boxes")
+{
+	AABBArrayBenchmarkData &data = TestData::BenchmarkData<AABBArrayBenchmarkData>();
+	int numHits = 0;
+	for(int j = 0; j < (int)data.aabbs.size(); ++j)
+		if (data.aabbs[j].Intersects(data.query))
+			data.indices[numHits++] = j;
+	TestData::dummyResultInt += numHits;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(AABBArray_FindIntersecting_AABB_10000, 10, 100, "AABBArray::FindIntersecting(AABB) for 10000 boxes")
+{
+	AABBArrayBenchmarkData &data = TestData::BenchmarkData<AABBArrayBenchmarkData>();
+	TestData::dummyResultInt += data.arr.FindIntersecting(data.query, &data.indices[0]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(AABB_Intersects_Ray_array_10000, 10, 100, "AABB::Intersects(Ray) over std::vector<AABB> of 10000 boxes")
+{
+	AABBArrayBenchmarkData &data = TestData::BenchmarkData<AABBArrayBenchmarkData>();
+	Ray ray(POINT_VEC_SCALAR(0.f), DIR_VEC(1.f, 2.f, 3.f).Normalized());
+	int numHits = 0;
+	for(int j = 0; j < (int)data.aabbs.size(); ++j)
+		if (data.aabbs[j].Intersects(ray))
+			data.indices[numHits++] = j;
+	TestData::dummyResultInt += numHits;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(AABBArray_FindIntersecting_Ray_10000, 10, 100, "AABBArray::FindIntersecting(Ray) for 10000 boxes")
+{
+	AABBArrayBenchmarkData &data = TestData::BenchmarkData<AABBArrayBenchmarkData>();
+	Ray ray(POINT_VEC_SCALAR(0.f), DIR_VEC(1.f, 2.f, 3.f).Normalized());
+	TestData::dummyResultInt += data.arr.FindIntersecting(ray, &data.indices[0]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(AABBArray_MinimalEnclosingAABB_10000, 10, 100, "AABBArray::MinimalEnclosingAABB() for 10000 boxes")
+{
+	AABBArrayBenchmarkData &data = TestData::BenchmarkData<AABBArrayBenchmarkData>();
+	TestData::dummyResultInt += (int)data.arr.MinimalEnclosingAABB().maxPoint.x;
+}
+BENCHMARK_ITERS_END
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+AABB RandomBVHTestAABB(LCG &lcg)
+{
+	vec center = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	vec halfSize = vec::RandomBox(lcg, DIR_VEC_SCALAR(0.5f), DIR_VEC_SCALAR(5.f));
+	return AABB(center - halfSize, center + halfSize);
+}
+
+struct BVHCollectObjectsVisitor
+{
+	std::vector<int> objects;
+	bool operator()(BVH<int> &tree, const BVHNode &leaf, const AABB &)
+	{
+		objects.push_back(tree.Object(leaf.ObjectIndex()));
+		return false;
+	}
+};
+
+void CheckBVHAABBQueries(BVH<int> &tree, const std::vector<AABB> &aabbs, const std::vector<bool> &alive, LCG &lcg)
+{
+	for(int i = 0; i < 50; ++i)
+	{
+		AABB query = RandomBVHTestAABB(lcg);
+		query.Scale(query.CenterPoint(), 5.f);
+		BVHCollectObjectsVisitor visitor;
+		tree.AABBQuery(query, visitor);
+		std::sort(visitor.objects.begin(), visitor.objects.end());
+
+		std::vector<int> bruteForce;
+		for(size_t j = 0; j < aabbs.size(); ++j)
+			if (alive[j] && query.Intersects(tree.ObjectAABB((int)j)))
+				bruteForce.push_back((int)j);
+		assert(visitor.objects == bruteForce);
+	}
+}
+
+UNIQUE_TEST(BVHInsertRemoveUpdate)
+{
+	LCG lcg(1234);
+	const int numObjects = 2000;
+	BVH<int> tree(0.5f);
+	std::vector<AABB> aabbs;
+	std::vector<bool> alive;
+	for(int i = 0; i < numObjects; ++i)
+	{
+		aabbs.push_back(RandomBVHTestAABB(lcg));
+		alive.push_back(true);
+		int objectIndex = tree.Insert(i, aabbs.back());
+		assert(objectIndex == i);
+		assert(tree.ObjectAABB(objectIndex).Contains(aabbs.back()));
+	}
+	tree.DebugSanityCheck();
+	assert(tree.NumObjects() == numObjects);
+	assert(tree.NumNodes() == 2 * numObjects - 1);
+	assert(tree.TreeHeight() <= 2 * 11 + 1); // The tree is kept balanced.
+	CheckBVHAABBQueries(tree, aabbs, alive, lcg);
+
+	for(int i = 0; i < 5000; ++i)
+	{
+		int objectIndex = lcg.Int(0, numObjects-1);
+		if (alive[objectIndex])
+		{
+			if (lcg.Int(0, 3) == 0)
+			{
+				tree.Remove(objectIndex);
+				alive[objectIndex] = false;
+			}
+			else
+			{
+				aabbs[objectIndex].Translate(vec::RandomDir(lcg) * lcg.Float(0.f, 2.f));
+				tree.Update(objectIndex, aabbs[objectIndex]);
+				assert(tree.ObjectAABB(objectIndex).Contains(aabbs[objectIndex]));
+			}
+		}
+		else
+		{
+			// Indices of removed objects get reused, though not necessarily this one.
+			AABB aabb = RandomBVHTestAABB(lcg);
+			int newIndex = tree.Insert(-1, aabb);
+			assert(!alive[newIndex]);
+			tree.Object(newIndex) = newIndex;
+			aabbs[newIndex] = aabb;
+			alive[newIndex] = true;
+		}
+		if (i % 500 == 0)
+			tree.DebugSanityCheck();
+	}
+	tree.DebugSanityCheck();
+	CheckBVHAABBQueries(tree, aabbs, alive, lcg);
+
+	tree.Compact();
+	assert(tree.NodeCapacity() == tree.NumNodes());
+	assert(tree.RootIndex() == 0);
+	tree.DebugSanityCheck();
+	CheckBVHAABBQueries(tree, aabbs, alive, lcg);
+}
+
+UNIQUE_TEST(BVHRefit)
+{
+	LCG lcg(1234);
+	const int numObjects = 2000;
+	BVH<int> tree;
+	std::vector<AABB> aabbs;
+	std::vector<bool> alive(numObjects, true);
+	for(int i = 0; i < numObjects; ++i)
+	{
+		aabbs.push_back(RandomBVHTestAABB(lcg));
+		tree.Insert(i, aabbs.back());
+	}
+
+	for(int compact = 0; compact < 2; ++compact)
+	{
+		if (compact)
+			tree.Compact();
+		for(int i = 0; i < numObjects; ++i)
+		{
+			aabbs[i].Translate(vec::RandomDir(lcg) * lcg.Float(0.f, 20.f));
+			tree.SetObjectAABB(i, aabbs[i]);
+		}
+		tree.Refit();
+		tree.DebugSanityCheck();
+		CheckBVHAABBQueries(tree, aabbs, alive, lcg);
+	}
+
+	// Scramble the objects, which destroys the quality of the tree. Refitting with rotations must recover some of it.
+	for(int i = 0; i < numObjects; ++i)
+	{
+		aabbs[i] = RandomBVHTestAABB(lcg);
+		tree.SetObjectAABB(i, aabbs[i]);
+	}
+	tree.Refit();
+	float costBefore = tree.SAHCost();
+	for(int i = 0; i < 5; ++i)
+		tree.Refit(true);
+	float costAfter = tree.SAHCost();
+	tree.DebugSanityCheck();
+	CheckBVHAABBQueries(tree, aabbs, alive, lcg);
+	LOGI("SAH cost of a scrambled tree: %f, after rotations: %f.", costBefore, costAfter);
+	assert(costAfter < costBefore);
+}
+
+UNIQUE_TEST(BVHRayQuery)
+{
+	LCG lcg(1234);
+	BVH<Triangle> tree(0.1f);
+	std::vector<Triangle> tris;
+	for(int i = 0; i < 2000; ++i)
+	{
+		vec a = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		vec b = a + vec::RandomBox(lcg, DIR_VEC_SCALAR(-5.f), DIR_VEC_SCALAR(5.f));
+		vec c = a + vec::RandomBox(lcg, DIR_VEC_SCALAR(-5.f), DIR_VEC_SCALAR(5.f));
+		tris.push_back(Triangle(a, b, c));
+		tree.Insert(tris.back());
+	}
+
+	for(int i = 0; i < 500; ++i)
+	{
+		vec pos = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		vec target = tris[lcg.Int(0, (int)tris.size()-1)].CenterPoint();
+		Ray ray(pos, (target - pos).Normalized());
+
+		TriangleBVHRayQueryNearestHitVisitor result;
+		tree.RayQuery(ray, result);
+
+		float nearestT = FLOAT_INF;
+		for(size_t j = 0; j < tris.size(); ++j)
+		{
+			float u, v;
+			float t = Triangle::IntersectLineTri(ray.pos, ray.dir, tris[j].a, tris[j].b, tris[j].c, u, v);
+			if (t >= 0.f && t < nearestT)
+				nearestT = t;
+		}
+		assert(result.triangleIndex != -1);
+		assert2(EqualAbs(result.rayT, nearestT, 1e-3f), result.rayT, nearestT);
+	}
+}
+
+const int numBVHBenchmarkObjects = 10000;
+
+struct BVHBenchmarkData
+{
+	BVH<int> tree;
+	BVH<int> compactTree;
+	std::vector<AABB> aabbs;
+
+	BVHBenchmarkData()
+	:tree(0.1f), compactTree(0.1f)
+	{
+		LCG lcg(1234);
+		for(int i = 0; i < numBVHBenchmarkObjects; ++i)
+		{
+			aabbs.push_back(RandomBVHTestAABB(lcg));
+			tree.Insert(i, aabbs.back());
+			compactTree.Insert(i, aabbs.back());
+		}
+		compactTree.Compact();
+	}
+
+	// Moves all objects a bit back and forth.
+	void MoveObjects(int frame, float distance)
+	{
+		vec offset = (frame % 2 == 0) ? DIR_VEC(distance, 0.f, 0.f) : DIR_VEC(-distance, 0.f, 0.f);
+		for(int i = 0; i < numBVHBenchmarkObjects; ++i)
+			aabbs[i].Translate(offset);
+	}
+};
+
+BENCHMARK(BVHUpdate_small_motion, "BVH::Update() an object that moves within its margin")
+{
+	BVHBenchmarkData &b = BenchmarkData<BVHBenchmarkData>();
+	int objectIndex = i % numBVHBenchmarkObjects;
+	AABB aabb = b.aabbs[objectIndex];
+	aabb.Translate(DIR_VEC((i % 2 == 0) ? 0.05f : -0.05f, 0.f, 0.f));
+	dummyResultInt += b.tree.Update(objectIndex, aabb) ? 1 : 0;
+}
+BENCHMARK_END
+
+BENCHMARK(BVHUpdate_reinsert, "BVH::Update() an object that moves out of its leaf")
+{
+	BVHBenchmarkData &b = BenchmarkData<BVHBenchmarkData>();
+	int objectIndex = (i * 7919) % numBVHBenchmarkObjects;
+	b.aabbs[objectIndex].Translate(DIR_VEC((i % 2 == 0) ? 10.f : -10.f, 0.f, 0.f));
+	dummyResultInt += b.tree.Update(objectIndex, b.aabbs[objectIndex]) ? 1 : 0;
+}
+BENCHMARK_END
+
+BENCHMARK_ITERS(BVHRefit, 10, 10, "BVH::SetObjectAABB() + BVH::Refit() for 10000 objects")
+{
+	BVHBenchmarkData &b = BenchmarkData<BVHBenchmarkData>();
+	b.MoveObjects(i, 1.f);
+	for(int j = 0; j < numBVHBenchmarkObjects; ++j)
+		b.tree.SetObjectAABB(j, b.aabbs[j]);
+	b.tree.Refit();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(BVHRefit_compacted, 10, 10, "BVH::SetObjectAABB() + BVH::Refit() for 10000 objects, compacted tree")
+{
+	BVHBenchmarkData &b = BenchmarkData<BVHBenchmarkData>();
+	b.MoveObjects(i, 1.f);
+	for(int j = 0; j < numBVHBenchmarkObjects; ++j)
+		b.compactTree.SetObjectAABB(j, b.aabbs[j]);
+	b.compactTree.Refit();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(BVHRefit_rotate, 10, 10, "BVH::SetObjectAABB() + BVH::Refit(true) for 10000 objects")
+{
+	BVHBenchmarkData &b = BenchmarkData<BVHBenchmarkData>();
+	b.MoveObjects(i, 1.f);
+	for(int j = 0; j < numBVHBenchmarkObjects; ++j)
+		b.tree.SetObjectAABB(j, b.aabbs[j]);
+	b.tree.Refit(true);
+}
+BENCHMARK_ITERS_END
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "../src/Algorithm/EPA.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+// Computes the penetration of the intersecting objects a and b, and checks that translating b by the reported
+// penetration vector brings the objects to touching contact: a slightly shorter translation leaves them intersecting,
+// and a slightly longer one separates them.
+template<typename A, typename B>
+float CheckedEPAPenetration(const A &a, const B &b, vec &normal)
+{
+	float depth;
+	vec pa, pb;
+	bool intersects = EPAPenetration(a, b, normal, depth, &pa, &pb);
+	assert(intersects);
+	assert1(depth >= 0.f, depth);
+	assert1(normal.IsNormalized(), normal);
+	float tolerance = 1e-2f * Max(1.f, depth);
+	assert3((pa - pb).Equals(depth * normal, tolerance), pa - pb, depth, normal);
+
+	B moved = b;
+	moved.Translate(normal * (depth + tolerance));
+	assert2(!GJKIntersect(a, moved), depth, normal);
+	if (depth > 2.f * tolerance)
+	{
+		moved = b;
+		moved.Translate(normal * (depth - tolerance));
+		assert2(GJKIntersect(a, moved), depth, normal);
+	}
+	return depth;
+}
+
+UNIQUE_TEST(EPAAABBAABB)
+{
+	AABB a(POINT_VEC(-1.f, -1.f, -1.f), POINT_VEC(1.f, 1.f, 1.f));
+	AABB b(POINT_VEC(0.5f, -0.5f, -0.5f), POINT_VEC(3.f, 0.5f, 0.5f));
+	vec normal, pa, pb;
+	float depth;
+	bool intersects = EPAPenetration(a, b, normal, depth, &pa, &pb);
+	assert(intersects);
+	assert1(EqualAbs(depth, 0.5f, 1e-4f), depth);
+	assert1(normal.Equals(DIR_VEC(1.f, 0.f, 0.f), 1e-4f), normal);
+	assert1(EqualAbs(pa.x, 1.f, 1e-4f), pa);
+	assert1(EqualAbs(pb.x, 0.5f, 1e-4f), pb);
+}
+
+UNIQUE_TEST(EPADisjoint)
+{
+	Sphere a(POINT_VEC(0.f, 0.f, 0.f), 1.f);
+	Sphere b(POINT_VEC(3.f, 0.f, 0.f), 1.f);
+	vec normal;
+	float depth;
+	bool intersects = EPAPenetration(a, b, normal, depth);
+	assert(!intersects);
+}
+
+UNIQUE_TEST(EPACoplanarTriangles)
+{
+	// The Minkowski difference of two coplanar triangles is flat, so the triangles are only touching.
+	Triangle a(POINT_VEC(0.f, 0.f, 0.f), POINT_VEC(2.f, 0.f, 0.f), POINT_VEC(0.f, 2.f, 0.f));
+	Triangle b(POINT_VEC(0.5f, 0.5f, 0.f), POINT_VEC(3.f, 0.5f, 0.f), POINT_VEC(0.5f, 3.f, 0.f));
+	vec normal, pa, pb;
+	float depth;
+	bool intersects = EPAPenetration(a, b, normal, depth, &pa, &pb);
+	assert(intersects);
+	assert1(depth == 0.f, depth);
+	assert1(EqualAbs(Abs(normal.z), 1.f, 1e-4f), normal);
+	assert1(a.Distance(pa) < 1e-3f, pa);
+	assert1(b.Distance(pb) < 1e-3f, pb);
+}
+
+RANDOMIZED_TEST(EPASphereSphere)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Sphere a = RandomSphereContainingPoint(pt, 10.f);
+	Sphere b = RandomSphereContainingPoint(pt, 10.f);
+	vec normal;
+	float depth = CheckedEPAPenetration(a, b, normal);
+	float d = a.pos.Distance(b.pos);
+	if (d > 1e-2f && d > Abs(a.r - b.r)) // Skip the cases where one sphere is inside the other, since then the direction is ill-conditioned.
+	{
+		float depthTolerance = 1e-2f * Max(1.f, depth);
+		assert2(EqualAbs(depth, a.r + b.r - d, depthTolerance), depth, a.r + b.r - d);
+		// Tilting the normal by an angle x from the true direction lengthens the separating translation only by about d*x^2/2,
+		// so the normal can only be expected to be as accurate as that allows within the depth tolerance.
+		float normalTolerance = Max(1e-2f, Sqrt(2.f * depthTolerance / d));
+		assert3(normal.Equals((b.pos - a.pos) / d, normalTolerance), normal, (b.pos - a.pos) / d, normalTolerance);
+	}
+}
+
+RANDOMIZED_TEST(EPACapsuleCapsule)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Capsule a = RandomCapsuleContainingPoint(pt);
+	Capsule b = RandomCapsuleContainingPoint(pt);
+	vec normal;
+	float depth = CheckedEPAPenetration(a, b, normal);
+	float d = a.l.Distance(b.l);
+	if (d > 1e-2f)
+		assert2(EqualAbs(depth, a.r + b.r - d, 1e-2f * Max(1.f, depth)), depth, a.r + b.r - d);
+}
+
+RANDOMIZED_TEST(EPAAABBOBB)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	AABB a = RandomAABBContainingPoint(pt, 10.f);
+	OBB b = RandomOBBContainingPoint(pt, 10.f);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+RANDOMIZED_TEST(EPAOBBOBB)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	OBB a = RandomOBBContainingPoint(pt, 10.f);
+	OBB b = RandomOBBContainingPoint(pt, 10.f);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+RANDOMIZED_TEST(EPAOBBSphere)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	OBB a = RandomOBBContainingPoint(pt, 10.f);
+	Sphere b = RandomSphereContainingPoint(pt, 10.f);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+RANDOMIZED_TEST(EPAFrustumCapsule)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Frustum a = RandomFrustumContainingPoint(rng, pt);
+	Capsule b = RandomCapsuleContainingPoint(pt);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+RANDOMIZED_TEST(EPAPolyhedronSphere)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Polyhedron a = RandomPolyhedronContainingPoint(pt);
+	Sphere b = RandomSphereContainingPoint(pt, 10.f);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+RANDOMIZED_TEST(EPATriangleOBB)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Triangle a = RandomTriangleContainingPoint(pt);
+	OBB b = RandomOBBContainingPoint(pt, 10.f);
+	vec normal;
+	CheckedEPAPenetration(a, b, normal);
+}
+
+struct EPABenchmarkData
+{
+	std::vector<OBB> obbs, obbs2;
+	std::vector<Sphere> spheres;
+	std::vector<Capsule> capsules;
+
+	/// Generates 100 pairs of intersecting objects for each of the benchmarked shape combinations.
+
+	EPABenchmarkData()
+	{
+		LCG lcg(1234);
+		for(int i = 0; i < 100; ++i)
+		{
+			vec pt = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+			obbs.push_back(RandomOBBContainingPoint(pt, 10.f));
+			obbs2.push_back(RandomOBBContainingPoint(pt, 10.f));
+			spheres.push_back(RandomSphereContainingPoint(pt, 10.f));
+			capsules.push_back(RandomCapsuleContainingPoint(pt));
+		}
+	}
+};
+
+BENCHMARK_ITERS(EPAPenetration_OBB_OBB, 10, 10, "GJKIntersect() and EPAPenetration() for 100 intersecting OBB pairs")
+{
+	EPABenchmarkData &data = BenchmarkData<EPABenchmarkData>();
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+	{
+		vec normal;
+		float depth;
+		EPAPenetration(data.obbs[j], data.obbs2[j], normal, depth);
+		dummyResultInt += (int)depth;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(EPAPenetration_OBB_Sphere, 10, 10, "GJKIntersect() and EPAPenetration() for 100 intersecting OBB-Sphere pairs")
+{
+	EPABenchmarkData &data = BenchmarkData<EPABenchmarkData>();
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+	{
+		vec normal;
+		float depth;
+		EPAPenetration(data.obbs[j], data.spheres[j], normal, depth);
+		dummyResultInt += (int)depth;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(EPAPenetration_Capsule_OBB, 10, 10, "GJKIntersect() and EPAPenetration() for 100 intersecting Capsule-OBB pairs")
+{
+	EPABenchmarkData &data = BenchmarkData<EPABenchmarkData>();
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+	{
+		vec normal;
+		float depth;
+		EPAPenetration(data.capsules[j], data.obbs[j], normal, depth);
+		dummyResultInt += (int)depth;
+	}
+}
+BENCHMARK_ITERS_END
@@ -597,6 +597,89 @@ BENCHMARK(Frustum_Contains_Triangle, "Frustum::Contains(Triangle)")
 }
 BENCHMARK_END
 
+RANDOMIZED_TEST(Frustum_CullAABBs)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Frustum f = RandomFrustumContainingPoint(rng, pt);
+	PBVolume<6> pbvol = f.ToPBVolume();
+
+	// Use an odd number of objects to exercise both the SIMD blocks and the scalar tail.
+	const int numObjects = 37;
+	AABB aabbs[numObjects];
+	Sphere spheres[numObjects];
+	for(int i = 0; i < numObjects; ++i)
+	{
+		vec objectPos = pt + vec::RandomBox(rng, DIR_VEC_SCALAR(-10.f), DIR_VEC_SCALAR(10.f));
+		aabbs[i] = RandomAABBContainingPoint(objectPos, 5.f);
+		spheres[i] = RandomSphereContainingPoint(objectPos, 5.f);
+	}
+	u8 aabbResults[numObjects];
+	u8 sphereResults[numObjects];
+	f.CullAABBs(aabbs, numObjects, aabbResults);
+	f.CullSpheres(spheres, numObjects, sphereResults);
+	for(int i = 0; i < numObjects; ++i)
+	{
+		assert2(aabbResults[i] == (u8)pbvol.InsideOrIntersects(aabbs[i]), (int)aabbResults[i], (int)pbvol.InsideOrIntersects(aabbs[i]));
+		assert2(sphereResults[i] == (u8)pbvol.InsideOrIntersects(spheres[i]), (int)sphereResults[i], (int)pbvol.InsideOrIntersects(spheres[i]));
+		assert(aabbResults[i] != TestInside || f.Contains(aabbs[i]));
+	}
+}
+
+struct FrustumCullBenchmarkData
+{
+	Frustum frustum;
+	std::vector<AABB> aabbs;
+	std::vector<Sphere> spheres;
+	std::vector<u8> results;
+
+	FrustumCullBenchmarkData()
+	{
+		LCG rng(1234);
+		frustum = RandomFrustumContainingPoint(rng, POINT_VEC_SCALAR(0.f));
+		for(int i = 0; i < 1000; ++i)
+		{
+			vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+			aabbs.push_back(RandomAABBContainingPoint(pt, 10.f));
+			spheres.push_back(RandomSphereContainingPoint(pt, 10.f));
+		}
+		results.resize(1000);
+	}
+};
+
+BENCHMARK_ITERS(Frustum_Intersects_AABB_GJK_1000, 10, 10, "Frustum::Intersects(AABB) for 1000 AABBs")
+{
+	FrustumCullBenchmarkData &data = BenchmarkData<FrustumCullBenchmarkData>();
+	for(int j = 0; j < 1000; ++j)
+		if (data.frustum.Intersects(data.aabbs[j]))
+			++dummyResultInt;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Frustum_CullAABBs_1000, 10, 10, "Frustum::CullAABBs() for 1000 AABBs")
+{
+	FrustumCullBenchmarkData &data = BenchmarkData<FrustumCullBenchmarkData>();
+	data.frustum.CullAABBs(&data.aabbs[0], 1000, &data.results[0]);
+	dummyResultInt += data.results[i];
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Frustum_Intersects_Sphere_GJK_1000, 10, 10, "Frustum::Intersects(Sphere) for 1000 Spheres")
+{
+	FrustumCullBenchmarkData &data = BenchmarkData<FrustumCullBenchmarkData>();
+	for(int j = 0; j < 1000; ++j)
+		if (data.frustum.Intersects(data.spheres[j]))
+			++dummyResultInt;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Frustum_CullSpheres_1000, 10, 10, "Frustum::CullSpheres() for 1000 Spheres")
+{
+	FrustumCullBenchmarkData &data = BenchmarkData<FrustumCullBenchmarkData>();
+	data.frustum.CullSpheres(&data.spheres[0], 1000, &data.results[0]);
+	dummyResultInt += data.results[i];
+}
+BENCHMARK_ITERS_END
+
 RANDOMIZED_TEST(Frustum_ClosestPoint_Point)
 {
 	vec pt = POINT_VEC_SCALAR(0.f);
@@ -1,14 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "../src/MathGeoLib.h"
 #include "../src/Math/myassert.h"
 #include "TestRunner.h"
 #include "../src/Algorithm/GJK.h"
 #include "ObjectGenerators.h"
+#include "TestData.h"
 
 MATH_IGNORE_UNUSED_VARS_WARNING
 
+using namespace TestData;
+
 UNIQUE_TEST(TrickyAABBCapsuleNoIntersect)
 {
 	Capsule a(POINT_VEC(-37.3521881f,-61.0987396f,77.0996475f), POINT_VEC(46.2122498f,-61.2913399f,15.9034805f) ,53.990406f);
@@ -569,3 +573,364 @@ RANDOMIZED_TEST(GJKTriangleTriangleNoIntersect)
 	Triangle b = RandomTriangleInHalfspace(p);
 	assert(!GJKIntersect(a, b));
 }
+
+// Computes GJKDistance(a, b), and checks that the reported closest points lie on both objects, are separated by the
+// reported distance, and that the query is symmetric.
+template<typename A, typename B>
+float CheckedGJKDistance(const A &a, const B &b)
+{
+	vec pa, pb;
+	float d = GJKDistance(a, b, &pa, &pb);
+	float tolerance = 1e-3f * Max(1.f, d);
+	assert2(d >= 0.f, d, tolerance);
+	assert2(a.Distance(pa) <= tolerance, a.Distance(pa), d);
+	assert2(b.Distance(pb) <= tolerance, b.Distance(pb), d);
+	assert2(EqualAbs(pa.Distance(pb), d, tolerance), pa.Distance(pb), d);
+	float d2 = GJKDistance(b, a);
+	assert2(EqualAbs(d, d2, tolerance), d, d2);
+	return d;
+}
+
+UNIQUE_TEST(GJKDistanceAABBAABB)
+{
+	AABB a(POINT_VEC(-1.f, -1.f, -1.f), POINT_VEC(1.f, 1.f, 1.f));
+	AABB b(POINT_VEC(4.f, -3.f, -0.5f), POINT_VEC(6.f, 0.f, 0.5f));
+	vec pa, pb;
+	float d = GJKDistance(a, b, &pa, &pb);
+	assert1(EqualAbs(d, 3.f, 1e-4f), d);
+	assert1(EqualAbs(pa.x, 1.f, 1e-4f), pa);
+	assert1(EqualAbs(pb.x, 4.f, 1e-4f), pb);
+	assert2(pa.Distance(pb) <= 3.f + 1e-4f, pa, pb);
+}
+
+UNIQUE_TEST(GJKDistanceSphereSphereIntersect)
+{
+	Sphere a(POINT_VEC(1.f, 2.f, 3.f), 2.f);
+	Sphere b(POINT_VEC(2.f, 2.f, 3.f), 2.f);
+	vec pa, pb;
+	assert(GJKDistance(a, b, &pa, &pb) == 0.f);
+	assert2(pa.Equals(pb), pa, pb);
+	assert1(a.Contains(pa, 1e-3f), pa);
+	assert1(b.Contains(pb, 1e-3f), pb);
+}
+
+RANDOMIZED_TEST(GJKDistanceSphereSphere)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	Sphere a = RandomSphereInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Sphere b = RandomSphereInHalfspace(p, 10.f);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceAABBSphere)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	AABB a = RandomAABBInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Sphere b = RandomSphereInHalfspace(p, 10.f);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceOBBSphere)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	OBB a = RandomOBBInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Sphere b = RandomSphereInHalfspace(p, 10.f);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceCapsuleCapsule)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	Capsule a = RandomCapsuleInHalfspace(p);
+	p.ReverseNormal();
+	Capsule b = RandomCapsuleInHalfspace(p);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceTriangleCapsule)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	Triangle a = RandomTriangleInHalfspace(p);
+	p.ReverseNormal();
+	Capsule b = RandomCapsuleInHalfspace(p);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceLineSegmentLineSegment)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	LineSegment a = RandomLineSegmentInHalfspace(p);
+	p.ReverseNormal();
+	LineSegment b = RandomLineSegmentInHalfspace(p);
+	float d = CheckedGJKDistance(a, b);
+	assert2(EqualAbs(d, a.Distance(b), 1e-3f * Max(1.f, d)), d, a.Distance(b));
+}
+
+RANDOMIZED_TEST(GJKDistanceOBBOBB)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	OBB a = RandomOBBInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	OBB b = RandomOBBInHalfspace(p, 10.f);
+	float d = CheckedGJKDistance(a, b);
+	assert1(d > 0.f, d);
+	// No corner of either box can be closer to the other box than the reported distance.
+	for(int i = 0; i < 8; ++i)
+	{
+		assert2(d <= b.Distance(a.CornerPoint(i)) + 1e-3f * Max(1.f, d), d, b.Distance(a.CornerPoint(i)));
+		assert2(d <= a.Distance(b.CornerPoint(i)) + 1e-3f * Max(1.f, d), d, a.Distance(b.CornerPoint(i)));
+	}
+}
+
+RANDOMIZED_TEST(GJKDistanceAABBFrustum)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	AABB a = RandomAABBInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Frustum b = RandomFrustumInHalfspace(p);
+	float d = CheckedGJKDistance(a, b);
+	assert1(d > 0.f, d);
+}
+
+RANDOMIZED_TEST(GJKDistanceTriangleTriangle)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	Triangle a = RandomTriangleInHalfspace(p);
+	p.ReverseNormal();
+	Triangle b = RandomTriangleInHalfspace(p);
+	float d = CheckedGJKDistance(a, b);
+	assert1(d > 0.f, d);
+	for(int i = 0; i < 3; ++i)
+	{
+		assert2(d <= b.Distance(a.Vertex(i)) + 1e-3f * Max(1.f, d), d, b.Distance(a.Vertex(i)));
+		assert2(d <= a.Distance(b.Vertex(i)) + 1e-3f * Max(1.f, d), d, a.Distance(b.Vertex(i)));
+	}
+}
+
+RANDOMIZED_TEST(GJKDistanceOBBCapsuleIntersect)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	OBB a = RandomOBBContainingPoint(pt, 10.f);
+	Capsule b = RandomCapsuleContainingPoint(pt);
+	vec pa, pb;
+	float d = GJKDistance(a, b, &pa, &pb);
+	assert1(d == 0.f, d);
+	assert2(a.Distance(pa) <= 1e-2f, a.Distance(pa), pa);
+	assert2(b.Distance(pb) <= 1e-2f, b.Distance(pb), pb);
+}
+
+RANDOMIZED_TEST(GJKDistanceFrustumTriangleIntersect)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Frustum a = RandomFrustumContainingPoint(rng, pt);
+	Triangle b = RandomTriangleContainingPoint(pt);
+	assert(GJKDistance(a, b) == 0.f);
+}
+
+struct GJKDistanceBenchmarkData
+{
+	std::vector<OBB> obbs, obbs2;
+	std::vector<Capsule> capsules, capsules2;
+	std::vector<Triangle> triangles;
+	std::vector<Sphere> spheres;
+	std::vector<AABB> aabbs;
+	std::vector<Frustum> frustums;
+
+	/// Generates 100 pairs of separated objects for each of the benchmarked shape combinations.
+
+	GJKDistanceBenchmarkData()
+	{
+		LCG lcg(1234);
+		for(int i = 0; i < 100; ++i)
+		{
+			Plane p(vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(lcg));
+			Plane p2 = p;
+			p2.ReverseNormal();
+			obbs.push_back(RandomOBBInHalfspace(p, 10.f));
+			obbs2.push_back(RandomOBBInHalfspace(p2, 10.f));
+			capsules.push_back(RandomCapsuleInHalfspace(p));
+			capsules2.push_back(RandomCapsuleInHalfspace(p2));
+			triangles.push_back(RandomTriangleInHalfspace(p));
+			spheres.push_back(RandomSphereInHalfspace(p2, 10.f));
+			aabbs.push_back(RandomAABBInHalfspace(p, 10.f));
+			frustums.push_back(RandomFrustumInHalfspace(p2));
+		}
+	}
+};
+
+BENCHMARK_ITERS(GJKDistance_OBB_OBB, 10, 10, "GJKDistance(OBB, OBB) for 100 separated pairs")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+		dummyResultInt += (int)GJKDistance(data.obbs[j], data.obbs2[j]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKIntersect_OBB_OBB, 10, 10, "GJKIntersect(OBB, OBB) for 100 separated pairs, for comparison against GJKDistance()")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+		dummyResultInt += GJKIntersect(data.obbs[j], data.obbs2[j]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKDistance_Capsule_Capsule, 10, 10, "GJKDistance(Capsule, Capsule) for 100 separated pairs")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.capsules.size(); ++j)
+		dummyResultInt += (int)GJKDistance(data.capsules[j], data.capsules2[j]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Capsule_Distance_Capsule, 10, 10, "Capsule::Distance(Capsule) for 100 separated pairs, for comparison against GJKDistance()")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.capsules.size(); ++j)
+		dummyResultInt += (int)data.capsules[j].Distance(data.capsules2[j]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKDistance_Triangle_Sphere, 10, 10, "GJKDistance(Triangle, Sphere) for 100 separated pairs")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.triangles.size(); ++j)
+		dummyResultInt += (int)GJKDistance(data.triangles[j], data.spheres[j]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKDistance_AABB_Frustum, 10, 10, "GJKDistance(AABB, Frustum) for 100 separated pairs")
+{
+	GJKDistanceBenchmarkData &data = BenchmarkData<GJKDistanceBenchmarkData>();
+	for(size_t j = 0; j < data.aabbs.size(); ++j)
+		dummyResultInt += (int)GJKDistance(data.aabbs[j], data.frustums[j]);
+}
+BENCHMARK_ITERS_END
+
+// Forwards the GJK support functions to the given object, and counts the number of support function evaluations.
+template<typename T>
+struct GJKSupportCounter
+{
+	const T &object;
+	int &numEvaluations;
+
+	GJKSupportCounter(const T &object_, int &numEvaluations_):object(object_), numEvaluations(numEvaluations_) {}
+	vec AnyPointFast() const { return object.AnyPointFast(); }
+	vec ExtremePoint(const vec &direction, float &projectionDistance) const { ++numEvaluations; return object.ExtremePoint(direction, projectionDistance); }
+};
+
+// Animates numPairs pairs of OBBs over numFrames frames. The box a of each pair stays in place, while the box b drifts and spins
+// slowly, so that the pairs go in and out of intersection during the animation. The resulting boxes are stored frame by frame.
+static void GenerateGJKMovingOBBPairs(LCG &lcg, int numPairs, int numFrames, std::vector<OBB> &a, std::vector<OBB> &b)
+{
+	std::vector<OBB> boxes;
+	std::vector<vec> velocities, axes;
+	for(int i = 0; i < numPairs; ++i)
+	{
+		vec pt = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		a.push_back(RandomOBBContainingPoint(pt, 10.f));
+		boxes.push_back(RandomOBBContainingPoint(pt + vec::RandomBox(lcg, DIR_VEC_SCALAR(-10.f), DIR_VEC_SCALAR(10.f)), 10.f));
+		velocities.push_back(vec::RandomBox(lcg, DIR_VEC_SCALAR(-0.2f), DIR_VEC_SCALAR(0.2f)));
+		axes.push_back(vec::RandomDir(lcg));
+	}
+	for(int i = 1; i < numFrames; ++i)
+		a.insert(a.end(), a.begin(), a.begin() + numPairs);
+	for(int i = 0; i < numFrames; ++i)
+		for(int j = 0; j < numPairs; ++j)
+		{
+			b.push_back(boxes[j]);
+			boxes[j].Transform(float3x4::RotateAxisAngle(DIR_TO_FLOAT3(axes[j]), 0.02f, POINT_TO_FLOAT3(boxes[j].pos)));
+			boxes[j].Translate(velocities[j]);
+		}
+}
+
+RANDOMIZED_TEST(GJKIntersectWarmStartMovingOBBs)
+{
+	std::vector<OBB> a, b;
+	GenerateGJKMovingOBBPairs(rng, 10, 32, a, b);
+	GJKCache cache[10];
+	// OBB::Intersects() pads the separating axis test by its epsilon parameter, so that it reports boxes that are slightly apart
+	// as intersecting. Compare against the unpadded test instead, and allow the result to go either way when the boxes are just
+	// touching, i.e. closer than the padding that OBB::Intersects() applies to the box dimensions by default.
+	const float epsilon = 1e-3f;
+	for(size_t i = 0; i < a.size(); ++i)
+	{
+		bool intersects = GJKIntersect(a[i], b[i], cache[i % 10]);
+		if (intersects != a[i].Intersects(b[i], 0.f))
+		{
+			float d = GJKDistance(a[i], b[i]);
+			float tolerance = epsilon * (a[i].r.SumOfElements() + b[i].r.SumOfElements());
+			assert3(d <= tolerance, d, tolerance, intersects);
+		}
+		assert1(cache[i % 10].numDirs >= 0 && cache[i % 10].numDirs <= 3, cache[i % 10].numDirs);
+	}
+}
+
+RANDOMIZED_TEST(GJKIntersectWarmStartSphereCapsule)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	Sphere a = RandomSphereInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Capsule b = RandomCapsuleInHalfspace(p);
+	GJKCache cache;
+	assert(!GJKIntersect(a, b, cache));
+	assert1(cache.numDirs == 1, cache.numDirs);
+	assert(!GJKIntersect(a, b, cache)); // The cached separating direction must still be valid.
+
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	a = RandomSphereContainingPoint(pt, 10.f);
+	b = RandomCapsuleContainingPoint(pt);
+	assert(GJKIntersect(a, b, cache)); // A stale cache must not affect the result.
+	assert(GJKIntersect(a, b, cache));
+}
+
+UNIQUE_TEST(GJKIntersectWarmStartSupportEvaluations)
+{
+	LCG lcg(1234);
+	std::vector<OBB> a, b;
+	GenerateGJKMovingOBBPairs(lcg, 100, 32, a, b);
+	int numCold = 0, numWarm = 0;
+	GJKCache cache[100];
+	for(size_t i = 0; i < a.size(); ++i)
+	{
+		GJKIntersect(GJKSupportCounter<OBB>(a[i], numCold), b[i]);
+		GJKIntersect(GJKSupportCounter<OBB>(a[i], numWarm), b[i], cache[i % 100]);
+	}
+	LOGI("Average number of support function evaluations per GJK test: %f cold, %f warm-started.", (float)numCold / a.size(), (float)numWarm / a.size());
+	assert2(numWarm < numCold, numWarm, numCold);
+}
+
+struct GJKWarmStartBenchmarkData
+{
+	std::vector<OBB> a, b;
+
+	GJKWarmStartBenchmarkData()
+	{
+		LCG lcg(1234);
+		GenerateGJKMovingOBBPairs(lcg, 100, 32, a, b);
+	}
+};
+
+BENCHMARK_ITERS(GJKIntersect_OBB_OBB_MovingPairs, 10, 1, "GJKIntersect(OBB, OBB) for 100 moving pairs over 32 frames")
+{
+	GJKWarmStartBenchmarkData &data = BenchmarkData<GJKWarmStartBenchmarkData>();
+	for(size_t j = 0; j < data.a.size(); ++j)
+		dummyResultInt += GJKIntersect(data.a[j], data.b[j]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKIntersect_OBB_OBB_MovingPairs_WarmStarted, 10, 1, "GJKIntersect(OBB, OBB, GJKCache) for 100 moving pairs over 32 frames")
+{
+	GJKWarmStartBenchmarkData &data = BenchmarkData<GJKWarmStartBenchmarkData>();
+	GJKCache cache[100];
+	for(size_t j = 0; j < data.a.size(); ++j)
+		dummyResultInt += GJKIntersect(data.a[j], data.b[j], cache[j % 100]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
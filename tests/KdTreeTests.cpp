@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "../src/Geometry/KDTree.h"
+#include "TestRunner.h"
+#include "TestData.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+// Generates an uneven triangle soup: a handful of dense clusters of small triangles, plus a few large triangles.
+std::vector<Triangle> GenerateKdTreeTestTriangles(LCG &lcg, int numTriangles)
+{
+	std::vector<Triangle> tris;
+	const int numClusters = 8;
+	vec clusterCenters[numClusters];
+	for(int i = 0; i < numClusters; ++i)
+		clusterCenters[i] = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		float size = (i % 64 == 0) ? SCALE * 0.5f : 1.f;
+		vec a = clusterCenters[i % numClusters] + vec::RandomBox(lcg, POINT_VEC_SCALAR(-10.f), POINT_VEC_SCALAR(10.f));
+		vec b = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-size), POINT_VEC_SCALAR(size));
+		vec c = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-size), POINT_VEC_SCALAR(size));
+		tris.push_back(Triangle(a, b, c));
+	}
+	return tris;
+}
+
+float BruteForceNearestHit(const std::vector<Triangle> &tris, const Ray &ray, int &outTriangleIndex)
+{
+	float nearestT = FLOAT_INF;
+	outTriangleIndex = -1;
+	for(size_t i = 0; i < tris.size(); ++i)
+	{
+		float u, v;
+		float t = Triangle::IntersectLineTri(ray.pos, ray.dir, tris[i].a, tris[i].b, tris[i].c, u, v);
+		if (t >= 0.f && t < nearestT)
+		{
+			nearestT = t;
+			outTriangleIndex = (int)i;
+		}
+	}
+	return nearestT;
+}
+
+void TestKdTreeRayQueries(KdTree<Triangle> &tree, const std::vector<Triangle> &tris, LCG &lcg)
+{
+	for(int i = 0; i < 500; ++i)
+	{
+		vec pos = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		vec target = tris[lcg.Int(0, (int)tris.size()-1)].CenterPoint();
+		Ray ray(pos, (target - pos).Normalized());
+
+		TriangleKdTreeRayQueryNearestHitVisitor result;
+		tree.RayQuery(ray, result);
+
+		int bruteForceIndex;
+		float bruteForceT = BruteForceNearestHit(tris, ray, bruteForceIndex);
+		assert(bruteForceIndex != -1); // The ray was aimed at a triangle, so it must hit something.
+		assert2(EqualAbs(result.rayT, bruteForceT, 1e-3f), result.rayT, bruteForceT);
+	}
+}
+
+UNIQUE_TEST(KdTreeMidpointBuildRayQuery)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	tree.Build();
+	assert(tree.BuildParams().splitHeuristic == KdTreeSplitMidpoint);
+	TestKdTreeRayQueries(tree, tris, lcg);
+}
+
+UNIQUE_TEST(KdTreeSAHBuildRayQuery)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	tree.Build(params);
+	assert(tree.BuildParams().splitHeuristic == KdTreeSplitSAH);
+	TestKdTreeRayQueries(tree, tris, lcg);
+}
+
+UNIQUE_TEST(KdTreeSAHBuildSingleLeaf)
+{
+	// Tilt the triangle so that the bounding box of the tree is not flat.
+	Triangle tri(POINT_VEC(0,0,0), POINT_VEC(1,0,1), POINT_VEC(0,1,1));
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tri, 1);
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	tree.Build(params);
+
+	KdTreeStatistics stats = tree.Statistics();
+	assert(stats.numObjectReferences >= 1);
+	assert(stats.maxLeafSize == 1);
+
+	TriangleKdTreeRayQueryNearestHitVisitor result;
+	tree.RayQuery(Ray(POINT_VEC(0.25f, 0.25f, 2.f), DIR_VEC(0,0,-1)), result);
+	assert(result.triangleIndex == 0);
+	assert(EqualAbs(result.rayT, 1.5f));
+}
+
+UNIQUE_TEST(KdTreeStatistics)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 5000);
+	KdTree<Triangle> midpointTree, sahTree;
+	midpointTree.AddObjects(&tris[0], (int)tris.size());
+	sahTree.AddObjects(&tris[0], (int)tris.size());
+	midpointTree.Build();
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	sahTree.Build(params);
+
+	KdTreeStatistics m = midpointTree.Statistics();
+	KdTreeStatistics s = sahTree.Statistics();
+	assert(m.numLeaves == midpointTree.NumLeaves());
+	assert(m.numInnerNodes == midpointTree.NumInnerNodes());
+	assert(m.treeHeight == midpointTree.TreeHeight());
+	assert(s.numLeaves == sahTree.NumLeaves());
+	assert(s.treeHeight == sahTree.TreeHeight());
+	assert(m.duplicationFactor >= 1.f);
+	assert(s.duplicationFactor >= 1.f);
+
+	LOGI("Midpoint: %d nodes, height %d, %d leaves (%d empty), avg leaf size %.2f, max leaf size %d, duplication %.2f, SAH cost %.2f.",
+		m.numNodes, m.treeHeight, m.numLeaves, m.numEmptyLeaves, m.averageLeafSize, m.maxLeafSize, m.duplicationFactor, m.sahCost);
+	LOGI("SAH:      %d nodes, height %d, %d leaves (%d empty), avg leaf size %.2f, max leaf size %d, duplication %.2f, SAH cost %.2f.",
+		s.numNodes, s.treeHeight, s.numLeaves, s.numEmptyLeaves, s.averageLeafSize, s.maxLeafSize, s.duplicationFactor, s.sahCost);
+}
+
+bool KdTreesAreIdentical(const KdTree<Triangle> &a, const KdTree<Triangle> &b)
+{
+	if (a.NumNodes() != b.NumNodes())
+		return false;
+	for(int i = 0; i < a.NumNodes(); ++i)
+	{
+		const KdTreeNode &na = a.Root()[i];
+		const KdTreeNode &nb = b.Root()[i];
+		if (na.splitAxis != nb.splitAxis || na.childIndex != nb.childIndex || na.bucketIndex != nb.bucketIndex)
+			return false;
+		if (na.IsLeaf() && !na.IsEmptyLeaf())
+		{
+			const u32 *ba = a.Bucket(na.bucketIndex);
+			const u32 *bb = b.Bucket(nb.bucketIndex);
+			while(*ba == *bb && *ba != KdTree<Triangle>::BUCKET_SENTINEL)
+				++ba, ++bb;
+			if (*ba != *bb)
+				return false;
+		}
+	}
+	return true;
+}
+
+void TestKdTreeParallelBuild(KdTreeSplitHeuristic splitHeuristic)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 50000);
+	KdTreeBuildParams params;
+	params.splitHeuristic = splitHeuristic;
+	params.maxObjectsPerLeaf = (splitHeuristic == KdTreeSplitSAH) ? 2 : 16;
+
+	KdTree<Triangle> serialTree;
+	serialTree.AddObjects(&tris[0], (int)tris.size());
+	serialTree.Build(params);
+
+	for(int numThreads = 2; numThreads <= 8; numThreads *= 2)
+	{
+		KdTree<Triangle> parallelTree;
+		parallelTree.AddObjects(&tris[0], (int)tris.size());
+		params.numThreads = numThreads;
+		parallelTree.Build(params);
+		assert(KdTreesAreIdentical(serialTree, parallelTree));
+	}
+}
+
+UNIQUE_TEST(KdTreeParallelMidpointBuildIsIdenticalToSerial)
+{
+	TestKdTreeParallelBuild(KdTreeSplitMidpoint);
+}
+
+UNIQUE_TEST(KdTreeParallelSAHBuildIsIdenticalToSerial)
+{
+	TestKdTreeParallelBuild(KdTreeSplitSAH);
+}
+
+RANDOMIZED_TEST(KdTreeParallelBuildRayQuery)
+{
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(rng, 5000);
+	KdTreeBuildParams params;
+	params.splitHeuristic = rng.Int(0, 1) ? KdTreeSplitSAH : KdTreeSplitMidpoint;
+	params.maxObjectsPerLeaf = (params.splitHeuristic == KdTreeSplitSAH) ? 2 : 16;
+
+	KdTree<Triangle> serialTree;
+	serialTree.AddObjects(&tris[0], (int)tris.size());
+	serialTree.Build(params);
+
+	KdTree<Triangle> parallelTree;
+	parallelTree.AddObjects(&tris[0], (int)tris.size());
+	params.numThreads = rng.Int(2, 8);
+	parallelTree.Build(params);
+
+	for(int i = 0; i < 100; ++i)
+	{
+		vec pos = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		vec target = tris[rng.Int(0, (int)tris.size()-1)].CenterPoint();
+		Ray ray(pos, (target - pos).Normalized());
+
+		TriangleKdTreeRayQueryNearestHitVisitor serialHit;
+		serialTree.RayQuery(ray, serialHit);
+		TriangleKdTreeRayQueryNearestHitVisitor parallelHit;
+		parallelTree.RayQuery(ray, parallelHit);
+		assert3(parallelHit.triangleIndex == serialHit.triangleIndex, parallelHit.triangleIndex, serialHit.triangleIndex, params.numThreads);
+		assert2(parallelHit.rayT == serialHit.rayT, parallelHit.rayT, serialHit.rayT);
+	}
+}
+
+struct KdTreeBuildBenchmarkData
+{
+	std::vector<Triangle> tris;
+
+	KdTreeBuildBenchmarkData()
+	{
+		LCG lcg(1234);
+		tris = GenerateKdTreeTestTriangles(lcg, 100000);
+	}
+};
+
+// Builds a SAH kD-tree of the benchmark triangles with the given number of threads.
+static int BuildKdTreeBenchmarkTree(int numThreads)
+{
+	KdTreeBuildBenchmarkData &data = BenchmarkData<KdTreeBuildBenchmarkData>();
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	params.numThreads = numThreads;
+	KdTree<Triangle> tree;
+	tree.AddObjects(&data.tris[0], (int)data.tris.size());
+	tree.Build(params);
+	return tree.NumNodes();
+}
+
+BENCHMARK_ITERS(KdTree_Build_SAH_100000_1_thread, 3, 1, "KdTree::Build() of 100000 triangles with the SAH heuristic on 1 thread")
+{
+	dummyResultInt += BuildKdTreeBenchmarkTree(1);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_Build_SAH_100000_2_threads, 3, 1, "KdTree::Build() of 100000 triangles with the SAH heuristic on 2 threads")
+{
+	dummyResultInt += BuildKdTreeBenchmarkTree(2);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_Build_SAH_100000_4_threads, 3, 1, "KdTree::Build() of 100000 triangles with the SAH heuristic on 4 threads")
+{
+	dummyResultInt += BuildKdTreeBenchmarkTree(4);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_Build_SAH_100000_8_threads, 3, 1, "KdTree::Build() of 100000 triangles with the SAH heuristic on 8 threads")
+{
+	dummyResultInt += BuildKdTreeBenchmarkTree(8);
+}
+BENCHMARK_ITERS_END
+
+std::vector<float> BruteForceSortedDistancesSq(const std::vector<Triangle> &tris, const vec &point)
+{
+	std::vector<float> distancesSq;
+	for(size_t i = 0; i < tris.size(); ++i)
+		distancesSq.push_back(tris[i].DistanceSq(point));
+	std::sort(distancesSq.begin(), distancesSq.end());
+	return distancesSq;
+}
+
+UNIQUE_TEST(KdTreeKNearestObjects)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	tree.Build(params);
+
+	for(int i = 0; i < 100; ++i)
+	{
+		vec point = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		std::vector<float> expected = BruteForceSortedDistancesSq(tris, point);
+		const int k = (i % 3 == 0) ? 1 : ((i % 3 == 1) ? 8 : KdTree<Triangle>::maxNearestNeighbors);
+		u32 indices[KdTree<Triangle>::maxNearestNeighbors];
+		float distancesSq[KdTree<Triangle>::maxNearestNeighbors];
+		int numFound = tree.KNearestObjects(point, k, indices, distancesSq);
+		assert2(numFound == k, numFound, k);
+		for(int j = 0; j < numFound; ++j)
+		{
+			assert2(distancesSq[j] == expected[j], distancesSq[j], expected[j]);
+			assert(tris[indices[j]].DistanceSq(point) == distancesSq[j]);
+			for(int l = 0; l < j; ++l)
+				assert(indices[l] != indices[j]);
+		}
+	}
+
+	// Asking for more objects than there are in the tree returns all of them.
+	KdTree<Triangle> smallTree;
+	smallTree.AddObjects(&tris[0], 10);
+	smallTree.Build();
+	u32 indices[KdTree<Triangle>::maxNearestNeighbors];
+	int numFound = smallTree.KNearestObjects(POINT_VEC_SCALAR(0.f), 20, indices, 0);
+	assert1(numFound == 10, numFound);
+}
+
+UNIQUE_TEST(KdTreeObjectsWithinRadius)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	tree.Build();
+
+	std::vector<u32> indices;
+	std::vector<float> distancesSq;
+	for(int i = 0; i < 100; ++i)
+	{
+		vec point = tris[lcg.Int(0, (int)tris.size()-1)].CenterPoint() + vec::RandomBox(lcg, POINT_VEC_SCALAR(-5.f), POINT_VEC_SCALAR(5.f));
+		float radius = lcg.Float(0.f, 10.f);
+		tree.ObjectsWithinRadius(point, radius, indices, distancesSq);
+
+		std::vector<u32> expected;
+		for(size_t j = 0; j < tris.size(); ++j)
+			if (tris[j].DistanceSq(point) <= radius * radius)
+				expected.push_back((u32)j);
+		assert2(indices.size() == expected.size(), (int)indices.size(), (int)expected.size());
+		assert(indices == expected);
+		assert(distancesSq.size() == indices.size());
+		for(size_t j = 0; j < indices.size(); ++j)
+			assert(distancesSq[j] == tris[indices[j]].DistanceSq(point));
+	}
+}
+
+struct KdTreeNearestNeighborBenchmarkData
+{
+	std::vector<Triangle> tris;
+	KdTree<Triangle> tree;
+	std::vector<vec> points;
+
+	KdTreeNearestNeighborBenchmarkData()
+	{
+		LCG lcg(1234);
+		tris = GenerateKdTreeTestTriangles(lcg, 10000);
+		tree.AddObjects(&tris[0], (int)tris.size());
+		KdTreeBuildParams params;
+		params.splitHeuristic = KdTreeSplitSAH;
+		params.maxObjectsPerLeaf = 2;
+		tree.Build(params);
+		for(int i = 0; i < 100; ++i)
+			points.push_back(vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)));
+	}
+};
+
+BENCHMARK_ITERS(KdTree_KNearestObjects_8, 10, 10, "KdTree::KNearestObjects() of 8 neighbors for 100 points among 10000 triangles")
+{
+	KdTreeNearestNeighborBenchmarkData &data = BenchmarkData<KdTreeNearestNeighborBenchmarkData>();
+	for(size_t j = 0; j < data.points.size(); ++j)
+	{
+		u32 indices[8];
+		dummyResultInt += data.tree.KNearestObjects(data.points[j], 8, indices, 0) + (int)indices[0];
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_KNearestObjects_8_BruteForce, 10, 10, "Brute force search of 8 nearest neighbors for 100 points among 10000 triangles, for comparison against KdTree::KNearestObjects()")
+{
+	KdTreeNearestNeighborBenchmarkData &data = BenchmarkData<KdTreeNearestNeighborBenchmarkData>();
+	for(size_t j = 0; j < data.points.size(); ++j)
+	{
+		NearestNeighborHeap<u32, 8> nearest(8);
+		for(size_t k = 0; k < data.tris.size(); ++k)
+		{
+			float d = data.tris[k].DistanceSq(data.points[j]);
+			if (d < nearest.MaxDistanceSq())
+				nearest.Insert((u32)k, d);
+		}
+		dummyResultInt += nearest.Size() + (int)nearest[0].object;
+	}
+}
+BENCHMARK_ITERS_END
+
+// Generates a soup of small triangles inside a box of size 20x20x20 centered at the origin.
+std::vector<Triangle> GenerateKdTreeQueryTestMesh(LCG &lcg, int numTriangles)
+{
+	std::vector<Triangle> tris;
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		vec a = vec::RandomBox(lcg, POINT_VEC_SCALAR(-10.f), POINT_VEC_SCALAR(10.f));
+		vec b = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-2.f), POINT_VEC_SCALAR(2.f));
+		vec c = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-2.f), POINT_VEC_SCALAR(2.f));
+		tris.push_back(Triangle(a, b, c));
+	}
+	return tris;
+}
+
+// Collects the pairs of intersecting triangles from the leaf pairs reported by KdTree::KdTreeQuery().
+struct KdTreeQueryTrianglePairs
+{
+	float3x4 tree2Transform; // Maps the triangles of tree2 to the local space of the first tree.
+	std::vector<std::pair<u32, u32> > pairs;
+	int numLeafPairs;
+
+	KdTreeQueryTrianglePairs():numLeafPairs(0) {}
+
+	bool operator ()(KdTree<Triangle> &tree, KdTreeNode &leaf, const AABB &leafAABB, KdTree<Triangle> &tree2, KdTreeNode &tree2Leaf, const OBB &tree2LeafOBB)
+	{
+		MARK_UNUSED(leafAABB);
+		MARK_UNUSED(tree2LeafOBB);
+		assert(leafAABB.Intersects(tree2LeafOBB));
+		++numLeafPairs;
+		for(const u32 *a = tree.Bucket(leaf.bucketIndex); *a != KdTree<Triangle>::BUCKET_SENTINEL; ++a)
+			for(const u32 *b = tree2.Bucket(tree2Leaf.bucketIndex); *b != KdTree<Triangle>::BUCKET_SENTINEL; ++b)
+			{
+				Triangle t = tree2.Object(*b);
+				t.Transform(tree2Transform);
+				if (tree.Object(*a).Intersects(t))
+					pairs.push_back(std::make_pair(*a, *b));
+			}
+		return false;
+	}
+
+	// Triangles can be stored in several leaves, so the same pair can be found from several leaf pairs.
+	void RemoveDuplicates()
+	{
+		std::sort(pairs.begin(), pairs.end());
+		pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+	}
+};
+
+std::vector<std::pair<u32, u32> > BruteForceIntersectingTrianglePairs(const std::vector<Triangle> &tris, const std::vector<Triangle> &tris2, const float3x4 &tree2Transform)
+{
+	std::vector<std::pair<u32, u32> > pairs;
+	for(size_t j = 0; j < tris2.size(); ++j)
+	{
+		Triangle t = tris2[j];
+		t.Transform(tree2Transform);
+		for(size_t i = 0; i < tris.size(); ++i)
+			if (tris[i].Intersects(t))
+				pairs.push_back(std::make_pair((u32)i, (u32)j));
+	}
+	std::sort(pairs.begin(), pairs.end());
+	return pairs;
+}
+
+float3x4 RandomKdTreeQueryTransform(LCG &lcg)
+{
+	return float3x4::FromTRS(float3::RandomBox(lcg, -5.f, 5.f), Quat::RandomRotation(lcg), float3::FromScalar(lcg.Float(0.5f, 2.f)));
+}
+
+UNIQUE_TEST(KdTreeKdTreeQuery)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeQueryTestMesh(lcg, 500);
+	std::vector<Triangle> tris2 = GenerateKdTreeQueryTestMesh(lcg, 300);
+	for(int heuristic = KdTreeSplitMidpoint; heuristic <= KdTreeSplitSAH; ++heuristic)
+	{
+		KdTreeBuildParams params;
+		params.splitHeuristic = (KdTreeSplitHeuristic)heuristic;
+		params.maxObjectsPerLeaf = 4;
+		KdTree<Triangle> tree;
+		tree.AddObjects(&tris[0], (int)tris.size());
+		tree.Build(params);
+		KdTree<Triangle> tree2;
+		tree2.AddObjects(&tris2[0], (int)tris2.size());
+		tree2.Build(params);
+
+		int numIntersectingPairs = 0;
+		for(int i = 0; i < 20; ++i)
+		{
+			float3x4 transform = RandomKdTreeQueryTransform(lcg);
+			float3x4 transform2 = RandomKdTreeQueryTransform(lcg);
+
+			KdTreeQueryTrianglePairs query;
+			query.tree2Transform = transform.Inverted() * transform2;
+			tree.KdTreeQuery(tree2, transform, transform2, query);
+			query.RemoveDuplicates();
+
+			std::vector<std::pair<u32, u32> > expected = BruteForceIntersectingTrianglePairs(tris, tris2, query.tree2Transform);
+			assert2(query.pairs.size() == expected.size(), (int)query.pairs.size(), (int)expected.size());
+			assert(query.pairs == expected);
+			numIntersectingPairs += (int)expected.size();
+		}
+		assert(numIntersectingPairs > 0);
+	}
+}
+
+UNIQUE_TEST(KdTreeKdTreeQueryDisjoint)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeQueryTestMesh(lcg, 100);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	tree.Build();
+
+	// The same mesh placed far away does not overlap the tree at all.
+	KdTreeQueryTrianglePairs query;
+	query.tree2Transform = float3x4::Translate(100.f, 0.f, 0.f);
+	tree.KdTreeQuery(tree, float3x4::identity, query.tree2Transform, query);
+	assert1(query.numLeafPairs == 0, query.numLeafPairs);
+}
+
+struct KdTreeQueryBenchmarkData
+{
+	std::vector<Triangle> tris;
+	std::vector<Triangle> tris2;
+	KdTree<Triangle> tree;
+	KdTree<Triangle> tree2;
+	float3x4 transform;
+	float3x4 transform2;
+
+	KdTreeQueryBenchmarkData()
+	{
+		LCG lcg(1234);
+		tris = GenerateKdTreeQueryTestMesh(lcg, 2000);
+		tris2 = GenerateKdTreeQueryTestMesh(lcg, 2000);
+		KdTreeBuildParams params;
+		params.splitHeuristic = KdTreeSplitSAH;
+		params.maxObjectsPerLeaf = 4;
+		tree.AddObjects(&tris[0], (int)tris.size());
+		tree.Build(params);
+		tree2.AddObjects(&tris2[0], (int)tris2.size());
+		tree2.Build(params);
+		transform = RandomKdTreeQueryTransform(lcg);
+		transform2 = RandomKdTreeQueryTransform(lcg);
+	}
+};
+
+BENCHMARK_ITERS(KdTree_KdTreeQuery_2000x2000, 10, 1, "KdTree::KdTreeQuery() and triangle tests between two meshes of 2000 triangles")
+{
+	KdTreeQueryBenchmarkData &data = BenchmarkData<KdTreeQueryBenchmarkData>();
+	KdTreeQueryTrianglePairs query;
+	query.tree2Transform = data.transform.Inverted() * data.transform2;
+	data.tree.KdTreeQuery(data.tree2, data.transform, data.transform2, query);
+	dummyResultInt += (int)query.pairs.size();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_KdTreeQuery_2000x2000_BruteForce, 3, 1, "Brute force triangle tests between two meshes of 2000 triangles, for comparison against KdTree::KdTreeQuery()")
+{
+	KdTreeQueryBenchmarkData &data = BenchmarkData<KdTreeQueryBenchmarkData>();
+	dummyResultInt += (int)BruteForceIntersectingTrianglePairs(data.tris, data.tris2, data.transform.Inverted() * data.transform2).size();
+}
+BENCHMARK_ITERS_END
+
+#ifdef MATH_SSE
+// Generates packets of numLanes rays. Coherent packets share an origin and point in nearly the same direction, while
+// the rays of incoherent packets point to random directions.
+void GenerateKdTreeTestRayPacket(LCG &lcg, const std::vector<Triangle> &tris, Ray *rays, int numLanes, bool coherent)
+{
+	vec pos = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	vec target = tris[lcg.Int(0, (int)tris.size()-1)].CenterPoint();
+	for(int i = 0; i < numLanes; ++i)
+	{
+		if (coherent)
+			rays[i] = Ray(pos, (target + vec::RandomBox(lcg, POINT_VEC_SCALAR(-2.f), POINT_VEC_SCALAR(2.f)) - pos).Normalized());
+		else
+			rays[i] = Ray(pos, vec::RandomDir(lcg));
+	}
+}
+
+template<int numLanes>
+void TestKdTreeRayPacketQueries(KdTree<Triangle> &tree, const std::vector<Triangle> &tris, LCG &lcg, bool coherent)
+{
+	for(int i = 0; i < 200; ++i)
+	{
+		Ray rays[numLanes];
+		GenerateKdTreeTestRayPacket(lcg, tris, rays, numLanes, coherent);
+
+		TriangleKdTreeRayPacketNearestHitVisitor packetResult;
+#ifdef MATH_AVX
+		if (numLanes == 8)
+			tree.RayPacketQuery8(rays, packetResult);
+		else
+#endif
+			tree.RayPacketQuery4(rays, packetResult);
+
+		for(int j = 0; j < numLanes; ++j)
+		{
+			TriangleKdTreeRayQueryNearestHitVisitor result;
+			tree.RayQuery(rays[j], result);
+			assert2(packetResult.rayT[j] == result.rayT, packetResult.rayT[j], result.rayT);
+			assert2(packetResult.triangleIndex[j] == result.triangleIndex, packetResult.triangleIndex[j], result.triangleIndex);
+		}
+	}
+}
+
+UNIQUE_TEST(KdTreeRayPacketQuery4)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	tree.Build(params);
+	TestKdTreeRayPacketQueries<4>(tree, tris, lcg, true);
+	TestKdTreeRayPacketQueries<4>(tree, tris, lcg, false);
+}
+
+#ifdef MATH_AVX
+UNIQUE_TEST(KdTreeRayPacketQuery8)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris = GenerateKdTreeTestTriangles(lcg, 2000);
+	KdTree<Triangle> tree;
+	tree.AddObjects(&tris[0], (int)tris.size());
+	KdTreeBuildParams params;
+	params.splitHeuristic = KdTreeSplitSAH;
+	params.maxObjectsPerLeaf = 2;
+	tree.Build(params);
+	TestKdTreeRayPacketQueries<8>(tree, tris, lcg, true);
+	TestKdTreeRayPacketQueries<8>(tree, tris, lcg, false);
+}
+#endif
+
+struct KdTreeRayPacketBenchmarkData
+{
+	std::vector<Triangle> tris;
+	KdTree<Triangle> tree;
+	/// Coherent packets of eight rays each, which can also be traversed as two packets of four rays.
+	std::vector<Ray> rays;
+
+	KdTreeRayPacketBenchmarkData()
+	{
+		LCG lcg(1234);
+		tris = GenerateKdTreeTestTriangles(lcg, 100000);
+		tree.AddObjects(&tris[0], (int)tris.size());
+		KdTreeBuildParams params;
+		params.splitHeuristic = KdTreeSplitSAH;
+		params.maxObjectsPerLeaf = 2;
+		tree.Build(params);
+		const int numPackets = 1024;
+		rays.resize(numPackets * 8);
+		for(int i = 0; i < numPackets; ++i)
+			GenerateKdTreeTestRayPacket(lcg, tris, &rays[i*8], 8, true);
+	}
+};
+
+BENCHMARK_ITERS(KdTree_RayQuery_8192_rays, 10, 1, "KdTree::RayQuery() of 8192 coherent rays, one ray at a time, among 100000 triangles")
+{
+	KdTreeRayPacketBenchmarkData &data = BenchmarkData<KdTreeRayPacketBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); ++j)
+	{
+		TriangleKdTreeRayQueryNearestHitVisitor result;
+		data.tree.RayQuery(data.rays[j], result);
+		dummyResultInt += (int)result.triangleIndex;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(KdTree_RayPacketQuery4_8192_rays, 10, 1, "KdTree::RayPacketQuery4() of 8192 coherent rays in packets of four, among 100000 triangles")
+{
+	KdTreeRayPacketBenchmarkData &data = BenchmarkData<KdTreeRayPacketBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); j += 4)
+	{
+		TriangleKdTreeRayPacketNearestHitVisitor result;
+		data.tree.RayPacketQuery4(&data.rays[j], result);
+		dummyResultInt += (int)result.triangleIndex[0];
+	}
+}
+BENCHMARK_ITERS_END
+
+#ifdef MATH_AVX
+BENCHMARK_ITERS(KdTree_RayPacketQuery8_8192_rays, 10, 1, "KdTree::RayPacketQuery8() of 8192 coherent rays in packets of eight, among 100000 triangles")
+{
+	KdTreeRayPacketBenchmarkData &data = BenchmarkData<KdTreeRayPacketBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); j += 8)
+	{
+		TriangleKdTreeRayPacketNearestHitVisitor result;
+		data.tree.RayPacketQuery8(&data.rays[j], result);
+		dummyResultInt += (int)result.triangleIndex[0];
+	}
+}
+BENCHMARK_ITERS_END
+#endif
+#endif
@@ -951,3 +951,70 @@ BENCHMARK(matrix_copy7, "matrix-copy-avx-unrolled")
 }
 BENCHMARK_END;
 #endif
+
+UNIQUE_TEST(ActiveSIMDCapability)
+{
+	LOGI("Host CPU supports %s, the runtime-dispatched kernels use %s.", SIMDCapabilityToString(DetectSIMDCapability()),
+		SIMDCapabilityToString(ActiveSIMDCapability()));
+	assert(ActiveSIMDCapability() <= DetectSIMDCapability());
+}
+
+RANDOMIZED_TEST(Float4x4TransformPosArray)
+{
+	float4x4 m = float4x4(float3x4::RandomGeneral(rng, -10.f, 10.f)); // TransformPos() requires a matrix without projection.
+	const int numPoints = 1 + rng.Int(0, 40); // Exercise the SIMD batches and the scalar tail.
+	float3 points[41];
+	float3 correct[41];
+	for(int i = 0; i < numPoints; ++i)
+	{
+		points[i] = float3::RandomGeneral(rng, -10.f, 10.f);
+		correct[i] = m.TransformPos(points[i]);
+	}
+	m.TransformPos(points, numPoints);
+	for(int i = 0; i < numPoints; ++i)
+		assert2(points[i].Equals(correct[i], 1e-3f), points[i], correct[i]);
+}
+
+RANDOMIZED_TEST(Float4x4TransformDirArray)
+{
+	float4x4 m = float4x4(float3x4::RandomGeneral(rng, -10.f, 10.f)); // TransformDir() requires a matrix without projection.
+	const int numPoints = 1 + rng.Int(0, 40);
+	float3 dirs[41];
+	float3 correct[41];
+	for(int i = 0; i < numPoints; ++i)
+	{
+		dirs[i] = float3::RandomGeneral(rng, -10.f, 10.f);
+		correct[i] = m.TransformDir(dirs[i]);
+	}
+	m.TransformDir(dirs, numPoints, sizeof(float3));
+	for(int i = 0; i < numPoints; ++i)
+		assert2(dirs[i].Equals(correct[i], 1e-3f), dirs[i], correct[i]);
+}
+
+static float3 *TransformArrayBenchmarkData()
+{
+	static float3 *points = 0;
+	if (!points)
+	{
+		points = new float3[1000];
+		LCG rng(Clock::TickU32());
+		for(int i = 0; i < 1000; ++i)
+			points[i] = float3::RandomBox(rng, -10.f, 10.f);
+	}
+	return points;
+}
+
+// The matrices om[i] are orthonormal, so transforming the same array repeatedly does not blow up the values.
+BENCHMARK(float4x4_TransformDir_array_naive, "float4x4::TransformDir(float3) in a loop over 1000 directions")
+{
+	float3 *points = TransformArrayBenchmarkData();
+	for(int j = 0; j < 1000; ++j)
+		points[j] = om[i].TransformDir(points[j]);
+}
+BENCHMARK_END;
+
+BENCHMARK(float4x4_TransformDir_array, "float4x4::TransformDir(float3 *array, 1000)")
+{
+	om[i].TransformDir(TransformArrayBenchmarkData(), 1000);
+}
+BENCHMARK_END;
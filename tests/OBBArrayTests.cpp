@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+// Note: TestData is not pulled in with a using directive here, since TestData::OBBArray() would shadow the class.
+
+// Generates pairs of boxes whose centers are close enough that roughly half of the pairs intersect. An odd number of
+// pairs is used, so that both the SIMD blocks and the scalar tail of the tests get exercised.
+static void RandomOBBPairs(LCG &rng, int numPairs, std::vector<OBB> &outA, std::vector<OBB> &outB)
+{
+	for(int i = 0; i < numPairs; ++i)
+	{
+		vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		outA.push_back(RandomOBBContainingPoint(pt, 10.f));
+		outB.push_back(RandomOBBContainingPoint(pt + vec::RandomBox(rng, DIR_VEC_SCALAR(-10.f), DIR_VEC_SCALAR(10.f)), 10.f));
+	}
+}
+
+static bool MaskBit(const std::vector<u32> &mask, int index)
+{
+	return ((mask[index >> 5] >> (index & 31)) & 1) != 0;
+}
+
+UNIQUE_TEST(OBBArray_SetGet)
+{
+	std::vector<OBB> obbs, obbs2;
+	RandomOBBPairs(rng, 13, obbs, obbs2);
+	OBBArray arr(&obbs[0], (int)obbs.size());
+	assert(arr.Size() == 13);
+	assert(IS32ALIGNED(arr.Pos(0)));
+	assert(IS32ALIGNED(arr.Axis(2, 2)));
+	for(int i = 0; i < arr.Size(); ++i)
+	{
+		OBB obb = arr.Get(i);
+		assert(obb.pos.Equals(obbs[i].pos));
+		assert(obb.r.Equals(obbs[i].r));
+		for(int j = 0; j < 3; ++j)
+			assert(obb.axis[j].Equals(obbs[i].axis[j]));
+	}
+
+	arr.Set(3, obbs2[3]);
+	assert(arr.Get(3).pos.Equals(obbs2[3].pos));
+
+	arr.Clear();
+	assert(arr.IsEmpty());
+	arr.Add(obbs[5]);
+	assert(arr.Size() == 1);
+	assert(arr.Get(0).r.Equals(obbs[5].r));
+}
+
+RANDOMIZED_TEST(OBBArray_PairwiseIntersects_OBB)
+{
+	std::vector<OBB> obbs, obbs2;
+	RandomOBBPairs(rng, 101, obbs, obbs2);
+	OBBArray arr(&obbs[0], (int)obbs.size());
+	OBBArray arr2(&obbs2[0], (int)obbs2.size());
+
+	std::vector<u32> mask((obbs.size() + 31) / 32);
+	int numHits = arr.PairwiseIntersects(arr2, &mask[0]);
+	int n = 0;
+	for(int i = 0; i < (int)obbs.size(); ++i)
+	{
+		bool intersects = obbs[i].Intersects(obbs2[i]);
+		assert3(MaskBit(mask, i) == intersects, i, obbs[i], obbs2[i]);
+		n += intersects ? 1 : 0;
+	}
+	assert2(n == numHits, n, numHits);
+}
+
+RANDOMIZED_TEST(OBBArray_PairwiseIntersects_Sphere)
+{
+	std::vector<OBB> obbs, obbs2;
+	RandomOBBPairs(rng, 101, obbs, obbs2);
+	std::vector<Sphere> spheres;
+	for(size_t i = 0; i < obbs2.size(); ++i)
+		spheres.push_back(Sphere(obbs2[i].pos, obbs2[i].r.x));
+	OBBArray arr(&obbs[0], (int)obbs.size());
+
+	std::vector<u32> mask((obbs.size() + 31) / 32);
+	int numHits = arr.PairwiseIntersects(&spheres[0], &mask[0]);
+	int n = 0;
+	for(int i = 0; i < (int)obbs.size(); ++i)
+	{
+		bool intersects = obbs[i].Intersects(spheres[i]);
+		assert3(MaskBit(mask, i) == intersects, i, obbs[i], spheres[i]);
+		n += intersects ? 1 : 0;
+	}
+	assert2(n == numHits, n, numHits);
+}
+
+struct OBBArrayBenchmarkData
+{
+	std::vector<OBB> obbs, obbs2;
+	std::vector<Sphere> spheres;
+	OBBArray arr, arr2;
+	std::vector<u32> mask;
+
+	OBBArrayBenchmarkData()
+	{
+		LCG rng(1234);
+		RandomOBBPairs(rng, 10000, obbs, obbs2);
+		for(size_t i = 0; i < obbs2.size(); ++i)
+			spheres.push_back(Sphere(obbs2[i].pos, obbs2[i].r.x));
+		arr.Set(&obbs[0], (int)obbs.size());
+		arr2.Set(&obbs2[0], (int)obbs2.size());
+		mask.resize((obbs.size() + 31) / 32);
+	}
+};
+
+BENCHMARK_ITERS(OBB_Intersects_OBB_pairs_10000, 10, 10, "OBB::Intersects(OBB) for 10000 pairs of OBBs")
+{
+	OBBArrayBenchmarkData &data = TestData::BenchmarkData<OBBArrayBenchmarkData>();
+	int numHits = 0;
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+		numHits += data.obbs[j].Intersects(data.obbs2[j]) ? 1 : 0;
+	TestData::dummyResultInt += numHits;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(OBBArray_PairwiseIntersects_OBB_10000, 10, 10, "OBBArray::PairwiseIntersects(OBBArray) for 10000 pairs of OBBs")
+{
+	OBBArrayBenchmarkData &data = TestData::BenchmarkData<OBBArrayBenchmarkData>();
+	TestData::dummyResultInt += data.arr.PairwiseIntersects(data.arr2, &data.mask[0]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(OBB_Intersects_Sphere_pairs_10000, 10, 10, "OBB::Intersects(Sphere) for 10000 OBB-Sphere pairs")
+{
+	OBBArrayBenchmarkData &data = TestData::BenchmarkData<OBBArrayBenchmarkData>();
+	int numHits = 0;
+	for(size_t j = 0; j < data.obbs.size(); ++j)
+		numHits += data.obbs[j].Intersects(data.spheres[j]) ? 1 : 0;
+	TestData::dummyResultInt += numHits;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(OBBArray_PairwiseIntersects_Sphere_10000, 10, 10, "OBBArray::PairwiseIntersects(Sphere) for 10000 OBB-Sphere pairs")
+{
+	OBBArrayBenchmarkData &data = TestData::BenchmarkData<OBBArrayBenchmarkData>();
+	TestData::dummyResultInt += data.arr.PairwiseIntersects(&data.spheres[0], &data.mask[0]);
+}
+BENCHMARK_ITERS_END
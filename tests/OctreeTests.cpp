@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "../src/Geometry/KDTree.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+struct OctreeTestObject;
+typedef Octree<OctreeTestObject*> TestOctree;
+
+struct OctreeTestObject
+{
+	AABB aabb;
+	int id;
+	TestOctree::Node *node;
+};
+
+inline float MinX(const OctreeTestObject *o) { return o->aabb.minPoint.x; }
+inline float MaxX(const OctreeTestObject *o) { return o->aabb.maxPoint.x; }
+inline float MinY(const OctreeTestObject *o) { return o->aabb.minPoint.y; }
+inline float MaxY(const OctreeTestObject *o) { return o->aabb.maxPoint.y; }
+inline float MinZ(const OctreeTestObject *o) { return o->aabb.minPoint.z; }
+inline float MaxZ(const OctreeTestObject *o) { return o->aabb.maxPoint.z; }
+inline void AssociateOctreeNode(OctreeTestObject *o, TestOctree::Node *node) { o->node = node; }
+inline TestOctree::Node *GetOctreeNode(const OctreeTestObject *o) { return o->node; }
+
+static std::vector<OctreeTestObject> RandomOctreeObjects(LCG &rng, int numObjects, float worldSize, float maxObjectSize)
+{
+	std::vector<OctreeTestObject> objects(numObjects);
+	for(int i = 0; i < numObjects; ++i)
+	{
+		objects[i].aabb = RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-worldSize), POINT_VEC_SCALAR(worldSize)), maxObjectSize);
+		objects[i].id = i;
+		objects[i].node = 0;
+	}
+	return objects;
+}
+
+struct CollectOctreeObjectsInAABB
+{
+	std::vector<int> ids;
+
+	bool operator ()(TestOctree & /*tree*/, const AABB &queryAABB, TestOctree::Node &node)
+	{
+		for(size_t i = 0; i < node.objects.size(); ++i)
+			if (queryAABB.Intersects(node.objects[i]->aabb))
+				ids.push_back(node.objects[i]->id);
+		return false;
+	}
+};
+
+struct CollectOctreeCollidingPairs
+{
+	std::vector<std::pair<int, int> > pairs;
+
+	void operator ()(OctreeTestObject *a, OctreeTestObject *b)
+	{
+		pairs.push_back(std::make_pair(Min(a->id, b->id), Max(a->id, b->id)));
+	}
+};
+
+static void CheckAABBQuery(TestOctree &tree, const std::vector<OctreeTestObject> &objects, const AABB &queryAABB)
+{
+	CollectOctreeObjectsInAABB query;
+	tree.AABBQuery(queryAABB, query);
+	std::sort(query.ids.begin(), query.ids.end());
+
+	std::vector<int> expected;
+	for(size_t i = 0; i < objects.size(); ++i)
+		if (objects[i].node && queryAABB.Intersects(objects[i].aabb))
+			expected.push_back(objects[i].id);
+	assert2(query.ids.size() == expected.size(), (int)query.ids.size(), (int)expected.size());
+	assert(query.ids == expected);
+}
+
+static void CheckCollidingPairs(TestOctree &tree, const std::vector<OctreeTestObject> &objects)
+{
+	CollectOctreeCollidingPairs collector;
+	tree.CollidingPairsQuery(tree.BoundingAABB(), collector);
+	std::sort(collector.pairs.begin(), collector.pairs.end());
+
+	std::vector<std::pair<int, int> > expected;
+	for(size_t i = 0; i < objects.size(); ++i)
+		for(size_t j = i+1; j < objects.size(); ++j)
+			if (objects[i].aabb.Intersects(objects[j].aabb))
+				expected.push_back(std::make_pair((int)i, (int)j));
+	assert2(collector.pairs.size() == expected.size(), (int)collector.pairs.size(), (int)expected.size());
+	assert(collector.pairs == expected);
+}
+
+RANDOMIZED_TEST(Octree_AddRemoveAABBQuery)
+{
+	std::vector<OctreeTestObject> objects = RandomOctreeObjects(rng, 1000, 100.f, 10.f);
+	TestOctree tree;
+	tree.Clear(POINT_VEC_SCALAR(-10.f), POINT_VEC_SCALAR(10.f)); // Start small, so that the root has to grow.
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+	assert2(tree.NumObjects() == (int)objects.size(), tree.NumObjects(), (int)objects.size());
+	assert(tree.NumNodes() == tree.NumLeaves() + tree.NumInnerNodes());
+	tree.DebugSanityCheckNode(tree.Root());
+
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		for(int k = 0; k < 10; ++k)
+			CheckAABBQuery(tree, objects, RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-100.f), POINT_VEC_SCALAR(100.f)), 50.f));
+
+		// Remove every other object, and check the queries again.
+		for(size_t i = 0; i < objects.size(); i += 2)
+			if (objects[i].node)
+			{
+				tree.Remove(&objects[i]);
+				assert(objects[i].node == 0);
+			}
+		assert2(tree.NumObjects() == (int)objects.size()/2, tree.NumObjects(), (int)objects.size()/2);
+	}
+}
+
+RANDOMIZED_TEST(Octree_CollidingPairsQuery)
+{
+	std::vector<OctreeTestObject> objects = RandomOctreeObjects(rng, 500, 50.f, 10.f);
+	TestOctree tree;
+	tree.Clear(POINT_VEC_SCALAR(-60.f), POINT_VEC_SCALAR(60.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+	CheckCollidingPairs(tree, objects);
+}
+
+RANDOMIZED_TEST(Octree_Loose_CollidingPairsQuery)
+{
+	std::vector<OctreeTestObject> objects = RandomOctreeObjects(rng, 500, 50.f, 10.f);
+	TestOctree tree(2.f);
+	tree.Clear(POINT_VEC_SCALAR(-60.f), POINT_VEC_SCALAR(60.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+	tree.DebugSanityCheckNode(tree.Root());
+	CheckCollidingPairs(tree, objects);
+}
+
+static void TestOctreeUpdateMovingObjects(LCG &rng, float looseness)
+{
+	std::vector<OctreeTestObject> objects = RandomOctreeObjects(rng, 500, 50.f, 10.f);
+	std::vector<vec> velocities;
+	for(size_t i = 0; i < objects.size(); ++i)
+		velocities.push_back(vec::RandomDir(rng) * rng.Float(0.f, 3.f));
+	TestOctree tree(looseness);
+	tree.Clear(POINT_VEC_SCALAR(-60.f), POINT_VEC_SCALAR(60.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	for(int frame = 0; frame < 20; ++frame)
+	{
+		for(size_t i = 0; i < objects.size(); ++i)
+		{
+			objects[i].aabb.Translate(velocities[i]);
+			tree.Update(&objects[i]);
+		}
+		assert2(tree.NumObjects() == (int)objects.size(), tree.NumObjects(), (int)objects.size());
+		tree.DebugSanityCheckNode(tree.Root());
+		CheckAABBQuery(tree, objects, RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-100.f), POINT_VEC_SCALAR(100.f)), 50.f));
+	}
+	CheckCollidingPairs(tree, objects);
+}
+
+RANDOMIZED_TEST(Octree_Update)
+{
+	TestOctreeUpdateMovingObjects(rng, 1.f);
+}
+
+RANDOMIZED_TEST(Octree_Loose_Update)
+{
+	TestOctreeUpdateMovingObjects(rng, 2.f);
+}
+
+struct CollectNearestOctreeObjects
+{
+	int maxObjects;
+	std::vector<float> distancesSq;
+	std::vector<int> ids;
+
+	explicit CollectNearestOctreeObjects(int maxObjects_):maxObjects(maxObjects_) {}
+
+	bool operator ()(TestOctree & /*tree*/, const vec & /*targetPoint*/, TestOctree::Node *node, float distanceSquared,
+		OctreeTestObject * const &object, int nearestNeighborIndex)
+	{
+		MARK_UNUSED(node);
+		MARK_UNUSED(nearestNeighborIndex);
+		assert(nearestNeighborIndex == (int)ids.size());
+		assert(node == object->node);
+		distancesSq.push_back(distanceSquared);
+		ids.push_back(object->id);
+		return (int)ids.size() >= maxObjects;
+	}
+};
+
+static void TestOctreeNearestNeighborObjects(LCG &rng, float looseness)
+{
+	std::vector<OctreeTestObject> objects = RandomOctreeObjects(rng, 1000, 50.f, 10.f);
+	TestOctree tree(looseness);
+	tree.Clear(POINT_VEC_SCALAR(-60.f), POINT_VEC_SCALAR(60.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	vec point = vec::RandomBox(rng, POINT_VEC_SCALAR(-70.f), POINT_VEC_SCALAR(70.f));
+	std::vector<float> expected;
+	for(size_t i = 0; i < objects.size(); ++i)
+		expected.push_back(objects[i].aabb.ClosestPoint(point).DistanceSq(point));
+	std::sort(expected.begin(), expected.end());
+
+	// Stop early after a few objects.
+	CollectNearestOctreeObjects nearest(10);
+	tree.NearestNeighborObjects(point, nearest);
+	assert1(nearest.ids.size() == 10, (int)nearest.ids.size());
+	for(size_t i = 0; i < nearest.ids.size(); ++i)
+	{
+		assert2(nearest.distancesSq[i] == expected[i], nearest.distancesSq[i], expected[i]);
+		assert(EqualAbs(objects[nearest.ids[i]].aabb.ClosestPoint(point).DistanceSq(point), nearest.distancesSq[i]));
+	}
+
+	// Without stopping, every object must be visited exactly once, in distance-sorted order.
+	CollectNearestOctreeObjects all((int)objects.size() + 1);
+	tree.NearestNeighborObjects(point, all);
+	assert2(all.distancesSq == expected, (int)all.distancesSq.size(), (int)expected.size());
+	std::sort(all.ids.begin(), all.ids.end());
+	for(size_t i = 0; i < all.ids.size(); ++i)
+		assert(all.ids[i] == (int)i);
+}
+
+RANDOMIZED_TEST(Octree_NearestNeighborObjects)
+{
+	TestOctreeNearestNeighborObjects(rng, 1.f);
+}
+
+RANDOMIZED_TEST(Octree_Loose_NearestNeighborObjects)
+{
+	TestOctreeNearestNeighborObjects(rng, 2.f);
+}
+
+struct CountOctreeCollidingPairs
+{
+	int numPairs;
+	CountOctreeCollidingPairs():numPairs(0) {}
+	void operator ()(OctreeTestObject * /*a*/, OctreeTestObject * /*b*/) { ++numPairs; }
+};
+
+/// Generates the objects and the velocities for the moving object benchmarks.
+static void InitOctreeBenchmarkObjects(std::vector<OctreeTestObject> &objects, std::vector<vec> &velocities)
+{
+	LCG rng(1234);
+	objects = RandomOctreeObjects(rng, 10000, 200.f, 5.f);
+	for(size_t i = 0; i < objects.size(); ++i)
+		velocities.push_back(vec::RandomDir(rng) * rng.Float(0.f, 2.f));
+}
+
+/// Moves each object by its velocity, bouncing the objects off the walls of the world volume.
+static void MoveOctreeBenchmarkObjects(std::vector<OctreeTestObject> &objects, std::vector<vec> &velocities)
+{
+	for(size_t i = 0; i < objects.size(); ++i)
+	{
+		AABB &aabb = objects[i].aabb;
+		for(int j = 0; j < 3; ++j)
+			if ((aabb.minPoint[j] < -200.f && velocities[i][j] < 0.f) || (aabb.maxPoint[j] > 200.f && velocities[i][j] > 0.f))
+				velocities[i][j] = -velocities[i][j];
+		aabb.Translate(velocities[i]);
+	}
+}
+
+/// A set of objects that move around inside a fixed world volume, and are kept in a tree with Update().
+struct MovingOctreeBenchmarkData
+{
+	std::vector<OctreeTestObject> objects;
+	std::vector<vec> velocities;
+	TestOctree tree;
+
+	explicit MovingOctreeBenchmarkData(float looseness = 1.f)
+	:tree(looseness)
+	{
+		InitOctreeBenchmarkObjects(objects, velocities);
+		tree.Clear(POINT_VEC_SCALAR(-205.f), POINT_VEC_SCALAR(205.f));
+		for(size_t i = 0; i < objects.size(); ++i)
+			tree.Add(&objects[i]);
+		// Let the objects settle into the tree the way they would during a running simulation.
+		for(int i = 0; i < 20; ++i)
+			Step();
+	}
+
+	void Step()
+	{
+		MoveOctreeBenchmarkObjects(objects, velocities);
+		for(size_t i = 0; i < objects.size(); ++i)
+			tree.Update(&objects[i]);
+	}
+};
+
+/// The same moving objects as in MovingOctreeBenchmarkData, kept in a loose Octree.
+struct MovingLooseOctreeBenchmarkData : public MovingOctreeBenchmarkData
+{
+	MovingLooseOctreeBenchmarkData():MovingOctreeBenchmarkData(2.f) {}
+};
+
+BENCHMARK_ITERS(Octree_Update_10000, 10, 10, "Octree::Update() of 10000 moving objects")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingOctreeBenchmarkData>();
+	data.Step();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Octree_Loose_Update_10000, 10, 10, "Octree::Update() of 10000 moving objects in a loose Octree")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingLooseOctreeBenchmarkData>();
+	data.Step();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Octree_CollidingPairsQuery_10000, 10, 10, "Octree::CollidingPairsQuery() of 10000 moving objects")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingOctreeBenchmarkData>();
+	CountOctreeCollidingPairs counter;
+	data.tree.CollidingPairsQuery(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Octree_Loose_CollidingPairsQuery_10000, 10, 10, "Octree::CollidingPairsQuery() of 10000 moving objects in a loose Octree")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingLooseOctreeBenchmarkData>();
+	CountOctreeCollidingPairs counter;
+	data.tree.CollidingPairsQuery(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
+
+static const AABB octreeBenchmarkQueryAABB(POINT_VEC_SCALAR(-20.f), POINT_VEC_SCALAR(20.f));
+
+BENCHMARK_ITERS(Octree_AABBQuery_10000, 10, 100, "Octree::AABBQuery() over 10000 moving objects")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingOctreeBenchmarkData>();
+	CollectOctreeObjectsInAABB query;
+	data.tree.AABBQuery(octreeBenchmarkQueryAABB, query);
+	dummyResultInt += (int)query.ids.size();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Octree_Loose_AABBQuery_10000, 10, 100, "Octree::AABBQuery() over 10000 moving objects in a loose Octree")
+{
+	MovingOctreeBenchmarkData &data = BenchmarkData<MovingLooseOctreeBenchmarkData>();
+	CollectOctreeObjectsInAABB query;
+	data.tree.AABBQuery(octreeBenchmarkQueryAABB, query);
+	dummyResultInt += (int)query.ids.size();
+}
+BENCHMARK_ITERS_END
+
+/// The same moving objects as in MovingOctreeBenchmarkData, stored as triangles in a KdTree. Since a KdTree cannot be
+/// updated, it is rebuilt on each step. This is the baseline that the Octree benchmarks are compared to.
+struct MovingKdTreeBenchmarkData
+{
+	std::vector<OctreeTestObject> objects;
+	std::vector<vec> velocities;
+	std::vector<Triangle> tris;
+	KdTree<Triangle> tree;
+
+	MovingKdTreeBenchmarkData()
+	{
+		InitOctreeBenchmarkObjects(objects, velocities);
+		Rebuild();
+	}
+
+	void Rebuild()
+	{
+		// Each object is represented by a triangle that has the same bounding box as the object.
+		tris.resize(objects.size());
+		for(size_t i = 0; i < objects.size(); ++i)
+		{
+			const AABB &aabb = objects[i].aabb;
+			tris[i] = Triangle(aabb.minPoint, POINT_VEC(aabb.maxPoint.x, aabb.minPoint.y, aabb.minPoint.z), aabb.maxPoint);
+		}
+		tree.Clear();
+		tree.AddObjects(&tris[0], (int)tris.size());
+		tree.Build();
+	}
+
+	void Step()
+	{
+		MoveOctreeBenchmarkObjects(objects, velocities);
+		Rebuild();
+	}
+};
+
+/// Counts the objects whose bounding boxes intersect the query AABB, in the same way as Octree::AABBQuery() does. An object
+/// can be stored in several leaves of a KdTree, so each object is counted only once.
+struct CountKdTreeObjectsInAABB
+{
+	const std::vector<OctreeTestObject> &objects;
+	std::vector<bool> seen;
+	int numObjects;
+	explicit CountKdTreeObjectsInAABB(const std::vector<OctreeTestObject> &objects_)
+	:objects(objects_), seen(objects_.size(), false), numObjects(0) {}
+
+	bool operator ()(KdTree<Triangle> &tree, const KdTreeNode &leaf, const AABB &aabb)
+	{
+		if (leaf.IsEmptyLeaf())
+			return false;
+		for(const u32 *bucket = tree.Bucket(leaf.bucketIndex); *bucket != KdTree<Triangle>::BUCKET_SENTINEL; ++bucket)
+			if (!seen[*bucket] && objects[*bucket].aabb.Intersects(aabb))
+			{
+				seen[*bucket] = true;
+				++numObjects;
+			}
+		return false;
+	}
+};
+
+BENCHMARK_ITERS(Octree_KdTree_Rebuild_10000, 10, 10, "KdTree::Build() of 10000 moving objects, for comparison against Octree::Update()")
+{
+	MovingKdTreeBenchmarkData &data = BenchmarkData<MovingKdTreeBenchmarkData>();
+	data.Step();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(Octree_KdTree_AABBQuery_10000, 10, 100, "KdTree::AABBQuery() over 10000 moving objects, for comparison against Octree::AABBQuery()")
+{
+	MovingKdTreeBenchmarkData &data = BenchmarkData<MovingKdTreeBenchmarkData>();
+	CountKdTreeObjectsInAABB query(data.objects);
+	data.tree.AABBQuery(octreeBenchmarkQueryAABB, query);
+	dummyResultInt += query.numObjects;
+}
+BENCHMARK_ITERS_END
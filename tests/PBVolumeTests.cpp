@@ -5,10 +5,13 @@
 #include "../src/Math/myassert.h"
 #include "../src/Geometry/PBVolume.h"
 #include "TestRunner.h"
+#include "TestData.h"
 #include "ObjectGenerators.h"
 
 MATH_IGNORE_UNUSED_VARS_WARNING
 
+using namespace TestData;
+
 RANDOMIZED_TEST(AABBPBVolumeIntersect)
 {
 	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
@@ -82,3 +85,103 @@ RANDOMIZED_TEST(SpherePBVolumeNoIntersect)
 	MARK_UNUSED(r);
 	assert(r == TestOutside || r == TestNotContained);
 }
+
+// Recursively splits the given AABB into octants, and checks that culling each of them with the plane mask of its
+// parent gives the same result as culling it with all the planes.
+static void CheckHierarchicalCulling(const PBVolume<6> &pbVolume, const AABB &aabb, u32 parentPlaneMask, int depth)
+{
+	u32 planeMask = parentPlaneMask;
+	int lastRejectingPlane = 0;
+	CullTestResult r = pbVolume.InsideOrIntersects(aabb, planeMask, lastRejectingPlane);
+	CullTestResult r2 = pbVolume.InsideOrIntersects(aabb);
+	assert2(r == r2, (int)r, (int)r2);
+	assert((planeMask & ~parentPlaneMask) == 0);
+	if (r == TestOutside)
+	{
+		// Culling again must reject the AABB with the first plane test.
+		u32 planeMask2 = parentPlaneMask;
+		int lastRejectingPlane2 = lastRejectingPlane;
+		assert(pbVolume.InsideOrIntersects(aabb, planeMask2, lastRejectingPlane2) == TestOutside);
+		assert(lastRejectingPlane2 == lastRejectingPlane);
+		assert(pbVolume.PlaneTest(lastRejectingPlane, aabb) == TestOutside);
+		return;
+	}
+	if (depth <= 0)
+		return;
+	for(int i = 0; i < 8; ++i)
+	{
+		vec c = aabb.CenterPoint();
+		vec corner = aabb.CornerPoint(i);
+		AABB octant(c.Min(corner), c.Max(corner));
+		CheckHierarchicalCulling(pbVolume, octant, planeMask, depth - 1);
+	}
+}
+
+RANDOMIZED_TEST(AABBPBVolumeHierarchicalCulling)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Frustum b = RandomFrustumContainingPoint(rng, pt);
+	PBVolume<6> pbVolume = b.ToPBVolume();
+	AABB a = RandomAABBContainingPoint(pt, 50.f);
+	CheckHierarchicalCulling(pbVolume, a, PBVolume<6>::AllPlanesMask(), 3);
+}
+
+RANDOMIZED_TEST(SpherePBVolumeMaskedCulling)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Frustum b = RandomFrustumContainingPoint(rng, pt);
+	PBVolume<6> pbVolume = b.ToPBVolume();
+	Sphere parent = RandomSphereContainingPoint(pt, 20.f);
+	u32 parentMask = PBVolume<6>::AllPlanesMask();
+	int lastRejectingPlane = 0;
+	CullTestResult r = pbVolume.InsideOrIntersects(parent, parentMask, lastRejectingPlane);
+	assert(r == pbVolume.InsideOrIntersects(parent));
+	if (r == TestOutside)
+		return;
+	for(int i = 0; i < 10; ++i)
+	{
+		// A child sphere fully inside the parent sphere.
+		float radius = rng.Float(0.f, parent.r * 0.5f);
+		Sphere child(parent.pos + vec::RandomDir(rng) * rng.Float(0.f, parent.r - radius), radius);
+		u32 planeMask = parentMask;
+		int childRejectingPlane = 0;
+		CullTestResult r2 = pbVolume.InsideOrIntersects(child, planeMask, childRejectingPlane);
+		assert2(r2 == pbVolume.InsideOrIntersects(child), (int)r2, (int)pbVolume.InsideOrIntersects(child));
+		MARK_UNUSED(r2);
+	}
+}
+
+struct PBVolumeCullBenchmarkData
+{
+	PBVolume<6> pbVolume;
+	std::vector<AABB> aabbs;
+	std::vector<int> lastRejectingPlanes;
+
+	PBVolumeCullBenchmarkData()
+	{
+		LCG rng(1234);
+		pbVolume = RandomFrustumContainingPoint(rng, POINT_VEC_SCALAR(0.f)).ToPBVolume();
+		for(int i = 0; i < 1000; ++i)
+			aabbs.push_back(RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), 10.f));
+		lastRejectingPlanes.resize(1000, 0);
+	}
+};
+
+BENCHMARK_ITERS(PBVolume_InsideOrIntersects_AABB_1000, 10, 100, "PBVolume<6>::InsideOrIntersects(AABB) for 1000 AABBs")
+{
+	PBVolumeCullBenchmarkData &data = BenchmarkData<PBVolumeCullBenchmarkData>();
+	for(int j = 0; j < 1000; ++j)
+		dummyResultInt += (int)data.pbVolume.InsideOrIntersects(data.aabbs[j]);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(PBVolume_InsideOrIntersects_AABB_Coherent_1000, 10, 100, "PBVolume<6>::InsideOrIntersects(AABB) with plane coherency for 1000 AABBs")
+{
+	PBVolumeCullBenchmarkData &data = BenchmarkData<PBVolumeCullBenchmarkData>();
+	for(int j = 0; j < 1000; ++j)
+	{
+		u32 planeMask = PBVolume<6>::AllPlanesMask();
+		dummyResultInt += (int)data.pbVolume.InsideOrIntersects(data.aabbs[j], planeMask, data.lastRejectingPlanes[j]);
+	}
+}
+BENCHMARK_ITERS_END
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+struct QuadTreeTestObject;
+typedef QuadTree<QuadTreeTestObject*> TestQuadTree;
+
+struct QuadTreeTestObject
+{
+	AABB2D aabb;
+	int id;
+	TestQuadTree::Node *node;
+};
+
+inline float MinX(const QuadTreeTestObject *o) { return o->aabb.minPoint.x; }
+inline float MaxX(const QuadTreeTestObject *o) { return o->aabb.maxPoint.x; }
+inline float MinY(const QuadTreeTestObject *o) { return o->aabb.minPoint.y; }
+inline float MaxY(const QuadTreeTestObject *o) { return o->aabb.maxPoint.y; }
+inline AABB2D GetAABB2D(const QuadTreeTestObject *o) { return o->aabb; }
+inline void AssociateQuadTreeNode(QuadTreeTestObject *o, TestQuadTree::Node *node) { o->node = node; }
+inline TestQuadTree::Node *GetQuadTreeNode(const QuadTreeTestObject *o) { return o->node; }
+
+static std::vector<QuadTreeTestObject> RandomQuadTreeObjects(LCG &rng, int numObjects, float worldSize, float maxObjectSize)
+{
+	std::vector<QuadTreeTestObject> objects(numObjects);
+	for(int i = 0; i < numObjects; ++i)
+	{
+		float2 pos = float2::RandomBox(rng, -worldSize, worldSize);
+		float2 size(rng.Float(0.f, maxObjectSize), rng.Float(0.f, maxObjectSize));
+		objects[i].aabb = AABB2D(pos, pos + size);
+		objects[i].id = i;
+		objects[i].node = 0;
+	}
+	return objects;
+}
+
+struct CollectObjectsInAABB
+{
+	std::vector<int> ids;
+
+	bool operator ()(TestQuadTree & /*tree*/, const AABB2D &queryAABB, TestQuadTree::Node &node)
+	{
+		for(size_t i = 0; i < node.objects.size(); ++i)
+			if (queryAABB.Intersects(node.objects[i]->aabb))
+				ids.push_back(node.objects[i]->id);
+		return false;
+	}
+};
+
+struct CollectCollidingPairs
+{
+	std::vector<std::pair<int, int> > pairs;
+
+	void operator ()(QuadTreeTestObject *a, QuadTreeTestObject *b)
+	{
+		pairs.push_back(std::make_pair(Min(a->id, b->id), Max(a->id, b->id)));
+	}
+};
+
+static std::vector<int> BruteForceAABBQuery(const std::vector<QuadTreeTestObject> &objects, const std::vector<bool> &inTree, const AABB2D &queryAABB)
+{
+	std::vector<int> ids;
+	for(size_t i = 0; i < objects.size(); ++i)
+		if (inTree[i] && queryAABB.Intersects(objects[i].aabb))
+			ids.push_back(objects[i].id);
+	return ids;
+}
+
+static void CheckCollidingPairs(TestQuadTree &tree, const std::vector<QuadTreeTestObject> &objects)
+{
+	CollectCollidingPairs collector;
+	tree.CollidingPairsQuery(tree.BoundingAABB(), collector);
+	std::sort(collector.pairs.begin(), collector.pairs.end());
+
+	std::vector<std::pair<int, int> > expected;
+	for(size_t i = 0; i < objects.size(); ++i)
+		for(size_t j = i+1; j < objects.size(); ++j)
+			if (objects[i].aabb.Intersects(objects[j].aabb))
+				expected.push_back(std::make_pair((int)i, (int)j));
+	assert2(collector.pairs.size() == expected.size(), (int)collector.pairs.size(), (int)expected.size());
+	assert(collector.pairs == expected);
+}
+
+RANDOMIZED_TEST(QuadTree_AddRemoveAABBQuery)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 1000, 100.f, 10.f);
+	std::vector<bool> inTree(objects.size(), true);
+	TestQuadTree tree;
+	tree.Clear(float2(-10.f, -10.f), float2(10.f, 10.f)); // Start small, so that the root has to grow.
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+	assert2(tree.NumObjects() == (int)objects.size(), tree.NumObjects(), (int)objects.size());
+
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		for(int k = 0; k < 10; ++k)
+		{
+			float2 pos = float2::RandomBox(rng, -100.f, 100.f);
+			AABB2D queryAABB(pos, pos + float2(rng.Float(0.f, 50.f), rng.Float(0.f, 50.f)));
+			CollectObjectsInAABB query;
+			tree.AABBQuery(queryAABB, query);
+			std::sort(query.ids.begin(), query.ids.end());
+			std::vector<int> expected = BruteForceAABBQuery(objects, inTree, queryAABB);
+			assert(query.ids == expected);
+		}
+
+		// Remove every other object, and check the queries again.
+		for(size_t i = 0; i < objects.size(); i += 2)
+			if (inTree[i])
+			{
+				tree.Remove(&objects[i]);
+				assert(objects[i].node == 0);
+				inTree[i] = false;
+			}
+		assert2(tree.NumObjects() == (int)objects.size()/2, tree.NumObjects(), (int)objects.size()/2);
+	}
+}
+
+RANDOMIZED_TEST(QuadTree_CollidingPairsQuery)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 500, 100.f, 10.f);
+	TestQuadTree tree;
+	tree.Clear(float2(-100.f, -100.f), float2(110.f, 110.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	CheckCollidingPairs(tree, objects);
+}
+
+RANDOMIZED_TEST(QuadTree_Loose_CollidingPairsQuery)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 500, 100.f, 10.f);
+	TestQuadTree tree(2.f);
+	tree.Clear(float2(-100.f, -100.f), float2(110.f, 110.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+	tree.DebugSanityCheckNode(tree.Root());
+	CheckCollidingPairs(tree, objects);
+}
+
+static void TestUpdateMovingObjects(LCG &rng, float looseness)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 500, 100.f, 10.f);
+	std::vector<float2> velocities;
+	for(size_t i = 0; i < objects.size(); ++i)
+		velocities.push_back(float2::RandomDir(rng) * rng.Float(0.f, 5.f));
+	std::vector<bool> inTree(objects.size(), true);
+	TestQuadTree tree(looseness);
+	tree.Clear(float2(-100.f, -100.f), float2(110.f, 110.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	for(int frame = 0; frame < 20; ++frame)
+	{
+		for(size_t i = 0; i < objects.size(); ++i)
+		{
+			objects[i].aabb.minPoint += velocities[i];
+			objects[i].aabb.maxPoint += velocities[i];
+			tree.Update(&objects[i]);
+		}
+		assert2(tree.NumObjects() == (int)objects.size(), tree.NumObjects(), (int)objects.size());
+		tree.DebugSanityCheckNode(tree.Root());
+
+		float2 pos = float2::RandomBox(rng, -150.f, 150.f);
+		AABB2D queryAABB(pos, pos + float2(rng.Float(0.f, 50.f), rng.Float(0.f, 50.f)));
+		CollectObjectsInAABB query;
+		tree.AABBQuery(queryAABB, query);
+		std::sort(query.ids.begin(), query.ids.end());
+		std::vector<int> expected = BruteForceAABBQuery(objects, inTree, queryAABB);
+		assert(query.ids == expected);
+	}
+	CheckCollidingPairs(tree, objects);
+}
+
+RANDOMIZED_TEST(QuadTree_Update)
+{
+	TestUpdateMovingObjects(rng, 1.f);
+}
+
+RANDOMIZED_TEST(QuadTree_Loose_Update)
+{
+	TestUpdateMovingObjects(rng, 2.f);
+}
+
+struct CollectCollidingPairsInOrder
+{
+	std::vector<std::pair<int, int> > pairs;
+
+	void operator ()(QuadTreeTestObject *a, QuadTreeTestObject *b)
+	{
+		pairs.push_back(std::make_pair(a->id, b->id));
+	}
+};
+
+static void TestCollidingPairsQueryParallel(LCG &rng, float looseness)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 2000, 100.f, 10.f);
+	TestQuadTree tree(looseness);
+	tree.Clear(float2(-100.f, -100.f), float2(110.f, 110.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	float2 pos = float2::RandomBox(rng, -100.f, 50.f);
+	AABB2D queryAABBs[2] = { tree.BoundingAABB(), AABB2D(pos, pos + float2(rng.Float(0.f, 100.f), rng.Float(0.f, 100.f))) };
+	for(int i = 0; i < 2; ++i)
+	{
+		CollectCollidingPairsInOrder serial;
+		tree.CollidingPairsQuery(queryAABBs[i], serial);
+
+		// The pairs must be reported in exactly the same order regardless of the number of threads.
+		const int numThreads[] = { 0, 2, 3, 8, 32 };
+		for(int j = 0; j < 5; ++j)
+		{
+			CollectCollidingPairsInOrder parallel;
+			tree.CollidingPairsQueryParallel(queryAABBs[i], parallel, numThreads[j]);
+			assert2(parallel.pairs.size() == serial.pairs.size(), (int)parallel.pairs.size(), (int)serial.pairs.size());
+			assert(parallel.pairs == serial.pairs);
+		}
+	}
+}
+
+RANDOMIZED_TEST(QuadTree_CollidingPairsQueryParallel)
+{
+	TestCollidingPairsQueryParallel(rng, 1.f);
+}
+
+RANDOMIZED_TEST(QuadTree_Loose_CollidingPairsQueryParallel)
+{
+	TestCollidingPairsQueryParallel(rng, 2.f);
+}
+
+static void TestKNearestObjectsAndRadius(LCG &rng, float looseness)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 1000, 100.f, 10.f);
+	TestQuadTree tree(looseness);
+	tree.Clear(float2(-100.f, -100.f), float2(110.f, 110.f));
+	for(size_t i = 0; i < objects.size(); ++i)
+		tree.Add(&objects[i]);
+
+	float2 point = float2::RandomBox(rng, -120.f, 120.f);
+	std::vector<float> expected;
+	for(size_t i = 0; i < objects.size(); ++i)
+		expected.push_back(objects[i].aabb.DistanceSq(point));
+	std::sort(expected.begin(), expected.end());
+
+	const int k = rng.Int(1, TestQuadTree::maxNearestNeighbors);
+	QuadTreeTestObject *nearest[TestQuadTree::maxNearestNeighbors];
+	float distancesSq[TestQuadTree::maxNearestNeighbors];
+	int numFound = tree.KNearestObjects(point, k, nearest, distancesSq);
+	assert2(numFound == k, numFound, k);
+	for(int i = 0; i < numFound; ++i)
+	{
+		assert2(distancesSq[i] == expected[i], distancesSq[i], expected[i]);
+		assert(nearest[i]->aabb.DistanceSq(point) == distancesSq[i]);
+		for(int j = 0; j < i; ++j)
+			assert(nearest[j] != nearest[i]);
+	}
+
+	float radius = rng.Float(0.f, 30.f);
+	std::vector<QuadTreeTestObject*> found;
+	std::vector<float> foundDistancesSq;
+	tree.ObjectsWithinRadius(point, radius, found, foundDistancesSq);
+	assert(found.size() == foundDistancesSq.size());
+	std::vector<int> ids;
+	for(size_t i = 0; i < found.size(); ++i)
+	{
+		assert(found[i]->aabb.DistanceSq(point) == foundDistancesSq[i]);
+		ids.push_back(found[i]->id);
+	}
+	std::sort(ids.begin(), ids.end());
+	std::vector<int> expectedIds;
+	for(size_t i = 0; i < objects.size(); ++i)
+		if (objects[i].aabb.DistanceSq(point) <= radius * radius)
+			expectedIds.push_back(objects[i].id);
+	assert2(ids.size() == expectedIds.size(), (int)ids.size(), (int)expectedIds.size());
+	assert(ids == expectedIds);
+}
+
+RANDOMIZED_TEST(QuadTree_KNearestObjects)
+{
+	TestKNearestObjectsAndRadius(rng, 1.f);
+}
+
+RANDOMIZED_TEST(QuadTree_Loose_KNearestObjects)
+{
+	TestKNearestObjectsAndRadius(rng, 2.f);
+}
+
+UNIQUE_TEST(QuadTree_ClearReuse)
+{
+	std::vector<QuadTreeTestObject> objects = RandomQuadTreeObjects(rng, 20000, 100.f, 1.f);
+	TestQuadTree tree;
+	for(int pass = 0; pass < 3; ++pass)
+	{
+		tree.Clear(float2(-100.f, -100.f), float2(101.f, 101.f));
+		assert(tree.NumObjects() == 0);
+		for(size_t i = 0; i < objects.size(); ++i)
+			tree.Add(&objects[i]);
+		assert(tree.NumObjects() == (int)objects.size());
+		// More nodes than fit in a single chunk of the node storage.
+		assert(tree.NumNodes() > 1024);
+		tree.DebugSanityCheckNode(tree.Root());
+	}
+}
+
+struct QuadTreeBenchmarkData
+{
+	std::vector<QuadTreeTestObject> objects;
+	TestQuadTree tree;
+	/// A separate copy of the objects for building temporary trees, since the objects store a pointer to their node.
+	std::vector<QuadTreeTestObject> buildObjects;
+
+	QuadTreeBenchmarkData()
+	{
+		LCG rng(1234);
+		objects = RandomQuadTreeObjects(rng, 10000, 1000.f, 5.f);
+		tree.Clear(float2(-1000.f, -1000.f), float2(1005.f, 1005.f));
+		for(size_t i = 0; i < objects.size(); ++i)
+			tree.Add(&objects[i]);
+		buildObjects = objects;
+	}
+};
+
+BENCHMARK_ITERS(QuadTree_Build_10000, 10, 10, "Add() of 10000 objects to a new QuadTree")
+{
+	QuadTreeBenchmarkData &data = BenchmarkData<QuadTreeBenchmarkData>();
+	TestQuadTree tree;
+	tree.Clear(float2(-1000.f, -1000.f), float2(1005.f, 1005.f));
+	for(size_t j = 0; j < data.buildObjects.size(); ++j)
+		tree.Add(&data.buildObjects[j]);
+	dummyResultInt += tree.NumNodes();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_RemoveAdd_10000, 10, 10, "QuadTree::Remove() and Add() of 10000 objects")
+{
+	QuadTreeBenchmarkData &data = BenchmarkData<QuadTreeBenchmarkData>();
+	for(size_t j = 0; j < data.objects.size(); ++j)
+	{
+		data.tree.Remove(&data.objects[j]);
+		data.tree.Add(&data.objects[j]);
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_AABBQuery_10000, 10, 100, "QuadTree::AABBQuery() over 10000 objects")
+{
+	QuadTreeBenchmarkData &data = BenchmarkData<QuadTreeBenchmarkData>();
+	CollectObjectsInAABB query;
+	data.tree.AABBQuery(AABB2D(float2(-200.f, -200.f), float2(200.f, 200.f)), query);
+	dummyResultInt += (int)query.ids.size();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_KNearestObjects_8, 10, 10, "QuadTree::KNearestObjects() of 8 neighbors for 100 points among 10000 objects")
+{
+	QuadTreeBenchmarkData &data = BenchmarkData<QuadTreeBenchmarkData>();
+	LCG lcg(1234);
+	for(int j = 0; j < 100; ++j)
+	{
+		QuadTreeTestObject *nearest[8];
+		dummyResultInt += data.tree.KNearestObjects(float2::RandomBox(lcg, -1000.f, 1000.f), 8, nearest, 0) + nearest[0]->id;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_KNearestObjects_8_BruteForce, 10, 10, "Brute force search of 8 nearest neighbors for 100 points among 10000 objects, for comparison against QuadTree::KNearestObjects()")
+{
+	QuadTreeBenchmarkData &data = BenchmarkData<QuadTreeBenchmarkData>();
+	LCG lcg(1234);
+	for(int j = 0; j < 100; ++j)
+	{
+		float2 point = float2::RandomBox(lcg, -1000.f, 1000.f);
+		NearestNeighborHeap<int, 8> nearest(8);
+		for(size_t k = 0; k < data.objects.size(); ++k)
+		{
+			float d = data.objects[k].aabb.DistanceSq(point);
+			if (d < nearest.MaxDistanceSq())
+				nearest.Insert((int)k, d);
+		}
+		dummyResultInt += nearest.Size() + nearest[0].object;
+	}
+}
+BENCHMARK_ITERS_END
+
+struct CountCollidingPairs
+{
+	int numPairs;
+	CountCollidingPairs():numPairs(0) {}
+	void operator ()(QuadTreeTestObject * /*a*/, QuadTreeTestObject * /*b*/) { ++numPairs; }
+};
+
+/// A set of objects that move around inside a fixed world area, and are kept in a tree with Update().
+struct MovingQuadTreeBenchmarkData
+{
+	std::vector<QuadTreeTestObject> objects;
+	std::vector<float2> velocities;
+	TestQuadTree tree;
+
+	explicit MovingQuadTreeBenchmarkData(float looseness = 1.f)
+	:tree(looseness)
+	{
+		LCG rng(1234);
+		objects = RandomQuadTreeObjects(rng, 10000, 1000.f, 5.f);
+		for(size_t i = 0; i < objects.size(); ++i)
+			velocities.push_back(float2::RandomDir(rng) * rng.Float(0.f, 2.f));
+		tree.Clear(float2(-1000.f, -1000.f), float2(1005.f, 1005.f));
+		for(size_t i = 0; i < objects.size(); ++i)
+			tree.Add(&objects[i]);
+		// Let the objects settle into the tree the way they would during a running simulation.
+		for(int i = 0; i < 20; ++i)
+			Step();
+	}
+
+	void Step()
+	{
+		for(size_t i = 0; i < objects.size(); ++i)
+		{
+			AABB2D &aabb = objects[i].aabb;
+			if ((aabb.minPoint.x < -1000.f && velocities[i].x < 0.f) || (aabb.maxPoint.x > 1000.f && velocities[i].x > 0.f))
+				velocities[i].x = -velocities[i].x;
+			if ((aabb.minPoint.y < -1000.f && velocities[i].y < 0.f) || (aabb.maxPoint.y > 1000.f && velocities[i].y > 0.f))
+				velocities[i].y = -velocities[i].y;
+			aabb.minPoint += velocities[i];
+			aabb.maxPoint += velocities[i];
+			tree.Update(&objects[i]);
+		}
+	}
+};
+
+/// The same moving objects as in MovingQuadTreeBenchmarkData, kept in a loose QuadTree.
+struct MovingLooseQuadTreeBenchmarkData : public MovingQuadTreeBenchmarkData
+{
+	MovingLooseQuadTreeBenchmarkData():MovingQuadTreeBenchmarkData(2.f) {}
+};
+
+BENCHMARK_ITERS(QuadTree_Update_10000, 10, 10, "QuadTree::Update() of 10000 moving objects")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingQuadTreeBenchmarkData>();
+	data.Step();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_Loose_Update_10000, 10, 10, "QuadTree::Update() of 10000 moving objects in a loose QuadTree")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingLooseQuadTreeBenchmarkData>();
+	data.Step();
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_CollidingPairsQuery_10000, 10, 10, "QuadTree::CollidingPairsQuery() of 10000 moving objects")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingQuadTreeBenchmarkData>();
+	CountCollidingPairs counter;
+	data.tree.CollidingPairsQuery(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_Loose_CollidingPairsQuery_10000, 10, 10, "QuadTree::CollidingPairsQuery() of 10000 moving objects in a loose QuadTree")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingLooseQuadTreeBenchmarkData>();
+	CountCollidingPairs counter;
+	data.tree.CollidingPairsQuery(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_CollidingPairsQueryParallel_10000, 10, 10, "QuadTree::CollidingPairsQueryParallel() of 10000 moving objects")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingQuadTreeBenchmarkData>();
+	CountCollidingPairs counter;
+	data.tree.CollidingPairsQueryParallel(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(QuadTree_Loose_CollidingPairsQueryParallel_10000, 10, 10, "QuadTree::CollidingPairsQueryParallel() of 10000 moving objects in a loose QuadTree")
+{
+	MovingQuadTreeBenchmarkData &data = BenchmarkData<MovingLooseQuadTreeBenchmarkData>();
+	CountCollidingPairs counter;
+	data.tree.CollidingPairsQueryParallel(data.tree.BoundingAABB(), counter);
+	dummyResultInt += counter.numPairs;
+}
+BENCHMARK_ITERS_END
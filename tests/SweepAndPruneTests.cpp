@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "../src/Algorithm/SweepAndPrune.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+static bool PairLess(const SweepAndPrune::Pair &x, const SweepAndPrune::Pair &y)
+{
+	return x.a < y.a || (x.a == y.a && x.b < y.b);
+}
+
+static std::vector<SweepAndPrune::Pair> BruteForcePairs(const std::vector<AABB> &aabbs)
+{
+	std::vector<SweepAndPrune::Pair> pairs;
+	for(int i = 0; i < (int)aabbs.size(); ++i)
+		for(int j = i+1; j < (int)aabbs.size(); ++j)
+			if (aabbs[i].Intersects(aabbs[j]))
+			{
+				SweepAndPrune::Pair p = { i, j };
+				pairs.push_back(p);
+			}
+	return pairs;
+}
+
+static std::vector<SweepAndPrune::Pair> SweepAndPrunePairs(const SweepAndPrune &sap)
+{
+	std::vector<SweepAndPrune::Pair> pairs;
+	int numPairs = sap.FindOverlappingPairs(0, 0);
+	pairs.resize(numPairs);
+	if (numPairs > 0)
+	{
+		int numPairs2 = sap.FindOverlappingPairs(&pairs[0], numPairs);
+		assert2(numPairs2 == numPairs, numPairs2, numPairs);
+		MARK_UNUSED(numPairs2);
+	}
+	std::sort(pairs.begin(), pairs.end(), PairLess);
+	return pairs;
+}
+
+static void AssertSamePairs(const std::vector<SweepAndPrune::Pair> &a, const std::vector<SweepAndPrune::Pair> &b)
+{
+	assert2(a.size() == b.size(), (int)a.size(), (int)b.size());
+	for(size_t i = 0; i < a.size() && i < b.size(); ++i)
+	{
+		assert2(a[i].a == b[i].a, a[i].a, b[i].a);
+		assert2(a[i].b == b[i].b, a[i].b, b[i].b);
+	}
+}
+
+RANDOMIZED_TEST(SweepAndPrune_Build)
+{
+	std::vector<AABB> aabbs;
+	for(int i = 0; i < 300; ++i)
+		aabbs.push_back(RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), 20.f));
+	// Some of the boxes have negative coordinates and some positive, which exercises the sign handling of the radix sort keys.
+	SweepAndPrune sap;
+	sap.Build(&aabbs[0], (int)aabbs.size());
+	assert(sap.NumAABBs() == 300);
+	AssertSamePairs(SweepAndPrunePairs(sap), BruteForcePairs(aabbs));
+}
+
+RANDOMIZED_TEST(SweepAndPrune_Update)
+{
+	std::vector<AABB> aabbs;
+	std::vector<vec> velocities;
+	for(int i = 0; i < 300; ++i)
+	{
+		aabbs.push_back(RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), 20.f));
+		velocities.push_back(vec::RandomDir(rng) * rng.Float(0.f, 5.f));
+	}
+	SweepAndPrune sap;
+	sap.Build(&aabbs[0], (int)aabbs.size());
+	const int sweepAxis = sap.SweepAxis();
+	for(int frame = 0; frame < 10; ++frame)
+	{
+		for(size_t i = 0; i < aabbs.size(); ++i)
+			aabbs[i].Translate(velocities[i]);
+		sap.Update(&aabbs[0], (int)aabbs.size());
+		assert(sap.SweepAxis() == sweepAxis);
+		AssertSamePairs(SweepAndPrunePairs(sap), BruteForcePairs(aabbs));
+	}
+
+	// Adding a box falls back to a full rebuild.
+	aabbs.push_back(aabbs[0]);
+	sap.Update(&aabbs[0], (int)aabbs.size());
+	assert(sap.NumAABBs() == 301);
+	AssertSamePairs(SweepAndPrunePairs(sap), BruteForcePairs(aabbs));
+}
+
+UNIQUE_TEST(SweepAndPrune_TruncatedOutput)
+{
+	// Five mutually overlapping boxes have 10 pairs.
+	AABB aabbs[5];
+	for(int i = 0; i < 5; ++i)
+		aabbs[i] = AABB(POINT_VEC_SCALAR((float)i), POINT_VEC_SCALAR(10.f + i));
+	SweepAndPrune sap;
+	sap.Build(aabbs, 5);
+	SweepAndPrune::Pair pairs[4];
+	assert(sap.FindOverlappingPairs(pairs, 4) == 10);
+	for(int i = 0; i < 4; ++i)
+		assert(pairs[i].a < pairs[i].b);
+
+	// Boxes that only touch do not overlap, as in AABB::Intersects().
+	AABB touching[2] = { AABB(POINT_VEC_SCALAR(0.f), POINT_VEC_SCALAR(1.f)), AABB(POINT_VEC(1.f, 0.f, 0.f), POINT_VEC(2.f, 1.f, 1.f)) };
+	sap.Build(touching, 2);
+	assert(sap.FindOverlappingPairs(pairs, 4) == 0);
+
+	sap.Build(0, 0);
+	assert(sap.FindOverlappingPairs(pairs, 4) == 0);
+}
+
+struct SweepAndPruneBenchmarkData
+{
+	std::vector<AABB> aabbs;
+	std::vector<vec> velocities;
+	std::vector<SweepAndPrune::Pair> pairs;
+	SweepAndPrune sap;
+
+	SweepAndPruneBenchmarkData()
+	{
+		LCG rng(1234);
+		for(int i = 0; i < 10000; ++i)
+		{
+			aabbs.push_back(RandomAABBContainingPoint(vec::RandomBox(rng, POINT_VEC_SCALAR(-1000.f), POINT_VEC_SCALAR(1000.f)), 20.f));
+			velocities.push_back(vec::RandomDir(rng, 0.5f));
+		}
+		pairs.resize(100000);
+		sap.Build(&aabbs[0], (int)aabbs.size());
+	}
+};
+
+BENCHMARK_ITERS(SweepAndPrune_Build_10000, 10, 10, "SweepAndPrune::Build() and FindOverlappingPairs() for 10000 AABBs")
+{
+	SweepAndPruneBenchmarkData &data = BenchmarkData<SweepAndPruneBenchmarkData>();
+	data.sap.Build(&data.aabbs[0], (int)data.aabbs.size());
+	dummyResultInt += data.sap.FindOverlappingPairs(&data.pairs[0], (int)data.pairs.size());
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(SweepAndPrune_Update_10000, 10, 10, "SweepAndPrune::Update() and FindOverlappingPairs() for 10000 moving AABBs")
+{
+	SweepAndPruneBenchmarkData &data = BenchmarkData<SweepAndPruneBenchmarkData>();
+	for(size_t j = 0; j < data.aabbs.size(); ++j)
+		data.aabbs[j].Translate(data.velocities[j]);
+	data.sap.Update(&data.aabbs[0], (int)data.aabbs.size());
+	dummyResultInt += data.sap.FindOverlappingPairs(&data.pairs[0], (int)data.pairs.size());
+}
+BENCHMARK_ITERS_END
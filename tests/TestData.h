@@ -72,6 +72,15 @@ extern Quat uninitializedQuat;
 extern int dummyResultInt;
 extern vec dummyResultVec;
 
+/// Returns the data shared by a group of benchmarks. The data is generated by the default constructor of T the first time
+/// it is needed, so that the test run only pays for generating the data of the benchmarks that actually get run.
+template<typename T>
+T &BenchmarkData()
+{
+	static T data;
+	return data;
+}
+
 } // ~TestData
 
 MATH_END_NAMESPACE
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../src/MathGeoLib.h"
+#include "../src/Math/myassert.h"
+#include "TestRunner.h"
+#include "TestData.h"
+#include "../src/Algorithm/TimeOfImpact.h"
+#include "ObjectGenerators.h"
+
+MATH_IGNORE_UNUSED_VARS_WARNING
+
+using namespace TestData;
+
+template<typename T>
+T TranslatedObject(const T &object, const vec &offset)
+{
+	T translated = object;
+	translated.Translate(offset);
+	return translated;
+}
+
+UNIQUE_TEST(GJKTimeOfImpactSphereSphere)
+{
+	Sphere a(POINT_VEC(0.f, 0.f, 0.f), 1.f);
+	Sphere b(POINT_VEC(10.f, 0.f, 0.f), 1.f);
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(a, vec::zero, b, DIR_VEC(-16.f, 0.f, 0.f), t, normal);
+	assert(hit);
+	assert1(EqualAbs(t, 0.5f, 1e-3f), t);
+	assert1(normal.Equals(DIR_VEC(1.f, 0.f, 0.f), 1e-3f), normal);
+
+	// Moving sideways, b passes by a without touching.
+	hit = GJKTimeOfImpact(a, vec::zero, b, DIR_VEC(-16.f, 5.f, 0.f), t, normal);
+	assert(!hit);
+	// Moving away, b never touches a.
+	hit = GJKTimeOfImpact(a, vec::zero, b, DIR_VEC(16.f, 0.f, 0.f), t, normal);
+	assert(!hit);
+}
+
+UNIQUE_TEST(GJKTimeOfImpactIntersectingAtStart)
+{
+	AABB a(POINT_VEC(-1.f, -1.f, -1.f), POINT_VEC(1.f, 1.f, 1.f));
+	AABB b(POINT_VEC(0.5f, -0.5f, -0.5f), POINT_VEC(3.f, 0.5f, 0.5f));
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(a, vec::zero, b, DIR_VEC(0.f, 1.f, 0.f), t, normal);
+	assert(hit);
+	assert1(t == 0.f, t);
+	assert1(normal.Equals(DIR_VEC(1.f, 0.f, 0.f), 1e-3f), normal);
+}
+
+UNIQUE_TEST(GJKTimeOfImpactThinWall)
+{
+	// A fast projectile flies through a thin wall. Testing for intersection at 16 evenly spaced points in time misses the hit.
+	Sphere projectile(POINT_VEC(-10.3f, 0.f, 0.f), 0.1f);
+	vec velocity = DIR_VEC(20.f, 0.f, 0.f);
+	OBB wall(AABB(POINT_VEC(-0.05f, -5.f, -5.f), POINT_VEC(0.05f, 5.f, 5.f)));
+	for(int i = 0; i <= 16; ++i)
+		assert(!GJKIntersect(TranslatedObject(projectile, velocity * (i / 16.f)), wall));
+
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(projectile, velocity, wall, vec::zero, t, normal);
+	assert(hit);
+	assert1(EqualAbs(t, (10.3f - 0.15f) / 20.f, 1e-3f), t);
+	assert1(normal.Equals(DIR_VEC(1.f, 0.f, 0.f), 1e-3f), normal);
+}
+
+UNIQUE_TEST(GJKTimeOfImpactRotatingOBB)
+{
+	// A bat rotates a quarter turn about the z axis, and hits a ball with its side.
+	OBB bat(AABB(POINT_VEC(-5.f, -0.2f, -0.2f), POINT_VEC(5.f, 0.2f, 0.2f)));
+	Sphere ball(POINT_VEC(0.f, 4.f, 0.f), 0.5f);
+	GJKMotion batMotion(vec::zero, DIR_VEC(0.f, 0.f, pi / 2.f), POINT_VEC_SCALAR(0.f));
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(bat, batMotion, ball, GJKMotion(vec::zero), t, normal);
+	assert(hit);
+	// The side of the bat is at distance 0.2 from its axis, so contact happens when 4 * cos(angle) == 0.2 + 0.5.
+	float expectedTime = Acos(0.7f / 4.f) / (pi / 2.f);
+	assert2(EqualAbs(t, expectedTime, 1e-3f), t, expectedTime);
+
+	OBB hitBat = bat;
+	hitBat.Transform(Quat::RotateZ(t * pi / 2.f));
+	float d = GJKDistance(hitBat, ball);
+	assert1(d <= 1e-2f, d);
+	assert2(normal.Equals((ball.pos - hitBat.ClosestPoint(ball.pos)).Normalized(), 1e-2f), normal, hitBat.ClosestPoint(ball.pos));
+}
+
+RANDOMIZED_TEST(GJKTimeOfImpactOBBCapsule)
+{
+	Plane p(vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE)), vec::RandomDir(rng));
+	OBB a = RandomOBBInHalfspace(p, 10.f);
+	p.ReverseNormal();
+	Capsule b = RandomCapsuleInHalfspace(p);
+	vec velocityA = vec::RandomBox(rng, DIR_VEC_SCALAR(-SCALE), DIR_VEC_SCALAR(SCALE));
+	vec velocityB = vec::RandomBox(rng, DIR_VEC_SCALAR(-SCALE), DIR_VEC_SCALAR(SCALE));
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(a, velocityA, b, velocityB, t, normal);
+	float end = 1.f;
+	if (hit)
+	{
+		assert1(t >= 0.f && t <= 1.f, t);
+		assert1(normal.IsNormalized(), normal);
+		OBB hitA = TranslatedObject(a, velocityA * t);
+		float d = GJKDistance(hitA, TranslatedObject(b, velocityB * t));
+		// As in GJKTimeOfImpactPolyhedronSphere, the precision of the contact is relative to the magnitude of the coordinates.
+		float tolerance = Max(1e-2f, 1e-3f * hitA.pos.Abs().MaxElement());
+		assert3(d <= tolerance, d, t, tolerance);
+		end = t;
+	}
+	// The objects must not intersect at any time before the time of impact.
+	for(int i = 0; i < 32; ++i)
+	{
+		float s = end * i / 32.f;
+		OBB movedA = TranslatedObject(a, velocityA * s);
+		Capsule movedB = TranslatedObject(b, velocityB * s);
+		assert3(!GJKIntersect(movedA, movedB) || GJKDistance(movedA, movedB) < 1e-2f, s, t, hit);
+	}
+}
+
+RANDOMIZED_TEST(GJKTimeOfImpactPolyhedronSphere)
+{
+	vec pt = vec::RandomBox(rng, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+	Polyhedron a = RandomPolyhedronContainingPoint(pt);
+	Sphere b = RandomSphereContainingPoint(pt, 5.f);
+	// Start the sphere outside the polyhedron, which can be large, and shoot it toward the polyhedron so that it passes
+	// through it within the time interval.
+	vec dir = vec::RandomDir(rng);
+	float extent;
+	a.ExtremePoint(-dir, extent);
+	float startDistance = extent + Dot(dir, b.pos) + b.r + 10.f;
+	b.pos -= dir * startDistance;
+	vec velocity = dir * (2.f * startDistance);
+	float t = 0.f;
+	vec normal;
+	bool hit = GJKTimeOfImpact(a, vec::zero, b, velocity, t, normal);
+	assert(hit);
+	assert1(t > 0.f && t < 0.5f, t);
+	// The precision of the contact is limited by the floating point precision of the support points, which is relative to
+	// the magnitude of their coordinates. The polyhedra can extend several hundred units from the origin.
+	Sphere hitB = TranslatedObject(b, velocity * t);
+	float d = a.Distance(hitB.pos) - hitB.r;
+	AABB bounds = a.MinimalEnclosingAABB();
+	float tolerance = Max(1e-2f, 1e-3f * Max(bounds.minPoint.Abs().MaxElement(), bounds.maxPoint.Abs().MaxElement()));
+	assert3(d <= tolerance, d, t, tolerance);
+	assert2(Dot(normal, velocity) < 0.f, normal, velocity);
+}
+
+struct TimeOfImpactBenchmarkData
+{
+	std::vector<Sphere> projectiles;
+	std::vector<vec> velocities;
+	std::vector<OBB> targets;
+
+	/// Generates 100 fast projectiles that fly past or through targets that are thin compared to the distance traveled.
+
+	TimeOfImpactBenchmarkData()
+	{
+		LCG lcg(1234);
+		for(int i = 0; i < 100; ++i)
+		{
+			vec pt = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+			targets.push_back(RandomOBBContainingPoint(pt, 10.f));
+			vec dir = vec::RandomDir(lcg);
+			projectiles.push_back(Sphere(pt - dir * 100.f + vec::RandomBox(lcg, DIR_VEC_SCALAR(-10.f), DIR_VEC_SCALAR(10.f)), 0.2f));
+			velocities.push_back(dir * 200.f);
+		}
+	}
+};
+
+BENCHMARK_ITERS(GJKTimeOfImpact_Sphere_OBB, 10, 10, "GJKTimeOfImpact() of 100 fast moving spheres against OBBs")
+{
+	TimeOfImpactBenchmarkData &data = BenchmarkData<TimeOfImpactBenchmarkData>();
+	for(size_t j = 0; j < data.projectiles.size(); ++j)
+	{
+		float t = 0.f;
+		vec normal;
+		dummyResultInt += GJKTimeOfImpact(data.projectiles[j], data.velocities[j], data.targets[j], vec::zero, t, normal) ? 1 : 0;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(GJKIntersect_Sphere_OBB_32_substeps, 10, 10, "GJKIntersect() at 32 points in time for 100 fast moving spheres against OBBs, for comparison against GJKTimeOfImpact()")
+{
+	TimeOfImpactBenchmarkData &data = BenchmarkData<TimeOfImpactBenchmarkData>();
+	for(size_t j = 0; j < data.projectiles.size(); ++j)
+		for(int k = 0; k <= 32; ++k)
+			if (GJKIntersect(TranslatedObject(data.projectiles[j], data.velocities[j] * (k / 32.f)), data.targets[j]))
+			{
+				++dummyResultInt;
+				break;
+			}
+}
+BENCHMARK_ITERS_END
@@ -1,6 +1,9 @@
 #include "../src/Math/myassert.h"
 #include "../src/MathGeoLib.h"
 #include "../tests/TestRunner.h"
+#include "../tests/TestData.h"
+
+using namespace TestData;
 
 UNIQUE_TEST(TriangleMeshSet)
 {
@@ -46,3 +49,611 @@ TEST(TriangleMeshSet3)
 	triangleMesh->Set((Triangle*)p, 12);
 	delete triangleMesh;
 }
+
+// Generates a random triangle soup of numTris triangles, and numRays rays aimed at random triangles.
+static void GenerateIntersectRaysTestData(LCG &lcg, int numTris, int numRays, std::vector<Triangle> &tris, std::vector<Ray> &rays)
+{
+	for(int i = 0; i < numTris; ++i)
+	{
+		vec a = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		vec b = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-10.f), POINT_VEC_SCALAR(10.f));
+		vec c = a + vec::RandomBox(lcg, POINT_VEC_SCALAR(-10.f), POINT_VEC_SCALAR(10.f));
+		tris.push_back(Triangle(a, b, c));
+	}
+	for(int i = 0; i < numRays; ++i)
+	{
+		vec pos = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+		// Aim half of the rays at a triangle, and shoot the rest of them to random directions.
+		vec dir = (i % 2 == 0) ? (tris[lcg.Int(0, numTris-1)].CenterPoint() - pos).Normalized() : vec::RandomDir(lcg);
+		rays.push_back(Ray(pos, dir));
+	}
+}
+
+UNIQUE_TEST(TriangleMeshIntersectRays_CPP)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh mesh;
+	mesh.SetAoS((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		mesh.IntersectRays_CPP(&rays[0], (int)rays.size(), &t[0], &triIndex[0], numThreads);
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1;
+			float u, v;
+			float d = mesh.IntersectRay_TriangleIndex_UV_CPP(rays[i], index, u, v);
+			assert2(t[i] == d, t[i], d);
+			assert2(triIndex[i] == index, triIndex[i], index);
+		}
+	}
+
+	// The triangle indices are optional.
+	mesh.IntersectRays_CPP(&rays[0], (int)rays.size(), &t[0], 0);
+}
+
+#ifdef MATH_SSE2
+UNIQUE_TEST(TriangleMeshIntersectRays_SSE2)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh mesh;
+	mesh.SetSoA4((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		mesh.IntersectRays_SSE2(&rays[0], (int)rays.size(), &t[0], &triIndex[0], numThreads);
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1;
+			float d = mesh.IntersectRay_TriangleIndex_SSE2(rays[i], index);
+			assert2(t[i] == d, t[i], d);
+			if (d < FLOAT_INF)
+				assert2(triIndex[i] == index, triIndex[i], index);
+			else
+				assert(triIndex[i] == -1);
+		}
+	}
+}
+#endif
+
+#ifdef MATH_AVX
+UNIQUE_TEST(TriangleMeshIntersectRays_AVX)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh mesh;
+	mesh.SetSoA8((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		mesh.IntersectRays_AVX(&rays[0], (int)rays.size(), &t[0], &triIndex[0], numThreads);
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1;
+			float d = mesh.IntersectRay_TriangleIndex_AVX(rays[i], index);
+			assert2(t[i] == d, t[i], d);
+			if (d < FLOAT_INF)
+				assert2(triIndex[i] == index, triIndex[i], index);
+			else
+				assert(triIndex[i] == -1);
+		}
+	}
+}
+#endif
+
+#ifdef MATH_AVX512
+UNIQUE_TEST(TriangleMeshIntersectRays_AVX512)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh mesh;
+	mesh.SetSoA16((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		mesh.IntersectRays_AVX512(&rays[0], (int)rays.size(), &t[0], &triIndex[0], numThreads);
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1;
+			float d = mesh.IntersectRay_TriangleIndex_AVX512(rays[i], index);
+			assert2(t[i] == d, t[i], d);
+			if (d < FLOAT_INF)
+				assert2(triIndex[i] == index, triIndex[i], index);
+			else
+				assert(triIndex[i] == -1);
+		}
+	}
+}
+#endif
+
+UNIQUE_TEST(TriangleMeshIntersectRays)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh mesh;
+	mesh.Set(&tris[0], (int)tris.size());
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		mesh.IntersectRays(&rays[0], (int)rays.size(), &t[0], &triIndex[0], numThreads);
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1;
+			float d = mesh.IntersectRay_TriangleIndex(rays[i], index);
+			assert2(t[i] == d, t[i], d);
+			assert2(triIndex[i] == index, triIndex[i], index);
+		}
+	}
+}
+
+struct TriangleMeshIntersectRaysBenchmarkData
+{
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	TriangleMesh mesh;
+	std::vector<float> t;
+	std::vector<int> triIndex;
+
+	TriangleMeshIntersectRaysBenchmarkData()
+	{
+		LCG lcg(1234);
+		GenerateIntersectRaysTestData(lcg, 2000, 1000, tris, rays);
+		mesh.Set(&tris[0], (int)tris.size());
+		t.resize(rays.size());
+		triIndex.resize(rays.size());
+	}
+};
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRay_TriangleIndex_1000_rays, 5, 1, "TriangleMesh::IntersectRay_TriangleIndex() of 1000 rays one at a time, 2000 triangles")
+{
+	TriangleMeshIntersectRaysBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRaysBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); ++j)
+		data.t[j] = data.mesh.IntersectRay_TriangleIndex(data.rays[j], data.triIndex[j]);
+	dummyResultInt += data.triIndex[i];
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRays_1000_rays_1_thread, 5, 1, "TriangleMesh::IntersectRays() of 1000 rays on 1 thread, 2000 triangles")
+{
+	TriangleMeshIntersectRaysBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRaysBenchmarkData>();
+	data.mesh.IntersectRays(&data.rays[0], (int)data.rays.size(), &data.t[0], &data.triIndex[0], 1);
+	dummyResultInt += data.triIndex[i];
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRays_1000_rays_2_threads, 5, 1, "TriangleMesh::IntersectRays() of 1000 rays on 2 threads, 2000 triangles")
+{
+	TriangleMeshIntersectRaysBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRaysBenchmarkData>();
+	data.mesh.IntersectRays(&data.rays[0], (int)data.rays.size(), &data.t[0], &data.triIndex[0], 2);
+	dummyResultInt += data.triIndex[i];
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRays_1000_rays_4_threads, 5, 1, "TriangleMesh::IntersectRays() of 1000 rays on 4 threads, 2000 triangles")
+{
+	TriangleMeshIntersectRaysBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRaysBenchmarkData>();
+	data.mesh.IntersectRays(&data.rays[0], (int)data.rays.size(), &data.t[0], &data.triIndex[0], 4);
+	dummyResultInt += data.triIndex[i];
+}
+BENCHMARK_ITERS_END
+
+UNIQUE_TEST(TriangleMeshIntersectRayParallel)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 16384, 200, tris, rays);
+	TriangleMesh mesh;
+	mesh.Set(&tris[0], (int)tris.size());
+
+	for(int numThreads = 1; numThreads <= 4; numThreads *= 2)
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			int index = -1, index2 = -1;
+			float u = 0.f, v = 0.f, u2 = 0.f, v2 = 0.f;
+			float d = mesh.IntersectRay_TriangleIndex_UV(rays[i], index, u, v);
+			float d2 = mesh.IntersectRayParallel(rays[i], index2, u2, v2, numThreads, 1000);
+			assert2(d == d2, d, d2);
+			assert2(index == index2, index, index2);
+			assert2(u == u2, u, u2);
+			assert2(v == v2, v, v2);
+		}
+}
+
+struct TriangleMeshIntersectRayParallelBenchmarkData
+{
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	TriangleMesh mesh;
+
+	TriangleMeshIntersectRayParallelBenchmarkData()
+	{
+		LCG lcg(1234);
+		GenerateIntersectRaysTestData(lcg, 1 << 18, 8, tris, rays);
+		mesh.Set(&tris[0], (int)tris.size());
+	}
+};
+
+// Intersects each benchmark ray against the mesh with IntersectRayParallel() on the given number of threads.
+static int IntersectRayParallelBenchmarkRays(int numThreads)
+{
+	TriangleMeshIntersectRayParallelBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRayParallelBenchmarkData>();
+	int sum = 0;
+	for(size_t j = 0; j < data.rays.size(); ++j)
+	{
+		int index = -1;
+		float u, v;
+		data.mesh.IntersectRayParallel(data.rays[j], index, u, v, numThreads);
+		sum += index;
+	}
+	return sum;
+}
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRay_TriangleIndex_UV_262144_tris, 3, 1, "TriangleMesh::IntersectRay_TriangleIndex_UV() of 8 rays, 262144 triangles")
+{
+	TriangleMeshIntersectRayParallelBenchmarkData &data = BenchmarkData<TriangleMeshIntersectRayParallelBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); ++j)
+	{
+		int index = -1;
+		float u, v;
+		data.mesh.IntersectRay_TriangleIndex_UV(data.rays[j], index, u, v);
+		dummyResultInt += index;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRayParallel_262144_tris_1_thread, 3, 1, "TriangleMesh::IntersectRayParallel() of 8 rays on 1 thread, 262144 triangles")
+{
+	dummyResultInt += IntersectRayParallelBenchmarkRays(1);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRayParallel_262144_tris_2_threads, 3, 1, "TriangleMesh::IntersectRayParallel() of 8 rays on 2 threads, 262144 triangles")
+{
+	dummyResultInt += IntersectRayParallelBenchmarkRays(2);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRayParallel_262144_tris_4_threads, 3, 1, "TriangleMesh::IntersectRayParallel() of 8 rays on 4 threads, 262144 triangles")
+{
+	dummyResultInt += IntersectRayParallelBenchmarkRays(4);
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRayParallel_262144_tris_8_threads, 3, 1, "TriangleMesh::IntersectRayParallel() of 8 rays on 8 threads, 262144 triangles")
+{
+	dummyResultInt += IntersectRayParallelBenchmarkRays(8);
+}
+BENCHMARK_ITERS_END
+
+UNIQUE_TEST(TriangleMeshBVH)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	// Use a triangle count that is not a multiple of any SIMD width, the BVH build pads the mesh as needed.
+	GenerateIntersectRaysTestData(lcg, 5003, 2000, tris, rays);
+	// The last triangles are only added to the BVH mesh, so move them out of the reach of the test rays.
+	for(int i = 4992; i < 5003; ++i)
+		tris[i] = Triangle(POINT_VEC_SCALAR(1e6f), POINT_VEC_SCALAR(1e6f) + DIR_VEC(1.f, 0.f, 0.f), POINT_VEC_SCALAR(1e6f) + DIR_VEC(0.f, 1.f, 0.f));
+	TriangleMesh mesh;
+	mesh.Set(&tris[0], 4992);
+	TriangleMesh bvhMesh;
+	bvhMesh.Set(&tris[0], 5003, true);
+	assert(bvhMesh.HasBVH());
+	assert(!mesh.HasBVH());
+
+	TriangleMesh copy(bvhMesh);
+	assert(copy.HasBVH());
+
+	std::vector<float> t(rays.size());
+	std::vector<int> triIndex(rays.size());
+	copy.IntersectRays(&rays[0], (int)rays.size(), &t[0], &triIndex[0], 2);
+	for(size_t i = 0; i < rays.size(); ++i)
+	{
+		int index = -1, index2 = -1;
+		float u = 0.f, v = 0.f, u2 = 0.f, v2 = 0.f;
+		float d = mesh.IntersectRay_TriangleIndex_UV(rays[i], index, u, v);
+		float d2 = bvhMesh.IntersectRay_TriangleIndex_UV(rays[i], index2, u2, v2);
+		assert2(d == d2, d, d2);
+		assert2(index == index2, index, index2);
+		assert2(u == u2 && v == v2, u, u2);
+		assert2(t[i] == d, t[i], d);
+		assert2(triIndex[i] == index, triIndex[i], index);
+		assert(bvhMesh.IntersectRay(rays[i]) == d);
+		assert(bvhMesh.IntersectRayAny(rays[i]) == (d < FLOAT_INF));
+		assert(!bvhMesh.IntersectRayAny(rays[i], d));
+
+		int index3 = -1;
+		float u3 = 0.f, v3 = 0.f;
+		float d3 = bvhMesh.IntersectRayParallel(rays[i], index3, u3, v3, 1, 1000);
+		assert2(d == d3, d, d3);
+		assert2(index == index3, index, index3);
+
+		// A task size larger than the mesh takes the single task code path, which must map the triangle index back too.
+		int index4 = -1;
+		float u4 = 0.f, v4 = 0.f;
+		float d4 = bvhMesh.IntersectRayParallel(rays[i], index4, u4, v4, 1, 10000);
+		assert2(d == d4, d, d4);
+		assert2(index == index4, index, index4);
+	}
+}
+
+RANDOMIZED_TEST(TriangleMeshBVHMatchesLinearSearch)
+{
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(rng, rng.Int(1, 3000), 100, tris, rays);
+	TriangleMesh mesh;
+	mesh.Set(&tris[0], (int)tris.size());
+	TriangleMesh bvhMesh;
+	bvhMesh.Set(&tris[0], (int)tris.size(), true);
+	for(size_t i = 0; i < rays.size(); ++i)
+	{
+		int index = -1, index2 = -1;
+		float u = 0.f, v = 0.f, u2 = 0.f, v2 = 0.f;
+		float d = mesh.IntersectRay_TriangleIndex_UV(rays[i], index, u, v);
+		float d2 = bvhMesh.IntersectRay_TriangleIndex_UV(rays[i], index2, u2, v2);
+		assert3(d == d2, d, d2, tris.size());
+		assert3(index == index2, index, index2, tris.size());
+	}
+}
+
+struct TriangleMeshBVHBenchmarkData
+{
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	TriangleMesh mesh;
+	TriangleMesh bvhMesh;
+
+	TriangleMeshBVHBenchmarkData()
+	{
+		LCG lcg(1234);
+		GenerateIntersectRaysTestData(lcg, 1 << 16, 20, tris, rays);
+		mesh.Set(&tris[0], (int)tris.size());
+		bvhMesh.Set(&tris[0], (int)tris.size(), true);
+	}
+};
+
+BENCHMARK_ITERS(TriangleMesh_Set_BVH_65536_tris, 3, 1, "TriangleMesh::Set() with a BVH, 65536 triangles")
+{
+	TriangleMeshBVHBenchmarkData &data = BenchmarkData<TriangleMeshBVHBenchmarkData>();
+	TriangleMesh mesh;
+	mesh.Set(&data.tris[0], (int)data.tris.size(), true);
+	dummyResultInt += mesh.HasBVH() ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRay_TriangleIndex_UV_65536_tris, 3, 1, "TriangleMesh::IntersectRay_TriangleIndex_UV() of 20 rays without a BVH, 65536 triangles")
+{
+	TriangleMeshBVHBenchmarkData &data = BenchmarkData<TriangleMeshBVHBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); ++j)
+	{
+		int index = -1;
+		float u, v;
+		data.mesh.IntersectRay_TriangleIndex_UV(data.rays[j], index, u, v);
+		dummyResultInt += index;
+	}
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMesh_IntersectRay_TriangleIndex_UV_BVH_65536_tris, 10, 1, "TriangleMesh::IntersectRay_TriangleIndex_UV() of 20 rays with a BVH, 65536 triangles")
+{
+	TriangleMeshBVHBenchmarkData &data = BenchmarkData<TriangleMeshBVHBenchmarkData>();
+	for(size_t j = 0; j < data.rays.size(); ++j)
+	{
+		int index = -1;
+		float u, v;
+		data.bvhMesh.IntersectRay_TriangleIndex_UV(data.rays[j], index, u, v);
+		dummyResultInt += index;
+	}
+}
+BENCHMARK_ITERS_END
+
+UNIQUE_TEST(TriangleMeshIntersectRayAny)
+{
+	LCG lcg(1234);
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	GenerateIntersectRaysTestData(lcg, 1024, 2000, tris, rays);
+	TriangleMesh aos;
+	aos.SetAoS((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#ifdef MATH_SSE2
+	TriangleMesh soa4;
+	soa4.SetSoA4((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+#ifdef MATH_AVX
+	TriangleMesh soa8;
+	soa8.SetSoA8((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+#ifdef MATH_AVX512
+	TriangleMesh soa16;
+	soa16.SetSoA16((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+
+	for(size_t i = 0; i < rays.size(); ++i)
+	{
+		int index;
+		float u, v;
+		float d = aos.IntersectRay_TriangleIndex_UV_CPP(rays[i], index, u, v);
+		// Test both a distance that is beyond the nearest hit, and one that falls short of it. Stay clear of the
+		// exact hit distance, since the SIMD kernels compute it using an approximate reciprocal.
+		float maxDistance = (i % 2 == 0) ? d * 1.01f : d * 0.99f;
+		bool expected = d < FLOAT_INF && (i % 2 == 0);
+		MARK_UNUSED(maxDistance);
+		MARK_UNUSED(expected);
+		assert(aos.IntersectRayAny_CPP(rays[i], maxDistance) == expected);
+		assert(aos.IntersectRayAny_CPP(rays[i]) == (d < FLOAT_INF));
+#ifdef MATH_SSE2
+		assert(soa4.IntersectRayAny_SSE2(rays[i], maxDistance) == expected);
+		assert(soa4.IntersectRayAny_SSE2(rays[i]) == (d < FLOAT_INF));
+#endif
+#ifdef MATH_SSE41
+		assert(soa4.IntersectRayAny_SSE41(rays[i], maxDistance) == expected);
+#endif
+#ifdef MATH_AVX
+		assert(soa8.IntersectRayAny_AVX(rays[i], maxDistance) == expected);
+		assert(soa8.IntersectRayAny_AVX(rays[i]) == (d < FLOAT_INF));
+#endif
+#ifdef MATH_AVX512
+		assert(soa16.IntersectRayAny_AVX512(rays[i], maxDistance) == expected);
+		assert(soa16.IntersectRayAny_AVX512(rays[i]) == (d < FLOAT_INF));
+#endif
+	}
+}
+
+const int numTriangleMeshBenchmarkTris = 2000;
+const int numTriangleMeshBenchmarkRays = 1024;
+
+// Shadow rays from random points towards a light source in the middle of a triangle soup.
+struct TriangleMeshBenchmarkData
+{
+	std::vector<Triangle> tris;
+	std::vector<Ray> rays;
+	std::vector<float> lightDistance;
+	TriangleMesh aos;
+#ifdef MATH_SSE2
+	TriangleMesh soa4;
+#endif
+#ifdef MATH_AVX
+	TriangleMesh soa8;
+#endif
+#ifdef MATH_AVX512
+	TriangleMesh soa16;
+#endif
+
+	TriangleMeshBenchmarkData()
+	{
+		LCG lcg(1234);
+		GenerateIntersectRaysTestData(lcg, numTriangleMeshBenchmarkTris, 0, tris, rays);
+		for(int i = 0; i < numTriangleMeshBenchmarkRays; ++i)
+		{
+			vec pos = vec::RandomBox(lcg, POINT_VEC_SCALAR(-SCALE), POINT_VEC_SCALAR(SCALE));
+			vec light = vec::RandomBox(lcg, POINT_VEC_SCALAR(-1.f), POINT_VEC_SCALAR(1.f));
+			rays.push_back(Ray(pos, (light - pos).Normalized()));
+			lightDistance.push_back(pos.Distance(light));
+		}
+		aos.SetAoS((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#ifdef MATH_SSE2
+		soa4.SetSoA4((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+#ifdef MATH_AVX
+		soa8.SetSoA8((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+#ifdef MATH_AVX512
+		soa16.SetSoA16((const float*)&tris[0], (int)tris.size(), sizeof(Triangle)/3);
+#endif
+	}
+};
+
+BENCHMARK_ITERS(TriangleMeshIntersectRay_CPP_shadow, 10, 100, "TriangleMesh::IntersectRay_TriangleIndex_UV_CPP() as a shadow ray, 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	int index;
+	float u, v;
+	dummyResultInt += (b.aos.IntersectRay_TriangleIndex_UV_CPP(b.rays[r], index, u, v) < b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMeshIntersectRayAny_CPP, 10, 100, "TriangleMesh::IntersectRayAny_CPP(), 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += b.aos.IntersectRayAny_CPP(b.rays[r], b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+#ifdef MATH_SSE2
+BENCHMARK_ITERS(TriangleMeshIntersectRay_SSE2_shadow, 10, 100, "TriangleMesh::IntersectRay_SSE2() as a shadow ray, 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += (b.soa4.IntersectRay_SSE2(b.rays[r]) < b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMeshIntersectRayAny_SSE2, 10, 100, "TriangleMesh::IntersectRayAny_SSE2(), 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += b.soa4.IntersectRayAny_SSE2(b.rays[r], b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+#endif
+
+#ifdef MATH_SSE41
+BENCHMARK_ITERS(TriangleMeshIntersectRay_SSE41_shadow, 10, 100, "TriangleMesh::IntersectRay_SSE41() as a shadow ray, 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += (b.soa4.IntersectRay_SSE41(b.rays[r]) < b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMeshIntersectRayAny_SSE41, 10, 100, "TriangleMesh::IntersectRayAny_SSE41(), 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += b.soa4.IntersectRayAny_SSE41(b.rays[r], b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+#endif
+
+#ifdef MATH_AVX
+BENCHMARK_ITERS(TriangleMeshIntersectRay_AVX_shadow, 10, 100, "TriangleMesh::IntersectRay_AVX() as a shadow ray, 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += (b.soa8.IntersectRay_AVX(b.rays[r]) < b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMeshIntersectRayAny_AVX, 10, 100, "TriangleMesh::IntersectRayAny_AVX(), 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += b.soa8.IntersectRayAny_AVX(b.rays[r], b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+#endif
+
+#ifdef MATH_AVX512
+BENCHMARK_ITERS(TriangleMeshIntersectRay_AVX512_shadow, 10, 100, "TriangleMesh::IntersectRay_AVX512() as a shadow ray, 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += (b.soa16.IntersectRay_AVX512(b.rays[r]) < b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+
+BENCHMARK_ITERS(TriangleMeshIntersectRayAny_AVX512, 10, 100, "TriangleMesh::IntersectRayAny_AVX512(), 2000 triangles")
+{
+	TriangleMeshBenchmarkData &b = BenchmarkData<TriangleMeshBenchmarkData>();
+	int r = i % numTriangleMeshBenchmarkRays;
+	dummyResultInt += b.soa16.IntersectRayAny_AVX512(b.rays[r], b.lightDistance[r]) ? 1 : 0;
+}
+BENCHMARK_ITERS_END
+#endif